@@ -0,0 +1,395 @@
+#include "BoidAllocationTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace
+{
+	struct ZoneCounters
+	{
+		std::atomic<uint64_t> Allocations{ 0 };
+		std::atomic<uint64_t> Bytes{ 0 };
+		std::atomic<uint64_t> Frees{ 0 };
+	};
+
+	// One slot per thread on its own cache lines, threads past the maximum share the last slot
+	struct alignas(64) ThreadCounters
+	{
+		ZoneCounters Zones[BoidAllocationTracker::MaximumZones];
+	};
+
+	ThreadCounters s_Threads[BoidAllocationTracker::MaximumThreads];
+	std::atomic<uint32_t> s_ThreadCount{ 0 };
+
+	// Zone 0 is always the untracked zone
+	const char* s_ZoneNames[BoidAllocationTracker::MaximumZones] = { "Untracked" };
+	std::atomic<uint32_t> s_ZoneCount{ 1 };
+	std::mutex s_ZoneMutex;
+
+	BoidAllocationCounts s_FrameStart[BoidAllocationTracker::MaximumZones] = {};
+	BoidAllocationCounts s_LastFrame[BoidAllocationTracker::MaximumZones] = {};
+
+	// Plain thread locals, so reaching them from inside operator new never allocates
+	thread_local uint32_t t_Zone = BoidAllocationTracker::UntrackedZone;
+	thread_local ThreadCounters* t_Counters = nullptr;
+
+	ThreadCounters& GetThreadCounters()
+	{
+		if (!t_Counters)
+		{
+			uint32_t Slot = s_ThreadCount.fetch_add(1, std::memory_order_relaxed);
+			t_Counters = &s_Threads[Slot < BoidAllocationTracker::MaximumThreads ? Slot : BoidAllocationTracker::MaximumThreads - 1];
+		}
+		return *t_Counters;
+	}
+
+	// Checked allocations pass through here so the compiler can't pair up and remove the new and delete
+	void* volatile s_CheckSink = nullptr;
+
+	BoidAllocationCounts Subtract(const BoidAllocationCounts& Stop, const BoidAllocationCounts& Start)
+	{
+		return { Stop.Allocations - Start.Allocations, Stop.Bytes - Start.Bytes, Stop.Frees - Start.Frees };
+	}
+}
+
+bool BoidAllocationTracker::IsEnabled()
+{
+#ifdef BOIDS_TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint32_t BoidAllocationTracker::RegisterZone(const char* Name)
+{
+	std::lock_guard<std::mutex> Lock(s_ZoneMutex);
+
+	uint32_t ZoneCount = s_ZoneCount.load(std::memory_order_relaxed);
+	for (uint32_t Zone = 0; Zone < ZoneCount; Zone++)
+	{
+		if (std::strcmp(s_ZoneNames[Zone], Name) == 0)
+		{
+			return Zone;
+		}
+	}
+
+	if (ZoneCount == MaximumZones)
+	{
+		return UntrackedZone;
+	}
+
+	s_ZoneNames[ZoneCount] = Name;
+	s_ZoneCount.store(ZoneCount + 1, std::memory_order_release);
+	return ZoneCount;
+}
+
+uint32_t BoidAllocationTracker::GetZoneCount()
+{
+	return s_ZoneCount.load(std::memory_order_acquire);
+}
+
+const char* BoidAllocationTracker::GetZoneName(uint32_t Zone)
+{
+	return Zone < GetZoneCount() ? s_ZoneNames[Zone] : "Unknown";
+}
+
+uint32_t BoidAllocationTracker::GetCurrentZone()
+{
+	return t_Zone;
+}
+
+void BoidAllocationTracker::SetCurrentZone(uint32_t Zone)
+{
+	t_Zone = Zone < MaximumZones ? Zone : UntrackedZone;
+}
+
+BoidAllocationCounts BoidAllocationTracker::GetTotal(uint32_t Zone)
+{
+	BoidAllocationCounts Total = {};
+	if (Zone >= MaximumZones)
+	{
+		return Total;
+	}
+
+	uint32_t ThreadCount = s_ThreadCount.load(std::memory_order_relaxed);
+	if (ThreadCount > MaximumThreads)
+	{
+		ThreadCount = MaximumThreads;
+	}
+
+	for (uint32_t Thread = 0; Thread < ThreadCount; Thread++)
+	{
+		const ZoneCounters& Counters = s_Threads[Thread].Zones[Zone];
+		Total.Allocations += Counters.Allocations.load(std::memory_order_relaxed);
+		Total.Bytes += Counters.Bytes.load(std::memory_order_relaxed);
+		Total.Frees += Counters.Frees.load(std::memory_order_relaxed);
+	}
+
+	return Total;
+}
+
+BoidAllocationCounts BoidAllocationTracker::GetTotal()
+{
+	BoidAllocationCounts Total = {};
+	for (uint32_t Zone = 0; Zone < MaximumZones; Zone++)
+	{
+		BoidAllocationCounts ZoneTotal = GetTotal(Zone);
+		Total.Allocations += ZoneTotal.Allocations;
+		Total.Bytes += ZoneTotal.Bytes;
+		Total.Frees += ZoneTotal.Frees;
+	}
+
+	return Total;
+}
+
+void BoidAllocationTracker::BeginFrame()
+{
+	for (uint32_t Zone = 0; Zone < MaximumZones; Zone++)
+	{
+		s_FrameStart[Zone] = GetTotal(Zone);
+	}
+}
+
+void BoidAllocationTracker::EndFrame()
+{
+	for (uint32_t Zone = 0; Zone < MaximumZones; Zone++)
+	{
+		s_LastFrame[Zone] = Subtract(GetTotal(Zone), s_FrameStart[Zone]);
+	}
+}
+
+BoidAllocationCounts BoidAllocationTracker::GetLastFrame(uint32_t Zone)
+{
+	return Zone < MaximumZones ? s_LastFrame[Zone] : BoidAllocationCounts{};
+}
+
+BoidAllocationCounts BoidAllocationTracker::GetLastFrame()
+{
+	BoidAllocationCounts Total = {};
+	for (const BoidAllocationCounts& Counts : s_LastFrame)
+	{
+		Total.Allocations += Counts.Allocations;
+		Total.Bytes += Counts.Bytes;
+		Total.Frees += Counts.Frees;
+	}
+
+	return Total;
+}
+
+bool BoidAllocationTracker::CheckAlignedCounting()
+{
+	// Past the default new alignment, so both go through the align_val_t forms
+	struct alignas(64) AlignedBlock
+	{
+		float Values[16];
+	};
+
+	uint32_t Zone = RegisterZone("Aligned Check");
+	BoidAllocationCounts Start = GetTotal(Zone);
+	{
+		BoidAllocationScope Scope(Zone);
+
+		s_CheckSink = new AlignedBlock();
+		delete static_cast<AlignedBlock*>(s_CheckSink);
+
+		s_CheckSink = new AlignedBlock[4];
+		delete[] static_cast<AlignedBlock*>(s_CheckSink);
+	}
+	BoidAllocationCounts Counted = Subtract(GetTotal(Zone), Start);
+
+	uint64_t ExpectedAllocations = IsEnabled() ? 2 : 0;
+	uint64_t ExpectedBytes = IsEnabled() ? 5 * sizeof(AlignedBlock) : 0;
+	return Counted.Allocations == ExpectedAllocations && Counted.Frees == ExpectedAllocations && Counted.Bytes == ExpectedBytes;
+}
+
+void BoidAllocationTracker::RecordAllocation(uint64_t Size)
+{
+	// Only the owning thread writes its slot, unless threads overflowed into the shared last one
+	ZoneCounters& Counters = GetThreadCounters().Zones[t_Zone];
+	Counters.Allocations.fetch_add(1, std::memory_order_relaxed);
+	Counters.Bytes.fetch_add(Size, std::memory_order_relaxed);
+}
+
+void BoidAllocationTracker::RecordFree()
+{
+	GetThreadCounters().Zones[t_Zone].Frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+BoidAllocationScope::BoidAllocationScope(uint32_t Zone)
+	: m_PreviousZone(BoidAllocationTracker::GetCurrentZone())
+{
+	BoidAllocationTracker::SetCurrentZone(Zone);
+}
+
+BoidAllocationScope::~BoidAllocationScope()
+{
+	BoidAllocationTracker::SetCurrentZone(m_PreviousZone);
+}
+
+#ifdef BOIDS_TRACK_ALLOCATIONS
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace
+{
+	// Over-aligned memory has to be freed differently from malloc on Windows, so aligned forms never share the plain ones
+	void* AllocateAligned(std::size_t Size, std::size_t Alignment)
+	{
+		Size = Size > 0 ? Size : 1;
+#ifdef _WIN32
+		return _aligned_malloc(Size, Alignment);
+#else
+		void* Memory = nullptr;
+		return posix_memalign(&Memory, Alignment < sizeof(void*) ? sizeof(void*) : Alignment, Size) == 0 ? Memory : nullptr;
+#endif
+	}
+
+	void FreeAligned(void* Memory)
+	{
+#ifdef _WIN32
+		_aligned_free(Memory);
+#else
+		std::free(Memory);
+#endif
+	}
+}
+
+// Replacements for every standard form, the library's aligned forms allocate directly instead of forwarding to the
+// plain ones, so alignas types such as the per thread counters of the task graph and analytics need their own
+void* operator new(std::size_t Size)
+{
+	void* Memory = std::malloc(Size > 0 ? Size : 1);
+	if (!Memory)
+	{
+		throw std::bad_alloc();
+	}
+
+	BoidAllocationTracker::RecordAllocation(Size);
+	return Memory;
+}
+
+void* operator new[](std::size_t Size)
+{
+	return operator new(Size);
+}
+
+void* operator new(std::size_t Size, const std::nothrow_t&) noexcept
+{
+	void* Memory = std::malloc(Size > 0 ? Size : 1);
+	if (Memory)
+	{
+		BoidAllocationTracker::RecordAllocation(Size);
+	}
+	return Memory;
+}
+
+void* operator new[](std::size_t Size, const std::nothrow_t& NoThrow) noexcept
+{
+	return operator new(Size, NoThrow);
+}
+
+void operator delete(void* Memory) noexcept
+{
+	if (Memory)
+	{
+		BoidAllocationTracker::RecordFree();
+		std::free(Memory);
+	}
+}
+
+void operator delete[](void* Memory) noexcept
+{
+	operator delete(Memory);
+}
+
+void operator delete(void* Memory, std::size_t) noexcept
+{
+	operator delete(Memory);
+}
+
+void operator delete[](void* Memory, std::size_t) noexcept
+{
+	operator delete(Memory);
+}
+
+void operator delete(void* Memory, const std::nothrow_t&) noexcept
+{
+	operator delete(Memory);
+}
+
+void operator delete[](void* Memory, const std::nothrow_t&) noexcept
+{
+	operator delete(Memory);
+}
+
+void* operator new(std::size_t Size, std::align_val_t Alignment)
+{
+	void* Memory = AllocateAligned(Size, static_cast<std::size_t>(Alignment));
+	if (!Memory)
+	{
+		throw std::bad_alloc();
+	}
+
+	BoidAllocationTracker::RecordAllocation(Size);
+	return Memory;
+}
+
+void* operator new[](std::size_t Size, std::align_val_t Alignment)
+{
+	return operator new(Size, Alignment);
+}
+
+void* operator new(std::size_t Size, std::align_val_t Alignment, const std::nothrow_t&) noexcept
+{
+	void* Memory = AllocateAligned(Size, static_cast<std::size_t>(Alignment));
+	if (Memory)
+	{
+		BoidAllocationTracker::RecordAllocation(Size);
+	}
+	return Memory;
+}
+
+void* operator new[](std::size_t Size, std::align_val_t Alignment, const std::nothrow_t& NoThrow) noexcept
+{
+	return operator new(Size, Alignment, NoThrow);
+}
+
+void operator delete(void* Memory, std::align_val_t) noexcept
+{
+	if (Memory)
+	{
+		BoidAllocationTracker::RecordFree();
+		FreeAligned(Memory);
+	}
+}
+
+void operator delete[](void* Memory, std::align_val_t Alignment) noexcept
+{
+	operator delete(Memory, Alignment);
+}
+
+void operator delete(void* Memory, std::size_t, std::align_val_t Alignment) noexcept
+{
+	operator delete(Memory, Alignment);
+}
+
+void operator delete[](void* Memory, std::size_t, std::align_val_t Alignment) noexcept
+{
+	operator delete(Memory, Alignment);
+}
+
+void operator delete(void* Memory, std::align_val_t Alignment, const std::nothrow_t&) noexcept
+{
+	operator delete(Memory, Alignment);
+}
+
+void operator delete[](void* Memory, std::align_val_t Alignment, const std::nothrow_t&) noexcept
+{
+	operator delete(Memory, Alignment);
+}
+#endif
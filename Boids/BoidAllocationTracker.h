@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+
+// Allocations counted in one zone, Frees are counted where memory is released, not where it was allocated
+struct BoidAllocationCounts
+{
+	uint64_t Allocations;
+	uint64_t Bytes;
+	uint64_t Frees;
+};
+
+// Counts heap allocations by instrumentation zone, replacing global operator new and delete when BOIDS_TRACK_ALLOCATIONS is defined
+// Without it nothing is counted, zones and scopes still compile and cost a thread local store, so callers need no preprocessor checks
+// Each thread counts into its own slot, so tracking never contends between threads, totals sum every slot
+// Aligned forms are replaced as well, so alignas types stored in vectors count like any other allocation
+class BoidAllocationTracker
+{
+public:
+	static const uint32_t MaximumZones = 32;
+	static const uint32_t MaximumThreads = 64;
+
+	// Zone allocations outside of any scope land in
+	static const uint32_t UntrackedZone = 0;
+
+	// Whether operator new is replaced in this build
+	static bool IsEnabled();
+
+	// Zone of name, registering it on first use, names must outlive the tracker so are normally literals
+	// Zones past MaximumZones share the untracked zone
+	static uint32_t RegisterZone(const char* Name);
+	static uint32_t GetZoneCount();
+	static const char* GetZoneName(uint32_t Zone);
+
+	// Zone of calling thread, thread pool workers take on the zone of whoever started the job
+	static uint32_t GetCurrentZone();
+	static void SetCurrentZone(uint32_t Zone);
+
+	// Counts since start, summed over every thread
+	static BoidAllocationCounts GetTotal(uint32_t Zone);
+	static BoidAllocationCounts GetTotal();
+
+	// Bracket one frame, counts of the last complete frame are kept per zone
+	// Never allocates, so calling these does not show up in the counts
+	static void BeginFrame();
+	static void EndFrame();
+	static BoidAllocationCounts GetLastFrame(uint32_t Zone);
+	static BoidAllocationCounts GetLastFrame();
+
+	// Over-aligned new and delete inside a zone of its own, true if the zone counted exactly those, or nothing when not enabled
+	static bool CheckAlignedCounting();
+
+	// Called by replaced operators only
+	static void RecordAllocation(uint64_t Size);
+	static void RecordFree();
+};
+
+// Attributes allocations of calling thread to zone until it goes out of scope, scopes nest
+class BoidAllocationScope
+{
+public:
+	BoidAllocationScope(uint32_t Zone);
+	~BoidAllocationScope();
+
+	BoidAllocationScope(const BoidAllocationScope&) = delete;
+	BoidAllocationScope& operator=(const BoidAllocationScope&) = delete;
+
+protected:
+	uint32_t m_PreviousZone;
+};
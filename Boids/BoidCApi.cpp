@@ -0,0 +1,242 @@
+#include "BoidCApi.h"
+
+#include <algorithm>
+#include "BoidPhysicsSystem.h"
+#include "BoidObject.h"
+#include "BoidThreadPool.h"
+
+using namespace DirectX;
+
+// World behind the opaque handle, state is the step output of the last tick in spawn order
+struct BoidWorld
+{
+	BoidPhysicsSystem Physics;
+	BoidLargeVector<BoidProperties> State;
+	uint64_t Tick = 0;
+};
+
+namespace
+{
+	BoidModelParameters ToModelParameters(const ModelProperties& Properties)
+	{
+		BoidModelParameters Parameters;
+		Parameters.BoidSpeed = Properties.BoidSpeed;
+		Parameters.MinimumSeparationDistance = Properties.MinimumSeparationDistance;
+		Parameters.MaximumSeparationDistance = Properties.MaximumSeparationDistance;
+		Parameters.SeparationWeight = Properties.SeparationDistanceWeight;
+		Parameters.MinimumAlignmentDistance = Properties.MinimumAlignmentDistnace;
+		Parameters.MaximumAlignmentDistance = Properties.MaximumAlignmentDistance;
+		Parameters.AlignmentWeight = Properties.AlignmentDistanceWeight;
+		Parameters.MinimumCohesionDistance = Properties.MinimumCohesionDistance;
+		Parameters.MaximumCohesionDistance = Properties.MaximumCohesionDistance;
+		Parameters.CohesionWeight = Properties.CohesionDistanceWeight;
+		Parameters.ObstacleAvoidanceDistance = Properties.ObstacleAvoidanceDistance;
+		Parameters.ObstacleAvoidanceWeight = Properties.ObstacleAvoidanceWeight;
+		return Parameters;
+	}
+
+	// Fields the C struct does not carry, boid count and padding, are kept from the current properties
+	void FromModelParameters(const BoidModelParameters& Parameters, ModelProperties& Properties)
+	{
+		Properties.BoidSpeed = Parameters.BoidSpeed;
+		Properties.MinimumSeparationDistance = Parameters.MinimumSeparationDistance;
+		Properties.MaximumSeparationDistance = Parameters.MaximumSeparationDistance;
+		Properties.SeparationDistanceWeight = Parameters.SeparationWeight;
+		Properties.MinimumAlignmentDistnace = Parameters.MinimumAlignmentDistance;
+		Properties.MaximumAlignmentDistance = Parameters.MaximumAlignmentDistance;
+		Properties.AlignmentDistanceWeight = Parameters.AlignmentWeight;
+		Properties.MinimumCohesionDistance = Parameters.MinimumCohesionDistance;
+		Properties.MaximumCohesionDistance = Parameters.MaximumCohesionDistance;
+		Properties.CohesionDistanceWeight = Parameters.CohesionWeight;
+		Properties.ObstacleAvoidanceDistance = Parameters.ObstacleAvoidanceDistance;
+		Properties.ObstacleAvoidanceWeight = Parameters.ObstacleAvoidanceWeight;
+	}
+}
+
+uint32_t Boids_GetApiVersion(void)
+{
+	return BOIDS_API_VERSION;
+}
+
+void Boids_SetThreadCount(uint32_t ThreadCount)
+{
+	try
+	{
+		BoidThreadPool::Get().SetThreadCount(ThreadCount);
+	}
+	catch (...)
+	{
+	}
+}
+
+BoidWorld* BoidWorld_Create(const BoidWorldDesc* Desc)
+{
+	try
+	{
+		BoidWorld* World = new BoidWorld();
+		if (Desc)
+		{
+			World->Physics.SetBoundingBoxHalfSize(XMFLOAT3(Desc->BoxHalfSize[0], Desc->BoxHalfSize[1], Desc->BoxHalfSize[2]));
+			World->State.reserve(Desc->BoidCapacity);
+		}
+		return World;
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+void BoidWorld_Destroy(BoidWorld* World)
+{
+	delete World;
+}
+
+bool BoidWorld_SpawnBoids(BoidWorld* World, const float* Positions, const float* Directions, const uint32_t* Species, uint32_t Count)
+{
+	if (!World || (Count > 0 && (!Positions || !Directions)))
+	{
+		return false;
+	}
+
+	uint32_t FirstBoid = World->Physics.GetRegisteredBoidCount();
+	size_t BoidCount = static_cast<size_t>(FirstBoid) + Count;
+
+	try
+	{
+		// Grown ahead of spawning, so committing the view below can't fail
+		if (BoidCount > World->State.capacity())
+		{
+			World->State.reserve(std::max(BoidCount, World->State.capacity() * 2));
+		}
+
+		std::vector<BoidObject> Batch;
+		Batch.reserve(Count);
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			XMFLOAT3 Position(Positions[i * 3], Positions[i * 3 + 1], Positions[i * 3 + 2]);
+			XMFLOAT3 Direction(Directions[i * 3], Directions[i * 3 + 1], Directions[i * 3 + 2]);
+			Batch.push_back(BoidObject(Position, Direction, Species ? Species[i] : 0));
+		}
+
+		World->Physics.SpawnBoids(Batch.data(), Count);
+	}
+	catch (...)
+	{
+		// Boids are registered whole or not at all, so despawning those past the first leaves the world as it was
+		for (uint32_t i = World->Physics.GetRegisteredBoidCount(); i > FirstBoid; i--)
+		{
+			World->Physics.DespawnBoid(World->Physics.GetBoidHandle(i - 1));
+		}
+		return false;
+	}
+
+	// Every boid is registered, only now do new boids join the view, boids already there keep the state of the last tick
+	World->State.resize(BoidCount);
+	for (uint32_t i = FirstBoid; i < BoidCount; i++)
+	{
+		const BoidObject* Boid = World->Physics.GetBoid(World->Physics.GetBoidHandle(i));
+		World->State[i] = { XMFLOAT4(Boid->m_Position.x, Boid->m_Position.y, Boid->m_Position.z, 0.0f),
+							XMFLOAT4(Boid->m_Direction.x, Boid->m_Direction.y, Boid->m_Direction.z, 0.0f) };
+	}
+	return true;
+}
+
+bool BoidWorld_Step(BoidWorld* World, float DeltaTime, uint32_t Ticks)
+{
+	if (!World)
+	{
+		return false;
+	}
+
+	try
+	{
+		// Only the last tick writes the view, earlier ones would be overwritten before anyone could read them
+		for (uint32_t Tick = 0; Tick < Ticks; Tick++)
+		{
+			bool LastTick = Tick + 1 == Ticks;
+			World->Physics.SetStepOutput(LastTick ? World->State.data() : nullptr, LastTick ? static_cast<uint32_t>(World->State.size()) : 0);
+			World->Physics.UpdateBoidPhysics(DeltaTime);
+			World->Tick++;
+		}
+
+		World->Physics.SetStepOutput(nullptr, 0);
+		return true;
+	}
+	catch (...)
+	{
+		World->Physics.SetStepOutput(nullptr, 0);
+		return false;
+	}
+}
+
+uint32_t BoidWorld_GetBoidCount(const BoidWorld* World)
+{
+	return World ? static_cast<uint32_t>(World->State.size()) : 0;
+}
+
+BoidStateView BoidWorld_GetStateView(const BoidWorld* World)
+{
+	BoidStateView View = {};
+	if (!World || World->State.empty())
+	{
+		return View;
+	}
+
+	View.Positions = &World->State[0].BoidPosition.x;
+	View.Directions = &World->State[0].BoidDirection.x;
+	View.Count = static_cast<uint32_t>(World->State.size());
+	View.Stride = sizeof(BoidProperties);
+	View.Tick = World->Tick;
+	return View;
+}
+
+bool BoidWorld_SetModelParameters(BoidWorld* World, uint32_t Species, const BoidModelParameters* Parameters)
+{
+	if (!World || !Parameters)
+	{
+		return false;
+	}
+
+	// Checked before adding species, so Species + 1 can't wrap and the interaction table stays small
+	if (Species >= BOIDS_MAXIMUM_SPECIES)
+	{
+		return false;
+	}
+
+	try
+	{
+		if (Species >= World->Physics.GetSpeciesCount())
+		{
+			World->Physics.SetSpeciesCount(Species + 1);
+		}
+
+		ModelProperties Properties = World->Physics.GetSpeciesProperties(Species);
+		FromModelParameters(*Parameters, Properties);
+		World->Physics.SetSpeciesProperties(Species, Properties);
+		return true;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+bool BoidWorld_GetModelParameters(const BoidWorld* World, uint32_t Species, BoidModelParameters* OutParameters)
+{
+	if (!World || !OutParameters || Species >= World->Physics.GetSpeciesCount())
+	{
+		return false;
+	}
+
+	*OutParameters = ToModelParameters(World->Physics.GetSpeciesProperties(Species));
+	return true;
+}
+
+void BoidWorld_SetBoxHalfSize(BoidWorld* World, float X, float Y, float Z)
+{
+	if (World)
+	{
+		World->Physics.SetBoundingBoxHalfSize(XMFLOAT3(X, Y, Z));
+	}
+}
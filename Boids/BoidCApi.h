@@ -0,0 +1,103 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Stable C interface to the CPU physics, for driving worlds from other languages through a shared library
+// Only plain C types cross it, so it does not change when the C++ classes behind it do, and no exception ever leaves it
+// Build Boids/*.cpp except the render system with BOIDS_SHARED and BOIDS_EXPORTS defined, and hidden visibility on Linux,
+// hosts include this header with BOIDS_SHARED alone, static builds define neither
+#if defined(BOIDS_SHARED)
+#if defined(_WIN32)
+#if defined(BOIDS_EXPORTS)
+#define BOIDS_API __declspec(dllexport)
+#else
+#define BOIDS_API __declspec(dllimport)
+#endif
+#else
+#define BOIDS_API __attribute__((visibility("default")))
+#endif
+#else
+#define BOIDS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Raised whenever a function or struct below changes incompatibly, hosts should check it before anything else
+#define BOIDS_API_VERSION 1
+
+// Species are 0 up to but not including this, every pair of species has its own interaction
+#define BOIDS_MAXIMUM_SPECIES 256
+
+typedef struct BoidWorld BoidWorld;
+
+typedef struct BoidWorldDesc
+{
+	float BoxHalfSize[3];
+
+	// Boids the state view has room for without moving, spawning past it moves the view
+	uint32_t BoidCapacity;
+} BoidWorldDesc;
+
+// Rule values of one species, same meaning as ModelProperties, defaults come from BoidWorld_GetModelParameters of a new world
+typedef struct BoidModelParameters
+{
+	float BoidSpeed;
+
+	float MinimumSeparationDistance;
+	float MaximumSeparationDistance;
+	float SeparationWeight;
+
+	float MinimumAlignmentDistance;
+	float MaximumAlignmentDistance;
+	float AlignmentWeight;
+
+	float MinimumCohesionDistance;
+	float MaximumCohesionDistance;
+	float CohesionWeight;
+
+	float ObstacleAvoidanceDistance;
+	float ObstacleAvoidanceWeight;
+} BoidModelParameters;
+
+// Read-only view of every boid in spawn order, straight into memory the world steps into, nothing is copied to hand it out
+// Position and direction are x, y, z, w floats, consecutive boids are Stride bytes apart, e.g. a numpy array of shape (Count, 3)
+// with strides (Stride, 4) over either pointer, pointers stay valid until the next spawn or until the world is destroyed
+typedef struct BoidStateView
+{
+	const float* Positions;
+	const float* Directions;
+	uint32_t Count;
+	uint32_t Stride;
+	uint64_t Tick;
+} BoidStateView;
+
+BOIDS_API uint32_t Boids_GetApiVersion(void);
+
+// Threads shared by every world, 0 selects hardware concurrency, must not be called while any world is stepping
+BOIDS_API void Boids_SetThreadCount(uint32_t ThreadCount);
+
+// Null if the world could not be created, each world may be used from one thread at a time and different worlds from different threads
+BOIDS_API BoidWorld* BoidWorld_Create(const BoidWorldDesc* Desc);
+BOIDS_API void BoidWorld_Destroy(BoidWorld* World);
+
+// Count boids from packed x, y, z triples, Species may be null for all species 0, false if they could not be spawned
+BOIDS_API bool BoidWorld_SpawnBoids(BoidWorld* World, const float* Positions, const float* Directions, const uint32_t* Species, uint32_t Count);
+
+// Advance every boid by Ticks steps of DeltaTime, the state view holds the result once it returns
+BOIDS_API bool BoidWorld_Step(BoidWorld* World, float DeltaTime, uint32_t Ticks);
+
+BOIDS_API uint32_t BoidWorld_GetBoidCount(const BoidWorld* World);
+BOIDS_API BoidStateView BoidWorld_GetStateView(const BoidWorld* World);
+
+// Setting a species past the current count adds species up to it, getting one fails until it has been added
+// Species from BOIDS_MAXIMUM_SPECIES on are rejected
+BOIDS_API bool BoidWorld_SetModelParameters(BoidWorld* World, uint32_t Species, const BoidModelParameters* Parameters);
+BOIDS_API bool BoidWorld_GetModelParameters(const BoidWorld* World, uint32_t Species, BoidModelParameters* OutParameters);
+
+BOIDS_API void BoidWorld_SetBoxHalfSize(BoidWorld* World, float X, float Y, float Z);
+
+#ifdef __cplusplus
+}
+#endif
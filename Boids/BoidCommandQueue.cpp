@@ -0,0 +1,129 @@
+#include "BoidCommandQueue.h"
+
+BoidCommandQueue::BoidCommandQueue(uint32_t Capacity)
+{
+	uint64_t RoundedCapacity = 2;
+	while (RoundedCapacity < Capacity)
+	{
+		RoundedCapacity *= 2;
+	}
+
+	m_Cells.reset(new Cell[RoundedCapacity]);
+	m_Mask = RoundedCapacity - 1;
+
+	// Cell is free for the producer whose position equals its sequence
+	for (uint64_t i = 0; i < RoundedCapacity; i++)
+	{
+		m_Cells[i].Sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+uint32_t BoidCommandQueue::GetCapacity() const
+{
+	return static_cast<uint32_t>(m_Mask + 1);
+}
+
+bool BoidCommandQueue::Push(const BoidCommand& Command)
+{
+	uint64_t Position = m_EnqueuePosition.load(std::memory_order_relaxed);
+	Cell* Target = nullptr;
+
+	while (true)
+	{
+		Target = &m_Cells[Position & m_Mask];
+		uint64_t Sequence = Target->Sequence.load(std::memory_order_acquire);
+		int64_t Difference = static_cast<int64_t>(Sequence - Position);
+
+		if (Difference == 0)
+		{
+			// Cell is free, claim it unless another producer got there first
+			if (m_EnqueuePosition.compare_exchange_weak(Position, Position + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (Difference < 0)
+		{
+			// Consumer has not drained this cell since the last lap
+			m_RejectedCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+		{
+			Position = m_EnqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	Target->Command = Command;
+	Target->Sequence.store(Position + 1, std::memory_order_release);
+	return true;
+}
+
+bool BoidCommandQueue::PushSpawn(DirectX::XMFLOAT3 Position, DirectX::XMFLOAT3 Direction, uint32_t Species)
+{
+	BoidCommand Command = {};
+	Command.Type = BoidCommandType::Spawn;
+	Command.Species = Species;
+	Command.Position = Position;
+	Command.Vector = Direction;
+
+	return Push(Command);
+}
+
+bool BoidCommandQueue::PushDespawn(BoidHandle Handle)
+{
+	BoidCommand Command = {};
+	Command.Type = BoidCommandType::Despawn;
+	Command.Handle = Handle;
+
+	return Push(Command);
+}
+
+bool BoidCommandQueue::PushImpulse(BoidHandle Handle, DirectX::XMFLOAT3 Impulse)
+{
+	BoidCommand Command = {};
+	Command.Type = BoidCommandType::Impulse;
+	Command.Handle = Handle;
+	Command.Vector = Impulse;
+
+	return Push(Command);
+}
+
+bool BoidCommandQueue::PushSpeciesProperties(uint32_t Species, const ModelProperties& Properties)
+{
+	BoidCommand Command = {};
+	Command.Type = BoidCommandType::SetSpeciesProperties;
+	Command.Species = Species;
+	Command.Properties = Properties;
+
+	return Push(Command);
+}
+
+uint32_t BoidCommandQueue::Drain(std::vector<BoidCommand>& Commands)
+{
+	const uint64_t End = m_EnqueuePosition.load(std::memory_order_acquire);
+	uint32_t DrainedCount = 0;
+
+	while (m_DequeuePosition < End)
+	{
+		Cell& Source = m_Cells[m_DequeuePosition & m_Mask];
+		if (Source.Sequence.load(std::memory_order_acquire) != m_DequeuePosition + 1)
+		{
+			// Claimed but not yet written, commands after it wait as well so order is kept
+			break;
+		}
+
+		Commands.push_back(Source.Command);
+		Source.Sequence.store(m_DequeuePosition + m_Mask + 1, std::memory_order_release);
+
+		m_DequeuePosition++;
+		DrainedCount++;
+	}
+
+	return DrainedCount;
+}
+
+uint64_t BoidCommandQueue::GetRejectedCount() const
+{
+	return m_RejectedCount.load(std::memory_order_relaxed);
+}
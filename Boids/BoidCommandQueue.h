@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "BoidPhysicsSystem.h"
+
+enum class BoidCommandType : uint32_t
+{
+	// Spawn a boid of Species at Position heading along Vector
+	Spawn,
+
+	// Despawn boid of Handle
+	Despawn,
+
+	// Turn boid of Handle towards its direction plus Vector
+	Impulse,
+
+	// Replace model properties of Species, only the last one queued per species is applied
+	SetSpeciesProperties
+};
+
+struct BoidCommand
+{
+	BoidCommandType Type;
+	uint32_t Species;
+	BoidHandle Handle;
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 Vector;
+	ModelProperties Properties;
+};
+
+// Bounded multi-producer single-consumer queue of boid mutations
+// Any thread may push while the simulation steps, the physics system drains it at the start of the next step
+// Producers claim a cell with a single compare and swap and never wait on the consumer, a full queue rejects the command
+class BoidCommandQueue
+{
+public:
+	// Capacity is rounded up to a power of two
+	BoidCommandQueue(uint32_t Capacity = 4096);
+
+	uint32_t GetCapacity() const;
+
+	// Safe from any thread, false if the queue is full
+	bool Push(const BoidCommand& Command);
+
+	bool PushSpawn(DirectX::XMFLOAT3 Position, DirectX::XMFLOAT3 Direction, uint32_t Species = 0);
+	bool PushDespawn(BoidHandle Handle);
+	bool PushImpulse(BoidHandle Handle, DirectX::XMFLOAT3 Impulse);
+	bool PushSpeciesProperties(uint32_t Species, const ModelProperties& Properties);
+
+	// Consumer only, appends commands completed when the drain started, so busy producers cannot keep it going forever
+	// Commands still being written by a producer are left for the next drain, returns how many were appended
+	uint32_t Drain(std::vector<BoidCommand>& Commands);
+
+	// Commands rejected because the queue was full, since construction
+	uint64_t GetRejectedCount() const;
+
+protected:
+	struct Cell
+	{
+		std::atomic<uint64_t> Sequence;
+		BoidCommand Command;
+	};
+
+	std::unique_ptr<Cell[]> m_Cells;
+	uint64_t m_Mask;
+
+	// Producer and consumer positions on their own cache lines so they never contend
+	alignas(64) std::atomic<uint64_t> m_EnqueuePosition{ 0 };
+	alignas(64) uint64_t m_DequeuePosition = 0;
+	alignas(64) std::atomic<uint64_t> m_RejectedCount{ 0 };
+};
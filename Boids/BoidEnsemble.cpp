@@ -0,0 +1,171 @@
+#include "BoidEnsemble.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include "BoidThreadPool.h"
+
+using namespace DirectX;
+
+BoidEnsemble::BoidEnsemble(const std::vector<BoidWorldSettings>& Worlds)
+{
+	uint32_t WorldCount = static_cast<uint32_t>(Worlds.size());
+
+	m_WorldStart.resize(WorldCount + 1, 0);
+	for (uint32_t World = 0; World < WorldCount; World++)
+	{
+		m_WorldStart[World + 1] = m_WorldStart[World] + Worlds[World].BoidCount;
+	}
+	m_Boids.resize(m_WorldStart[WorldCount]);
+	m_Statistics.resize(WorldCount);
+
+	for (uint32_t World = 0; World < WorldCount; World++)
+	{
+		const BoidWorldSettings& Settings = Worlds[World];
+
+		m_Systems.emplace_back(new BoidPhysicsSystem());
+		m_Systems[World]->SetBoundingBoxHalfSize(Settings.BoxHalfSize);
+		m_Systems[World]->SetModelProperties(Settings.Properties);
+
+		(Settings.BoidCount >= LargeWorldBoids ? m_LargeWorlds : m_SmallWorlds).push_back(World);
+	}
+
+	std::stable_sort(m_SmallWorlds.begin(), m_SmallWorlds.end(), [&Worlds](uint32_t A, uint32_t B) { return Worlds[A].BoidCount > Worlds[B].BoidCount; });
+
+	// Each world is laid out by its own seeded generator, so layouts do not depend on which thread fills them
+	// Filling in parallel also places each world's pages with the threads of the first sweep
+	BoidThreadPool::Get().ParallelFor(WorldCount, 1, [this, &Worlds](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t World = Begin; World < End; World++)
+		{
+			const BoidWorldSettings& Settings = Worlds[World];
+			std::mt19937 MTEngine(Settings.Seed);
+			std::uniform_real_distribution<float> Unit(-1.0f, 1.0f);
+
+			for (uint32_t i = m_WorldStart[World]; i < m_WorldStart[World + 1]; i++)
+			{
+				XMFLOAT3 Position = { Unit(MTEngine) * Settings.BoxHalfSize.x, Unit(MTEngine) * Settings.BoxHalfSize.y, Unit(MTEngine) * Settings.BoxHalfSize.z };
+
+				XMVECTOR Direction = XMVector3Normalize(XMVectorSet(Unit(MTEngine), Unit(MTEngine), Unit(MTEngine), 0) + XMVectorSet(0, 0.01f, 0, 0));
+				m_Boids[i].BoidPosition = XMFLOAT4(Position.x, Position.y, Position.z, 0.0f);
+				XMStoreFloat4(&m_Boids[i].BoidDirection, Direction);
+			}
+
+			m_Statistics[World] = {};
+			UpdateStatistics(World);
+		}
+	});
+}
+
+uint32_t BoidEnsemble::GetWorldCount() const
+{
+	return static_cast<uint32_t>(m_Systems.size());
+}
+
+uint32_t BoidEnsemble::GetBoidCount() const
+{
+	return static_cast<uint32_t>(m_Boids.size());
+}
+
+void BoidEnsemble::Step(float DeltaTime, uint32_t Steps)
+{
+	// One world per chunk, nested parallel loops inside a world then run inline on the thread that took it
+	BoidThreadPool::Get().ParallelFor(static_cast<uint32_t>(m_SmallWorlds.size()), 1, [this, DeltaTime, Steps](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			StepWorld(m_SmallWorlds[i], DeltaTime, Steps);
+		}
+	});
+
+	for (uint32_t World : m_LargeWorlds)
+	{
+		StepWorld(World, DeltaTime, Steps);
+	}
+}
+
+const BoidProperties* BoidEnsemble::GetWorldBoids(uint32_t World, uint32_t& Count) const
+{
+	if (World >= GetWorldCount())
+	{
+		Count = 0;
+		return nullptr;
+	}
+
+	Count = m_WorldStart[World + 1] - m_WorldStart[World];
+	return m_Boids.data() + m_WorldStart[World];
+}
+
+const std::vector<BoidWorldStatistics>& BoidEnsemble::GetStatistics() const
+{
+	return m_Statistics;
+}
+
+void BoidEnsemble::StepWorld(uint32_t World, float DeltaTime, uint32_t Steps)
+{
+	BoidProperties* Boids = m_Boids.data() + m_WorldStart[World];
+	uint32_t Count = m_WorldStart[World + 1] - m_WorldStart[World];
+
+	auto Start = std::chrono::high_resolution_clock::now();
+	for (uint32_t Step = 0; Step < Steps; Step++)
+	{
+		m_Systems[World]->UpdateBoidPhysics(Boids, nullptr, nullptr, Count, DeltaTime);
+	}
+	auto Stop = std::chrono::high_resolution_clock::now();
+
+	BoidWorldStatistics& Statistics = m_Statistics[World];
+	Statistics.Steps += Steps;
+	Statistics.MillisecondsPerStep = Steps > 0 ? std::chrono::duration<double, std::milli>(Stop - Start).count() / Steps : 0;
+	UpdateStatistics(World);
+}
+
+void BoidEnsemble::UpdateStatistics(uint32_t World)
+{
+	const BoidProperties* Boids = m_Boids.data() + m_WorldStart[World];
+	uint32_t Count = m_WorldStart[World + 1] - m_WorldStart[World];
+
+	BoidWorldStatistics& Statistics = m_Statistics[World];
+	Statistics.World = World;
+	Statistics.BoidCount = Count;
+
+	XMVECTOR PositionSum = XMVectorZero();
+	XMVECTOR DirectionSum = XMVectorZero();
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		PositionSum += XMLoadFloat4(&Boids[i].BoidPosition);
+		DirectionSum += XMLoadFloat4(&Boids[i].BoidDirection);
+	}
+
+	float InverseCount = Count > 0 ? 1.0f / Count : 0.0f;
+	XMVECTOR CenterOfMass = XMVectorScale(PositionSum, InverseCount);
+
+	float SquaredDistanceSum = 0;
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		SquaredDistanceSum += XMVectorGetX(XMVector3LengthSq(XMLoadFloat4(&Boids[i].BoidPosition) - CenterOfMass));
+	}
+
+	XMStoreFloat3(&Statistics.CenterOfMass, CenterOfMass);
+	Statistics.Polarization = XMVectorGetX(XMVector3Length(XMVectorScale(DirectionSum, InverseCount)));
+	Statistics.RadiusOfGyration = sqrtf(SquaredDistanceSum * InverseCount);
+}
+
+bool BoidEnsemble::WriteStatistics(const char* Path, const std::vector<BoidWorldStatistics>& Statistics)
+{
+	std::ofstream File(Path);
+	if (!File)
+	{
+		return false;
+	}
+
+	File << "World,BoidCount,Steps,CenterX,CenterY,CenterZ,Polarization,RadiusOfGyration,MillisecondsPerStep" << std::endl;
+	for (const BoidWorldStatistics& World : Statistics)
+	{
+		File << World.World << "," << World.BoidCount << "," << World.Steps << "," << World.CenterOfMass.x << "," << World.CenterOfMass.y << "," << World.CenterOfMass.z << ","
+			 << World.Polarization << "," << World.RadiusOfGyration << "," << World.MillisecondsPerStep << std::endl;
+	}
+
+	return static_cast<bool>(File);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+#include "BoidPhysicsSystem.h"
+
+// One independent flock of an ensemble, boids start from a seeded random layout filling the box
+struct BoidWorldSettings
+{
+	uint32_t BoidCount = 1000;
+	ModelProperties Properties;
+	DirectX::XMFLOAT3 BoxHalfSize = DirectX::XMFLOAT3{ 40, 40, 40 };
+	uint32_t Seed = 1;
+};
+
+// State of one world after the last ensemble step
+// Polarization is the length of the mean direction, 1 when every boid heads the same way and near 0 for a disordered flock
+// Radius of gyration is the root mean square distance of boids from their centre of mass
+struct BoidWorldStatistics
+{
+	uint32_t World;
+	uint32_t BoidCount;
+	uint64_t Steps;
+	DirectX::XMFLOAT3 CenterOfMass;
+	float Polarization;
+	float RadiusOfGyration;
+	double MillisecondsPerStep;
+};
+
+// Many independent flocks stepped together for parameter studies
+// Boids of every world live back to back in one allocation, each world keeps its own physics system for rules, grid and scratch
+// Small worlds are stepped one per task in a single sweep over the thread pool, each on one thread, so worlds never wait on each other
+// Worlds of at least LargeWorldBoids are stepped after the sweep one at a time, each split across the whole pool instead
+class BoidEnsemble
+{
+public:
+	static const uint32_t LargeWorldBoids = 16384;
+
+	BoidEnsemble(const std::vector<BoidWorldSettings>& Worlds);
+
+	uint32_t GetWorldCount() const;
+	uint32_t GetBoidCount() const;
+
+	// Advance every world by Steps steps, worlds in the sweep run all their steps without synchronizing with the others
+	void Step(float DeltaTime, uint32_t Steps = 1);
+
+	// Boids of world in their original order, valid until the next step
+	const BoidProperties* GetWorldBoids(uint32_t World, uint32_t& Count) const;
+
+	// Statistics of every world, in world order, updated by every step
+	const std::vector<BoidWorldStatistics>& GetStatistics() const;
+
+	// Statistics as comma separated values, one world per line after a header
+	static bool WriteStatistics(const char* Path, const std::vector<BoidWorldStatistics>& Statistics);
+
+protected:
+	// Step one world and measure it, called from whichever thread owns the world for this step
+	void StepWorld(uint32_t World, float DeltaTime, uint32_t Steps);
+	void UpdateStatistics(uint32_t World);
+
+	// Boids of world w are [m_WorldStart[w], m_WorldStart[w + 1])
+	BoidLargeVector<BoidProperties> m_Boids;
+	std::vector<uint32_t> m_WorldStart;
+
+	std::vector<std::unique_ptr<BoidPhysicsSystem>> m_Systems;
+	std::vector<BoidWorldStatistics> m_Statistics;
+
+	// Small worlds largest first, so the longest tasks start first and the sweep ends evenly, then large worlds
+	std::vector<uint32_t> m_SmallWorlds;
+	std::vector<uint32_t> m_LargeWorlds;
+};
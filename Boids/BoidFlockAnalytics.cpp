@@ -0,0 +1,324 @@
+#include "BoidFlockAnalytics.h"
+
+#include <math.h>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include "BoidThreadPool.h"
+
+using namespace DirectX;
+
+void BoidFlockAnalytics::SetLinkDistance(float LinkDistance)
+{
+	m_LinkDistance = std::max(LinkDistance, 0.0f);
+}
+
+float BoidFlockAnalytics::GetLinkDistance() const
+{
+	return m_LinkDistance;
+}
+
+const BoidFlockMetrics& BoidFlockAnalytics::GetMetrics() const
+{
+	return m_Metrics;
+}
+
+const uint32_t* BoidFlockAnalytics::GetClusterLabels() const
+{
+	return m_Labels.get();
+}
+
+void BoidFlockAnalytics::PrepareAnalysis(uint32_t BoidCount, uint32_t ThreadCount)
+{
+	if (BoidCount > m_Capacity)
+	{
+		m_Parents.reset(new std::atomic<uint32_t>[BoidCount]);
+		m_Labels.reset(new uint32_t[BoidCount]);
+		m_ClusterSizes.reset(new uint32_t[BoidCount]);
+		m_Capacity = BoidCount;
+	}
+
+	m_ThreadMetrics.resize(ThreadCount);
+}
+
+uint32_t BoidFlockAnalytics::FindRoot(uint32_t Boid)
+{
+	while (true)
+	{
+		uint32_t Parent = m_Parents[Boid].load(std::memory_order_relaxed);
+		if (Parent == Boid)
+		{
+			return Boid;
+		}
+
+		// Another thread may have moved it already, the grandparent is still an ancestor either way
+		uint32_t GrandParent = m_Parents[Parent].load(std::memory_order_relaxed);
+		if (GrandParent != Parent)
+		{
+			m_Parents[Boid].compare_exchange_weak(Parent, GrandParent, std::memory_order_relaxed);
+		}
+
+		Boid = GrandParent;
+	}
+}
+
+void BoidFlockAnalytics::Unite(uint32_t First, uint32_t Second)
+{
+	while (true)
+	{
+		First = FindRoot(First);
+		Second = FindRoot(Second);
+		if (First == Second)
+		{
+			return;
+		}
+
+		if (First < Second)
+		{
+			std::swap(First, Second);
+		}
+
+		// Only succeeds while First is still a root, otherwise another union got there first and both are found again
+		uint32_t Expected = First;
+		if (m_Parents[First].compare_exchange_strong(Expected, Second, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+}
+
+void BoidFlockAnalytics::Analyze(const BoidSpatialGrid& Grid, const BoidLargeVector<BoidProperties>& SortedBoids, const BoidLargeVector<uint32_t>& SortedSpecies,
+								 const std::vector<ModelProperties>& SpeciesProperties)
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	BoidThreadPool& ThreadPool = BoidThreadPool::Get();
+	uint32_t NumberOfBoids = static_cast<uint32_t>(SortedBoids.size());
+	uint32_t SpeciesCount = Grid.GetSpeciesCount();
+	PrepareAnalysis(NumberOfBoids, ThreadPool.GetThreadCount());
+
+	// Boids close enough to keep clear of each other by default
+	float LinkDistance = m_LinkDistance;
+	if (LinkDistance <= 0)
+	{
+		for (const ModelProperties& Properties : SpeciesProperties)
+		{
+			LinkDistance = std::max(LinkDistance, Properties.MaximumSeparationDistance);
+		}
+	}
+
+	// Every boid within a cell size of another lies in the 3x3x3 block around it, so neither distance can be searched any further
+	float CellSize = Grid.GetCellSize();
+	LinkDistance = std::min(LinkDistance, CellSize);
+	XMINT3 Dimensions = Grid.GetDimensions();
+	float LinkDistanceSquared = LinkDistance * LinkDistance;
+	float CellSizeSquared = CellSize * CellSize;
+	float BucketsPerDistance = BoidFlockMetrics::HistogramBuckets / CellSize;
+
+	for (ThreadMetrics& Metrics : m_ThreadMetrics)
+	{
+		Metrics = {};
+		Metrics.NearestNeighbourMinimum = FLT_MAX;
+	}
+
+	ThreadPool.ParallelFor(NumberOfBoids, 1024, [this](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			m_Parents[i].store(i, std::memory_order_relaxed);
+		}
+	});
+
+	ThreadPool.ParallelFor(NumberOfBoids, 256, [&](uint32_t Begin, uint32_t End, uint32_t ThreadIndex)
+	{
+		ThreadMetrics& Metrics = m_ThreadMetrics[ThreadIndex];
+
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			const BoidProperties& Boid = SortedBoids[i];
+			const XMFLOAT4& Position = Boid.BoidPosition;
+			float NearestSquared = FLT_MAX;
+
+			// Root is cached, a neighbour already under it needs no union, and it only changes when this boid's set joins a smaller one
+			uint32_t Root = FindRoot(i);
+
+			auto VisitCell = [&](XMINT3 Cell)
+			{
+				for (uint32_t Species = 0; Species < SpeciesCount; Species++)
+				{
+					uint32_t CellStart = 0;
+					uint32_t CellCount = 0;
+					if (!Grid.GetCellRange(Cell, Species, CellStart, CellCount))
+					{
+						continue;
+					}
+
+					for (uint32_t j = CellStart; j < CellStart + CellCount; j++)
+					{
+						const XMFLOAT4& OtherPosition = SortedBoids[j].BoidPosition;
+						float X = OtherPosition.x - Position.x;
+						float Y = OtherPosition.y - Position.y;
+						float Z = OtherPosition.z - Position.z;
+						float DistanceSquared = X * X + Y * Y + Z * Z;
+
+						if (j == i)
+						{
+							continue;
+						}
+
+						NearestSquared = std::min(NearestSquared, DistanceSquared);
+
+						// Each pair is joined once, from the boid earlier in grid order
+						if (j > i && DistanceSquared < LinkDistanceSquared && m_Parents[j].load(std::memory_order_relaxed) != Root)
+						{
+							Unite(Root, j);
+							Root = FindRoot(Root);
+						}
+					}
+				}
+			};
+
+			// Own cell first, then only cells that could still hold something nearer than the nearest so far or within link distance
+			XMINT3 CurrentCell = Grid.CalculateCell(Position);
+			VisitCell(CurrentCell);
+
+			for (int z = CurrentCell.z - 1; z <= CurrentCell.z + 1; z++)
+			{
+				for (int y = CurrentCell.y - 1; y <= CurrentCell.y + 1; y++)
+				{
+					for (int x = CurrentCell.x - 1; x <= CurrentCell.x + 1; x++)
+					{
+						if (x == CurrentCell.x && y == CurrentCell.y && z == CurrentCell.z)
+						{
+							continue;
+						}
+
+						// Border cells also hold boids clamped in from outside the grid, so they reach out forever
+						XMFLOAT3 CellMin;
+						XMFLOAT3 CellMax;
+						Grid.GetCellBounds(XMINT3(x, y, z), CellMin, CellMax);
+
+						float GapX = std::max(std::max(x > 0 ? CellMin.x - Position.x : 0.0f, x < Dimensions.x - 1 ? Position.x - CellMax.x : 0.0f), 0.0f);
+						float GapY = std::max(std::max(y > 0 ? CellMin.y - Position.y : 0.0f, y < Dimensions.y - 1 ? Position.y - CellMax.y : 0.0f), 0.0f);
+						float GapZ = std::max(std::max(z > 0 ? CellMin.z - Position.z : 0.0f, z < Dimensions.z - 1 ? Position.z - CellMax.z : 0.0f), 0.0f);
+						float GapSquared = GapX * GapX + GapY * GapY + GapZ * GapZ;
+
+						if (GapSquared < LinkDistanceSquared || GapSquared < NearestSquared)
+						{
+							VisitCell(XMINT3(x, y, z));
+						}
+					}
+				}
+			}
+
+			Metrics.DirectionSum[0] += Boid.BoidDirection.x;
+			Metrics.DirectionSum[1] += Boid.BoidDirection.y;
+			Metrics.DirectionSum[2] += Boid.BoidDirection.z;
+			Metrics.SpeedSum += SpeciesProperties[std::min(SortedSpecies[i], static_cast<uint32_t>(SpeciesProperties.size()) - 1)].BoidSpeed;
+
+			// Nearest found further than a cell may not be the true nearest, so it only counts as isolated
+			if (NearestSquared >= CellSizeSquared)
+			{
+				Metrics.IsolatedBoids++;
+				continue;
+			}
+
+			float Nearest = sqrtf(NearestSquared);
+			Metrics.NearestNeighbourSum += Nearest;
+			Metrics.NearestNeighbourMinimum = std::min(Metrics.NearestNeighbourMinimum, Nearest);
+			Metrics.NearestNeighbourMaximum = std::max(Metrics.NearestNeighbourMaximum, Nearest);
+
+			uint32_t Bucket = static_cast<uint32_t>(Nearest * BucketsPerDistance);
+			Metrics.NearestNeighbourHistogram[std::min(Bucket, BoidFlockMetrics::HistogramBuckets - 1)]++;
+		}
+	});
+
+	// Every union has finished, so each root found now is final
+	ThreadPool.ParallelFor(NumberOfBoids, 1024, [this](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			m_Labels[i] = FindRoot(i);
+			m_ClusterSizes[i] = 0;
+		}
+	});
+
+	BoidFlockMetrics Metrics = {};
+	Metrics.BoidCount = NumberOfBoids;
+	Metrics.LinkDistance = LinkDistance;
+	Metrics.HistogramRange = CellSize;
+
+	for (uint32_t i = 0; i < NumberOfBoids; i++)
+	{
+		m_ClusterSizes[m_Labels[i]]++;
+	}
+
+	// Largest clusters kept sorted by insertion, only a handful are listed
+	for (uint32_t i = 0; i < NumberOfBoids; i++)
+	{
+		uint32_t Size = m_ClusterSizes[i];
+		if (Size == 0)
+		{
+			continue;
+		}
+
+		Metrics.ClusterCount++;
+		Metrics.SingleBoidClusters += Size == 1 ? 1 : 0;
+
+		uint32_t Slot = BoidFlockMetrics::ListedClusters;
+		for (; Slot > 0 && Metrics.LargestClusterSizes[Slot - 1] < Size; Slot--)
+		{
+			if (Slot < BoidFlockMetrics::ListedClusters)
+			{
+				Metrics.LargestClusterSizes[Slot] = Metrics.LargestClusterSizes[Slot - 1];
+			}
+		}
+		if (Slot < BoidFlockMetrics::ListedClusters)
+		{
+			Metrics.LargestClusterSizes[Slot] = Size;
+		}
+	}
+
+	double DirectionSum[3] = {};
+	double SpeedSum = 0;
+	double NearestNeighbourSum = 0;
+	Metrics.NearestNeighbourMinimum = FLT_MAX;
+	for (const ThreadMetrics& Partial : m_ThreadMetrics)
+	{
+		DirectionSum[0] += Partial.DirectionSum[0];
+		DirectionSum[1] += Partial.DirectionSum[1];
+		DirectionSum[2] += Partial.DirectionSum[2];
+		SpeedSum += Partial.SpeedSum;
+		NearestNeighbourSum += Partial.NearestNeighbourSum;
+		Metrics.NearestNeighbourMinimum = std::min(Metrics.NearestNeighbourMinimum, Partial.NearestNeighbourMinimum);
+		Metrics.NearestNeighbourMaximum = std::max(Metrics.NearestNeighbourMaximum, Partial.NearestNeighbourMaximum);
+		Metrics.IsolatedBoids += Partial.IsolatedBoids;
+
+		for (uint32_t Bucket = 0; Bucket < BoidFlockMetrics::HistogramBuckets; Bucket++)
+		{
+			Metrics.NearestNeighbourHistogram[Bucket] += Partial.NearestNeighbourHistogram[Bucket];
+		}
+	}
+
+	if (NumberOfBoids > 0)
+	{
+		Metrics.MeanClusterSize = static_cast<float>(NumberOfBoids) / Metrics.ClusterCount;
+		Metrics.Polarization = static_cast<float>(sqrt(DirectionSum[0] * DirectionSum[0] + DirectionSum[1] * DirectionSum[1] + DirectionSum[2] * DirectionSum[2]) / NumberOfBoids);
+		Metrics.MeanSpeed = static_cast<float>(SpeedSum / NumberOfBoids);
+	}
+
+	uint32_t NeighbouredBoids = NumberOfBoids - Metrics.IsolatedBoids;
+	if (NeighbouredBoids > 0)
+	{
+		Metrics.NearestNeighbourMean = static_cast<float>(NearestNeighbourSum / NeighbouredBoids);
+	}
+	else
+	{
+		Metrics.NearestNeighbourMinimum = 0;
+	}
+
+	auto Stop = std::chrono::high_resolution_clock::now();
+	Metrics.Milliseconds = std::chrono::duration<double, std::milli>(Stop - Start).count();
+
+	m_Metrics = Metrics;
+}
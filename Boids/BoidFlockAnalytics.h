@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "BoidPhysicsSystem.h"
+
+// Summary of the flock after one step, small enough to copy every frame
+// Clusters are connected groups of boids, two boids within link distance of each other always share one
+// Polarization is the length of the mean direction, 1 when every boid heads the same way and near 0 for a disordered flock
+// Nearest neighbour distances are only known up to the grid cell size, boids with nobody that close count as isolated instead
+struct BoidFlockMetrics
+{
+	static const uint32_t HistogramBuckets = 16;
+	static const uint32_t ListedClusters = 8;
+
+	uint32_t BoidCount;
+	float LinkDistance;
+
+	uint32_t ClusterCount;
+	uint32_t SingleBoidClusters;
+	float MeanClusterSize;
+
+	// Largest first, zero past the number of clusters
+	uint32_t LargestClusterSizes[ListedClusters];
+
+	float Polarization;
+	float MeanSpeed;
+
+	float NearestNeighbourMean;
+	float NearestNeighbourMinimum;
+	float NearestNeighbourMaximum;
+	uint32_t IsolatedBoids;
+
+	// Boids by nearest neighbour distance, buckets evenly split [0, HistogramRange)
+	float HistogramRange;
+	uint32_t NearestNeighbourHistogram[HistogramBuckets];
+
+	double Milliseconds;
+};
+
+// Per step flock analytics over the physics system's spatial grid, attach with BoidPhysicsSystem::SetFlockAnalytics
+// One parallel pass over the 3x3x3 cells around every boid finds its nearest neighbour and joins it to every boid in link distance
+// through a lock free union-find, a second flattens the union-find into cluster labels, only counting cluster sizes is serial
+// Surrounding cells further than both the link distance and the nearest neighbour so far are skipped, so in a dense flock
+// most boids only scan their own cell
+// Storage is kept between steps, so analysing a flock of the same size does not allocate
+class BoidFlockAnalytics
+{
+public:
+	// Boids closer than this share a cluster, 0 uses the largest separation distance, always clamped to the grid cell size
+	void SetLinkDistance(float LinkDistance);
+	float GetLinkDistance() const;
+
+	// Analyse boids in grid order, called by the physics system at the end of every step once the grid is rebuilt
+	void Analyze(const BoidSpatialGrid& Grid, const BoidLargeVector<BoidProperties>& SortedBoids, const BoidLargeVector<uint32_t>& SortedSpecies,
+				 const std::vector<ModelProperties>& SpeciesProperties);
+
+	// Metrics of the last analysed step
+	const BoidFlockMetrics& GetMetrics() const;
+
+	// Cluster of every boid in grid order from the last analysed step, the smallest grid index of its boids
+	const uint32_t* GetClusterLabels() const;
+
+protected:
+	// Sums of one thread, merged once every thread has finished
+	struct alignas(64) ThreadMetrics
+	{
+		double DirectionSum[3];
+		double SpeedSum;
+		double NearestNeighbourSum;
+		float NearestNeighbourMinimum;
+		float NearestNeighbourMaximum;
+		uint32_t IsolatedBoids;
+		uint32_t NearestNeighbourHistogram[BoidFlockMetrics::HistogramBuckets];
+	};
+
+	// Root of boid's set, halving the path on the way so later finds are shorter
+	uint32_t FindRoot(uint32_t Boid);
+
+	// Join sets of both boids, the larger root always links under the smaller so concurrent unions cannot form a cycle
+	void Unite(uint32_t First, uint32_t Second);
+
+	// Grow per boid arrays to boid count, only allocates when the flock grew
+	void PrepareAnalysis(uint32_t BoidCount, uint32_t ThreadCount);
+
+	float m_LinkDistance = 0;
+
+	std::unique_ptr<std::atomic<uint32_t>[]> m_Parents;
+	std::unique_ptr<uint32_t[]> m_Labels;
+	std::unique_ptr<uint32_t[]> m_ClusterSizes;
+	uint32_t m_Capacity = 0;
+
+	std::vector<ThreadMetrics> m_ThreadMetrics;
+
+	BoidFlockMetrics m_Metrics = {};
+};
@@ -2,6 +2,6 @@
 
 using namespace DirectX;
 
-BoidObject::BoidObject(XMFLOAT3 BoidPosition, XMFLOAT3 BoidDirection) : m_Position(BoidPosition), m_Direction(BoidDirection)
+BoidObject::BoidObject(XMFLOAT3 BoidPosition, XMFLOAT3 BoidDirection, uint32_t Species) : m_Position(BoidPosition), m_Direction(BoidDirection), m_Species(Species)
 {
 }
\ No newline at end of file
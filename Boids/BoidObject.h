@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <DirectXMath.h>
 
 // Provides storage for both position and direction of boid object
@@ -7,8 +8,12 @@ class BoidObject
 {
 public:
 	BoidObject(	DirectX::XMFLOAT3 BoidPosition = DirectX::XMFLOAT3(0,0,0), 
-				DirectX::XMFLOAT3 BoidDirection = DirectX::XMFLOAT3(0,1,0));
+				DirectX::XMFLOAT3 BoidDirection = DirectX::XMFLOAT3(0,1,0),
+				uint32_t Species = 0);
 
 	DirectX::XMFLOAT3 m_Position;
 	DirectX::XMFLOAT3 m_Direction;
+
+	// Index into physics system species, boids of species past the registered count use the last species
+	uint32_t m_Species;
 };
@@ -0,0 +1,402 @@
+#include "BoidObstacleField.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <math.h>
+#include "BoidThreadPool.h"
+
+using namespace DirectX;
+
+void BoidObstacleField::AddSphere(XMFLOAT3 Center, float Radius)
+{
+	m_Spheres.push_back({ Center, Radius });
+}
+
+void BoidObstacleField::AddBox(XMFLOAT3 Center, XMFLOAT3 HalfSize)
+{
+	m_Boxes.push_back({ Center, HalfSize });
+}
+
+void BoidObstacleField::AddMesh(const XMFLOAT3* Vertices, uint32_t VertexCount, const uint32_t* Indices, uint32_t IndexCount)
+{
+	MeshObstacle Mesh;
+	Mesh.FirstTriangle = static_cast<uint32_t>(m_Triangles.size());
+	Mesh.TriangleCount = 0;
+
+	for (uint32_t i = 0; i + 2 < IndexCount; i += 3)
+	{
+		// Skip triangles referencing missing vertices rather than reading past the array
+		if (Indices[i] >= VertexCount || Indices[i + 1] >= VertexCount || Indices[i + 2] >= VertexCount)
+		{
+			continue;
+		}
+
+		m_Triangles.push_back({ { Vertices[Indices[i]], Vertices[Indices[i + 1]], Vertices[Indices[i + 2]] } });
+		Mesh.TriangleCount++;
+	}
+
+	if (Mesh.TriangleCount > 0)
+	{
+		m_Meshes.push_back(Mesh);
+	}
+}
+
+void BoidObstacleField::ClearObstacles()
+{
+	m_Spheres.clear();
+	m_Boxes.clear();
+	m_Meshes.clear();
+	m_Triangles.clear();
+}
+
+void BoidObstacleField::Bake(XMFLOAT3 Min, XMFLOAT3 Max, float VoxelSize)
+{
+	// Size voxels so box is covered, growing voxels if the box would need too many
+	float LargestSize = std::max(Max.x - Min.x, std::max(Max.y - Min.y, Max.z - Min.z));
+	float SmallestVoxelSize = LargestSize / (MaximumVoxelsPerAxis - 1);
+	m_VoxelSize = std::max(VoxelSize, std::max(SmallestVoxelSize, 0.001f));
+	m_InverseVoxelSize = 1.0f / m_VoxelSize;
+
+	// Samples sit on voxel corners, so one more sample than voxels along every axis
+	m_Origin = Min;
+	m_Dimensions = XMINT3(std::max(2, static_cast<int>(ceil((Max.x - Min.x) * m_InverseVoxelSize)) + 1),
+						  std::max(2, static_cast<int>(ceil((Max.y - Min.y) * m_InverseVoxelSize)) + 1),
+						  std::max(2, static_cast<int>(ceil((Max.z - Min.z) * m_InverseVoxelSize)) + 1));
+
+	uint32_t SliceCount = m_Dimensions.z;
+	m_Voxels.assign(static_cast<size_t>(m_Dimensions.x) * m_Dimensions.y * m_Dimensions.z, XMFLOAT4(0, 0, 0, FLT_MAX));
+
+	// Every sample is independent, split slices across threads
+	BoidThreadPool::Get().ParallelFor(SliceCount, 1, [this](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t z = Begin; z < End; z++)
+		{
+			for (int y = 0; y < m_Dimensions.y; y++)
+			{
+				for (int x = 0; x < m_Dimensions.x; x++)
+				{
+					XMVECTOR Position = XMVectorSet(m_Origin.x + x * m_VoxelSize, m_Origin.y + y * m_VoxelSize, m_Origin.z + z * m_VoxelSize, 1.0f);
+					m_Voxels[CalculateVoxelIndex(x, y, z)].w = CalculateDistance(Position);
+				}
+			}
+		}
+	});
+
+	CalculateGradients();
+}
+
+bool BoidObstacleField::IsBaked() const
+{
+	return !m_Voxels.empty();
+}
+
+XMVECTOR BoidObstacleField::Sample(FXMVECTOR Position) const
+{
+	// Continuous voxel coordinate, clamped so all eight corners are inside the grid
+	XMVECTOR Origin = XMLoadFloat3(&m_Origin);
+	XMVECTOR Upper = XMVectorSet(m_Dimensions.x - 1.001f, m_Dimensions.y - 1.001f, m_Dimensions.z - 1.001f, 0.0f);
+	XMVECTOR Coord = XMVectorClamp((Position - Origin) * m_InverseVoxelSize, XMVectorZero(), Upper);
+
+	XMVECTOR Base = XMVectorFloor(Coord);
+	XMVECTOR Fraction = Coord - Base;
+
+	XMINT3 Cell;
+	XMStoreSInt3(&Cell, Base);
+
+	uint32_t StrideY = m_Dimensions.x;
+	uint32_t StrideZ = m_Dimensions.x * m_Dimensions.y;
+	const XMFLOAT4* Corner = &m_Voxels[CalculateVoxelIndex(Cell.x, Cell.y, Cell.z)];
+
+	// Gradient and distance are interpolated together, one lerp per pair of corners
+	XMVECTOR FractionX = XMVectorSplatX(Fraction);
+	XMVECTOR FractionY = XMVectorSplatY(Fraction);
+	XMVECTOR FractionZ = XMVectorSplatZ(Fraction);
+
+	XMVECTOR Lower00 = XMVectorLerpV(XMLoadFloat4(Corner), XMLoadFloat4(Corner + 1), FractionX);
+	XMVECTOR Lower10 = XMVectorLerpV(XMLoadFloat4(Corner + StrideY), XMLoadFloat4(Corner + StrideY + 1), FractionX);
+	XMVECTOR Upper00 = XMVectorLerpV(XMLoadFloat4(Corner + StrideZ), XMLoadFloat4(Corner + StrideZ + 1), FractionX);
+	XMVECTOR Upper10 = XMVectorLerpV(XMLoadFloat4(Corner + StrideZ + StrideY), XMLoadFloat4(Corner + StrideZ + StrideY + 1), FractionX);
+
+	XMVECTOR Lower = XMVectorLerpV(Lower00, Lower10, FractionY);
+	XMVECTOR UpperSlice = XMVectorLerpV(Upper00, Upper10, FractionY);
+
+	return XMVectorLerpV(Lower, UpperSlice, FractionZ);
+}
+
+XMINT3 BoidObstacleField::GetDimensions() const
+{
+	return m_Dimensions;
+}
+
+float BoidObstacleField::GetVoxelSize() const
+{
+	return m_VoxelSize;
+}
+
+float BoidObstacleField::CalculateDistance(FXMVECTOR Position) const
+{
+	float Distance = FLT_MAX;
+
+	for (const SphereObstacle& Sphere : m_Spheres)
+	{
+		XMVECTOR Center = XMLoadFloat3(&Sphere.Center);
+		Distance = std::min(Distance, XMVectorGetX(XMVector3Length(Position - Center)) - Sphere.Radius);
+	}
+
+	for (const BoxObstacle& Box : m_Boxes)
+	{
+		// Distance outside box plus negative distance to nearest face inside it
+		XMVECTOR Offset = XMVectorAbs(Position - XMLoadFloat3(&Box.Center)) - XMLoadFloat3(&Box.HalfSize);
+		float Outside = XMVectorGetX(XMVector3Length(XMVectorMax(Offset, XMVectorZero())));
+
+		XMFLOAT3 Components;
+		XMStoreFloat3(&Components, Offset);
+		float Inside = std::min(std::max(Components.x, std::max(Components.y, Components.z)), 0.0f);
+
+		Distance = std::min(Distance, Outside + Inside);
+	}
+
+	for (const MeshObstacle& Mesh : m_Meshes)
+	{
+		Distance = std::min(Distance, CalculateMeshDistance(Position, Mesh));
+	}
+
+	return Distance;
+}
+
+float BoidObstacleField::CalculateMeshDistance(FXMVECTOR Position, const MeshObstacle& Mesh) const
+{
+	float ClosestDistanceSquared = FLT_MAX;
+	float SolidAngle = 0;
+
+	for (uint32_t t = Mesh.FirstTriangle; t < Mesh.FirstTriangle + Mesh.TriangleCount; t++)
+	{
+		const Triangle& Tri = m_Triangles[t];
+
+		XMVECTOR ToPosition = Position - CalculateClosestPointOnTriangle(Position, Tri);
+		ClosestDistanceSquared = std::min(ClosestDistanceSquared, XMVectorGetX(XMVector3LengthSq(ToPosition)));
+
+		// Signed solid angle of the triangle seen from the position (Van Oosterom and Strackee)
+		XMVECTOR A = XMLoadFloat3(&Tri.Vertices[0]) - Position;
+		XMVECTOR B = XMLoadFloat3(&Tri.Vertices[1]) - Position;
+		XMVECTOR C = XMLoadFloat3(&Tri.Vertices[2]) - Position;
+		float LengthA = XMVectorGetX(XMVector3Length(A));
+		float LengthB = XMVectorGetX(XMVector3Length(B));
+		float LengthC = XMVectorGetX(XMVector3Length(C));
+
+		float Numerator = XMVectorGetX(XMVector3Dot(A, XMVector3Cross(B, C)));
+		float Denominator = LengthA * LengthB * LengthC + XMVectorGetX(XMVector3Dot(A, B)) * LengthC +
+							XMVectorGetX(XMVector3Dot(A, C)) * LengthB + XMVectorGetX(XMVector3Dot(B, C)) * LengthA;
+		SolidAngle += 2.0f * atan2f(Numerator, Denominator);
+	}
+
+	// Winding number is about 1 inside a closed mesh and 0 outside, unlike the face of the closest triangle it can't be fooled
+	// by a closest point on an edge or corner shared with faces pointing other ways
+	float Sign = fabsf(SolidAngle) > 2.0f * XM_PI ? -1.0f : 1.0f;
+	return Sign * sqrt(ClosestDistanceSquared);
+}
+
+XMVECTOR BoidObstacleField::CalculateClosestPointOnTriangle(FXMVECTOR Position, const Triangle& Tri) const
+{
+	XMVECTOR A = XMLoadFloat3(&Tri.Vertices[0]);
+	XMVECTOR B = XMLoadFloat3(&Tri.Vertices[1]);
+	XMVECTOR C = XMLoadFloat3(&Tri.Vertices[2]);
+
+	XMVECTOR AB = B - A;
+	XMVECTOR AC = C - A;
+	XMVECTOR AP = Position - A;
+
+	// Vertex region A
+	float D1 = XMVectorGetX(XMVector3Dot(AB, AP));
+	float D2 = XMVectorGetX(XMVector3Dot(AC, AP));
+	if (D1 <= 0 && D2 <= 0)
+	{
+		return A;
+	}
+
+	// Vertex region B
+	XMVECTOR BP = Position - B;
+	float D3 = XMVectorGetX(XMVector3Dot(AB, BP));
+	float D4 = XMVectorGetX(XMVector3Dot(AC, BP));
+	if (D3 >= 0 && D4 <= D3)
+	{
+		return B;
+	}
+
+	// Edge region AB
+	float VC = D1 * D4 - D3 * D2;
+	if (VC <= 0 && D1 >= 0 && D3 <= 0)
+	{
+		return A + AB * (D1 / (D1 - D3));
+	}
+
+	// Vertex region C
+	XMVECTOR CP = Position - C;
+	float D5 = XMVectorGetX(XMVector3Dot(AB, CP));
+	float D6 = XMVectorGetX(XMVector3Dot(AC, CP));
+	if (D6 >= 0 && D5 <= D6)
+	{
+		return C;
+	}
+
+	// Edge region AC
+	float VB = D5 * D2 - D1 * D6;
+	if (VB <= 0 && D2 >= 0 && D6 <= 0)
+	{
+		return A + AC * (D2 / (D2 - D6));
+	}
+
+	// Edge region BC
+	float VA = D3 * D6 - D5 * D4;
+	if (VA <= 0 && (D4 - D3) >= 0 && (D5 - D6) >= 0)
+	{
+		return B + (C - B) * ((D4 - D3) / ((D4 - D3) + (D5 - D6)));
+	}
+
+	// Inside face, degenerate triangles fall back to vertex A
+	float Denominator = VA + VB + VC;
+	if (Denominator == 0)
+	{
+		return A;
+	}
+
+	float V = VB / Denominator;
+	float W = VC / Denominator;
+	return A + AB * V + AC * W;
+}
+
+void BoidObstacleField::CalculateGradients()
+{
+	BoidThreadPool::Get().ParallelFor(m_Dimensions.z, 1, [this](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (int z = static_cast<int>(Begin); z < static_cast<int>(End); z++)
+		{
+			for (int y = 0; y < m_Dimensions.y; y++)
+			{
+				for (int x = 0; x < m_Dimensions.x; x++)
+				{
+					int X0 = std::max(x - 1, 0), X1 = std::min(x + 1, m_Dimensions.x - 1);
+					int Y0 = std::max(y - 1, 0), Y1 = std::min(y + 1, m_Dimensions.y - 1);
+					int Z0 = std::max(z - 1, 0), Z1 = std::min(z + 1, m_Dimensions.z - 1);
+
+					XMVECTOR Gradient = XMVectorSet((m_Voxels[CalculateVoxelIndex(X1, y, z)].w - m_Voxels[CalculateVoxelIndex(X0, y, z)].w) / (X1 - X0),
+													(m_Voxels[CalculateVoxelIndex(x, Y1, z)].w - m_Voxels[CalculateVoxelIndex(x, Y0, z)].w) / (Y1 - Y0),
+													(m_Voxels[CalculateVoxelIndex(x, y, Z1)].w - m_Voxels[CalculateVoxelIndex(x, y, Z0)].w) / (Z1 - Z0),
+													0.0f);
+
+					// Flat regions far from every obstacle keep a zero gradient instead of a normalized NaN
+					if (XMVectorGetX(XMVector3LengthSq(Gradient)) > 1e-12f)
+					{
+						Gradient = XMVector3Normalize(Gradient);
+					}
+
+					XMFLOAT4& Voxel = m_Voxels[CalculateVoxelIndex(x, y, z)];
+					Voxel.x = XMVectorGetX(Gradient);
+					Voxel.y = XMVectorGetY(Gradient);
+					Voxel.z = XMVectorGetZ(Gradient);
+				}
+			}
+		}
+	});
+}
+
+uint32_t BoidObstacleField::CalculateVoxelIndex(int x, int y, int z) const
+{
+	return x + m_Dimensions.x * (y + m_Dimensions.y * z);
+}
+
+bool BoidObstacleField::CheckMeshDistances()
+{
+	XMFLOAT3 Center(1.0f, 2.0f, 3.0f);
+	XMFLOAT3 HalfSize(1.0f, 1.5f, 2.0f);
+
+	// Corner i has bit 0, 1, 2 set for +x, +y, +z, two triangles per face wound outwards
+	XMFLOAT3 Vertices[8];
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		Vertices[i] = XMFLOAT3(Center.x + (i & 1 ? HalfSize.x : -HalfSize.x),
+							   Center.y + (i & 2 ? HalfSize.y : -HalfSize.y),
+							   Center.z + (i & 4 ? HalfSize.z : -HalfSize.z));
+	}
+
+	const uint32_t Indices[36] =
+	{
+		0, 4, 6, 0, 6, 2,	// -x
+		1, 3, 7, 1, 7, 5,	// +x
+		0, 1, 5, 0, 5, 4,	// -y
+		2, 6, 7, 2, 7, 3,	// +y
+		0, 2, 3, 0, 3, 1,	// -z
+		4, 5, 7, 4, 7, 6	// +z
+	};
+
+	BoidObstacleField MeshField;
+	MeshField.AddMesh(Vertices, 8, Indices, 36);
+
+	BoidObstacleField BoxField;
+	BoxField.AddBox(Center, HalfSize);
+
+	// Offsets just past and just short of every face, edge and corner, plus the centre
+	const float Offsets[] = { 0.01f, -0.01f };
+	bool Passed = fabsf(MeshField.CalculateDistance(XMLoadFloat3(&Center)) - BoxField.CalculateDistance(XMLoadFloat3(&Center))) < 1e-4f;
+
+	for (float Offset : Offsets)
+	{
+		for (int z = -1; z <= 1; z++)
+		{
+			for (int y = -1; y <= 1; y++)
+			{
+				for (int x = -1; x <= 1; x++)
+				{
+					if (x == 0 && y == 0 && z == 0)
+					{
+						continue;
+					}
+
+					XMVECTOR Position = XMVectorSet(Center.x + x * (HalfSize.x + Offset),
+													Center.y + y * (HalfSize.y + Offset),
+													Center.z + z * (HalfSize.z + Offset), 1.0f);
+
+					float MeshDistance = MeshField.CalculateDistance(Position);
+					float BoxDistance = BoxField.CalculateDistance(Position);
+					if (fabsf(MeshDistance - BoxDistance) > 1e-4f)
+					{
+						Passed = false;
+					}
+				}
+			}
+		}
+	}
+
+	// Square based spike, faces at the tip point so differently that just outside it some face of the tip is behind the point
+	const float BaseHalfWidth = 0.1f;
+	const float Height = 1.0f;
+	XMFLOAT3 SpikeVertices[5] =
+	{
+		XMFLOAT3(-BaseHalfWidth, -BaseHalfWidth, 0.0f), XMFLOAT3(BaseHalfWidth, -BaseHalfWidth, 0.0f),
+		XMFLOAT3(BaseHalfWidth, BaseHalfWidth, 0.0f), XMFLOAT3(-BaseHalfWidth, BaseHalfWidth, 0.0f),
+		XMFLOAT3(0.0f, 0.0f, Height)
+	};
+
+	const uint32_t SpikeIndices[18] = { 0, 1, 4, 1, 2, 4, 2, 3, 4, 3, 0, 4, 0, 2, 1, 0, 3, 2 };
+
+	BoidObstacleField SpikeField;
+	SpikeField.AddMesh(SpikeVertices, 5, SpikeIndices, 18);
+
+	// Tilted 30 degrees up from every side the tip is still the closest point, so distance is exactly the offset
+	const XMFLOAT2 Sides[4] = { XMFLOAT2(1, 0), XMFLOAT2(-1, 0), XMFLOAT2(0, 1), XMFLOAT2(0, -1) };
+	for (const XMFLOAT2& Side : Sides)
+	{
+		XMVECTOR Position = XMVectorSet(0.01f * 0.866f * Side.x, 0.01f * 0.866f * Side.y, Height + 0.01f * 0.5f, 1.0f);
+		if (fabsf(SpikeField.CalculateDistance(Position) - 0.01f) > 1e-4f)
+		{
+			Passed = false;
+		}
+	}
+
+	if (SpikeField.CalculateDistance(XMVectorSet(0.0f, 0.0f, 0.1f, 1.0f)) >= 0)
+	{
+		Passed = false;
+	}
+
+	return Passed;
+}
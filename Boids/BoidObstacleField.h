@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+
+// Static obstacles baked into a signed distance voxel grid, so avoidance costs one sample per boid however many obstacles exist
+// Distance is negative inside an obstacle, gradient points away from the nearest surface
+class BoidObstacleField
+{
+public:
+	// Cap on voxels per axis, voxel size grows past the requested size if the box would need more
+	static const int MaximumVoxelsPerAxis = 128;
+
+	// Add obstacles, only take effect on the next Bake
+	void AddSphere(DirectX::XMFLOAT3 Center, float Radius);
+	void AddBox(DirectX::XMFLOAT3 Center, DirectX::XMFLOAT3 HalfSize);
+
+	// Triangle mesh, expected to be closed, inside is decided by winding number so either consistent winding works
+	void AddMesh(const DirectX::XMFLOAT3* Vertices, uint32_t VertexCount, const uint32_t* Indices, uint32_t IndexCount);
+
+	void ClearObstacles();
+
+	// Bake every added obstacle into voxels of at least VoxelSize covering box [Min, Max], intended for load time
+	void Bake(DirectX::XMFLOAT3 Min, DirectX::XMFLOAT3 Max, float VoxelSize);
+	bool IsBaked() const;
+
+	// Trilinear sample returning gradient in x, y, z and signed distance in w, positions outside the box are clamped onto it
+	DirectX::XMVECTOR Sample(DirectX::FXMVECTOR Position) const;
+
+	DirectX::XMINT3 GetDimensions() const;
+	float GetVoxelSize() const;
+
+	// Cube mesh against the same cube as a box just outside and inside every corner, edge and face, then just outside the tip of a
+	// slender spike, false if any distance is off. Closest points shared by faces pointing different ways are where signs go wrong
+	static bool CheckMeshDistances();
+
+protected:
+	struct SphereObstacle
+	{
+		DirectX::XMFLOAT3 Center;
+		float Radius;
+	};
+
+	struct BoxObstacle
+	{
+		DirectX::XMFLOAT3 Center;
+		DirectX::XMFLOAT3 HalfSize;
+	};
+
+	// Range of m_Triangles belonging to one mesh
+	struct MeshObstacle
+	{
+		uint32_t FirstTriangle;
+		uint32_t TriangleCount;
+	};
+
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 Vertices[3];
+	};
+
+	// Exact signed distance from point to nearest obstacle
+	float CalculateDistance(DirectX::FXMVECTOR Position) const;
+
+	// Unsigned distance to the closest triangle, negated when the winding number of the mesh around the point says inside
+	float CalculateMeshDistance(DirectX::FXMVECTOR Position, const MeshObstacle& Mesh) const;
+
+	// Closest point on triangle to point, see Ericson, Real-Time Collision Detection 5.1.5
+	DirectX::XMVECTOR CalculateClosestPointOnTriangle(DirectX::FXMVECTOR Position, const Triangle& Tri) const;
+
+	// Central differences of baked distances, one sided along the border
+	void CalculateGradients();
+
+	uint32_t CalculateVoxelIndex(int x, int y, int z) const;
+
+	std::vector<SphereObstacle> m_Spheres;
+	std::vector<BoxObstacle> m_Boxes;
+	std::vector<MeshObstacle> m_Meshes;
+	std::vector<Triangle> m_Triangles;
+
+	DirectX::XMFLOAT3 m_Origin = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMINT3 m_Dimensions = DirectX::XMINT3(0, 0, 0);
+	float m_VoxelSize = 1;
+	float m_InverseVoxelSize = 1;
+
+	// Samples at voxel corners, gradient in x, y, z and distance in w so one load fetches everything a corner needs
+	std::vector<DirectX::XMFLOAT4> m_Voxels;
+};
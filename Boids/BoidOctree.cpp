@@ -0,0 +1,162 @@
+#include "BoidOctree.h"
+#include "BoidPhysicsSystem.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+void BoidOctree::Build(const BoidProperties* SortedBoids, const uint32_t* SpeciesStart, uint32_t SpeciesCount)
+{
+	m_SortedBoids = SortedBoids;
+	m_Nodes.clear();
+	m_Roots.assign(SpeciesCount, UINT32_MAX);
+
+	const uint32_t BoidCount = SpeciesStart[SpeciesCount];
+	m_Indices.resize(BoidCount);
+	m_Scratch.resize(BoidCount);
+
+	for (uint32_t i = 0; i < BoidCount; i++)
+	{
+		m_Indices[i] = i;
+	}
+
+	for (uint32_t Species = 0; Species < SpeciesCount; Species++)
+	{
+		const uint32_t Begin = SpeciesStart[Species];
+		const uint32_t End = SpeciesStart[Species + 1];
+		if (Begin == End)
+		{
+			continue;
+		}
+
+		// Root is the cube around every boid of this species
+		XMFLOAT3 Min = XMFLOAT3(SortedBoids[Begin].BoidPosition.x, SortedBoids[Begin].BoidPosition.y, SortedBoids[Begin].BoidPosition.z);
+		XMFLOAT3 Max = Min;
+		for (uint32_t i = Begin + 1; i < End; i++)
+		{
+			const XMFLOAT4& Position = SortedBoids[i].BoidPosition;
+			Min = XMFLOAT3(std::min(Min.x, Position.x), std::min(Min.y, Position.y), std::min(Min.z, Position.z));
+			Max = XMFLOAT3(std::max(Max.x, Position.x), std::max(Max.y, Position.y), std::max(Max.z, Position.z));
+		}
+
+		BoidOctreeNode Root = {};
+		Root.Center = XMFLOAT3((Min.x + Max.x) * 0.5f, (Min.y + Max.y) * 0.5f, (Min.z + Max.z) * 0.5f);
+		Root.HalfSize = std::max(std::max(Max.x - Min.x, Max.y - Min.y), Max.z - Min.z) * 0.5f + 0.001f;
+		Root.Begin = Begin;
+		Root.End = End;
+
+		m_Roots[Species] = static_cast<uint32_t>(m_Nodes.size());
+		m_Nodes.push_back(Root);
+		BuildNode(m_Roots[Species], 0);
+	}
+}
+
+void BoidOctree::BuildNode(uint32_t Node, uint32_t Depth)
+{
+	const uint32_t Begin = m_Nodes[Node].Begin;
+	const uint32_t End = m_Nodes[Node].End;
+	const XMFLOAT3 Center = m_Nodes[Node].Center;
+
+	XMVECTOR SumPosition = XMVectorZero();
+	XMVECTOR SumDirection = XMVectorZero();
+	for (uint32_t i = Begin; i < End; i++)
+	{
+		SumPosition += XMLoadFloat4(&m_SortedBoids[m_Indices[i]].BoidPosition);
+		SumDirection += XMLoadFloat4(&m_SortedBoids[m_Indices[i]].BoidDirection);
+	}
+
+	BoidOctreeNode& Current = m_Nodes[Node];
+	XMStoreFloat3(&Current.SumPosition, SumPosition);
+	XMStoreFloat3(&Current.SumDirection, SumDirection);
+	Current.Count = End - Begin;
+	Current.FirstChild = 0;
+	Current.ChildCount = 0;
+
+	if (End - Begin <= MaximumLeafBoids || Depth >= MaximumDepth)
+	{
+		return;
+	}
+
+	// Counting sort of the node's boids by octant, bit 0 is x, bit 1 is y and bit 2 is z
+	uint32_t OctantStart[9] = {};
+	for (uint32_t i = Begin; i < End; i++)
+	{
+		const XMFLOAT4& Position = m_SortedBoids[m_Indices[i]].BoidPosition;
+		uint32_t Octant = (Position.x >= Center.x ? 1 : 0) | (Position.y >= Center.y ? 2 : 0) | (Position.z >= Center.z ? 4 : 0);
+		OctantStart[Octant + 1]++;
+	}
+	for (uint32_t Octant = 0; Octant < 8; Octant++)
+	{
+		OctantStart[Octant + 1] += OctantStart[Octant];
+	}
+
+	uint32_t Cursor[8];
+	std::copy(OctantStart, OctantStart + 8, Cursor);
+	for (uint32_t i = Begin; i < End; i++)
+	{
+		const XMFLOAT4& Position = m_SortedBoids[m_Indices[i]].BoidPosition;
+		uint32_t Octant = (Position.x >= Center.x ? 1 : 0) | (Position.y >= Center.y ? 2 : 0) | (Position.z >= Center.z ? 4 : 0);
+		m_Scratch[Begin + Cursor[Octant]++] = m_Indices[i];
+	}
+	std::copy(m_Scratch.begin() + Begin, m_Scratch.begin() + End, m_Indices.begin() + Begin);
+
+	// Only occupied octants get a child, all of them contiguous
+	const float ChildHalfSize = m_Nodes[Node].HalfSize * 0.5f;
+	const uint32_t FirstChild = static_cast<uint32_t>(m_Nodes.size());
+	uint32_t ChildCount = 0;
+
+	for (uint32_t Octant = 0; Octant < 8; Octant++)
+	{
+		if (OctantStart[Octant] == OctantStart[Octant + 1])
+		{
+			continue;
+		}
+
+		BoidOctreeNode Child = {};
+		Child.Center = XMFLOAT3(Center.x + (Octant & 1 ? ChildHalfSize : -ChildHalfSize),
+								Center.y + (Octant & 2 ? ChildHalfSize : -ChildHalfSize),
+								Center.z + (Octant & 4 ? ChildHalfSize : -ChildHalfSize));
+		Child.HalfSize = ChildHalfSize;
+		Child.Begin = Begin + OctantStart[Octant];
+		Child.End = Begin + OctantStart[Octant + 1];
+
+		m_Nodes.push_back(Child);
+		ChildCount++;
+	}
+
+	m_Nodes[Node].FirstChild = FirstChild;
+	m_Nodes[Node].ChildCount = ChildCount;
+
+	// Push back above may have moved nodes, so children are built by index
+	for (uint32_t Child = FirstChild; Child < FirstChild + ChildCount; Child++)
+	{
+		BuildNode(Child, Depth + 1);
+	}
+}
+
+void BoidOctree::Clear()
+{
+	m_Nodes.clear();
+	m_Roots.clear();
+	m_Indices.clear();
+}
+
+uint32_t BoidOctree::GetRoot(uint32_t Species) const
+{
+	return Species < m_Roots.size() ? m_Roots[Species] : UINT32_MAX;
+}
+
+const BoidOctreeNode& BoidOctree::GetNode(uint32_t Node) const
+{
+	return m_Nodes[Node];
+}
+
+const std::vector<uint32_t>& BoidOctree::GetIndices() const
+{
+	return m_Indices;
+}
+
+uint32_t BoidOctree::GetNodeCount() const
+{
+	return static_cast<uint32_t>(m_Nodes.size());
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+
+struct BoidProperties;
+
+// Octree node with sums of the boids below it, so a distant node can stand in for all of them
+// Children of a node are contiguous, leaves hold a range of the tree's boid indices instead
+struct BoidOctreeNode
+{
+	DirectX::XMFLOAT3 Center;
+	float HalfSize;
+
+	DirectX::XMFLOAT3 SumPosition;
+	uint32_t Count;
+
+	DirectX::XMFLOAT3 SumDirection;
+	uint32_t FirstChild;
+
+	uint32_t ChildCount;
+	uint32_t Begin;
+	uint32_t End;
+};
+
+// One octree per species over boids in grid order, rebuilt every step for Barnes-Hut neighbour search
+class BoidOctree
+{
+public:
+	// Nodes with this many boids or fewer are not split further
+	static const uint32_t MaximumLeafBoids = 8;
+
+	// Stops splitting boids sharing a position forever
+	static const uint32_t MaximumDepth = 16;
+
+	// Build trees over sorted boids, species s being range [SpeciesStart[s], SpeciesStart[s + 1])
+	void Build(const BoidProperties* SortedBoids, const uint32_t* SpeciesStart, uint32_t SpeciesCount);
+	void Clear();
+
+	// Root node of species, UINT32_MAX if species has no boids
+	uint32_t GetRoot(uint32_t Species) const;
+
+	const BoidOctreeNode& GetNode(uint32_t Node) const;
+
+	// Sorted boid indices in tree order, leaf boids are GetIndices()[Begin, End)
+	const std::vector<uint32_t>& GetIndices() const;
+
+	uint32_t GetNodeCount() const;
+
+protected:
+	// Sum boids of node and split it into children if it holds too many
+	void BuildNode(uint32_t Node, uint32_t Depth);
+
+	const BoidProperties* m_SortedBoids = nullptr;
+
+	std::vector<BoidOctreeNode> m_Nodes;
+	std::vector<uint32_t> m_Roots;
+	std::vector<uint32_t> m_Indices;
+	std::vector<uint32_t> m_Scratch;
+};
@@ -0,0 +1,140 @@
+#include "BoidPageAllocator.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "BoidTopology.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	enum class PageKind
+	{
+		HugeTLB,
+		TransparentHuge,
+		Regular
+	};
+
+	// Live large arrays, only a handful exist so a list is enough to know what backs each on free
+	struct PageMapping
+	{
+		void* Memory;
+		uint64_t Bytes;
+		PageKind Kind;
+	};
+
+	std::mutex s_MappingMutex;
+	std::vector<PageMapping> s_Mappings;
+
+	void AddMapping(void* Memory, uint64_t Bytes, PageKind Kind)
+	{
+		std::lock_guard<std::mutex> Lock(s_MappingMutex);
+		s_Mappings.push_back({ Memory, Bytes, Kind });
+	}
+
+	void RemoveMapping(void* Memory)
+	{
+		std::lock_guard<std::mutex> Lock(s_MappingMutex);
+		auto Mapping = std::find_if(s_Mappings.begin(), s_Mappings.end(), [Memory](const PageMapping& Entry) { return Entry.Memory == Memory; });
+		if (Mapping != s_Mappings.end())
+		{
+			*Mapping = s_Mappings.back();
+			s_Mappings.pop_back();
+		}
+	}
+
+#ifdef __linux__
+	size_t RoundUp(size_t Bytes, size_t Alignment)
+	{
+		return (Bytes + Alignment - 1) / Alignment * Alignment;
+	}
+#endif
+}
+
+void* BoidPages::Allocate(size_t Bytes)
+{
+#ifdef __linux__
+	const BoidTopology& Topology = BoidTopology::Get();
+	const size_t HugePageSize = static_cast<size_t>(Topology.GetHugePageSize());
+	const size_t MappedBytes = RoundUp(Bytes, HugePageSize);
+
+	// Explicit huge pages fail straight away once the reserved pool runs out, so falling back costs one call
+	if (Topology.GetReservedHugePages() > 0)
+	{
+		void* Mapping = mmap(nullptr, MappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (Mapping != MAP_FAILED)
+		{
+			AddMapping(Mapping, MappedBytes, PageKind::HugeTLB);
+			return Mapping;
+		}
+	}
+
+	// Over-map by one huge page and trim, so the array starts on a huge page boundary and every page of it can be promoted
+	void* Mapping = mmap(nullptr, MappedBytes + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (Mapping == MAP_FAILED)
+	{
+		throw std::bad_alloc();
+	}
+
+	uintptr_t Start = reinterpret_cast<uintptr_t>(Mapping);
+	uintptr_t AlignedStart = RoundUp(Start, HugePageSize);
+	if (AlignedStart > Start)
+	{
+		munmap(Mapping, AlignedStart - Start);
+	}
+	munmap(reinterpret_cast<void*>(AlignedStart + MappedBytes), Start + HugePageSize - AlignedStart);
+
+	void* Memory = reinterpret_cast<void*>(AlignedStart);
+	bool Advised = Topology.HasTransparentHugePages() && madvise(Memory, MappedBytes, MADV_HUGEPAGE) == 0;
+	AddMapping(Memory, MappedBytes, Advised ? PageKind::TransparentHuge : PageKind::Regular);
+
+	return Memory;
+#else
+	void* Memory = ::operator new(Bytes);
+	AddMapping(Memory, Bytes, PageKind::Regular);
+	return Memory;
+#endif
+}
+
+void BoidPages::Free(void* Memory, size_t Bytes)
+{
+	if (!Memory)
+	{
+		return;
+	}
+
+	RemoveMapping(Memory);
+
+#ifdef __linux__
+	munmap(Memory, RoundUp(Bytes, static_cast<size_t>(BoidTopology::Get().GetHugePageSize())));
+#else
+	::operator delete(Memory);
+#endif
+}
+
+BoidPageStatistics BoidPages::GetStatistics()
+{
+	std::lock_guard<std::mutex> Lock(s_MappingMutex);
+
+	BoidPageStatistics Statistics = {};
+	for (const PageMapping& Mapping : s_Mappings)
+	{
+		switch (Mapping.Kind)
+		{
+		case PageKind::HugeTLB:
+			Statistics.HugeTLBBytes += Mapping.Bytes;
+			break;
+		case PageKind::TransparentHuge:
+			Statistics.TransparentHugeBytes += Mapping.Bytes;
+			break;
+		default:
+			Statistics.RegularBytes += Mapping.Bytes;
+			break;
+		}
+	}
+
+	return Statistics;
+}
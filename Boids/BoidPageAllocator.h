@@ -0,0 +1,96 @@
+#pragma once
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Bytes currently held by large arrays, by the kind of pages backing them
+struct BoidPageStatistics
+{
+	uint64_t HugeTLBBytes;
+	uint64_t TransparentHugeBytes;
+	uint64_t RegularBytes;
+};
+
+// Page level allocation for arrays large enough that TLB reach matters
+// On Linux explicit huge pages are tried first when any are reserved, then huge page aligned mappings advised to use transparent huge pages
+// Pages are not touched here, so each lands on the memory node of the thread that first writes it
+class BoidPages
+{
+public:
+	// Arrays below this go through operator new as usual
+	static const size_t LargeArrayBytes = 2 * 1024 * 1024;
+
+	static void* Allocate(size_t Bytes);
+	static void Free(void* Memory, size_t Bytes);
+
+	static BoidPageStatistics GetStatistics();
+};
+
+// Allocator for per-boid arrays, large ones come from BoidPages
+// Resizing leaves new elements uninitialized instead of zeroing them, so only use it for arrays fully written after resizing,
+// the parallel loops writing them then decide which memory node each page lands on
+template<typename T>
+class BoidPageAllocator
+{
+public:
+	using value_type = T;
+
+	BoidPageAllocator() = default;
+
+	template<typename U>
+	BoidPageAllocator(const BoidPageAllocator<U>&)
+	{
+	}
+
+	T* allocate(size_t Count)
+	{
+		size_t Bytes = Count * sizeof(T);
+		if (Bytes >= BoidPages::LargeArrayBytes)
+		{
+			return static_cast<T*>(BoidPages::Allocate(Bytes));
+		}
+		return static_cast<T*>(::operator new(Bytes));
+	}
+
+	void deallocate(T* Memory, size_t Count)
+	{
+		size_t Bytes = Count * sizeof(T);
+		if (Bytes >= BoidPages::LargeArrayBytes)
+		{
+			BoidPages::Free(Memory, Bytes);
+			return;
+		}
+		::operator delete(Memory);
+	}
+
+	// Default initialization, trivial types are left as they are
+	template<typename U>
+	void construct(U* Element)
+	{
+		::new (static_cast<void*>(Element)) U;
+	}
+
+	template<typename U, typename... Arguments>
+	void construct(U* Element, Arguments&&... Values)
+	{
+		::new (static_cast<void*>(Element)) U(std::forward<Arguments>(Values)...);
+	}
+
+	template<typename U>
+	bool operator==(const BoidPageAllocator<U>&) const
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const BoidPageAllocator<U>&) const
+	{
+		return false;
+	}
+};
+
+// Vector of per-boid data sized by boid count
+template<typename T>
+using BoidLargeVector = std::vector<T, BoidPageAllocator<T>>;
@@ -1,22 +1,70 @@
 #include "BoidPhysicsSystem.h"
 
-#include "CommandList.h"
 #include <math.h>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
 #include "BoidObject.h"
+#include "BoidObstacleField.h"
+#include "BoidThreadPool.h"
+#include "BoidCommandQueue.h"
+#include "BoidStepProfiler.h"
+#include "BoidFlockAnalytics.h"
+#include "BoidAllocationTracker.h"
 
 using namespace DirectX;
 
+const char* GetRulePrecisionName(RulePrecision Precision)
+{
+	switch (Precision)
+	{
+	case RulePrecision::Fast:
+		return "Fast";
+	case RulePrecision::Approximate:
+		return "Approximate";
+	default:
+		return "Exact";
+	}
+}
+
+const char* GetStepSchedulingName(StepScheduling Scheduling)
+{
+	switch (Scheduling)
+	{
+	case StepScheduling::Stages:
+		return "Stages";
+	default:
+		return "TaskGraph";
+	}
+}
+
+const char* GetNeighbourSearchModeName(NeighbourSearchMode Mode)
+{
+	switch (Mode)
+	{
+	case NeighbourSearchMode::BarnesHut:
+		return "Barnes-Hut";
+	case NeighbourSearchMode::Topological:
+		return "Topological";
+	default:
+		return "Spatial Grid";
+	}
+}
+
 BoidPhysicsSystem::BoidPhysicsSystem()
 {
+	UpdateSpeciesPairConstants();
 }
 
 BoidPhysicsSystem::BoidPhysicsSystem(BoidObject* BoidToRegister, bool RandomlyInitializeDirection)
 {
+	UpdateSpeciesPairConstants();
 	RegisterBoids(BoidToRegister, RandomlyInitializeDirection);
 }
 
 BoidPhysicsSystem::BoidPhysicsSystem(std::vector<BoidObject*> BoidsToRegister, bool RandomlyInitializeDirection)
 {
+	UpdateSpeciesPairConstants();
 	RegisterBoids(BoidsToRegister, RandomlyInitializeDirection);
 }
 
@@ -39,6 +87,8 @@ void BoidPhysicsSystem::RegisterBoids(BoidObject* BoidToRegister, bool RandomlyI
 		}
 
 		m_RegisteredBoids.push_back(BoidToRegister);
+		AddBoidSlot(false);
+		m_SpatialGridDirty = true;
 	}
 }
 
@@ -59,7 +109,10 @@ void BoidPhysicsSystem::RegisterBoids(std::vector<BoidObject*> BoidsToRegister,
 			}
 
 			m_RegisteredBoids.push_back(BoidsToRegister[i]);
+			AddBoidSlot(false);
 		}
+
+		m_SpatialGridDirty = true;
 	}
 }
 
@@ -67,331 +120,2187 @@ void BoidPhysicsSystem::DeleteAllBoids()
 {
 	for (int i = 0; i < m_RegisteredBoids.size(); i++)
 	{
-		delete m_RegisteredBoids[i];
+		// Pooled boids are freed with their slabs below
+		if (!m_BoidSlots[m_RegisteredSlots[i]].IsPooled)
+		{
+			delete m_RegisteredBoids[i];
+		}
 		m_RegisteredBoids[i] = nullptr;
 	}
 
 	m_RegisteredBoids.clear();
 	m_RegisteredBoids.shrink_to_fit();
-}
+	m_RegisteredSlots.clear();
+	m_RegisteredSlots.shrink_to_fit();
 
-void BoidPhysicsSystem::UpdateBoidPhysics(float DeltaTime)
-{
-	std::vector<XMFLOAT3> NewBoidPos;
-	std::vector<XMFLOAT3> NewBoidDir;
+	m_BoidSlabs.clear();
+	m_FreeBoidObjects.clear();
 
-	if (m_RegisteredBoids.size() > 0)
+	// Slots stay so handles issued before keep being rejected, every one is free with a new generation
+	m_FreeBoidSlot = UINT32_MAX;
+	for (uint32_t i = static_cast<uint32_t>(m_BoidSlots.size()); i > 0; i--)
 	{
-		int NumberOfRegisteredBoids = m_RegisteredBoids.size();
-		for (int i = 0; i < NumberOfRegisteredBoids; i++)
-		{
-			// Cache current boid in first loop
-			BoidObject* CurrentBoid = m_RegisteredBoids[i];
-			if (CurrentBoid)
-			{
-				int SeparationVectors = 0;
-				int AlignmentVectors = 0;
-				int CohesionVectors = 0;
-
-				XMVECTOR SeparationVectorResult{ 0, 0, 0 };
-				XMVECTOR AlignmentVectorResult{ 0, 0, 0 };
-				XMVECTOR CohesionVectorResult{ 0, 0, 0 };
+		BoidSlot& Slot = m_BoidSlots[i - 1];
+		Slot.Generation++;
+		Slot.DenseIndex = m_FreeBoidSlot;
+		m_FreeBoidSlot = i - 1;
+	}
 
-				for (int j = 0; j < NumberOfRegisteredBoids; j++)
-				{
-					// Cache other boid in second loop
-					BoidObject* OtherBoid = m_RegisteredBoids[j];
+	m_SpatialGrid.Clear();
+	m_UnsortedBoids.clear();
+	m_SortedBoids.clear();
+	m_UnsortedSpecies.clear();
+	m_SortedSpecies.clear();
+	m_SpatialGridDirty = true;
+}
 
-					// Is new boid entity same as current one?
-					if (i == j)
-					{
-						continue;
-					}
+BoidHandle BoidPhysicsSystem::SpawnBoid(XMFLOAT3 Position, XMFLOAT3 Direction, uint32_t Species)
+{
+	BoidObject* Boid = AllocateBoidObject();
+	Boid->m_Position = Position;
+	Boid->m_Direction = Direction;
+	Boid->m_Species = Species;
 
-					// Also ignore if in same position, intial position will be same for all boids
-					if (CheckSamePosition(CurrentBoid->m_Position, OtherBoid->m_Position))
-					{
-						continue;
-					}
+	m_RegisteredBoids.push_back(Boid);
+	AddBoidSlot(true);
+	m_SpatialGridDirty = true;
 
-					if (OtherBoid)
-					{
-						// Calculate Distance between current boid and other boid
-						float DistanceBetweenTwoBoids = CalculateDistance(CurrentBoid->m_Position, OtherBoid->m_Position);
-						if (DistanceBetweenTwoBoids < m_ModelProperties.MaximumSeparationDistance)
-						{
-							// Calculate rule specific target vector 
-							SeparationVectorResult += CalculateSeparationRule(CurrentBoid, OtherBoid, DistanceBetweenTwoBoids);
-							SeparationVectors++;
-						}
-						if (DistanceBetweenTwoBoids < m_ModelProperties.MaximumAlignmentDistance)
-						{
-							// Calculate rule specific target vector
-							AlignmentVectorResult += CalculateAlignmentRule(CurrentBoid, OtherBoid, DistanceBetweenTwoBoids);
-							AlignmentVectors++;
-						}
-						if (DistanceBetweenTwoBoids < m_ModelProperties.MaximumCohesionDistance)
-						{
-							// Calculate rule specific target vector
-							CohesionVectorResult += CalculateCohesionRule(CurrentBoid, OtherBoid, DistanceBetweenTwoBoids);
-							CohesionVectors++;
-						}
-					}
-				}
+	uint32_t SlotIndex = m_RegisteredSlots.back();
+	return { SlotIndex, m_BoidSlots[SlotIndex].Generation };
+}
 
-				// Divide final rule vectors by number of vectors added per rule
-				if (SeparationVectors > 0)
-				{
-					SeparationVectorResult /= SeparationVectors;
-				}
-				if (AlignmentVectors > 0)
-				{
-					AlignmentVectorResult /= AlignmentVectors;
-				}
-				if (CohesionVectors > 0)
-				{
-					CohesionVectorResult /= CohesionVectors;
-				}
+void BoidPhysicsSystem::SpawnBoids(const BoidObject* Boids, uint32_t Count, BoidHandle* OutHandles)
+{
+	// With room for every boid and slot, only taking a boid object can throw, and that happens before a boid is registered
+	m_RegisteredBoids.reserve(m_RegisteredBoids.size() + Count);
+	m_RegisteredSlots.reserve(m_RegisteredSlots.size() + Count);
+	m_BoidSlots.reserve(m_BoidSlots.size() + Count);
 
-				// Modify final vectors by delta time and rule-specific weight value 
-				XMVECTOR NewDirectionVector = { CurrentBoid->m_Direction.x, CurrentBoid->m_Direction.y, CurrentBoid->m_Direction.z };
-				NewDirectionVector += SeparationVectorResult * m_ModelProperties.SeparationDistanceWeight * DeltaTime;
-				NewDirectionVector += AlignmentVectorResult * m_ModelProperties.AlignmentDistanceWeight * DeltaTime;
-				NewDirectionVector += CohesionVectorResult * m_ModelProperties.CohesionDistanceWeight * DeltaTime;
-				NewDirectionVector = XMVector3Normalize(NewDirectionVector);
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		BoidHandle Handle = SpawnBoid(Boids[i].m_Position, Boids[i].m_Direction, Boids[i].m_Species);
+		if (OutHandles)
+		{
+			OutHandles[i] = Handle;
+		}
+	}
+}
 
-				XMFLOAT3 NewDirection= { XMVectorGetX(NewDirectionVector), XMVectorGetY(NewDirectionVector), XMVectorGetZ(NewDirectionVector) };
+bool BoidPhysicsSystem::DespawnBoid(BoidHandle Handle)
+{
+	if (!FindBoidSlot(Handle))
+	{
+		return false;
+	}
 
-				XMFLOAT3 NewPosition = CalculateNextPosition(CurrentBoid, DeltaTime);
-				ForceAlignWithinBounds(NewDirection, NewPosition);
+	BoidSlot& Slot = m_BoidSlots[Handle.Index];
+	uint32_t DenseIndex = Slot.DenseIndex;
 
-				NewBoidDir.push_back(NewDirection);
-				NewBoidPos.push_back(NewPosition);
-			}
-		}
+	if (Slot.IsPooled)
+	{
+		m_FreeBoidObjects.push_back(m_RegisteredBoids[DenseIndex]);
+	}
+	else
+	{
+		delete m_RegisteredBoids[DenseIndex];
 	}
 
-	// Apply Final Vectors to Current boid entity 
-	for (int i = 0; i < m_RegisteredBoids.size(); i++)
+	// Swap remove, last boid takes the freed place and its slot follows it
+	uint32_t LastIndex = static_cast<uint32_t>(m_RegisteredBoids.size()) - 1;
+	m_RegisteredBoids[DenseIndex] = m_RegisteredBoids[LastIndex];
+	m_RegisteredSlots[DenseIndex] = m_RegisteredSlots[LastIndex];
+	m_BoidSlots[m_RegisteredSlots[DenseIndex]].DenseIndex = DenseIndex;
+	m_RegisteredBoids.pop_back();
+	m_RegisteredSlots.pop_back();
+
+	Slot.Generation++;
+	Slot.DenseIndex = m_FreeBoidSlot;
+	m_FreeBoidSlot = Handle.Index;
+
+	m_SpatialGridDirty = true;
+	return true;
+}
+
+uint32_t BoidPhysicsSystem::DespawnBoids(const BoidHandle* Handles, uint32_t Count)
+{
+	uint32_t DespawnedCount = 0;
+	for (uint32_t i = 0; i < Count; i++)
 	{
-		m_RegisteredBoids[i]->m_Direction = NewBoidDir[i];
-		m_RegisteredBoids[i]->m_Position = NewBoidPos[i];
+		DespawnedCount += DespawnBoid(Handles[i]) ? 1 : 0;
 	}
+
+	return DespawnedCount;
 }
 
-std::vector<BoidProperties> BoidPhysicsSystem::GetBoidProperties()
+bool BoidPhysicsSystem::IsBoidAlive(BoidHandle Handle) const
 {
-	// Convert all boids data into BoidProperties struct, from BoidObjects and return the conversion
-	std::vector<BoidProperties> PropertiesVector;
+	return FindBoidSlot(Handle) != nullptr;
+}
 
-	int NumberOfRegisteredBoids = m_RegisteredBoids.size();
-	for (int i = 0; i < NumberOfRegisteredBoids; i++)
-	{
-		BoidProperties Properties{XMFLOAT4(m_RegisteredBoids[i]->m_Position.x, m_RegisteredBoids[i]->m_Position.y, m_RegisteredBoids[i]->m_Position.z, 0.0f),
-								  XMFLOAT4(m_RegisteredBoids[i]->m_Direction.x, m_RegisteredBoids[i]->m_Direction.y, m_RegisteredBoids[i]->m_Direction.z, 0.0f) };
+BoidObject* BoidPhysicsSystem::GetBoid(BoidHandle Handle) const
+{
+	const BoidSlot* Slot = FindBoidSlot(Handle);
+	return Slot ? m_RegisteredBoids[Slot->DenseIndex] : nullptr;
+}
 
-		PropertiesVector.push_back(Properties);
+BoidHandle BoidPhysicsSystem::GetBoidHandle(uint32_t RegisteredIndex) const
+{
+	if (RegisteredIndex >= m_RegisteredSlots.size())
+	{
+		return BoidHandle();
 	}
 
-	return PropertiesVector;
+	uint32_t SlotIndex = m_RegisteredSlots[RegisteredIndex];
+	return { SlotIndex, m_BoidSlots[SlotIndex].Generation };
 }
 
-DirectX::XMFLOAT4 BoidPhysicsSystem::GetBoundingBoxProperties()
+uint32_t BoidPhysicsSystem::GetRegisteredBoidCount() const
 {
-	return DirectX::XMFLOAT4(m_Bounds.BoundingBoxHalfSize.x, m_Bounds.BoundingBoxHalfSize.y, m_Bounds.BoundingBoxHalfSize.z, 0);
+	return static_cast<uint32_t>(m_RegisteredBoids.size());
 }
 
-ModelProperties BoidPhysicsSystem::GetModelProperties()
+void BoidPhysicsSystem::SetCommandQueue(BoidCommandQueue* CommandQueue)
 {
-	// Lazy initialization for Boid Count 
-	// Don't know if more entities might be registered in future, so only set when updating Compute Shader model properties
-	SetBoidCount(m_RegisteredBoids.size());
+	m_CommandQueue = CommandQueue;
+}
 
-	return m_ModelProperties;
+void BoidPhysicsSystem::SetStepProfiler(BoidStepProfiler* StepProfiler)
+{
+	m_StepProfiler = StepProfiler;
 }
 
-void BoidPhysicsSystem::SetBoundingBoxHalfSize(DirectX::XMFLOAT3 BoxHalfSize)
+void BoidPhysicsSystem::SetFlockAnalytics(BoidFlockAnalytics* FlockAnalytics)
 {
-	m_Bounds.BoundingBoxHalfSize = BoxHalfSize;
+	m_FlockAnalytics = FlockAnalytics;
 }
 
-void BoidPhysicsSystem::SetModelProperties(ModelProperties NewProperties)
+void BoidPhysicsSystem::SetStepScheduling(StepScheduling Scheduling)
+{
+	m_StepScheduling = Scheduling;
+}
+
+StepScheduling BoidPhysicsSystem::GetStepScheduling() const
 {
-	int BoidCount = m_ModelProperties.BoidCount;
+	return m_StepScheduling;
+}
 
-	m_ModelProperties = NewProperties;
+void BoidPhysicsSystem::SetStepOutput(BoidProperties* Output, uint32_t Capacity)
+{
+	m_StepOutput = Output;
+	m_StepOutputCapacity = Output ? Capacity : 0;
+}
 
-	// Keep original boid count: Don't need to change this
-	m_ModelProperties.BoidCount = BoidCount;
+uint32_t BoidPhysicsSystem::GetStepOutputCount() const
+{
+	return m_StepOutputCount;
 }
 
-void BoidPhysicsSystem::SetBoidCount(int BoidAmount)
+bool BoidPhysicsSystem::WriteStepTrace(const char* Path) const
 {
-	m_ModelProperties.BoidCount = BoidAmount;
+	return m_StepGraphRan && m_StepGraph.WriteTrace(Path);
 }
 
-void BoidPhysicsSystem::ForceAlignWithinBounds(DirectX::XMFLOAT3& BoidDir, DirectX::XMFLOAT3& BoidPos)
+void BoidPhysicsSystem::ApplyQueuedCommands()
 {
-	if (BoidPos.x > m_Bounds.BoundingBoxHalfSize.x)
+	if (!m_CommandQueue)
 	{
-		BoidDir.x *= -1;
-		BoidPos.x = m_Bounds.BoundingBoxHalfSize.x - 0.1f;
+		return;
 	}
-	else if (BoidPos.x < -m_Bounds.BoundingBoxHalfSize.x)
+
+	m_QueuedCommands.clear();
+	if (m_CommandQueue->Drain(m_QueuedCommands) == 0)
 	{
-		BoidDir.x *= -1;
-		BoidPos.x = -m_Bounds.BoundingBoxHalfSize.x + 0.1f;
+		return;
 	}
 
-	if (BoidPos.y > m_Bounds.BoundingBoxHalfSize.y)
+	// Only the last properties queued for a species matter, so each species is updated at most once
+	uint32_t SpeciesCount = GetSpeciesCount();
+	if (m_QueuedProperties.size() < SpeciesCount)
 	{
-		BoidDir.y *= -1;
-		BoidPos.y = m_Bounds.BoundingBoxHalfSize.y - 0.1f;
+		m_QueuedProperties.resize(SpeciesCount, nullptr);
 	}
-	else if (BoidPos.y < -m_Bounds.BoundingBoxHalfSize.y)
+
+	m_QueuedSpawns.clear();
+	m_QueuedDespawns.clear();
+	m_QueuedImpulses.clear();
+
+	// Sort commands into one batch per type, so each type is then applied in a single pass
+	for (const BoidCommand& Command : m_QueuedCommands)
 	{
-		BoidDir.y *= -1;
-		BoidPos.y = -m_Bounds.BoundingBoxHalfSize.y + 0.1f;
+		switch (Command.Type)
+		{
+		case BoidCommandType::Spawn:
+			m_QueuedSpawns.push_back(BoidObject(Command.Position, Command.Vector, Command.Species));
+			XMStoreFloat3(&m_QueuedSpawns.back().m_Direction, XMVector3Normalize(XMLoadFloat3(&Command.Vector)));
+			break;
+		case BoidCommandType::Despawn:
+			m_QueuedDespawns.push_back(Command.Handle);
+			break;
+		case BoidCommandType::Impulse:
+			m_QueuedImpulses.push_back(&Command);
+			break;
+		case BoidCommandType::SetSpeciesProperties:
+			if (Command.Species < SpeciesCount)
+			{
+				m_QueuedProperties[Command.Species] = &Command.Properties;
+			}
+			break;
+		default:
+			break;
+		}
 	}
 
-	if (BoidPos.z > m_Bounds.BoundingBoxHalfSize.z)
+	// Same as SetSpeciesProperties per species, but pair constants are rebuilt once for the whole batch
+	bool PropertiesChanged = false;
+	for (uint32_t Species = 0; Species < SpeciesCount; Species++)
 	{
-		BoidDir.z *= -1;
-		BoidPos.z = m_Bounds.BoundingBoxHalfSize.z - 0.1f;
+		if (m_QueuedProperties[Species])
+		{
+			int BoidCount = m_SpeciesProperties[Species].BoidCount;
+			m_SpeciesProperties[Species] = *m_QueuedProperties[Species];
+			m_SpeciesProperties[Species].BoidCount = BoidCount;
+
+			m_QueuedProperties[Species] = nullptr;
+			PropertiesChanged = true;
+		}
 	}
-	else if (BoidPos.z < -m_Bounds.BoundingBoxHalfSize.z)
+
+	if (PropertiesChanged)
 	{
-		BoidDir.z *= -1;
-		BoidPos.z = -m_Bounds.BoundingBoxHalfSize.z + 0.1f;
+		UpdateSpeciesPairConstants();
+		m_SpatialGridDirty = true;
+	}
+
+	// Impulses go before despawns so every handle still points where it did when it was queued
+	for (const BoidCommand* Command : m_QueuedImpulses)
+	{
+		BoidObject* Boid = GetBoid(Command->Handle);
+		if (!Boid)
+		{
+			continue;
+		}
+
+		XMVECTOR Direction = XMVector3Normalize(XMLoadFloat3(&Boid->m_Direction) + XMLoadFloat3(&Command->Vector));
+		XMStoreFloat3(&Boid->m_Direction, Direction);
+		m_SpatialGridDirty = true;
 	}
+
+	DespawnBoids(m_QueuedDespawns.data(), static_cast<uint32_t>(m_QueuedDespawns.size()));
+	SpawnBoids(m_QueuedSpawns.data(), static_cast<uint32_t>(m_QueuedSpawns.size()));
 }
 
-float BoidPhysicsSystem::CalculateDistance(XMFLOAT3 ThisBoidPos, XMFLOAT3 OtherBoidPos)
+void BoidPhysicsSystem::AddBoidSlot(bool IsPooled)
 {
-	// sqrt[(x2 - x1)^2 + (y2 - y1)^2 + (z2 - z1)^2] for distance
+	uint32_t DenseIndex = static_cast<uint32_t>(m_RegisteredBoids.size()) - 1;
 
-	float XCoordsSquared = (OtherBoidPos.x - ThisBoidPos.x) * (OtherBoidPos.x - ThisBoidPos.x);
-	float YCoordsSquared = (OtherBoidPos.y - ThisBoidPos.y) * (OtherBoidPos.y - ThisBoidPos.y);
-	float ZCoordsSquared = (OtherBoidPos.z - ThisBoidPos.z) * (OtherBoidPos.z - ThisBoidPos.z);
-	float SumOfCoordsSquared = XCoordsSquared + YCoordsSquared + ZCoordsSquared;
+	uint32_t SlotIndex = m_FreeBoidSlot;
+	if (SlotIndex != UINT32_MAX)
+	{
+		m_FreeBoidSlot = m_BoidSlots[SlotIndex].DenseIndex;
+	}
+	else
+	{
+		SlotIndex = static_cast<uint32_t>(m_BoidSlots.size());
+		m_BoidSlots.push_back({ 0, 0, false });
+	}
 
-	return sqrt(SumOfCoordsSquared);
+	m_BoidSlots[SlotIndex].DenseIndex = DenseIndex;
+	m_BoidSlots[SlotIndex].IsPooled = IsPooled;
+	m_RegisteredSlots.push_back(SlotIndex);
 }
 
-bool BoidPhysicsSystem::CheckSamePosition(XMFLOAT3 ThisBoidPos, XMFLOAT3 OtherBoidPos)
+const BoidPhysicsSystem::BoidSlot* BoidPhysicsSystem::FindBoidSlot(BoidHandle Handle) const
 {
-	if (ThisBoidPos.x == OtherBoidPos.x && ThisBoidPos.y == OtherBoidPos.y && ThisBoidPos.z == OtherBoidPos.z)
+	if (Handle.Index >= m_BoidSlots.size())
 	{
-		return true;
+		return nullptr;
 	}
-	return false;
+
+	// Free slots always carry a newer generation than any handle issued for them
+	const BoidSlot& Slot = m_BoidSlots[Handle.Index];
+	if (Slot.Generation != Handle.Generation || Slot.DenseIndex >= m_RegisteredSlots.size() || m_RegisteredSlots[Slot.DenseIndex] != Handle.Index)
+	{
+		return nullptr;
+	}
+
+	return &Slot;
 }
 
-XMVECTOR BoidPhysicsSystem::CalculateSeparationRule(BoidObject* ThisBoid, BoidObject* OtherBoid, float Distance)
+BoidObject* BoidPhysicsSystem::AllocateBoidObject()
 {
-	XMVECTOR FinalSeparationVector{ 0, 0, 0 };
+	if (m_FreeBoidObjects.empty())
+	{
+		// Free list has room for every pooled boid before the slab exists, so returning boids to it never allocates
+		m_FreeBoidObjects.reserve((m_BoidSlabs.size() + 1) * BoidSlabSize);
+		m_BoidSlabs.reserve(m_BoidSlabs.size() + 1);
+		m_BoidSlabs.emplace_back(new BoidObject[BoidSlabSize]);
 
-	XMVECTOR ThisBoidPos = { ThisBoid->m_Position.x, ThisBoid->m_Position.y, ThisBoid->m_Position.z };
-	XMVECTOR OtherBoidPos = { OtherBoid->m_Position.x, OtherBoid->m_Position.y, OtherBoid->m_Position.z };
+		BoidObject* Slab = m_BoidSlabs.back().get();
+		for (uint32_t i = BoidSlabSize; i > 0; i--)
+		{
+			m_FreeBoidObjects.push_back(&Slab[i - 1]);
+		}
+	}
 
-	// Calculate target vector - Separation target vector is opposite direction to Other boid from This boid
-	XMVECTOR DirectionVector = ThisBoidPos - OtherBoidPos;
-	DirectionVector = XMVector3Normalize(DirectionVector);
+	BoidObject* Boid = m_FreeBoidObjects.back();
+	m_FreeBoidObjects.pop_back();
+	return Boid;
+}
 
-	float DistanceWeight = 1;
+void BoidPhysicsSystem::SetSubStepSettings(const BoidSubStepSettings& Settings)
+{
+	m_SubStepSettings = Settings;
+	m_SubStepSettings.MaximumSubSteps = std::max(Settings.MaximumSubSteps, 1u);
+}
 
-	Distance -= m_ModelProperties.MinimumSeparationDistance;
-	if (Distance > 0)
+const BoidSubStepSettings& BoidPhysicsSystem::GetSubStepSettings() const
+{
+	return m_SubStepSettings;
+}
+
+void BoidPhysicsSystem::AdvanceBoidPhysics(float FrameTime)
+{
+	uint32_t SubSteps = 1;
+	if (m_SubStepSettings.Enabled && FrameTime > 0)
 	{
-		float DistanceWeightDivisibleFactor = m_ModelProperties.MaximumSeparationDistance - m_ModelProperties.MinimumSeparationDistance;
-		DistanceWeight -= (Distance / DistanceWeightDivisibleFactor);
+		// Turn per step grows with step length, travel per step too, so each limit gives the sub-steps this frame needs
+		float FastestSpeed = 0;
+		for (const ModelProperties& Properties : m_SpeciesProperties)
+		{
+			FastestSpeed = std::max(FastestSpeed, Properties.BoidSpeed);
+		}
+
+		float TurnSubSteps = m_SubStepReport.MaximumTurnRate * FrameTime / std::max(m_SubStepSettings.MaximumTurnPerSubStep, 0.001f);
+		float Spacing = m_SubStepReport.PeakDensity > 0 ? 1.0f / cbrtf(m_SubStepReport.PeakDensity) : FLT_MAX;
+		float TravelSubSteps = FastestSpeed * FrameTime / std::max(m_SubStepSettings.MaximumTravelPerSpacing * Spacing, 0.001f);
+
+		float RequiredSubSteps = std::min(ceilf(std::max(TurnSubSteps, TravelSubSteps)), static_cast<float>(m_SubStepSettings.MaximumSubSteps));
+		uint32_t Required = static_cast<uint32_t>(std::max(RequiredSubSteps, 1.0f));
+
+		// Falls at most one sub-step of last frame's length per frame, so a hitch is not followed by frames of needlessly short sub-steps
+		uint32_t Kept = 1;
+		if (m_SubStepReport.SubStepTime > 0)
+		{
+			Kept = std::min(static_cast<uint32_t>(std::max(ceilf(FrameTime / m_SubStepReport.SubStepTime - 0.001f), 1.0f)), m_SubStepReport.SubSteps);
+		}
+
+		SubSteps = std::max(Required, Kept > 1 ? Kept - 1 : 1);
 	}
 
-	// Modify final vector by rule-specific distance value
-	if (DistanceWeight > 0.01f)
+	float SubStepTime = FrameTime / SubSteps;
+	for (uint32_t SubStep = 0; SubStep < SubSteps; SubStep++)
 	{
-		FinalSeparationVector = DirectionVector * DistanceWeight;
+		UpdateBoidPhysics(SubStepTime);
 	}
 
-	// Return target vector
-	return FinalSeparationVector;
+	// Nothing is measured without boids, turns and grid would still be those of the last flock
+	bool HasBoids = !m_RegisteredBoids.empty();
+	m_SubStepReport.SubSteps = SubSteps;
+	m_SubStepReport.SubStepTime = SubStepTime;
+	m_SubStepReport.MaximumTurnRate = HasBoids && SubStepTime > 0 ? MeasureMaximumTurn() / SubStepTime : 0;
+	m_SubStepReport.PeakDensity = HasBoids ? MeasurePeakDensity() : 0;
 }
 
-XMVECTOR BoidPhysicsSystem::CalculateCohesionRule(BoidObject* ThisBoid, BoidObject* OtherBoid, float Distance)
+const BoidSubStepReport& BoidPhysicsSystem::GetSubStepReport() const
 {
-	XMVECTOR FinalCohesionVector{ 0, 0, 0 };
+	return m_SubStepReport;
+}
 
-	XMVECTOR ThisBoidPos = { ThisBoid->m_Position.x, ThisBoid->m_Position.y, ThisBoid->m_Position.z };
-	XMVECTOR OtherBoidPos = { OtherBoid->m_Position.x, OtherBoid->m_Position.y, OtherBoid->m_Position.z };
+float BoidPhysicsSystem::MeasureMaximumTurn() const
+{
+	// Turns stay valid until the next step, even though the grid was rebuilt since
+	float SmallestCosine = 1;
+	for (float Cosine : m_NewBoidTurn)
+	{
+		SmallestCosine = std::min(SmallestCosine, Cosine);
+	}
 
-	// Calculate target vector - Cohesion target vector is direction to Other boid from This boid
-	XMVECTOR DirectionVector = OtherBoidPos - ThisBoidPos;
-	DirectionVector = XMVector3Normalize(DirectionVector);
+	return acosf(std::max(SmallestCosine, -1.0f));
+}
 
-	float DistanceWeight = 1;
+float BoidPhysicsSystem::MeasurePeakDensity() const
+{
+	uint32_t LargestCount = 0;
+	for (const SpatialGridCell& Cell : m_SpatialGrid.GetOccupiedCells())
+	{
+		LargestCount = std::max(LargestCount, Cell.Count);
+	}
 
-	Distance -= m_ModelProperties.MinimumCohesionDistance;
-	if (Distance > 0)
+	float CellSize = m_SpatialGrid.GetCellSize();
+	return LargestCount / (CellSize * CellSize * CellSize);
+}
+
+void BoidPhysicsSystem::UpdateBoidPhysics(float DeltaTime)
+{
+	static const uint32_t PhysicsZone = BoidAllocationTracker::RegisterZone("Physics");
+	BoidAllocationScope AllocationScope(PhysicsZone);
+
+	BoidStepProfiler* Profiler = m_StepProfiler;
+
+	// Step boundary, other threads' mutations land here and never in the middle of a step
+	if (Profiler)
+	{
+		Profiler->BeginStage(BoidProfileStage::Commands);
+	}
+	ApplyQueuedCommands();
+	if (Profiler)
 	{
-		float DistanceWeightDivisibleFactor = m_ModelProperties.MaximumCohesionDistance - m_ModelProperties.MinimumCohesionDistance;
-		DistanceWeight -= (Distance / DistanceWeightDivisibleFactor);
+		Profiler->EndStage(BoidProfileStage::Commands);
 	}
 
-	// Modify final vector by rule-specific distance value
-	if (DistanceWeight > 0.01f)
+	m_StepGraphRan = false;
+	m_StepOutputCount = 0;
+
+	uint32_t NumberOfRegisteredBoids = static_cast<uint32_t>(m_RegisteredBoids.size());
+	if (NumberOfRegisteredBoids == 0)
 	{
-		FinalCohesionVector = DirectionVector * DistanceWeight;
+		return;
 	}
 
-	// Return target vector
-	return FinalCohesionVector;
-}
+	// Grid is normally left over from end of previous step, only rebuilt here after registration or property changes
+	UpdateSpatialGrid();
 
-XMVECTOR BoidPhysicsSystem::CalculateAlignmentRule(BoidObject* ThisBoid, BoidObject* OtherBoid, float Distance)
-{
-	XMVECTOR FinalAlignmentVector{ 0, 0, 0 };
+	m_NewBoidPos.resize(NumberOfRegisteredBoids);
+	m_NewBoidDir.resize(NumberOfRegisteredBoids);
+	m_NewBoidTurn.resize(NumberOfRegisteredBoids);
 
-	XMVECTOR ThisBoidPos = { ThisBoid->m_Position.x, ThisBoid->m_Position.y, ThisBoid->m_Position.z };
-	XMVECTOR OtherBoidPos = { OtherBoid->m_Position.x, OtherBoid->m_Position.y, OtherBoid->m_Position.z };
+	if (m_StepScheduling == StepScheduling::TaskGraph && !Profiler)
+	{
+		RunStepTaskGraph(DeltaTime);
 
-	// Calculate target vector - Alignment target vector is Other boid's direction vector
-	XMVECTOR DirectionVector = { OtherBoid->m_Direction.x, OtherBoid->m_Direction.y, OtherBoid->m_Direction.z };
-	DirectionVector = XMVector3Normalize(DirectionVector);
+		if (m_FlockAnalytics)
+		{
+			m_FlockAnalytics->Analyze(m_SpatialGrid, m_SortedBoids, m_SortedSpecies, m_SpeciesProperties);
+		}
+		return;
+	}
 
-	float DistanceWeight = 1;
+	// Pairs are counted before the stage begins so counting them stays out of its counters
+	uint64_t CandidatePairs = 0;
+	if (Profiler)
+	{
+		CandidatePairs = CountCandidatePairs();
+		Profiler->BeginStage(BoidProfileStage::Rules);
+	}
 
-	Distance -= m_ModelProperties.MinimumAlignmentDistnace;
-	if (Distance > 0)
+	// Every boid reads only last step's sorted snapshot and writes its own slot, so boids can be split across threads
+	const SortedBoidUpdate Update = GetSortedBoidUpdate();
+	BoidThreadPool::Get().ParallelFor(NumberOfRegisteredBoids, 256, [this, Update, Profiler, DeltaTime](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		if (Profiler)
+		{
+			Profiler->AttachThread();
+		}
+
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			(this->*Update)(i, DeltaTime);
+		}
+	});
+
+	if (Profiler)
 	{
-		float DistanceWeightDivisibleFactor = m_ModelProperties.MaximumAlignmentDistance - m_ModelProperties.MinimumAlignmentDistnace;
-		DistanceWeight -= (Distance / DistanceWeightDivisibleFactor);
+		Profiler->EndStage(BoidProfileStage::Rules, CandidatePairs);
+		Profiler->BeginStage(BoidProfileStage::Apply);
 	}
 
-	// Modify final vector by rule-specific distance value
-	if (DistanceWeight > 0.01f)
+	// Apply Final Vectors to Current boid entity, sorted slot maps back to registered boid through grid
+	const BoidLargeVector<uint32_t>& SortedIndices = m_SpatialGrid.GetSortedIndices();
+	for (uint32_t i = 0; i < NumberOfRegisteredBoids; i++)
 	{
-		FinalAlignmentVector = DirectionVector * DistanceWeight;
+		BoidObject* Boid = m_RegisteredBoids[SortedIndices[i]];
+		Boid->m_Direction = m_NewBoidDir[i];
+		Boid->m_Position = m_NewBoidPos[i];
 	}
 
-	// Return target vector
-	return FinalAlignmentVector;
-}
+	if (Profiler)
+	{
+		Profiler->EndStage(BoidProfileStage::Apply);
+		Profiler->BeginStage(BoidProfileStage::Grid);
+	}
 
-XMFLOAT3 BoidPhysicsSystem::CalculateRandomDirection(std::mt19937 MTEngine, std::uniform_real_distribution<> RandomDistribution)
-{
-	XMVECTOR RandomBoidDirection = XMVECTOR{ static_cast<float>(RandomDistribution(MTEngine)),
-							 static_cast<float>(RandomDistribution(MTEngine)),
-							 static_cast<float>(RandomDistribution(MTEngine)) };
+	// Rebuild grid from new positions, so renderer and next step both read this frame's layout
+	m_SpatialGridDirty = true;
+	UpdateSpatialGrid();
 
-	RandomBoidDirection = XMVector3Normalize(RandomBoidDirection);
+	if (Profiler)
+	{
+		Profiler->EndStage(BoidProfileStage::Grid);
+	}
 
-	return XMFLOAT3{ XMVectorGetX(RandomBoidDirection), XMVectorGetY(RandomBoidDirection), XMVectorGetZ(RandomBoidDirection) };
+	// Grid snapshot is this step's boids in registration order, which is what step output holds
+	if (m_StepOutput && NumberOfRegisteredBoids <= m_StepOutputCapacity)
+	{
+		PackStepOutput(0, NumberOfRegisteredBoids);
+		m_StepOutputCount = NumberOfRegisteredBoids;
+	}
+
+	// Grid order of the rebuilt grid is the new positions, so metrics describe the flock as this step left it
+	if (m_FlockAnalytics)
+	{
+		m_FlockAnalytics->Analyze(m_SpatialGrid, m_SortedBoids, m_SortedSpecies, m_SpeciesProperties);
+	}
 }
 
-XMFLOAT3 BoidPhysicsSystem::CalculateNextPosition(BoidObject* Boid, float DeltaTime)
+void BoidPhysicsSystem::RunStepTaskGraph(float DeltaTime)
 {
-	XMFLOAT3 BoidNewPos = XMFLOAT3{ Boid->m_Position.x + (Boid->m_Direction.x * DeltaTime * m_ModelProperties.BoidSpeed),
-									Boid->m_Position.y + (Boid->m_Direction.y * DeltaTime * m_ModelProperties.BoidSpeed),
-									Boid->m_Position.z + (Boid->m_Direction.z * DeltaTime * m_ModelProperties.BoidSpeed) };
-	return BoidNewPos;
+	uint32_t NumberOfBoids = static_cast<uint32_t>(m_RegisteredBoids.size());
+	uint32_t SpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+	XMFLOAT3 BoxHalfSize = m_Bounds.BoundingBoxHalfSize;
+	float CellSize = CalculateGridCellSize();
+	bool PackOutput = m_StepOutput && NumberOfBoids <= m_StepOutputCapacity;
+
+	const SortedBoidUpdate Update = GetSortedBoidUpdate();
+	const BoidLargeVector<uint32_t>& SortedIndices = m_SpatialGrid.GetSortedIndices();
+	std::atomic<bool> AnyBoidOutsideBounds{ false };
+
+	// Rules only read last step's sorted snapshot and grid, so a range can be applied while others are still searching
+	auto Rules = [this, Update, DeltaTime](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			(this->*Update)(i, DeltaTime);
+		}
+	};
+
+	// Applying also takes the snapshot the next grid is built from, as UpdateSpatialGrid would
+	auto Apply = [this, &SortedIndices, SpeciesCount](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			uint32_t RegisteredIndex = SortedIndices[i];
+			BoidObject* Boid = m_RegisteredBoids[RegisteredIndex];
+			Boid->m_Direction = m_NewBoidDir[i];
+			Boid->m_Position = m_NewBoidPos[i];
+
+			m_UnsortedBoids[RegisteredIndex] = { XMFLOAT4(Boid->m_Position.x, Boid->m_Position.y, Boid->m_Position.z, 0.0f),
+												 XMFLOAT4(Boid->m_Direction.x, Boid->m_Direction.y, Boid->m_Direction.z, 0.0f) };
+			m_UnsortedSpecies[RegisteredIndex] = std::min(Boid->m_Species, SpeciesCount - 1);
+		}
+	};
+
+	// Grid rebuild in the phases of BoidSpatialGrid::Build, layout changes cell size and origin so it waits for every rules task
+	auto Layout = [this, NumberOfBoids, SpeciesCount, BoxHalfSize, CellSize](uint32_t, uint32_t, uint32_t)
+	{
+		m_SpatialGrid.BeginBuild(NumberOfBoids, SpeciesCount, BoxHalfSize, CellSize);
+	};
+
+	auto Bin = [this, &AnyBoidOutsideBounds](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		if (m_SpatialGrid.BinBoids(m_UnsortedBoids.data(), m_UnsortedSpecies.data(), Begin, End))
+		{
+			AnyBoidOutsideBounds.store(true, std::memory_order_relaxed);
+		}
+	};
+
+	auto Sort = [this, &AnyBoidOutsideBounds](uint32_t, uint32_t, uint32_t)
+	{
+		m_SpatialGrid.FinishBuild(AnyBoidOutsideBounds.load(std::memory_order_relaxed));
+	};
+
+	auto Gather = [this, &SortedIndices](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		m_SpatialGrid.Gather(m_UnsortedBoids.data(), m_SortedBoids.data(), Begin, End);
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			m_SortedSpecies[i] = m_UnsortedSpecies[SortedIndices[i]];
+		}
+	};
+
+	auto Octree = [this](uint32_t, uint32_t, uint32_t)
+	{
+		BuildOctree();
+	};
+
+	auto Pack = [this](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		PackStepOutput(Begin, End);
+	};
+
+	m_StepGraph.Clear();
+	uint32_t LayoutTask = m_StepGraph.AddTask("Grid Layout", Layout, 0, NumberOfBoids);
+
+	// Rules and apply over runs of whole cells, each apply only waits for the rules of its own cells
+	const std::vector<SpatialGridCell>& Cells = m_SpatialGrid.GetOccupiedCells();
+	uint32_t RangeStart = 0;
+	for (size_t c = 0; c < Cells.size(); c++)
+	{
+		uint32_t RangeEnd = Cells[c].Start + Cells[c].Count;
+		if (RangeEnd - RangeStart < StepTaskBoids && c + 1 < Cells.size())
+		{
+			continue;
+		}
+
+		uint32_t RulesTask = m_StepGraph.AddTask("Rules", Rules, RangeStart, RangeEnd);
+		uint32_t ApplyTask = m_StepGraph.AddTask("Apply", Apply, RangeStart, RangeEnd);
+		m_StepGraph.AddDependency(RulesTask, ApplyTask);
+		m_StepGraph.AddDependency(ApplyTask, LayoutTask);
+		RangeStart = RangeEnd;
+	}
+
+	// Layout is the join of every apply, binning and output packing both read the finished snapshot from there on
+	uint32_t SortTask = m_StepGraph.AddTask("Grid Sort", Sort, 0, NumberOfBoids);
+	for (uint32_t Begin = 0; Begin < NumberOfBoids; Begin += StepTaskGrain)
+	{
+		uint32_t End = std::min(Begin + StepTaskGrain, NumberOfBoids);
+		uint32_t BinTask = m_StepGraph.AddTask("Grid Bin", Bin, Begin, End);
+		m_StepGraph.AddDependency(LayoutTask, BinTask);
+		m_StepGraph.AddDependency(BinTask, SortTask);
+
+		// Packing is off the path to the end of the grid rebuild, so it fills gaps left by the serial sort
+		if (PackOutput)
+		{
+			uint32_t PackTask = m_StepGraph.AddTask("Pack Output", Pack, Begin, End);
+			m_StepGraph.AddDependency(LayoutTask, PackTask);
+		}
+	}
+
+	uint32_t OctreeTask = m_NeighbourSearchMode == NeighbourSearchMode::BarnesHut ? m_StepGraph.AddTask("Octree", Octree, 0, NumberOfBoids) : UINT32_MAX;
+	for (uint32_t Begin = 0; Begin < NumberOfBoids; Begin += StepTaskGrain)
+	{
+		uint32_t GatherTask = m_StepGraph.AddTask("Grid Gather", Gather, Begin, std::min(Begin + StepTaskGrain, NumberOfBoids));
+		m_StepGraph.AddDependency(SortTask, GatherTask);
+		if (OctreeTask != UINT32_MAX)
+		{
+			m_StepGraph.AddDependency(GatherTask, OctreeTask);
+		}
+	}
+
+	m_StepGraph.Run();
+
+	m_StepGraphRan = true;
+	m_SpatialGridDirty = false;
+	m_StepOutputCount = PackOutput ? NumberOfBoids : 0;
+}
+
+void BoidPhysicsSystem::PackStepOutput(uint32_t Begin, uint32_t End)
+{
+	std::copy(m_UnsortedBoids.begin() + Begin, m_UnsortedBoids.begin() + End, m_StepOutput + Begin);
+}
+
+void BoidPhysicsSystem::UpdateBoidPhysics(BoidProperties* Boids, const uint32_t* Species, const uint8_t* IsGhost, uint32_t Count, float DeltaTime)
+{
+	static const uint32_t PhysicsZone = BoidAllocationTracker::RegisterZone("Physics");
+	BoidAllocationScope AllocationScope(PhysicsZone);
+
+	// Grid is built over the given boids instead of registered ones, so it has to be rebuilt before registered boids are used again
+	m_SpatialGridDirty = true;
+	if (Count == 0)
+	{
+		return;
+	}
+
+	uint32_t SpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+	m_UnsortedBoids.assign(Boids, Boids + Count);
+	m_UnsortedSpecies.resize(Count);
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		m_UnsortedSpecies[i] = Species ? std::min(Species[i], SpeciesCount - 1) : 0;
+	}
+
+	BuildSpatialGrid();
+
+	m_NewBoidPos.resize(Count);
+	m_NewBoidDir.resize(Count);
+	m_NewBoidTurn.resize(Count);
+
+	// Ghost boids are only read as neighbours, their owner advances them
+	const BoidLargeVector<uint32_t>& SortedIndices = m_SpatialGrid.GetSortedIndices();
+	const SortedBoidUpdate Update = GetSortedBoidUpdate();
+	BoidThreadPool::Get().ParallelFor(Count, 256, [this, Update, IsGhost, &SortedIndices, DeltaTime](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			if (!IsGhost || !IsGhost[SortedIndices[i]])
+			{
+				(this->*Update)(i, DeltaTime);
+			}
+		}
+	});
+
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		uint32_t Index = SortedIndices[i];
+		if (!IsGhost || !IsGhost[Index])
+		{
+			Boids[Index].BoidPosition = XMFLOAT4(m_NewBoidPos[i].x, m_NewBoidPos[i].y, m_NewBoidPos[i].z, 0.0f);
+			Boids[Index].BoidDirection = XMFLOAT4(m_NewBoidDir[i].x, m_NewBoidDir[i].y, m_NewBoidDir[i].z, 0.0f);
+		}
+	}
+}
+
+// Rule policies, each names its slot in RuleSums, its pair constants and species weight, and its target vector
+struct BoidPhysicsSystem::SeparationRule
+{
+	static constexpr uint32_t Slot = 0;
+
+	// Keeps its distance falloff with topological neighbours, a far neighbour is nothing to keep clear of
+	static constexpr bool IsMetric = true;
+
+	static const RuleConstants& GetConstants(const SpeciesPairConstants& Pair) { return Pair.Separation; }
+	static float GetWeight(const ModelProperties& Properties) { return Properties.SeparationDistanceWeight; }
+
+	static XMVECTOR Calculate(BoidPhysicsSystem& System, FXMVECTOR ThisBoidPos, const BoidProperties& OtherBoid, float Distance, const RuleConstants& Rule)
+	{
+		return System.CalculateSeparationRule(ThisBoidPos, XMLoadFloat4(&OtherBoid.BoidPosition), Distance, Rule);
+	}
+
+	// Unit vector towards the other boid is already known at fast precision
+	static XMVECTOR CalculateTarget(FXMVECTOR ToOther, const BoidProperties&)
+	{
+		return -ToOther;
+	}
+};
+
+struct BoidPhysicsSystem::AlignmentRule
+{
+	static constexpr uint32_t Slot = 1;
+	static constexpr bool IsMetric = false;
+
+	static const RuleConstants& GetConstants(const SpeciesPairConstants& Pair) { return Pair.Alignment; }
+	static float GetWeight(const ModelProperties& Properties) { return Properties.AlignmentDistanceWeight; }
+
+	static XMVECTOR Calculate(BoidPhysicsSystem& System, FXMVECTOR, const BoidProperties& OtherBoid, float Distance, const RuleConstants& Rule)
+	{
+		return System.CalculateAlignmentRule(XMLoadFloat4(&OtherBoid.BoidDirection), Distance, Rule);
+	}
+
+	// Directions are normalized at the end of every step, so the other boid's direction is used as it is
+	static XMVECTOR CalculateTarget(FXMVECTOR, const BoidProperties& OtherBoid)
+	{
+		return XMLoadFloat4(&OtherBoid.BoidDirection);
+	}
+};
+
+struct BoidPhysicsSystem::CohesionRule
+{
+	static constexpr uint32_t Slot = 2;
+	static constexpr bool IsMetric = false;
+
+	static const RuleConstants& GetConstants(const SpeciesPairConstants& Pair) { return Pair.Cohesion; }
+	static float GetWeight(const ModelProperties& Properties) { return Properties.CohesionDistanceWeight; }
+
+	static XMVECTOR Calculate(BoidPhysicsSystem& System, FXMVECTOR ThisBoidPos, const BoidProperties& OtherBoid, float Distance, const RuleConstants& Rule)
+	{
+		return System.CalculateCohesionRule(ThisBoidPos, XMLoadFloat4(&OtherBoid.BoidPosition), Distance, Rule);
+	}
+
+	static XMVECTOR CalculateTarget(FXMVECTOR ToOther, const BoidProperties&)
+	{
+		return ToOther;
+	}
+};
+
+BoidPhysicsSystem::SortedBoidUpdate BoidPhysicsSystem::GetSortedBoidUpdate() const
+{
+	// One specialization per subset of rules, indexed by active rule mask, rules keep their order so results match the full pipeline
+	static const SortedBoidUpdate Updates[] =
+	{
+		&BoidPhysicsSystem::UpdateSortedBoid<>,
+		&BoidPhysicsSystem::UpdateSortedBoid<SeparationRule>,
+		&BoidPhysicsSystem::UpdateSortedBoid<AlignmentRule>,
+		&BoidPhysicsSystem::UpdateSortedBoid<SeparationRule, AlignmentRule>,
+		&BoidPhysicsSystem::UpdateSortedBoid<CohesionRule>,
+		&BoidPhysicsSystem::UpdateSortedBoid<SeparationRule, CohesionRule>,
+		&BoidPhysicsSystem::UpdateSortedBoid<AlignmentRule, CohesionRule>,
+		&BoidPhysicsSystem::UpdateSortedBoid<SeparationRule, AlignmentRule, CohesionRule>
+	};
+
+	return Updates[m_ActiveRules];
+}
+
+template<typename... Rules>
+void BoidPhysicsSystem::UpdateSortedBoid(uint32_t SortedIndex, float DeltaTime)
+{
+	// Cache current boid in first loop
+	const BoidProperties& CurrentBoid = m_SortedBoids[SortedIndex];
+	XMVECTOR CurrentBoidPos = XMLoadFloat4(&CurrentBoid.BoidPosition);
+
+	uint32_t CurrentSpecies = m_SortedSpecies[SortedIndex];
+	const ModelProperties& CurrentProperties = m_SpeciesProperties[CurrentSpecies];
+
+	RuleSums Sums = {};
+
+	// Without any rule left there is no reason to look at neighbours at all
+	if constexpr (sizeof...(Rules) > 0)
+	{
+		uint32_t SpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+
+		// k nearest of any interacting species take the place of every boid within rule distances
+		if (m_NeighbourSearchMode == NeighbourSearchMode::Topological)
+		{
+			AccumulateTopologicalNeighbours<Rules...>(SortedIndex, Sums);
+		}
+		else
+		{
+			// Cells are at least the largest rule distance wide, so only the surrounding 3x3x3 block can hold neighbours
+			XMINT3 CurrentCell = m_SpatialGrid.CalculateCell(CurrentBoid.BoidPosition);
+
+			// Each species is contiguous in grid order, so handle one species pair at a time with its constants held in locals
+			for (uint32_t OtherSpecies = 0; OtherSpecies < SpeciesCount; OtherSpecies++)
+			{
+				const SpeciesPairConstants Pair = m_SpeciesPairConstants[CurrentSpecies * SpeciesCount + OtherSpecies];
+				if (!Pair.Interacts)
+				{
+					continue;
+				}
+
+				if (m_NeighbourSearchMode == NeighbourSearchMode::BarnesHut)
+				{
+					AccumulateBarnesHutNeighbours(SortedIndex, OtherSpecies, Pair, Sums);
+					continue;
+				}
+
+				for (int z = CurrentCell.z - 1; z <= CurrentCell.z + 1; z++)
+				{
+					for (int y = CurrentCell.y - 1; y <= CurrentCell.y + 1; y++)
+					{
+						for (int x = CurrentCell.x - 1; x <= CurrentCell.x + 1; x++)
+						{
+							uint32_t CellStart = 0;
+							uint32_t CellCount = 0;
+							if (!m_SpatialGrid.GetCellRange(XMINT3(x, y, z), OtherSpecies, CellStart, CellCount))
+							{
+								continue;
+							}
+
+							for (uint32_t j = CellStart; j < CellStart + CellCount; j++)
+							{
+								// Is new boid entity same as current one?
+								if (SortedIndex == j)
+								{
+									continue;
+								}
+
+								// Cache other boid in second loop
+								const BoidProperties& OtherBoid = m_SortedBoids[j];
+
+								if (m_RulePrecision != RulePrecision::Exact)
+								{
+									AccumulateNeighbourFast<Rules...>(CurrentBoidPos, OtherBoid, Pair, Sums);
+									continue;
+								}
+
+								// Also ignore if in same position, intial position will be same for all boids
+								if (CheckSamePosition(CurrentBoid.BoidPosition, OtherBoid.BoidPosition))
+								{
+									continue;
+								}
+
+								// Calculate Distance between current boid and other boid, then every rule of the pipeline in turn
+								float DistanceBetweenTwoBoids = CalculateDistance(CurrentBoid.BoidPosition, OtherBoid.BoidPosition);
+								(AccumulateRule<Rules>(CurrentBoidPos, OtherBoid, DistanceBetweenTwoBoids, Pair, Sums), ...);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Modify final vectors by delta time and rule-specific weight value
+	XMVECTOR NewDirectionVector = { CurrentBoid.BoidDirection.x, CurrentBoid.BoidDirection.y, CurrentBoid.BoidDirection.z };
+	(ApplyRule<Rules>(Sums, CurrentProperties, DeltaTime, NewDirectionVector), ...);
+	NewDirectionVector += CalculateObstacleAvoidance(CurrentBoidPos, CurrentProperties) * DeltaTime;
+	NewDirectionVector = XMVector3Normalize(NewDirectionVector);
+	m_NewBoidTurn[SortedIndex] = XMVectorGetX(XMVector3Dot(NewDirectionVector, XMLoadFloat4(&CurrentBoid.BoidDirection)));
+
+	XMFLOAT3 NewDirection = { XMVectorGetX(NewDirectionVector), XMVectorGetY(NewDirectionVector), XMVectorGetZ(NewDirectionVector) };
+
+	XMFLOAT3 NewPosition = CalculateNextPosition(CurrentBoid, CurrentProperties.BoidSpeed, DeltaTime);
+	ForceAlignWithinBounds(NewDirection, NewPosition);
+
+	m_NewBoidDir[SortedIndex] = NewDirection;
+	m_NewBoidPos[SortedIndex] = NewPosition;
+}
+
+template<typename Rule>
+void BoidPhysicsSystem::AccumulateRule(FXMVECTOR ThisBoidPos, const BoidProperties& OtherBoid, float Distance, const SpeciesPairConstants& Pair, RuleSums& Sums)
+{
+	const RuleConstants& Constants = Rule::GetConstants(Pair);
+	if (Distance < Constants.MaximumDistance)
+	{
+		// Calculate rule specific target vector
+		Sums.Vectors[Rule::Slot] += Rule::Calculate(*this, ThisBoidPos, OtherBoid, Distance, Constants);
+		Sums.Counts[Rule::Slot]++;
+	}
+}
+
+template<typename Rule>
+void BoidPhysicsSystem::ApplyRule(const RuleSums& Sums, const ModelProperties& Properties, float DeltaTime, XMVECTOR& NewDirectionVector)
+{
+	// Divide final rule vector by number of vectors added
+	XMVECTOR RuleVector = Sums.Vectors[Rule::Slot];
+	if (Sums.Counts[Rule::Slot] > 0)
+	{
+		RuleVector /= static_cast<float>(Sums.Counts[Rule::Slot]);
+	}
+
+	NewDirectionVector += RuleVector * Rule::GetWeight(Properties) * DeltaTime;
+}
+
+template<typename... Rules>
+void BoidPhysicsSystem::AccumulateTopologicalNeighbours(uint32_t SortedIndex, RuleSums& Sums)
+{
+	const BoidProperties& CurrentBoid = m_SortedBoids[SortedIndex];
+	const XMFLOAT4& Position = CurrentBoid.BoidPosition;
+	uint32_t CurrentSpecies = m_SortedSpecies[SortedIndex];
+	uint32_t SpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+	const uint32_t K = m_TopologicalNeighbourCount;
+
+	// Nearest candidates so far by squared distance, nearest first, so the last is the one to beat once all K are found
+	float NeighbourDistances[MaximumTopologicalNeighbours];
+	uint32_t Neighbours[MaximumTopologicalNeighbours];
+	uint32_t NeighbourCount = 0;
+
+	// Candidates past the longest rule of their species pair could never steer, so they are never among the K
+	auto AddCandidates = [&](uint32_t CellStart, uint32_t CellCount, float MaximumDistanceSquared)
+	{
+		for (uint32_t j = CellStart; j < CellStart + CellCount; j++)
+		{
+			const XMFLOAT4& OtherPosition = m_SortedBoids[j].BoidPosition;
+			float X = OtherPosition.x - Position.x;
+			float Y = OtherPosition.y - Position.y;
+			float Z = OtherPosition.z - Position.z;
+			float DistanceSquared = X * X + Y * Y + Z * Z;
+
+			// This boid itself, or one in the same position with no direction to steer by
+			if (DistanceSquared == 0 || DistanceSquared >= MaximumDistanceSquared || (NeighbourCount == K && DistanceSquared >= NeighbourDistances[K - 1]))
+			{
+				continue;
+			}
+
+			// K is small, so shifting farther candidates up one place beats keeping a heap
+			uint32_t Slot = NeighbourCount < K ? NeighbourCount++ : K - 1;
+			for (; Slot > 0 && NeighbourDistances[Slot - 1] > DistanceSquared; Slot--)
+			{
+				NeighbourDistances[Slot] = NeighbourDistances[Slot - 1];
+				Neighbours[Slot] = Neighbours[Slot - 1];
+			}
+
+			NeighbourDistances[Slot] = DistanceSquared;
+			Neighbours[Slot] = j;
+		}
+	};
+
+	auto AddCell = [&](XMINT3 Cell)
+	{
+		for (uint32_t OtherSpecies = 0; OtherSpecies < SpeciesCount; OtherSpecies++)
+		{
+			uint32_t CellStart = 0;
+			uint32_t CellCount = 0;
+			const SpeciesPairConstants& Pair = m_SpeciesPairConstants[CurrentSpecies * SpeciesCount + OtherSpecies];
+			if (Pair.Interacts && m_SpatialGrid.GetCellRange(Cell, OtherSpecies, CellStart, CellCount))
+			{
+				AddCandidates(CellStart, CellCount, Pair.MaximumDistanceSquared);
+			}
+		}
+	};
+
+	// Own cell first, in a dense swirl it usually holds all K and the surrounding cells are then skipped
+	XMINT3 CurrentCell = m_SpatialGrid.CalculateCell(Position);
+	XMINT3 Dimensions = m_SpatialGrid.GetDimensions();
+	AddCell(CurrentCell);
+
+	// Longest rule of any species this boid interacts with, cells further away than that can't add a candidate
+	float ReachSquared = 0;
+	for (uint32_t OtherSpecies = 0; OtherSpecies < SpeciesCount; OtherSpecies++)
+	{
+		const SpeciesPairConstants& Pair = m_SpeciesPairConstants[CurrentSpecies * SpeciesCount + OtherSpecies];
+		if (Pair.Interacts)
+		{
+			ReachSquared = std::max(ReachSquared, Pair.MaximumDistanceSquared);
+		}
+	}
+
+	for (int z = CurrentCell.z - 1; z <= CurrentCell.z + 1; z++)
+	{
+		for (int y = CurrentCell.y - 1; y <= CurrentCell.y + 1; y++)
+		{
+			for (int x = CurrentCell.x - 1; x <= CurrentCell.x + 1; x++)
+			{
+				if (x == CurrentCell.x && y == CurrentCell.y && z == CurrentCell.z)
+				{
+					continue;
+				}
+
+				// Gap between this boid and the cell, border cells also hold boids clamped in from outside so reach out forever
+				// Until K are found only the reach limits the search, after that the farthest of the K does
+				XMFLOAT3 CellMin;
+				XMFLOAT3 CellMax;
+				m_SpatialGrid.GetCellBounds(XMINT3(x, y, z), CellMin, CellMax);
+
+				float GapX = std::max(x > 0 ? CellMin.x - Position.x : 0.0f, x < Dimensions.x - 1 ? Position.x - CellMax.x : 0.0f);
+				float GapY = std::max(y > 0 ? CellMin.y - Position.y : 0.0f, y < Dimensions.y - 1 ? Position.y - CellMax.y : 0.0f);
+				float GapZ = std::max(z > 0 ? CellMin.z - Position.z : 0.0f, z < Dimensions.z - 1 ? Position.z - CellMax.z : 0.0f);
+				GapX = std::max(GapX, 0.0f);
+				GapY = std::max(GapY, 0.0f);
+				GapZ = std::max(GapZ, 0.0f);
+
+				if (GapX * GapX + GapY * GapY + GapZ * GapZ >= (NeighbourCount == K ? NeighbourDistances[K - 1] : ReachSquared))
+				{
+					continue;
+				}
+
+				AddCell(XMINT3(x, y, z));
+			}
+		}
+	}
+
+	// Rules only ever run on the K found, however many boids the cells held
+	XMVECTOR CurrentBoidPos = XMLoadFloat4(&Position);
+	for (uint32_t i = 0; i < NeighbourCount; i++)
+	{
+		const SpeciesPairConstants& Pair = m_SpeciesPairConstants[CurrentSpecies * SpeciesCount + m_SortedSpecies[Neighbours[i]]];
+		float Distance = sqrtf(NeighbourDistances[i]);
+		(AccumulateTopologicalRule<Rules>(CurrentBoidPos, m_SortedBoids[Neighbours[i]], Distance, Pair, Sums), ...);
+	}
+}
+
+template<typename Rule>
+void BoidPhysicsSystem::AccumulateTopologicalRule(FXMVECTOR ThisBoidPos, const BoidProperties& OtherBoid, float Distance, const SpeciesPairConstants& Pair, RuleSums& Sums)
+{
+	// Only within the rule's own distance, the K nearest may be in range of separation but not alignment or cohesion
+	// Inside it taken as no further than the minimum distance, so the falloff leaves full weight, rules ignored for the pair still skip it
+	const RuleConstants& Constants = Rule::GetConstants(Pair);
+	if (Distance < Constants.MaximumDistance)
+	{
+		AccumulateRule<Rule>(ThisBoidPos, OtherBoid, Rule::IsMetric ? Distance : std::min(Distance, Constants.MinimumDistance), Pair, Sums);
+	}
+}
+
+void BoidPhysicsSystem::UpdateSpatialGrid()
+{
+	if (!m_SpatialGridDirty)
+	{
+		return;
+	}
+
+	// Snapshot boids in registration order, then bin and reorder them into grid order
+	uint32_t NumberOfRegisteredBoids = static_cast<uint32_t>(m_RegisteredBoids.size());
+	uint32_t SpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+	m_UnsortedBoids.resize(NumberOfRegisteredBoids);
+	m_UnsortedSpecies.resize(NumberOfRegisteredBoids);
+
+	for (uint32_t i = 0; i < NumberOfRegisteredBoids; i++)
+	{
+		const BoidObject* Boid = m_RegisteredBoids[i];
+		m_UnsortedBoids[i] = { XMFLOAT4(Boid->m_Position.x, Boid->m_Position.y, Boid->m_Position.z, 0.0f),
+							   XMFLOAT4(Boid->m_Direction.x, Boid->m_Direction.y, Boid->m_Direction.z, 0.0f) };
+		m_UnsortedSpecies[i] = std::min(Boid->m_Species, SpeciesCount - 1);
+	}
+
+	BuildSpatialGrid();
+	m_SpatialGridDirty = false;
+}
+
+void BoidPhysicsSystem::BuildSpatialGrid()
+{
+	uint32_t NumberOfBoids = static_cast<uint32_t>(m_UnsortedBoids.size());
+	uint32_t SpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+	m_SortedBoids.resize(NumberOfBoids);
+	m_SortedSpecies.resize(NumberOfBoids);
+
+	m_SpatialGrid.Build(m_UnsortedBoids.data(), m_UnsortedSpecies.data(), NumberOfBoids, SpeciesCount, m_Bounds.BoundingBoxHalfSize, CalculateGridCellSize());
+	m_SpatialGrid.Gather(m_UnsortedBoids.data(), m_SortedBoids.data());
+
+	// Same chunking as the gather, so each species entry is first written by the node that reads it in the rules pass
+	const BoidLargeVector<uint32_t>& SortedIndices = m_SpatialGrid.GetSortedIndices();
+	BoidThreadPool::Get().ParallelFor(NumberOfBoids, 4096, [this, &SortedIndices](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			m_SortedSpecies[i] = m_UnsortedSpecies[SortedIndices[i]];
+		}
+	});
+
+	if (m_NeighbourSearchMode == NeighbourSearchMode::BarnesHut)
+	{
+		BuildOctree();
+	}
+}
+
+void BoidPhysicsSystem::BuildOctree()
+{
+	// Species are contiguous in grid order, so each tree covers one range of sorted boids
+	uint32_t SpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+	m_OctreeSpeciesStart.resize(SpeciesCount + 1);
+
+	for (uint32_t Species = 0; Species < SpeciesCount; Species++)
+	{
+		uint32_t Count = 0;
+		m_SpatialGrid.GetSpeciesRange(Species, m_OctreeSpeciesStart[Species], Count);
+	}
+	m_OctreeSpeciesStart[SpeciesCount] = static_cast<uint32_t>(m_SortedBoids.size());
+
+	m_Octree.Build(m_SortedBoids.data(), m_OctreeSpeciesStart.data(), SpeciesCount);
+}
+
+const BoidSpatialGrid& BoidPhysicsSystem::GetSpatialGrid() const
+{
+	return m_SpatialGrid;
+}
+
+const BoidLargeVector<BoidProperties>& BoidPhysicsSystem::GetSortedBoidProperties() const
+{
+	return m_SortedBoids;
+}
+
+uint32_t BoidPhysicsSystem::QueryRadius(XMFLOAT3 Center, float Radius, uint32_t* OutIndices, uint32_t Capacity)
+{
+	UpdateSpatialGrid();
+	return GatherRadius(Center, Radius, OutIndices, Capacity);
+}
+
+uint32_t BoidPhysicsSystem::QueryBox(XMFLOAT3 Min, XMFLOAT3 Max, uint32_t* OutIndices, uint32_t Capacity)
+{
+	UpdateSpatialGrid();
+	return GatherBox(Min, Max, OutIndices, Capacity);
+}
+
+uint32_t BoidPhysicsSystem::QueryNearest(XMFLOAT3 Center, uint32_t K, uint32_t* OutIndices)
+{
+	UpdateSpatialGrid();
+	return GatherNearest(Center, K, OutIndices);
+}
+
+void BoidPhysicsSystem::QueryRadiusBatch(const BoidSpatialQuery* Queries, uint32_t QueryCount, uint32_t* OutIndices, uint32_t CapacityPerQuery, uint32_t* OutCounts)
+{
+	// Build once up front, queries then only read the grid
+	UpdateSpatialGrid();
+
+	BoidThreadPool::Get().ParallelFor(QueryCount, 64, [=](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t q = Begin; q < End; q++)
+		{
+			OutCounts[q] = GatherRadius(Queries[q].Center, Queries[q].Radius, OutIndices + static_cast<size_t>(q) * CapacityPerQuery, CapacityPerQuery);
+		}
+	});
+}
+
+void BoidPhysicsSystem::QueryNearestBatch(const BoidSpatialQuery* Queries, uint32_t QueryCount, uint32_t K, uint32_t* OutIndices, uint32_t* OutCounts)
+{
+	UpdateSpatialGrid();
+
+	BoidThreadPool::Get().ParallelFor(QueryCount, 64, [=](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t q = Begin; q < End; q++)
+		{
+			OutCounts[q] = GatherNearest(Queries[q].Center, K, OutIndices + static_cast<size_t>(q) * K);
+		}
+	});
+}
+
+std::vector<BoidProperties> BoidPhysicsSystem::GetBoidProperties()
+{
+	// Convert all boids data into BoidProperties struct, from BoidObjects and return the conversion
+	std::vector<BoidProperties> PropertiesVector;
+
+	int NumberOfRegisteredBoids = m_RegisteredBoids.size();
+	for (int i = 0; i < NumberOfRegisteredBoids; i++)
+	{
+		BoidProperties Properties{XMFLOAT4(m_RegisteredBoids[i]->m_Position.x, m_RegisteredBoids[i]->m_Position.y, m_RegisteredBoids[i]->m_Position.z, 0.0f),
+								  XMFLOAT4(m_RegisteredBoids[i]->m_Direction.x, m_RegisteredBoids[i]->m_Direction.y, m_RegisteredBoids[i]->m_Direction.z, 0.0f) };
+
+		PropertiesVector.push_back(Properties);
+	}
+
+	return PropertiesVector;
+}
+
+DirectX::XMFLOAT4 BoidPhysicsSystem::GetBoundingBoxProperties()
+{
+	return DirectX::XMFLOAT4(m_Bounds.BoundingBoxHalfSize.x, m_Bounds.BoundingBoxHalfSize.y, m_Bounds.BoundingBoxHalfSize.z, 0);
+}
+
+ModelProperties BoidPhysicsSystem::GetModelProperties()
+{
+	// Lazy initialization for Boid Count 
+	// Don't know if more entities might be registered in future, so only set when updating Compute Shader model properties
+	SetBoidCount(m_RegisteredBoids.size());
+
+	return m_SpeciesProperties[0];
+}
+
+void BoidPhysicsSystem::SetBoundingBoxHalfSize(DirectX::XMFLOAT3 BoxHalfSize)
+{
+	m_Bounds.BoundingBoxHalfSize = BoxHalfSize;
+	m_SpatialGridDirty = true;
+}
+
+void BoidPhysicsSystem::SetSpatialGridMode(SpatialGridMode Mode)
+{
+	m_SpatialGrid.SetMode(Mode);
+	m_SpatialGridDirty = true;
+}
+
+void BoidPhysicsSystem::SetNeighbourSearchMode(NeighbourSearchMode Mode)
+{
+	// Octree is only built alongside the grid while it is in use
+	m_NeighbourSearchMode = Mode;
+	m_SpatialGridDirty = true;
+}
+
+NeighbourSearchMode BoidPhysicsSystem::GetNeighbourSearchMode() const
+{
+	return m_NeighbourSearchMode;
+}
+
+void BoidPhysicsSystem::SetBarnesHutOpeningAngle(float OpeningAngle)
+{
+	m_BarnesHutOpeningAngle = std::max(OpeningAngle, 0.0f);
+}
+
+void BoidPhysicsSystem::SetTopologicalNeighbourCount(uint32_t NeighbourCount)
+{
+	// Compared rather than passed to std::min, which takes a reference and would need the constant defined out of class
+	NeighbourCount = std::max(NeighbourCount, 1u);
+	m_TopologicalNeighbourCount = NeighbourCount < MaximumTopologicalNeighbours ? NeighbourCount : MaximumTopologicalNeighbours;
+}
+
+uint32_t BoidPhysicsSystem::GetTopologicalNeighbourCount() const
+{
+	return m_TopologicalNeighbourCount;
+}
+
+NeighbourSearchReport BoidPhysicsSystem::CompareBarnesHutWithReference(float DeltaTime)
+{
+	NeighbourSearchReport Report = {};
+
+	uint32_t NumberOfBoids = static_cast<uint32_t>(m_RegisteredBoids.size());
+	if (NumberOfBoids == 0)
+	{
+		return Report;
+	}
+
+	UpdateSpatialGrid();
+	BuildOctree();
+
+	const NeighbourSearchMode PreviousMode = m_NeighbourSearchMode;
+
+	m_NeighbourSearchMode = NeighbourSearchMode::SpatialGrid;
+	Report.ReferenceMilliseconds = RunUnappliedStep(DeltaTime);
+	std::vector<XMFLOAT3> ReferenceDirections(m_NewBoidDir.begin(), m_NewBoidDir.end());
+
+	m_NeighbourSearchMode = NeighbourSearchMode::BarnesHut;
+	Report.BarnesHutMilliseconds = RunUnappliedStep(DeltaTime);
+	m_NeighbourSearchMode = PreviousMode;
+
+	MeasureDirectionError(ReferenceDirections, Report.MeanDirectionError, Report.MaximumDirectionError);
+	return Report;
+}
+
+void BoidPhysicsSystem::SetRulePrecision(RulePrecision Precision)
+{
+	m_RulePrecision = Precision;
+}
+
+RulePrecision BoidPhysicsSystem::GetRulePrecision() const
+{
+	return m_RulePrecision;
+}
+
+void BoidPhysicsSystem::SetNewtonRefinement(bool Enable)
+{
+	m_NewtonRefinement = Enable;
+}
+
+bool BoidPhysicsSystem::GetNewtonRefinement() const
+{
+	return m_NewtonRefinement;
+}
+
+RulePrecisionReport BoidPhysicsSystem::CompareRulePrecisionWithExact(float DeltaTime)
+{
+	RulePrecisionReport Report = {};
+	Report.Precision = m_RulePrecision;
+	Report.NewtonRefinement = m_NewtonRefinement;
+
+	uint32_t NumberOfBoids = static_cast<uint32_t>(m_RegisteredBoids.size());
+	if (NumberOfBoids == 0)
+	{
+		return Report;
+	}
+
+	// Octree is already built alongside the grid in Barnes-Hut mode
+	UpdateSpatialGrid();
+
+	// Same neighbour search for both, so only the tier differs
+	const RulePrecision SelectedPrecision = m_RulePrecision;
+
+	m_RulePrecision = RulePrecision::Exact;
+	Report.ExactMilliseconds = RunUnappliedStep(DeltaTime);
+	std::vector<XMFLOAT3> ReferenceDirections(m_NewBoidDir.begin(), m_NewBoidDir.end());
+
+	m_RulePrecision = SelectedPrecision;
+	Report.SelectedMilliseconds = RunUnappliedStep(DeltaTime);
+
+	MeasureDirectionError(ReferenceDirections, Report.MeanDirectionError, Report.MaximumDirectionError);
+	return Report;
+}
+
+uint64_t BoidPhysicsSystem::CountCandidatePairs() const
+{
+	uint32_t NumberOfBoids = static_cast<uint32_t>(m_SortedBoids.size());
+	uint32_t SpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+	uint64_t Pairs = 0;
+
+	// Same cells UpdateSortedBoid visits, Barnes-Hut visits fewer boids but this is what an exact search would cost
+	for (uint32_t i = 0; i < NumberOfBoids; i++)
+	{
+		XMINT3 CurrentCell = m_SpatialGrid.CalculateCell(m_SortedBoids[i].BoidPosition);
+		uint32_t CurrentSpecies = m_SortedSpecies[i];
+
+		for (uint32_t OtherSpecies = 0; OtherSpecies < SpeciesCount; OtherSpecies++)
+		{
+			if (!m_SpeciesPairConstants[CurrentSpecies * SpeciesCount + OtherSpecies].Interacts)
+			{
+				continue;
+			}
+
+			// Boid is in its own cell but never paired with itself
+			if (OtherSpecies == CurrentSpecies)
+			{
+				Pairs--;
+			}
+
+			for (int z = CurrentCell.z - 1; z <= CurrentCell.z + 1; z++)
+			{
+				for (int y = CurrentCell.y - 1; y <= CurrentCell.y + 1; y++)
+				{
+					for (int x = CurrentCell.x - 1; x <= CurrentCell.x + 1; x++)
+					{
+						uint32_t CellStart = 0;
+						uint32_t CellCount = 0;
+						if (m_SpatialGrid.GetCellRange(XMINT3(x, y, z), OtherSpecies, CellStart, CellCount))
+						{
+							Pairs += CellCount;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return Pairs;
+}
+
+double BoidPhysicsSystem::RunUnappliedStep(float DeltaTime)
+{
+	uint32_t NumberOfBoids = static_cast<uint32_t>(m_SortedBoids.size());
+	m_NewBoidPos.resize(NumberOfBoids);
+	m_NewBoidDir.resize(NumberOfBoids);
+	m_NewBoidTurn.resize(NumberOfBoids);
+
+	const SortedBoidUpdate Update = GetSortedBoidUpdate();
+
+	auto Start = std::chrono::high_resolution_clock::now();
+	BoidThreadPool::Get().ParallelFor(NumberOfBoids, 256, [this, Update, DeltaTime](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			(this->*Update)(i, DeltaTime);
+		}
+	});
+	auto Stop = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::milli>(Stop - Start).count();
+}
+
+void BoidPhysicsSystem::MeasureDirectionError(const std::vector<XMFLOAT3>& ReferenceDirections, float& MeanError, float& MaximumError) const
+{
+	// Angle between reference and new steering of every boid
+	double SumError = 0;
+	MaximumError = 0;
+
+	for (size_t i = 0; i < ReferenceDirections.size(); i++)
+	{
+		float Cosine = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&ReferenceDirections[i]), XMLoadFloat3(&m_NewBoidDir[i])));
+		float Error = XMConvertToDegrees(acosf(std::min(std::max(Cosine, -1.0f), 1.0f)));
+
+		SumError += Error;
+		MaximumError = std::max(MaximumError, Error);
+	}
+
+	MeanError = ReferenceDirections.empty() ? 0 : static_cast<float>(SumError / ReferenceDirections.size());
+}
+
+void BoidPhysicsSystem::SetObstacleField(const BoidObstacleField* ObstacleField)
+{
+	m_ObstacleField = ObstacleField;
+}
+
+void BoidPhysicsSystem::SetModelProperties(ModelProperties NewProperties)
+{
+	SetSpeciesProperties(0, NewProperties);
+}
+
+void BoidPhysicsSystem::SetBoidCount(int BoidAmount)
+{
+	m_SpeciesProperties[0].BoidCount = BoidAmount;
+}
+
+void BoidPhysicsSystem::SetSpeciesCount(uint32_t SpeciesCount)
+{
+	SpeciesCount = std::max(SpeciesCount, 1u);
+	uint32_t OldSpeciesCount = static_cast<uint32_t>(m_SpeciesProperties.size());
+	if (SpeciesCount == OldSpeciesCount)
+	{
+		return;
+	}
+
+	// Keep interactions between species that still exist
+	std::vector<SpeciesInteraction> NewInteractions(SpeciesCount * SpeciesCount);
+	for (uint32_t i = 0; i < std::min(SpeciesCount, OldSpeciesCount); i++)
+	{
+		for (uint32_t j = 0; j < std::min(SpeciesCount, OldSpeciesCount); j++)
+		{
+			NewInteractions[i * SpeciesCount + j] = m_SpeciesInteractions[i * OldSpeciesCount + j];
+		}
+	}
+
+	m_SpeciesProperties.resize(SpeciesCount);
+	m_SpeciesInteractions = NewInteractions;
+
+	UpdateSpeciesPairConstants();
+	m_SpatialGridDirty = true;
+}
+
+uint32_t BoidPhysicsSystem::GetSpeciesCount() const
+{
+	return static_cast<uint32_t>(m_SpeciesProperties.size());
+}
+
+ModelProperties BoidPhysicsSystem::GetSpeciesProperties(uint32_t Species) const
+{
+	return m_SpeciesProperties[std::min(Species, GetSpeciesCount() - 1)];
+}
+
+void BoidPhysicsSystem::SetSpeciesProperties(uint32_t Species, ModelProperties NewProperties)
+{
+	if (Species >= GetSpeciesCount())
+	{
+		return;
+	}
+
+	int BoidCount = m_SpeciesProperties[Species].BoidCount;
+
+	m_SpeciesProperties[Species] = NewProperties;
+
+	// Keep original boid count: Don't need to change this
+	m_SpeciesProperties[Species].BoidCount = BoidCount;
+
+	// Rule distances decide grid cell size
+	UpdateSpeciesPairConstants();
+	m_SpatialGridDirty = true;
+}
+
+SpeciesInteraction BoidPhysicsSystem::GetSpeciesInteraction(uint32_t Species, uint32_t OtherSpecies) const
+{
+	uint32_t SpeciesCount = GetSpeciesCount();
+	if (Species >= SpeciesCount || OtherSpecies >= SpeciesCount)
+	{
+		return SpeciesInteraction();
+	}
+
+	return m_SpeciesInteractions[Species * SpeciesCount + OtherSpecies];
+}
+
+void BoidPhysicsSystem::SetSpeciesInteraction(uint32_t Species, uint32_t OtherSpecies, SpeciesInteraction Interaction)
+{
+	uint32_t SpeciesCount = GetSpeciesCount();
+	if (Species >= SpeciesCount || OtherSpecies >= SpeciesCount)
+	{
+		return;
+	}
+
+	m_SpeciesInteractions[Species * SpeciesCount + OtherSpecies] = Interaction;
+	UpdateSpeciesPairConstants();
+}
+
+void BoidPhysicsSystem::UpdateSpeciesPairConstants()
+{
+	uint32_t SpeciesCount = GetSpeciesCount();
+	m_SpeciesPairConstants.resize(SpeciesCount * SpeciesCount);
+	m_ActiveRules = 0;
+
+	for (uint32_t Species = 0; Species < SpeciesCount; Species++)
+	{
+		// Rule distances always come from the reacting species
+		const ModelProperties& Properties = m_SpeciesProperties[Species];
+
+		for (uint32_t OtherSpecies = 0; OtherSpecies < SpeciesCount; OtherSpecies++)
+		{
+			const SpeciesInteraction& Interaction = m_SpeciesInteractions[Species * SpeciesCount + OtherSpecies];
+			SpeciesPairConstants& Pair = m_SpeciesPairConstants[Species * SpeciesCount + OtherSpecies];
+
+			Pair.Separation = CalculateRuleConstants(Properties.MinimumSeparationDistance, Properties.MaximumSeparationDistance, Interaction.SeparationWeight);
+			Pair.Alignment = CalculateRuleConstants(Properties.MinimumAlignmentDistnace, Properties.MaximumAlignmentDistance, Interaction.AlignmentWeight);
+			Pair.Cohesion = CalculateRuleConstants(Properties.MinimumCohesionDistance, Properties.MaximumCohesionDistance, Interaction.CohesionWeight);
+			Pair.Interacts = Interaction.SeparationWeight != 0 || Interaction.AlignmentWeight != 0 || Interaction.CohesionWeight != 0;
+			Pair.MaximumDistanceSquared = std::max(Pair.Separation.MaximumDistanceSquared, std::max(Pair.Alignment.MaximumDistanceSquared, Pair.Cohesion.MaximumDistanceSquared));
+
+			// Rule is only worth running if some species both weighs it and applies it to some other species
+			m_ActiveRules |= (Properties.SeparationDistanceWeight != 0 && Pair.Separation.MaximumDistance >= 0) ? 1u << SeparationRule::Slot : 0u;
+			m_ActiveRules |= (Properties.AlignmentDistanceWeight != 0 && Pair.Alignment.MaximumDistance >= 0) ? 1u << AlignmentRule::Slot : 0u;
+			m_ActiveRules |= (Properties.CohesionDistanceWeight != 0 && Pair.Cohesion.MaximumDistance >= 0) ? 1u << CohesionRule::Slot : 0u;
+		}
+	}
+}
+
+BoidPhysicsSystem::RuleConstants BoidPhysicsSystem::CalculateRuleConstants(float MinimumDistance, float MaximumDistance, float InteractionWeight) const
+{
+	RuleConstants Rule;
+	Rule.MaximumDistance = InteractionWeight != 0 ? MaximumDistance : -1.0f;
+	Rule.MinimumDistance = MinimumDistance;
+	Rule.InverseDistanceRange = 1.0f / (MaximumDistance - MinimumDistance);
+	Rule.InteractionWeight = InteractionWeight;
+	Rule.MaximumDistanceSquared = Rule.MaximumDistance >= 0 ? Rule.MaximumDistance * Rule.MaximumDistance : -1.0f;
+
+	return Rule;
+}
+
+void BoidPhysicsSystem::ForceAlignWithinBounds(DirectX::XMFLOAT3& BoidDir, DirectX::XMFLOAT3& BoidPos)
+{
+	if (BoidPos.x > m_Bounds.BoundingBoxHalfSize.x)
+	{
+		BoidDir.x *= -1;
+		BoidPos.x = m_Bounds.BoundingBoxHalfSize.x - 0.1f;
+	}
+	else if (BoidPos.x < -m_Bounds.BoundingBoxHalfSize.x)
+	{
+		BoidDir.x *= -1;
+		BoidPos.x = -m_Bounds.BoundingBoxHalfSize.x + 0.1f;
+	}
+
+	if (BoidPos.y > m_Bounds.BoundingBoxHalfSize.y)
+	{
+		BoidDir.y *= -1;
+		BoidPos.y = m_Bounds.BoundingBoxHalfSize.y - 0.1f;
+	}
+	else if (BoidPos.y < -m_Bounds.BoundingBoxHalfSize.y)
+	{
+		BoidDir.y *= -1;
+		BoidPos.y = -m_Bounds.BoundingBoxHalfSize.y + 0.1f;
+	}
+
+	if (BoidPos.z > m_Bounds.BoundingBoxHalfSize.z)
+	{
+		BoidDir.z *= -1;
+		BoidPos.z = m_Bounds.BoundingBoxHalfSize.z - 0.1f;
+	}
+	else if (BoidPos.z < -m_Bounds.BoundingBoxHalfSize.z)
+	{
+		BoidDir.z *= -1;
+		BoidPos.z = -m_Bounds.BoundingBoxHalfSize.z + 0.1f;
+	}
+}
+
+void BoidPhysicsSystem::AccumulateBarnesHutNeighbours(uint32_t SortedIndex, uint32_t OtherSpecies, const SpeciesPairConstants& Pair, RuleSums& Sums)
+{
+	// Always runs every rule, rules no species uses are simply never applied
+	XMVECTOR& SeparationVectorResult = Sums.Vectors[SeparationRule::Slot];
+	XMVECTOR& AlignmentVectorResult = Sums.Vectors[AlignmentRule::Slot];
+	XMVECTOR& CohesionVectorResult = Sums.Vectors[CohesionRule::Slot];
+	int& SeparationVectors = Sums.Counts[SeparationRule::Slot];
+	int& AlignmentVectors = Sums.Counts[AlignmentRule::Slot];
+	int& CohesionVectors = Sums.Counts[CohesionRule::Slot];
+
+	const uint32_t Root = m_Octree.GetRoot(OtherSpecies);
+	if (Root == UINT32_MAX)
+	{
+		return;
+	}
+
+	const BoidProperties& CurrentBoid = m_SortedBoids[SortedIndex];
+	XMVECTOR CurrentBoidPos = XMLoadFloat4(&CurrentBoid.BoidPosition);
+
+	const float FarReach = std::max(Pair.Alignment.MaximumDistance, Pair.Cohesion.MaximumDistance);
+	const float Reach = std::max(Pair.Separation.MaximumDistance, FarReach);
+	const std::vector<uint32_t>& Indices = m_Octree.GetIndices();
+
+	// Nodes still to visit, high bit marks nodes whose alignment and cohesion were already taken from their sums
+	const uint32_t SeparationOnly = 0x80000000u;
+	uint32_t Stack[(BoidOctree::MaximumDepth + 1) * 8];
+	uint32_t StackSize = 0;
+	Stack[StackSize++] = Root;
+
+	while (StackSize > 0)
+	{
+		const uint32_t Entry = Stack[--StackSize];
+		const BoidOctreeNode& Node = m_Octree.GetNode(Entry & ~SeparationOnly);
+		bool OnlySeparation = (Entry & SeparationOnly) != 0;
+
+		// Distance to nearest point of node's cube, zero when inside it
+		XMVECTOR NodeCenter = XMLoadFloat3(&Node.Center);
+		XMVECTOR Outside = XMVectorMax(XMVectorAbs(CurrentBoidPos - NodeCenter) - XMVectorReplicate(Node.HalfSize), XMVectorZero());
+		float BoxDistance = XMVectorGetX(XMVector3Length(Outside));
+
+		if (BoxDistance >= (OnlySeparation ? Pair.Separation.MaximumDistance : Reach))
+		{
+			continue;
+		}
+
+		// Leaves are always exact, same as the grid search
+		if (Node.ChildCount == 0)
+		{
+			for (uint32_t i = Node.Begin; i < Node.End; i++)
+			{
+				uint32_t j = Indices[i];
+				if (SortedIndex == j)
+				{
+					continue;
+				}
+
+				const BoidProperties& OtherBoid = m_SortedBoids[j];
+				if (m_RulePrecision != RulePrecision::Exact)
+				{
+					if (OnlySeparation)
+					{
+						AccumulateNeighbourFast<SeparationRule>(CurrentBoidPos, OtherBoid, Pair, Sums);
+					}
+					else
+					{
+						AccumulateNeighbourFast<SeparationRule, AlignmentRule, CohesionRule>(CurrentBoidPos, OtherBoid, Pair, Sums);
+					}
+					continue;
+				}
+
+				if (CheckSamePosition(CurrentBoid.BoidPosition, OtherBoid.BoidPosition))
+				{
+					continue;
+				}
+
+				XMVECTOR OtherBoidPos = XMLoadFloat4(&OtherBoid.BoidPosition);
+				float DistanceBetweenTwoBoids = CalculateDistance(CurrentBoid.BoidPosition, OtherBoid.BoidPosition);
+
+				if (DistanceBetweenTwoBoids < Pair.Separation.MaximumDistance)
+				{
+					SeparationVectorResult += CalculateSeparationRule(CurrentBoidPos, OtherBoidPos, DistanceBetweenTwoBoids, Pair.Separation);
+					SeparationVectors++;
+				}
+				if (OnlySeparation)
+				{
+					continue;
+				}
+				if (DistanceBetweenTwoBoids < Pair.Alignment.MaximumDistance)
+				{
+					AlignmentVectorResult += CalculateAlignmentRule(XMLoadFloat4(&OtherBoid.BoidDirection), DistanceBetweenTwoBoids, Pair.Alignment);
+					AlignmentVectors++;
+				}
+				if (DistanceBetweenTwoBoids < Pair.Cohesion.MaximumDistance)
+				{
+					CohesionVectorResult += CalculateCohesionRule(CurrentBoidPos, OtherBoidPos, DistanceBetweenTwoBoids, Pair.Cohesion);
+					CohesionVectors++;
+				}
+			}
+			continue;
+		}
+
+		// Far node stands in for its boids once it looks small enough, and only if each rule takes all or none of them
+		if (!OnlySeparation && BoxDistance > 0)
+		{
+			float CenterDistance = XMVectorGetX(XMVector3Length(CurrentBoidPos - NodeCenter));
+			float Radius = Node.HalfSize * 1.7320508f;
+
+			bool AlignmentInside = CenterDistance + Radius < Pair.Alignment.MaximumDistance;
+			bool AlignmentOutside = CenterDistance - Radius >= Pair.Alignment.MaximumDistance;
+			bool CohesionInside = CenterDistance + Radius < Pair.Cohesion.MaximumDistance;
+			bool CohesionOutside = CenterDistance - Radius >= Pair.Cohesion.MaximumDistance;
+
+			if (2 * Node.HalfSize < m_BarnesHutOpeningAngle * CenterDistance && (AlignmentInside || AlignmentOutside) && (CohesionInside || CohesionOutside))
+			{
+				XMVECTOR CentreOfMass = XMLoadFloat3(&Node.SumPosition) / static_cast<float>(Node.Count);
+				float CentreOfMassDistance = XMVectorGetX(XMVector3Length(CentreOfMass - CurrentBoidPos));
+
+				// Directions are unit length, so summed alignment is close to the summed direction scaled by the weight at the centre of mass
+				if (AlignmentInside)
+				{
+					XMVECTOR SumDirection = XMLoadFloat3(&Node.SumDirection);
+					float SumLength = XMVectorGetX(XMVector3Length(SumDirection));
+					if (SumLength > 0)
+					{
+						AlignmentVectorResult += CalculateAlignmentRule(SumDirection, CentreOfMassDistance, Pair.Alignment) * SumLength;
+					}
+					AlignmentVectors += Node.Count;
+				}
+				if (CohesionInside && CentreOfMassDistance > 0)
+				{
+					CohesionVectorResult += CalculateCohesionRule(CurrentBoidPos, CentreOfMass, CentreOfMassDistance, Pair.Cohesion) * static_cast<float>(Node.Count);
+					CohesionVectors += Node.Count;
+				}
+
+				if (BoxDistance >= Pair.Separation.MaximumDistance)
+				{
+					continue;
+				}
+				OnlySeparation = true;
+			}
+		}
+
+		for (uint32_t Child = Node.FirstChild; Child < Node.FirstChild + Node.ChildCount; Child++)
+		{
+			Stack[StackSize++] = OnlySeparation ? (Child | SeparationOnly) : Child;
+		}
+	}
+}
+
+template<typename... Rules>
+void BoidPhysicsSystem::AccumulateNeighbourFast(FXMVECTOR ThisBoidPos, const BoidProperties& OtherBoid, const SpeciesPairConstants& Pair, RuleSums& Sums)
+{
+	// Cutoffs compare squared distances, so boids out of reach never pay for a square root
+	XMVECTOR Offset = XMLoadFloat4(&OtherBoid.BoidPosition) - ThisBoidPos;
+	XMVECTOR DistanceSquared = XMVector3LengthSq(Offset);
+	float DistanceSquaredValue = XMVectorGetX(DistanceSquared);
+
+	// Same position as this boid, or this boid itself
+	if (DistanceSquaredValue == 0 || DistanceSquaredValue >= Pair.MaximumDistanceSquared)
+	{
+		return;
+	}
+
+	// One reciprocal square root serves distance and both separation and cohesion directions
+	XMVECTOR InverseDistance;
+	if (m_RulePrecision == RulePrecision::Approximate)
+	{
+		InverseDistance = XMVectorReciprocalSqrtEst(DistanceSquared);
+
+		// One Newton-Raphson step, y' = y * (1.5 - 0.5 * x * y * y)
+		if (m_NewtonRefinement)
+		{
+			XMVECTOR HalfDistanceSquared = DistanceSquared * 0.5f;
+			InverseDistance = InverseDistance * (XMVectorReplicate(1.5f) - HalfDistanceSquared * InverseDistance * InverseDistance);
+		}
+	}
+	else
+	{
+		InverseDistance = XMVectorReciprocalSqrt(DistanceSquared);
+	}
+
+	float Distance = DistanceSquaredValue * XMVectorGetX(InverseDistance);
+	XMVECTOR ToOther = Offset * InverseDistance;
+
+	(AccumulateRuleFast<Rules>(ToOther, OtherBoid, Distance, DistanceSquaredValue, Pair, Sums), ...);
+}
+
+template<typename Rule>
+void BoidPhysicsSystem::AccumulateRuleFast(FXMVECTOR ToOther, const BoidProperties& OtherBoid, float Distance, float DistanceSquared, const SpeciesPairConstants& Pair, RuleSums& Sums)
+{
+	const RuleConstants& Constants = Rule::GetConstants(Pair);
+	if (DistanceSquared < Constants.MaximumDistanceSquared)
+	{
+		Sums.Vectors[Rule::Slot] += Rule::CalculateTarget(ToOther, OtherBoid) * CalculateRuleWeight(Distance, Constants);
+		Sums.Counts[Rule::Slot]++;
+	}
+}
+
+float BoidPhysicsSystem::CalculateRuleWeight(float Distance, const RuleConstants& Rule)
+{
+	// Same falloff as the exact rule functions
+	float DistanceWeight = 1;
+
+	Distance -= Rule.MinimumDistance;
+	if (Distance > 0)
+	{
+		DistanceWeight -= Distance * Rule.InverseDistanceRange;
+	}
+
+	return DistanceWeight > 0.01f ? DistanceWeight * Rule.InteractionWeight : 0.0f;
+}
+
+float BoidPhysicsSystem::CalculateDistance(const XMFLOAT4& ThisBoidPos, const XMFLOAT4& OtherBoidPos)
+{
+	// sqrt[(x2 - x1)^2 + (y2 - y1)^2 + (z2 - z1)^2] for distance
+
+	float XCoordsSquared = (OtherBoidPos.x - ThisBoidPos.x) * (OtherBoidPos.x - ThisBoidPos.x);
+	float YCoordsSquared = (OtherBoidPos.y - ThisBoidPos.y) * (OtherBoidPos.y - ThisBoidPos.y);
+	float ZCoordsSquared = (OtherBoidPos.z - ThisBoidPos.z) * (OtherBoidPos.z - ThisBoidPos.z);
+	float SumOfCoordsSquared = XCoordsSquared + YCoordsSquared + ZCoordsSquared;
+
+	return sqrt(SumOfCoordsSquared);
+}
+
+bool BoidPhysicsSystem::CheckSamePosition(const XMFLOAT4& ThisBoidPos, const XMFLOAT4& OtherBoidPos)
+{
+	if (ThisBoidPos.x == OtherBoidPos.x && ThisBoidPos.y == OtherBoidPos.y && ThisBoidPos.z == OtherBoidPos.z)
+	{
+		return true;
+	}
+	return false;
+}
+
+XMVECTOR BoidPhysicsSystem::CalculateSeparationRule(FXMVECTOR ThisBoidPos, FXMVECTOR OtherBoidPos, float Distance, const RuleConstants& Rule)
+{
+	XMVECTOR FinalSeparationVector{ 0, 0, 0 };
+
+	// Calculate target vector - Separation target vector is opposite direction to Other boid from This boid
+	XMVECTOR DirectionVector = ThisBoidPos - OtherBoidPos;
+	DirectionVector = XMVector3Normalize(DirectionVector);
+
+	float DistanceWeight = 1;
+
+	Distance -= Rule.MinimumDistance;
+	if (Distance > 0)
+	{
+		DistanceWeight -= Distance * Rule.InverseDistanceRange;
+	}
+
+	// Modify final vector by rule-specific distance value and how strongly this species reacts to the other
+	if (DistanceWeight > 0.01f)
+	{
+		FinalSeparationVector = DirectionVector * (DistanceWeight * Rule.InteractionWeight);
+	}
+
+	// Return target vector
+	return FinalSeparationVector;
+}
+
+XMVECTOR BoidPhysicsSystem::CalculateCohesionRule(FXMVECTOR ThisBoidPos, FXMVECTOR OtherBoidPos, float Distance, const RuleConstants& Rule)
+{
+	XMVECTOR FinalCohesionVector{ 0, 0, 0 };
+
+	// Calculate target vector - Cohesion target vector is direction to Other boid from This boid
+	XMVECTOR DirectionVector = OtherBoidPos - ThisBoidPos;
+	DirectionVector = XMVector3Normalize(DirectionVector);
+
+	float DistanceWeight = 1;
+
+	Distance -= Rule.MinimumDistance;
+	if (Distance > 0)
+	{
+		DistanceWeight -= Distance * Rule.InverseDistanceRange;
+	}
+
+	// Modify final vector by rule-specific distance value and how strongly this species reacts to the other
+	if (DistanceWeight > 0.01f)
+	{
+		FinalCohesionVector = DirectionVector * (DistanceWeight * Rule.InteractionWeight);
+	}
+
+	// Return target vector
+	return FinalCohesionVector;
+}
+
+XMVECTOR BoidPhysicsSystem::CalculateAlignmentRule(FXMVECTOR OtherBoidDir, float Distance, const RuleConstants& Rule)
+{
+	XMVECTOR FinalAlignmentVector{ 0, 0, 0 };
+
+	// Calculate target vector - Alignment target vector is Other boid's direction vector
+	XMVECTOR DirectionVector = XMVector3Normalize(OtherBoidDir);
+
+	float DistanceWeight = 1;
+
+	Distance -= Rule.MinimumDistance;
+	if (Distance > 0)
+	{
+		DistanceWeight -= Distance * Rule.InverseDistanceRange;
+	}
+
+	// Modify final vector by rule-specific distance value and how strongly this species reacts to the other
+	if (DistanceWeight > 0.01f)
+	{
+		FinalAlignmentVector = DirectionVector * (DistanceWeight * Rule.InteractionWeight);
+	}
+
+	// Return target vector
+	return FinalAlignmentVector;
+}
+
+XMVECTOR BoidPhysicsSystem::CalculateObstacleAvoidance(FXMVECTOR ThisBoidPos, const ModelProperties& Properties)
+{
+	if (!m_ObstacleField || !m_ObstacleField->IsBaked() || Properties.ObstacleAvoidanceDistance <= 0)
+	{
+		return XMVectorZero();
+	}
+
+	// Single trilinear sample gives both distance to and direction away from the nearest obstacle
+	XMVECTOR Sample = m_ObstacleField->Sample(ThisBoidPos);
+	float Distance = XMVectorGetW(Sample);
+	if (Distance >= Properties.ObstacleAvoidanceDistance)
+	{
+		return XMVectorZero();
+	}
+
+	// Weight grows linearly towards the surface and keeps growing inside an obstacle
+	float DistanceWeight = 1 - (Distance / Properties.ObstacleAvoidanceDistance);
+
+	return XMVectorSetW(Sample, 0) * (DistanceWeight * Properties.ObstacleAvoidanceWeight);
+}
+
+XMFLOAT3 BoidPhysicsSystem::CalculateRandomDirection(std::mt19937 MTEngine, std::uniform_real_distribution<> RandomDistribution)
+{
+	XMVECTOR RandomBoidDirection = XMVECTOR{ static_cast<float>(RandomDistribution(MTEngine)),
+							 static_cast<float>(RandomDistribution(MTEngine)),
+							 static_cast<float>(RandomDistribution(MTEngine)) };
+
+	RandomBoidDirection = XMVector3Normalize(RandomBoidDirection);
+
+	return XMFLOAT3{ XMVectorGetX(RandomBoidDirection), XMVectorGetY(RandomBoidDirection), XMVectorGetZ(RandomBoidDirection) };
+}
+
+XMFLOAT3 BoidPhysicsSystem::CalculateNextPosition(const BoidProperties& Boid, float BoidSpeed, float DeltaTime)
+{
+	XMFLOAT3 BoidNewPos = XMFLOAT3{ Boid.BoidPosition.x + (Boid.BoidDirection.x * DeltaTime * BoidSpeed),
+									Boid.BoidPosition.y + (Boid.BoidDirection.y * DeltaTime * BoidSpeed),
+									Boid.BoidPosition.z + (Boid.BoidDirection.z * DeltaTime * BoidSpeed) };
+	return BoidNewPos;
+}
+
+uint32_t BoidPhysicsSystem::GatherRadius(XMFLOAT3 Center, float Radius, uint32_t* OutIndices, uint32_t Capacity) const
+{
+	if (m_SpatialGrid.GetBoidCount() == 0 || Radius < 0)
+	{
+		return 0;
+	}
+
+	const BoidLargeVector<uint32_t>& SortedIndices = m_SpatialGrid.GetSortedIndices();
+	float RadiusSquared = Radius * Radius;
+	uint32_t Found = 0;
+
+	// Clamping corners into grid keeps border cells, so boids clamped in from outside the box are still found
+	XMFLOAT3 Min(Center.x - Radius, Center.y - Radius, Center.z - Radius);
+	XMFLOAT3 Max(Center.x + Radius, Center.y + Radius, Center.z + Radius);
+
+	ForEachCellInBox(Min, Max, [&](uint32_t CellStart, uint32_t CellCount)
+	{
+		for (uint32_t j = CellStart; j < CellStart + CellCount; j++)
+		{
+			const XMFLOAT4& Position = m_SortedBoids[j].BoidPosition;
+			float X = Position.x - Center.x;
+			float Y = Position.y - Center.y;
+			float Z = Position.z - Center.z;
+
+			if (X * X + Y * Y + Z * Z <= RadiusSquared)
+			{
+				if (Found < Capacity)
+				{
+					OutIndices[Found] = SortedIndices[j];
+				}
+				Found++;
+			}
+		}
+	});
+
+	return Found;
+}
+
+uint32_t BoidPhysicsSystem::GatherBox(XMFLOAT3 Min, XMFLOAT3 Max, uint32_t* OutIndices, uint32_t Capacity) const
+{
+	if (m_SpatialGrid.GetBoidCount() == 0 || Min.x > Max.x || Min.y > Max.y || Min.z > Max.z)
+	{
+		return 0;
+	}
+
+	const BoidLargeVector<uint32_t>& SortedIndices = m_SpatialGrid.GetSortedIndices();
+	uint32_t Found = 0;
+
+	ForEachCellInBox(Min, Max, [&](uint32_t CellStart, uint32_t CellCount)
+	{
+		for (uint32_t j = CellStart; j < CellStart + CellCount; j++)
+		{
+			const XMFLOAT4& Position = m_SortedBoids[j].BoidPosition;
+			if (Position.x >= Min.x && Position.x <= Max.x &&
+				Position.y >= Min.y && Position.y <= Max.y &&
+				Position.z >= Min.z && Position.z <= Max.z)
+			{
+				if (Found < Capacity)
+				{
+					OutIndices[Found] = SortedIndices[j];
+				}
+				Found++;
+			}
+		}
+	});
+
+	return Found;
+}
+
+void BoidPhysicsSystem::ForEachCellInBox(XMFLOAT3 Min, XMFLOAT3 Max, const std::function<void(uint32_t CellStart, uint32_t CellCount)>& Function) const
+{
+	XMINT3 MinCell = m_SpatialGrid.CalculateCell(XMFLOAT4(Min.x, Min.y, Min.z, 0));
+	XMINT3 MaxCell = m_SpatialGrid.CalculateCell(XMFLOAT4(Max.x, Max.y, Max.z, 0));
+	uint32_t SpeciesCount = m_SpatialGrid.GetSpeciesCount();
+	const std::vector<SpatialGridCell>& OccupiedCells = m_SpatialGrid.GetOccupiedCells();
+
+	// Sparse grids can cover far more cells than are occupied, then filtering occupied cells is cheaper than looking each one up
+	uint64_t RangeCells = static_cast<uint64_t>(MaxCell.x - MinCell.x + 1) * (MaxCell.y - MinCell.y + 1) * (MaxCell.z - MinCell.z + 1);
+	if (m_SpatialGrid.IsSparse() && RangeCells * SpeciesCount > OccupiedCells.size())
+	{
+		for (const SpatialGridCell& Cell : OccupiedCells)
+		{
+			if (Cell.Coord.x >= MinCell.x && Cell.Coord.x <= MaxCell.x &&
+				Cell.Coord.y >= MinCell.y && Cell.Coord.y <= MaxCell.y &&
+				Cell.Coord.z >= MinCell.z && Cell.Coord.z <= MaxCell.z)
+			{
+				Function(Cell.Start, Cell.Count);
+			}
+		}
+		return;
+	}
+
+	// Each species is its own contiguous range, so walk the cells once per species
+	for (uint32_t Species = 0; Species < SpeciesCount; Species++)
+	{
+		for (int z = MinCell.z; z <= MaxCell.z; z++)
+		{
+			for (int y = MinCell.y; y <= MaxCell.y; y++)
+			{
+				for (int x = MinCell.x; x <= MaxCell.x; x++)
+				{
+					uint32_t CellStart = 0;
+					uint32_t CellCount = 0;
+					if (m_SpatialGrid.GetCellRange(XMINT3(x, y, z), Species, CellStart, CellCount))
+					{
+						Function(CellStart, CellCount);
+					}
+				}
+			}
+		}
+	}
+}
+
+uint32_t BoidPhysicsSystem::GatherNearest(XMFLOAT3 Center, uint32_t K, uint32_t* OutIndices) const
+{
+	uint32_t NumberOfBoids = m_SpatialGrid.GetBoidCount();
+	K = std::min(K, NumberOfBoids);
+	if (K == 0)
+	{
+		return 0;
+	}
+
+	// Max heap of best candidates so far, squared distance then sorted index, kept per thread to avoid reallocating
+	thread_local std::vector<std::pair<float, uint32_t>> Candidates;
+	Candidates.clear();
+
+	auto AddCandidates = [this, Center, K](uint32_t CellStart, uint32_t CellCount)
+	{
+		for (uint32_t j = CellStart; j < CellStart + CellCount; j++)
+		{
+			const XMFLOAT4& Position = m_SortedBoids[j].BoidPosition;
+			float X = Position.x - Center.x;
+			float Y = Position.y - Center.y;
+			float Z = Position.z - Center.z;
+			float DistanceSquared = X * X + Y * Y + Z * Z;
+
+			if (Candidates.size() < K)
+			{
+				Candidates.emplace_back(DistanceSquared, j);
+				std::push_heap(Candidates.begin(), Candidates.end());
+			}
+			else if (DistanceSquared < Candidates.front().first)
+			{
+				std::pop_heap(Candidates.begin(), Candidates.end());
+				Candidates.back() = { DistanceSquared, j };
+				std::push_heap(Candidates.begin(), Candidates.end());
+			}
+		}
+	};
+
+	XMINT3 Dimensions = m_SpatialGrid.GetDimensions();
+	XMFLOAT3 Origin = m_SpatialGrid.GetOrigin();
+	float CellSize = m_SpatialGrid.GetCellSize();
+	XMINT3 CenterCell = m_SpatialGrid.CalculateCell(XMFLOAT4(Center.x, Center.y, Center.z, 0));
+
+	int LargestDimension = std::max(Dimensions.x, std::max(Dimensions.y, Dimensions.z));
+	uint32_t SpeciesCount = m_SpatialGrid.GetSpeciesCount();
+	const std::vector<SpatialGridCell>& OccupiedCells = m_SpatialGrid.GetOccupiedCells();
+
+	// Search growing shells of cells around the centre cell, only visiting the cells new to each shell
+	int Ring = 0;
+	bool SearchComplete = false;
+	for (; Ring < LargestDimension; Ring++)
+	{
+		// Sparse grids can be mostly empty space, once a shell holds more cells than are occupied scan those directly
+		uint64_t ShellCells = static_cast<uint64_t>(2 * Ring + 1) * (2 * Ring + 1) * (2 * Ring + 1) -
+							  static_cast<uint64_t>(std::max(2 * Ring - 1, 0)) * std::max(2 * Ring - 1, 0) * std::max(2 * Ring - 1, 0);
+		if (m_SpatialGrid.IsSparse() && ShellCells * SpeciesCount > OccupiedCells.size())
+		{
+			break;
+		}
+
+		for (int z = CenterCell.z - Ring; z <= CenterCell.z + Ring; z++)
+		{
+			for (int y = CenterCell.y - Ring; y <= CenterCell.y + Ring; y++)
+			{
+				bool OnShell = abs(z - CenterCell.z) == Ring || abs(y - CenterCell.y) == Ring;
+				int StepX = OnShell || Ring == 0 ? 1 : 2 * Ring;
+
+				for (int x = CenterCell.x - Ring; x <= CenterCell.x + Ring; x += StepX)
+				{
+					for (uint32_t Species = 0; Species < SpeciesCount; Species++)
+					{
+						uint32_t CellStart = 0;
+						uint32_t CellCount = 0;
+						if (m_SpatialGrid.GetCellRange(XMINT3(x, y, z), Species, CellStart, CellCount))
+						{
+							AddCandidates(CellStart, CellCount);
+						}
+					}
+				}
+			}
+		}
+
+		if (Candidates.size() < K)
+		{
+			continue;
+		}
+
+		// Any boid not yet visited is beyond the searched block, sides already touching the grid border hide nothing
+		float Bound = FLT_MAX;
+		if (CenterCell.x - Ring > 0) Bound = std::min(Bound, Center.x - (Origin.x + (CenterCell.x - Ring) * CellSize));
+		if (CenterCell.y - Ring > 0) Bound = std::min(Bound, Center.y - (Origin.y + (CenterCell.y - Ring) * CellSize));
+		if (CenterCell.z - Ring > 0) Bound = std::min(Bound, Center.z - (Origin.z + (CenterCell.z - Ring) * CellSize));
+		if (CenterCell.x + Ring < Dimensions.x - 1) Bound = std::min(Bound, (Origin.x + (CenterCell.x + Ring + 1) * CellSize) - Center.x);
+		if (CenterCell.y + Ring < Dimensions.y - 1) Bound = std::min(Bound, (Origin.y + (CenterCell.y + Ring + 1) * CellSize) - Center.y);
+		if (CenterCell.z + Ring < Dimensions.z - 1) Bound = std::min(Bound, (Origin.z + (CenterCell.z + Ring + 1) * CellSize) - Center.z);
+
+		if (Bound == FLT_MAX || (Bound > 0 && Candidates.front().first <= Bound * Bound))
+		{
+			SearchComplete = true;
+			break;
+		}
+	}
+
+	// Shells stopped early, finish with every occupied cell outside the block they covered
+	if (!SearchComplete && Ring < LargestDimension)
+	{
+		for (const SpatialGridCell& Cell : OccupiedCells)
+		{
+			if (abs(Cell.Coord.x - CenterCell.x) < Ring && abs(Cell.Coord.y - CenterCell.y) < Ring && abs(Cell.Coord.z - CenterCell.z) < Ring)
+			{
+				continue;
+			}
+
+			AddCandidates(Cell.Start, Cell.Count);
+		}
+	}
+
+	// Heap sort leaves candidates nearest first
+	std::sort_heap(Candidates.begin(), Candidates.end());
+
+	const BoidLargeVector<uint32_t>& SortedIndices = m_SpatialGrid.GetSortedIndices();
+	for (uint32_t i = 0; i < K; i++)
+	{
+		OutIndices[i] = SortedIndices[Candidates[i].second];
+	}
+
+	return K;
+}
+
+float BoidPhysicsSystem::GetInteractionRange()
+{
+	return CalculateGridCellSize();
+}
+
+float BoidPhysicsSystem::CalculateGridCellSize()
+{
+	// Largest rule distance of any species, so every species pair is still covered by adjacent cells
+	float CellSize = 0;
+	for (const ModelProperties& Properties : m_SpeciesProperties)
+	{
+		CellSize = std::max(CellSize, std::max(Properties.MaximumSeparationDistance,
+											   std::max(Properties.MaximumAlignmentDistance, Properties.MaximumCohesionDistance)));
+	}
+
+	return CellSize;
 }
\ No newline at end of file
@@ -1,10 +1,21 @@
 #pragma once
 #include <vector>
 #include <random>
+#include <functional>
+#include <memory>
+#include <cstdint>
 #include <DirectXMath.h>
-#include "CommandList.h"
+#include "BoidSpatialGrid.h"
+#include "BoidOctree.h"
+#include "BoidPageAllocator.h"
+#include "BoidTaskGraph.h"
 
 class BoidObject;
+class BoidObstacleField;
+class BoidCommandQueue;
+struct BoidCommand;
+class BoidStepProfiler;
+class BoidFlockAnalytics;
 
 struct BoundingBox
 {
@@ -17,6 +28,21 @@ struct BoidProperties
 	DirectX::XMFLOAT4 BoidDirection;
 };
 
+// Generational handle to a registered boid, valid until that boid is despawned or all boids are deleted
+// Slots are reused with a new generation, so stale handles are rejected instead of reaching another boid
+struct BoidHandle
+{
+	uint32_t Index = UINT32_MAX;
+	uint32_t Generation = 0;
+};
+
+// Single query for batched spatial queries, Radius is ignored by nearest neighbour queries
+struct BoidSpatialQuery
+{
+	DirectX::XMFLOAT3 Center;
+	float Radius;
+};
+
 // Model properties, structured in easy to access method for compute shader
 struct ModelProperties
 {
@@ -38,6 +64,98 @@ struct ModelProperties
 	float MaximumCohesionDistance = 12;
 	float CohesionDistanceWeight = 4;
 	float padding4;
+
+	// Steering away from obstacle field, CPU only, compute shaders ignore these trailing values
+	float ObstacleAvoidanceDistance = 4;
+	float ObstacleAvoidanceWeight = 20;
+	DirectX::XMFLOAT2 padding5;
+};
+
+// How strongly boids of one species react to boids of another, per rule
+// Negative weights turn a rule around, so prey can be made to scatter from predators, 0 ignores the other species for that rule
+struct SpeciesInteraction
+{
+	float SeparationWeight = 1;
+	float AlignmentWeight = 1;
+	float CohesionWeight = 1;
+};
+
+// How neighbours are found every step on the CPU
+// Barnes-Hut keeps separation exact but takes alignment and cohesion of distant octree nodes from their sums,
+// which pays off once those rule distances approach the box size and grid cells stop pruning anything
+// Topological has every boid follow only its k nearest neighbours within the interaction range, so rule work per boid stays
+// the same however dense the flock gets, each rule only takes those within its own distance, alignment and cohesion at full weight
+// while separation keeps its falloff
+enum class NeighbourSearchMode
+{
+	SpatialGrid,
+	BarnesHut,
+	Topological
+};
+
+const char* GetNeighbourSearchModeName(NeighbourSearchMode Mode);
+
+// Timing of one step of both searches, and how far Barnes-Hut steering strays from the exact one in degrees
+struct NeighbourSearchReport
+{
+	double ReferenceMilliseconds;
+	double BarnesHutMilliseconds;
+	float MeanDirectionError;
+	float MaximumDirectionError;
+};
+
+// Arithmetic used for every neighbour pair on the CPU
+// Exact pays a square root for every distance and normalizes each rule vector, fast tests squared distances against cutoffs
+// and shares one reciprocal square root per pair, approximate takes that from the hardware estimate
+enum class RulePrecision
+{
+	Exact,
+	Fast,
+	Approximate
+};
+
+const char* GetRulePrecisionName(RulePrecision Precision);
+
+// Timing of one step at exact and at selected precision, and how far selected steering strays from exact in degrees
+struct RulePrecisionReport
+{
+	RulePrecision Precision;
+	bool NewtonRefinement;
+	double ExactMilliseconds;
+	double SelectedMilliseconds;
+	float MeanDirectionError;
+	float MaximumDirectionError;
+};
+
+// How a CPU step of registered boids is scheduled
+// Stages runs rules, apply and grid rebuild one after another with a barrier between each, task graph splits them into tasks over
+// ranges of cells that start as soon as what they read is ready, so applying one range overlaps the neighbour search of another
+enum class StepScheduling
+{
+	Stages,
+	TaskGraph
+};
+
+const char* GetStepSchedulingName(StepScheduling Scheduling);
+
+// Limits adaptive sub-stepping keeps every sub-step of a frame within, disabled runs each frame as one step
+// Turn is the steering turn of a boid before it bounces off the box, travel is a fraction of boid spacing in the most crowded cell
+struct BoidSubStepSettings
+{
+	bool Enabled = false;
+	uint32_t MaximumSubSteps = 8;
+	float MaximumTurnPerSubStep = 0.25f;
+	float MaximumTravelPerSpacing = 0.5f;
+};
+
+// Sub-steps chosen for last frame, and what they were chosen from, measured on the sub-step before
+// Turn rate is in radians per second, peak density in boids per unit volume
+struct BoidSubStepReport
+{
+	uint32_t SubSteps;
+	float SubStepTime;
+	float MaximumTurnRate;
+	float PeakDensity;
 };
 
 // Provides CPU implementation of boids algorithm
@@ -59,40 +177,362 @@ public:
 	// Remove all boids from physics system, freeing memory
 	void DeleteAllBoids();
 
+	// Spawn boids from pooled storage owned by the physics system, O(1) each with no full reset
+	// Handles are written to OutHandles when it is not null, if SpawnBoids throws the boids before the failure are registered whole
+	BoidHandle SpawnBoid(DirectX::XMFLOAT3 Position, DirectX::XMFLOAT3 Direction, uint32_t Species = 0);
+	void SpawnBoids(const BoidObject* Boids, uint32_t Count, BoidHandle* OutHandles = nullptr);
+
+	// Despawn in O(1) by moving the last registered boid into the freed place, so registration order is not kept
+	// Stale handles are ignored, returns whether the boid was despawned or how many were
+	bool DespawnBoid(BoidHandle Handle);
+	uint32_t DespawnBoids(const BoidHandle* Handles, uint32_t Count);
+
+	bool IsBoidAlive(BoidHandle Handle) const;
+	BoidObject* GetBoid(BoidHandle Handle) const;
+
+	// Handle of boid at registration index, every registered boid has one however it was registered
+	BoidHandle GetBoidHandle(uint32_t RegisteredIndex) const;
+	uint32_t GetRegisteredBoidCount() const;
+
+	// Queue other threads push mutations into, drained at the start of every step, not owned and must outlive the physics system
+	void SetCommandQueue(BoidCommandQueue* CommandQueue);
+
+	// Drain queued commands now, applying each command type as one batch, UpdateBoidPhysics calls this itself
+	void ApplyQueuedCommands();
+
+	// Profiler timing and counting each stage of UpdateBoidPhysics, not owned and must outlive the physics system, null stops profiling
+	void SetStepProfiler(BoidStepProfiler* StepProfiler);
+
+	// Analytics run at the end of every step of registered boids, not owned and must outlive the physics system, null stops them
+	void SetFlockAnalytics(BoidFlockAnalytics* FlockAnalytics);
+
+	// Steps with a profiler attached always run stage by stage, so each stage can be measured on its own
+	void SetStepScheduling(StepScheduling Scheduling);
+	StepScheduling GetStepScheduling() const;
+
+	// Every step also writes boids in registration order into Output, e.g. straight into a publisher slot, null stops it
+	// Task graph steps write it while the grid is being rebuilt, nothing is written while there are more boids than Capacity
+	void SetStepOutput(BoidProperties* Output, uint32_t Capacity);
+
+	// Boids written to step output by last step
+	uint32_t GetStepOutputCount() const;
+
+	// Tasks of last step with their threads, timings and dependencies as Chrome trace events, false if it did not run as a task graph
+	bool WriteStepTrace(const char* Path) const;
+
+	void SetSubStepSettings(const BoidSubStepSettings& Settings);
+	const BoidSubStepSettings& GetSubStepSettings() const;
+
+	// Advance registered boids by a whole frame, split into as many equal sub-steps as turn rate and density of the last one call for
+	// Sub-steps are added as soon as a frame needs them, but only dropped one per frame, so a single calm frame does not undo them
+	// Disabled, the frame is one step but turn rate and density are still measured
+	void AdvanceBoidPhysics(float FrameTime);
+	const BoidSubStepReport& GetSubStepReport() const;
+
 	// Update function for CPU boids. See Fig 3.4 for breakdown - comments similar to those in activity diagram
 	void UpdateBoidPhysics(float DeltaTime);
 
+	// Advance boids held by the caller instead of registered ones, in place, with the same rules and grid as above
+	// Ghost boids are neighbours owned elsewhere, read but not advanced, IsGhost may be null if there are none
+	// Within a cell neighbours are visited in array order, so callers keeping a stable order get reproducible results
+	void UpdateBoidPhysics(BoidProperties* Boids, const uint32_t* Species, const uint8_t* IsGhost, uint32_t Count, float DeltaTime);
+
+	// Rebuild spatial grid if boids, bounds or rule distances changed since the last build
+	void UpdateSpatialGrid();
+
+	// Spatial grid and boids in grid order for current frame, valid until next update or registration
+	const BoidSpatialGrid& GetSpatialGrid() const;
+	const BoidLargeVector<BoidProperties>& GetSortedBoidProperties() const;
+
+	// Spatial queries against current grid, results are boid indices in registration order
+	// Each writes at most Capacity indices and returns how many boids matched, which may be larger than Capacity
+	uint32_t QueryRadius(DirectX::XMFLOAT3 Center, float Radius, uint32_t* OutIndices, uint32_t Capacity);
+	uint32_t QueryBox(DirectX::XMFLOAT3 Min, DirectX::XMFLOAT3 Max, uint32_t* OutIndices, uint32_t Capacity);
+
+	// Up to K nearest boids to point, nearest first, returns how many were written
+	uint32_t QueryNearest(DirectX::XMFLOAT3 Center, uint32_t K, uint32_t* OutIndices);
+
+	// Answer many queries in parallel against the same grid
+	// Query q writes into OutIndices[q * CapacityPerQuery] and stores its result count in OutCounts[q]
+	void QueryRadiusBatch(const BoidSpatialQuery* Queries, uint32_t QueryCount, uint32_t* OutIndices, uint32_t CapacityPerQuery, uint32_t* OutCounts);
+	void QueryNearestBatch(const BoidSpatialQuery* Queries, uint32_t QueryCount, uint32_t K, uint32_t* OutIndices, uint32_t* OutCounts);
+
 	// Get boid, bounding box and overall model properties data
 	std::vector<BoidProperties> GetBoidProperties();
 	DirectX::XMFLOAT4 GetBoundingBoxProperties();
 	ModelProperties GetModelProperties();
 
 	void SetBoundingBoxHalfSize(DirectX::XMFLOAT3 BoxHalfSize);
+
+	// Dense grids suit boxes the flock fills, sparse grids suit huge boxes with only a few occupied areas
+	void SetSpatialGridMode(SpatialGridMode Mode);
+
+	void SetNeighbourSearchMode(NeighbourSearchMode Mode);
+	NeighbourSearchMode GetNeighbourSearchMode() const;
+
+	// Octree node is approximated once its size over its distance falls below this, smaller is more accurate and slower
+	void SetBarnesHutOpeningAngle(float OpeningAngle);
+
+	// Neighbours each boid follows in topological mode, clamped to 1 to MaximumTopologicalNeighbours
+	static const uint32_t MaximumTopologicalNeighbours = 32;
+	void SetTopologicalNeighbourCount(uint32_t NeighbourCount);
+	uint32_t GetTopologicalNeighbourCount() const;
+
+	// Run one step of exact grid search and of Barnes-Hut on current boids, without applying either
+	NeighbourSearchReport CompareBarnesHutWithReference(float DeltaTime);
+
+	void SetRulePrecision(RulePrecision Precision);
+	RulePrecision GetRulePrecision() const;
+
+	// One Newton-Raphson step on the approximate reciprocal square root, roughly 12 bits of accuracy to 22
+	void SetNewtonRefinement(bool Enable);
+	bool GetNewtonRefinement() const;
+
+	// Run one step at exact and at selected precision on current boids, without applying either
+	RulePrecisionReport CompareRulePrecisionWithExact(float DeltaTime);
+
+	// Baked obstacles boids steer away from, not owned and must outlive the physics system, null removes obstacles
+	void SetObstacleField(const BoidObstacleField* ObstacleField);
+
 	void SetModelProperties(ModelProperties NewProperties);
 	void SetBoidCount(int BoidAmount);
 
+	// Every species has its own model properties, model properties above are those of species 0, also used by compute shader versions
+	// New species start with default properties and full interaction with every other species
+	void SetSpeciesCount(uint32_t SpeciesCount);
+
+	// Largest rule distance of any species, boids further apart than this never affect each other
+	float GetInteractionRange();
+	uint32_t GetSpeciesCount() const;
+
+	ModelProperties GetSpeciesProperties(uint32_t Species) const;
+	void SetSpeciesProperties(uint32_t Species, ModelProperties NewProperties);
+
+	// Interaction of boids of Species with neighbours of OtherSpecies, uses the rule distances of Species
+	SpeciesInteraction GetSpeciesInteraction(uint32_t Species, uint32_t OtherSpecies) const;
+	void SetSpeciesInteraction(uint32_t Species, uint32_t OtherSpecies, SpeciesInteraction Interaction);
+
 protected:
+	// Rule values for one species pair, precomputed so the neighbour loop never touches model properties
+	// Rules the other species is ignored for get a negative maximum distance, so the distance test skips them for free
+	struct RuleConstants
+	{
+		float MaximumDistance;
+		float MinimumDistance;
+		float InverseDistanceRange;
+		float InteractionWeight;
+		float MaximumDistanceSquared;
+	};
+
+	struct SpeciesPairConstants
+	{
+		RuleConstants Separation;
+		RuleConstants Alignment;
+		RuleConstants Cohesion;
+		float MaximumDistanceSquared;
+		bool Interacts;
+	};
+
+	// Rebuild pair constants for every species pair after properties or interactions change
+	void UpdateSpeciesPairConstants();
+	RuleConstants CalculateRuleConstants(float MinimumDistance, float MaximumDistance, float InteractionWeight) const;
+
+	// Slot of boid registry, free slots link through DenseIndex
+	struct BoidSlot
+	{
+		uint32_t DenseIndex;
+		uint32_t Generation;
+		bool IsPooled;
+	};
+
+	// Give registered boid at end of m_RegisteredBoids a slot
+	void AddBoidSlot(bool IsPooled);
+	const BoidSlot* FindBoidSlot(BoidHandle Handle) const;
+
+	// Boid objects come from fixed size slabs so spawning never allocates one at a time
+	BoidObject* AllocateBoidObject();
+
 	// Force boid within alignment of bounds of bounding box using AABB collision detection
 	void ForceAlignWithinBounds(DirectX::XMFLOAT3& BoidDir, DirectX::XMFLOAT3& BoidPos);
 
+	// Rule policies, defined alongside the physics code, a pipeline is any ordered subset of them
+	struct SeparationRule;
+	struct AlignmentRule;
+	struct CohesionRule;
+
+	// Rule vectors summed over neighbours and how many were added, indexed by rule slot
+	struct RuleSums
+	{
+		DirectX::XMVECTOR Vectors[3];
+		int Counts[3];
+	};
+
+	using SortedBoidUpdate = void (BoidPhysicsSystem::*)(uint32_t SortedIndex, float DeltaTime);
+
+	// Sorted boid update specialized for the rules some species actually uses, chosen once per step
+	SortedBoidUpdate GetSortedBoidUpdate() const;
+
+	// Calculate new direction and position of a single boid in sorted order, searching only neighbouring grid cells
+	// Only rules in the pipeline are compiled in, so a disabled rule costs neither a distance test nor a call
+	template<typename... Rules>
+	void UpdateSortedBoid(uint32_t SortedIndex, float DeltaTime);
+
+	template<typename Rule>
+	void AccumulateRule(DirectX::FXMVECTOR ThisBoidPos, const BoidProperties& OtherBoid, float Distance, const SpeciesPairConstants& Pair, RuleSums& Sums);
+	template<typename Rule>
+	void ApplyRule(const RuleSums& Sums, const ModelProperties& Properties, float DeltaTime, DirectX::XMVECTOR& NewDirectionVector);
+
+	// Add rule vectors from boids of other species using octree, exact for separation and leaves, from node sums for distant nodes
+	void AccumulateBarnesHutNeighbours(uint32_t SortedIndex, uint32_t OtherSpecies, const SpeciesPairConstants& Pair, RuleSums& Sums);
+
+	// Add rule vectors of the k nearest boids of any interacting species in the surrounding 3x3x3 cells, always at exact precision
+	// Candidates are kept in a fixed buffer sorted by distance, cells no nearer than the current k-th neighbour are skipped
+	template<typename... Rules>
+	void AccumulateTopologicalNeighbours(uint32_t SortedIndex, RuleSums& Sums);
+	template<typename Rule>
+	void AccumulateTopologicalRule(DirectX::FXMVECTOR ThisBoidPos, const BoidProperties& OtherBoid, float Distance, const SpeciesPairConstants& Pair, RuleSums& Sums);
+
+	// Add rule vectors of one neighbour at fast or approximate precision
+	template<typename... Rules>
+	void AccumulateNeighbourFast(DirectX::FXMVECTOR ThisBoidPos, const BoidProperties& OtherBoid, const SpeciesPairConstants& Pair, RuleSums& Sums);
+	template<typename Rule>
+	void AccumulateRuleFast(DirectX::FXMVECTOR ToOther, const BoidProperties& OtherBoid, float Distance, float DistanceSquared, const SpeciesPairConstants& Pair, RuleSums& Sums);
+	static float CalculateRuleWeight(float Distance, const RuleConstants& Rule);
+
+	// Neighbours the grid search visits this step, summed over every boid and interacting species pair
+	uint64_t CountCandidatePairs() const;
+
+	// Run one step into m_NewBoidPos and m_NewBoidDir without applying it, grid must be up to date
+	double RunUnappliedStep(float DeltaTime);
+
+	// Mean and largest angle in degrees between reference directions and those in m_NewBoidDir
+	void MeasureDirectionError(const std::vector<DirectX::XMFLOAT3>& ReferenceDirections, float& MeanError, float& MaximumError) const;
+
 	// Calculate distance between two boids
-	float CalculateDistance(DirectX::XMFLOAT3 ThisBoidPos, DirectX::XMFLOAT3 OtherBoidPos);
-	bool CheckSamePosition(DirectX::XMFLOAT3 ThisBoidPos, DirectX::XMFLOAT3 OtherBoidPos);
+	float CalculateDistance(const DirectX::XMFLOAT4& ThisBoidPos, const DirectX::XMFLOAT4& OtherBoidPos);
+	bool CheckSamePosition(const DirectX::XMFLOAT4& ThisBoidPos, const DirectX::XMFLOAT4& OtherBoidPos);
 
 	// Calculate rules for all boids - see Fig 3.3 for simplified breakdown
-	DirectX::XMVECTOR CalculateSeparationRule(BoidObject* ThisBoid, BoidObject* OtherBoid, float Distance);
-	DirectX::XMVECTOR CalculateCohesionRule(BoidObject* ThisBoid, BoidObject* OtherBoid, float Distance);
-	DirectX::XMVECTOR CalculateAlignmentRule(BoidObject* ThisBoid, BoidObject* OtherBoid, float Distance);
+	DirectX::XMVECTOR CalculateSeparationRule(DirectX::FXMVECTOR ThisBoidPos, DirectX::FXMVECTOR OtherBoidPos, float Distance, const RuleConstants& Rule);
+	DirectX::XMVECTOR CalculateCohesionRule(DirectX::FXMVECTOR ThisBoidPos, DirectX::FXMVECTOR OtherBoidPos, float Distance, const RuleConstants& Rule);
+	DirectX::XMVECTOR CalculateAlignmentRule(DirectX::FXMVECTOR OtherBoidDir, float Distance, const RuleConstants& Rule);
+
+	// Steer away from nearest obstacle surface once within avoidance distance, stronger the closer the boid gets
+	DirectX::XMVECTOR CalculateObstacleAvoidance(DirectX::FXMVECTOR ThisBoidPos, const ModelProperties& Properties);
 
 	// Initialize random direction for boid
 	DirectX::XMFLOAT3 CalculateRandomDirection(std::mt19937 MTEngine, std::uniform_real_distribution<> RandomDistribution);
 
 	// Calculate next translation based on boid direction
-	DirectX::XMFLOAT3 CalculateNextPosition(BoidObject* Boid, float DeltaTime);
+	DirectX::XMFLOAT3 CalculateNextPosition(const BoidProperties& Boid, float BoidSpeed, float DeltaTime);
+
+	// Query implementations, grid must already be up to date so these can run from several threads at once
+	uint32_t GatherRadius(DirectX::XMFLOAT3 Center, float Radius, uint32_t* OutIndices, uint32_t Capacity) const;
+	uint32_t GatherBox(DirectX::XMFLOAT3 Min, DirectX::XMFLOAT3 Max, uint32_t* OutIndices, uint32_t Capacity) const;
+	uint32_t GatherNearest(DirectX::XMFLOAT3 Center, uint32_t K, uint32_t* OutIndices) const;
+
+	// Call function with sorted range of every occupied cell overlapping box, in any species
+	void ForEachCellInBox(DirectX::XMFLOAT3 Min, DirectX::XMFLOAT3 Max, const std::function<void(uint32_t CellStart, uint32_t CellCount)>& Function) const;
+
+	// Bin snapshot in m_UnsortedBoids and m_UnsortedSpecies into grid, filling sorted copies
+	void BuildSpatialGrid();
+
+	// Rules, apply and grid rebuild of registered boids as one task graph, grid must be up to date
+	void RunStepTaskGraph(float DeltaTime);
+
+	// Copy registration order range of snapshot in m_UnsortedBoids to step output
+	void PackStepOutput(uint32_t Begin, uint32_t End);
 
-	// Properties of Boids Model
-	ModelProperties m_ModelProperties;
+	// Fastest steering turn of last step in radians, and boids per unit volume in the most crowded cell of current grid
+	float MeasureMaximumTurn() const;
+	float MeasurePeakDensity() const;
+
+	// Build per species octrees over sorted boids
+	void BuildOctree();
+
+	// Grid cells must be at least as large as the largest rule distance so neighbours are always within adjacent cells
+	float CalculateGridCellSize();
+
+	// Properties of Boids Model, one entry per species
+	std::vector<ModelProperties> m_SpeciesProperties{ 1 };
+
+	// Species count squared entries, row is the reacting species
+	std::vector<SpeciesInteraction> m_SpeciesInteractions{ 1 };
+	std::vector<SpeciesPairConstants> m_SpeciesPairConstants;
+
+	// Bit per rule slot, set when any species uses that rule
+	uint32_t m_ActiveRules = 7;
 
 	std::vector<BoidObject*> m_RegisteredBoids;
+
+	// Registry, slot of every registered boid by registration index and slots by handle index
+	std::vector<uint32_t> m_RegisteredSlots;
+	std::vector<BoidSlot> m_BoidSlots;
+	uint32_t m_FreeBoidSlot = UINT32_MAX;
+
+	// Pooled boid objects, freed ones are reused before another slab is allocated
+	static const uint32_t BoidSlabSize = 1024;
+	std::vector<std::unique_ptr<BoidObject[]>> m_BoidSlabs;
+	std::vector<BoidObject*> m_FreeBoidObjects;
 	BoundingBox m_Bounds;
+
+	const BoidObstacleField* m_ObstacleField = nullptr;
+
+	// Drained commands and batches built from them, reused between steps
+	BoidCommandQueue* m_CommandQueue = nullptr;
+	std::vector<BoidCommand> m_QueuedCommands;
+	std::vector<BoidObject> m_QueuedSpawns;
+	std::vector<BoidHandle> m_QueuedDespawns;
+	std::vector<const BoidCommand*> m_QueuedImpulses;
+
+	// Last properties queued per species, only grows with the species count and is left all null after every drain
+	std::vector<const ModelProperties*> m_QueuedProperties;
+
+	BoidStepProfiler* m_StepProfiler = nullptr;
+	BoidFlockAnalytics* m_FlockAnalytics = nullptr;
+
+	// Task graph of last step, rebuilt every step into the same storage
+	// Rules and apply tasks cover whole cells of about StepTaskBoids boids, grid and output tasks fixed ranges of StepTaskGrain
+	static const uint32_t StepTaskBoids = 1024;
+	static const uint32_t StepTaskGrain = 4096;
+	StepScheduling m_StepScheduling = StepScheduling::TaskGraph;
+	BoidTaskGraph m_StepGraph;
+	bool m_StepGraphRan = false;
+
+	BoidProperties* m_StepOutput = nullptr;
+	uint32_t m_StepOutputCapacity = 0;
+	uint32_t m_StepOutputCount = 0;
+
+	BoidSubStepSettings m_SubStepSettings;
+	BoidSubStepReport m_SubStepReport = { 1, 0, 0, 0 };
+
+	// Spatial grid over current positions, rebuilt at end of every step so renderer and next step share it
+	BoidSpatialGrid m_SpatialGrid;
+	bool m_SpatialGridDirty = true;
+
+	// Octree over sorted boids, only built alongside the grid in Barnes-Hut mode
+	NeighbourSearchMode m_NeighbourSearchMode = NeighbourSearchMode::SpatialGrid;
+	float m_BarnesHutOpeningAngle = 0.5f;
+
+	// Seven neighbours, as observed in starling flocks
+	uint32_t m_TopologicalNeighbourCount = 7;
+
+	RulePrecision m_RulePrecision = RulePrecision::Exact;
+	bool m_NewtonRefinement = true;
+	BoidOctree m_Octree;
+	std::vector<uint32_t> m_OctreeSpeciesStart;
+
+	// Boids in registration order and grid order, reused between frames to avoid reallocating
+	// Grid order arrays are first written by the thread pool, so on multi-node machines each node's share of them is local to it
+	BoidLargeVector<BoidProperties> m_UnsortedBoids;
+	BoidLargeVector<BoidProperties> m_SortedBoids;
+	BoidLargeVector<uint32_t> m_UnsortedSpecies;
+	BoidLargeVector<uint32_t> m_SortedSpecies;
+
+	// Results of current step in grid order
+	BoidLargeVector<DirectX::XMFLOAT3> m_NewBoidPos;
+	BoidLargeVector<DirectX::XMFLOAT3> m_NewBoidDir;
+
+	// Cosine of each boid's steering turn this step, taken before bouncing off the box so bounces do not count as turns
+	BoidLargeVector<float> m_NewBoidTurn;
 };
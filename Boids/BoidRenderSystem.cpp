@@ -1,10 +1,14 @@
 #include "BoidRenderSystem.h"
 
+#include <algorithm>
+#include "BoidThreadPool.h"
+
 using namespace DirectX;
 
 BoidRenderSystem::BoidRenderSystem(CommandList& commandList)
 {
 	InitializePyramidVerticesAndIndices();
+	InitializeLowDetailVerticesAndIndices();
 	InitializeBuffers(commandList);
 }
 
@@ -15,7 +19,352 @@ void BoidRenderSystem::RenderBoids(CommandList& commandList, int amount)
 	commandList.SetIndexBuffer(m_BoidIndexBuffer);
 
 	// Custom command list calls DrawIndexedInstanced allowing for mesh instancing
-	commandList.DrawIndexed(m_NumOfIndices, amount);
+	const BoidLodMesh& Mesh = m_LodMeshes[0];
+	commandList.DrawIndexed(Mesh.IndexCount, amount, Mesh.StartIndex, Mesh.BaseVertex);
+}
+
+void BoidRenderSystem::RenderBoidLods(CommandList& commandList, UINT InstanceOffsetRootParameter)
+{
+	commandList.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	commandList.SetVertexBuffer(0, m_BoidVertexBuffer);
+	commandList.SetIndexBuffer(m_BoidIndexBuffer);
+
+	// One instanced draw per level of detail, each reading its own contiguous range of instances
+	for (int Lod = 0; Lod < LodCount; Lod++)
+	{
+		if (m_LodInstanceCount[Lod] == 0)
+		{
+			continue;
+		}
+
+		const BoidLodMesh& Mesh = m_LodMeshes[Lod];
+		commandList.SetGraphics32BitConstants(InstanceOffsetRootParameter, 1, &m_LodInstanceStart[Lod]);
+		commandList.DrawIndexed(Mesh.IndexCount, m_LodInstanceCount[Lod], Mesh.StartIndex, Mesh.BaseVertex);
+	}
+}
+
+void BoidRenderSystem::CullBoids(BoidPhysicsSystem& PhysicsSystem, FXMMATRIX View, CXMMATRIX Projection)
+{
+	// Make sure grid matches current boids before reading from it
+	PhysicsSystem.UpdateSpatialGrid();
+
+	const BoidSpatialGrid& Grid = PhysicsSystem.GetSpatialGrid();
+	const BoidLargeVector<BoidProperties>& SortedBoids = PhysicsSystem.GetSortedBoidProperties();
+	const std::vector<SpatialGridCell>& Cells = Grid.GetOccupiedCells();
+
+	uint32_t NumberOfBoids = static_cast<uint32_t>(SortedBoids.size());
+	uint32_t NumberOfCells = static_cast<uint32_t>(Cells.size());
+
+	m_VisibleBoids.resize(NumberOfBoids);
+	m_BoidLods.resize(NumberOfBoids);
+	m_CellLod.resize(NumberOfCells);
+	m_CellLodCounts.resize(NumberOfCells * LodCount);
+	m_CellLodOffsets.resize(NumberOfCells * LodCount);
+
+	XMMATRIX ViewProjection = XMMatrixMultiply(View, Projection);
+
+	CullingView Culling;
+	Culling.Frustum = CalculateFrustum(ViewProjection);
+	Culling.ProjectedRadiusScale = m_BoidBoundingRadius * XMVectorGetY(Projection.r[1]);
+
+	// Perspective projection writes view depth into w, so fourth column of view projection gives depth of any point
+	XMStoreFloat4(&Culling.DepthPlane, XMMatrixTranspose(ViewProjection).r[3]);
+
+	// Border cells may hold boids clamped in from outside the box, so their bounds can't be trusted for whole cell tests
+	bool TrustBorderCells = !Grid.HasBoidsOutsideBounds();
+	XMINT3 Dimensions = Grid.GetDimensions();
+
+	// First pass classifies cells and counts visible boids per cell and level of detail
+	BoidThreadPool::Get().ParallelFor(NumberOfCells, 8, [&](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t c = Begin; c < End; c++)
+		{
+			const SpatialGridCell& Cell = Cells[c];
+			uint32_t* LodCounts = &m_CellLodCounts[c * LodCount];
+			std::fill(LodCounts, LodCounts + LodCount, 0);
+
+			bool BorderCell = Cell.Coord.x == 0 || Cell.Coord.y == 0 || Cell.Coord.z == 0 ||
+							  Cell.Coord.x == Dimensions.x - 1 || Cell.Coord.y == Dimensions.y - 1 || Cell.Coord.z == Dimensions.z - 1;
+
+			XMFLOAT3 CellMin, CellMax;
+			Grid.GetCellBounds(Cell.Coord, CellMin, CellMax);
+
+			CellVisibility Visibility = CellVisibility::Intersecting;
+			if (TrustBorderCells || !BorderCell)
+			{
+				Visibility = ClassifyCell(Culling.Frustum, CellMin, CellMax);
+			}
+
+			m_CellLod[c] = -1;
+			if (Visibility == CellVisibility::Outside)
+			{
+				// Second pass reads per boid levels of cells without one, so stale levels from last frame must not survive
+				std::fill(m_BoidLods.begin() + Cell.Start, m_BoidLods.begin() + Cell.Start + Cell.Count, static_cast<uint8_t>(0));
+				continue;
+			}
+
+			// Fully visible cell close enough to one level of detail needs no per boid work at all
+			if (Visibility == CellVisibility::Inside)
+			{
+				m_CellLod[c] = CalculateCellLod(Culling, CellMin, CellMax);
+				if (m_CellLod[c] >= 0)
+				{
+					LodCounts[m_CellLod[c]] = Cell.Count;
+					continue;
+				}
+			}
+
+			CullCellBoids(Culling, &SortedBoids[Cell.Start], &m_BoidLods[Cell.Start], Cell.Count, LodCounts);
+		}
+	});
+
+	// Prefix sum in level of detail order, then cell order, so each level is one contiguous range still in grid order
+	m_VisibleBoidCount = 0;
+	for (int Lod = 0; Lod < LodCount; Lod++)
+	{
+		m_LodInstanceStart[Lod] = m_VisibleBoidCount;
+		for (uint32_t c = 0; c < NumberOfCells; c++)
+		{
+			m_CellLodOffsets[c * LodCount + Lod] = m_VisibleBoidCount;
+			m_VisibleBoidCount += m_CellLodCounts[c * LodCount + Lod];
+		}
+		m_LodInstanceCount[Lod] = m_VisibleBoidCount - m_LodInstanceStart[Lod];
+	}
+	m_CullInputBoidCount = NumberOfBoids;
+
+	// Second pass writes each visible boid once, straight into its level of detail range
+	BoidThreadPool::Get().ParallelFor(NumberOfCells, 8, [&](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		for (uint32_t c = Begin; c < End; c++)
+		{
+			const SpatialGridCell& Cell = Cells[c];
+			uint32_t* WriteIndex = &m_CellLodOffsets[c * LodCount];
+
+			if (m_CellLod[c] >= 0)
+			{
+				std::copy(SortedBoids.begin() + Cell.Start, SortedBoids.begin() + Cell.Start + Cell.Count, m_VisibleBoids.begin() + WriteIndex[m_CellLod[c]]);
+				continue;
+			}
+
+			for (uint32_t i = Cell.Start; i < Cell.Start + Cell.Count; i++)
+			{
+				if (m_BoidLods[i] > 0)
+				{
+					m_VisibleBoids[WriteIndex[m_BoidLods[i] - 1]++] = SortedBoids[i];
+				}
+			}
+		}
+	});
+}
+
+const std::vector<BoidProperties>& BoidRenderSystem::GetVisibleBoidProperties() const
+{
+	return m_VisibleBoids;
+}
+
+UINT BoidRenderSystem::GetVisibleBoidCount() const
+{
+	return m_VisibleBoidCount;
+}
+
+UINT BoidRenderSystem::GetLodInstanceStart(int Lod) const
+{
+	return m_LodInstanceStart[Lod];
+}
+
+UINT BoidRenderSystem::GetLodInstanceCount(int Lod) const
+{
+	return m_LodInstanceCount[Lod];
+}
+
+float BoidRenderSystem::GetVisibleFraction() const
+{
+	if (m_CullInputBoidCount == 0)
+	{
+		return 1.0f;
+	}
+
+	return static_cast<float>(m_VisibleBoidCount) / static_cast<float>(m_CullInputBoidCount);
+}
+
+void BoidRenderSystem::BakeVisibleBoidTransforms()
+{
+	m_InstanceTransforms.resize(m_VisibleBoids.size());
+	BakeBoidInstanceTransformsParallel(m_VisibleBoids.data(), m_InstanceTransforms.data(), m_VisibleBoidCount);
+}
+
+const std::vector<BoidInstanceTransform>& BoidRenderSystem::GetInstanceTransforms() const
+{
+	return m_InstanceTransforms;
+}
+
+BoidFrustum BoidRenderSystem::CalculateFrustum(FXMMATRIX ViewProjection)
+{
+	// Planes come from sums and differences of the matrix columns (Gribb-Hartmann), rows after transposing
+	XMMATRIX Columns = XMMatrixTranspose(ViewProjection);
+
+	XMVECTOR Planes[6] =
+	{
+		Columns.r[3] + Columns.r[0], // Left
+		Columns.r[3] - Columns.r[0], // Right
+		Columns.r[3] + Columns.r[1], // Bottom
+		Columns.r[3] - Columns.r[1], // Top
+		Columns.r[2],				 // Near, clip space depth starts at 0
+		Columns.r[3] - Columns.r[2], // Far
+	};
+
+	BoidFrustum Frustum;
+	for (int i = 0; i < 6; i++)
+	{
+		XMStoreFloat4(&Frustum.Planes[i], XMPlaneNormalize(Planes[i]));
+	}
+
+	return Frustum;
+}
+
+BoidRenderSystem::CellVisibility BoidRenderSystem::ClassifyCell(const BoidFrustum& Frustum, XMFLOAT3 Min, XMFLOAT3 Max) const
+{
+	XMVECTOR BoxMin = XMLoadFloat3(&Min);
+	XMVECTOR BoxMax = XMLoadFloat3(&Max);
+
+	XMVECTOR Center = (BoxMin + BoxMax) * 0.5f;
+	XMVECTOR Extents = (BoxMax - BoxMin) * 0.5f;
+	Center = XMVectorSetW(Center, 1.0f);
+
+	CellVisibility Visibility = CellVisibility::Inside;
+	for (int i = 0; i < 6; i++)
+	{
+		XMVECTOR Plane = XMLoadFloat4(&Frustum.Planes[i]);
+
+		// Projected box radius onto plane normal, grown by boid radius so boids poking out of the cell are kept
+		float Radius = XMVectorGetX(XMVector3Dot(XMVectorAbs(Plane), Extents)) + m_BoidBoundingRadius;
+		float Distance = XMVectorGetX(XMVector4Dot(Plane, Center));
+
+		if (Distance < -Radius)
+		{
+			return CellVisibility::Outside;
+		}
+		if (Distance < Radius)
+		{
+			Visibility = CellVisibility::Intersecting;
+		}
+	}
+
+	return Visibility;
+}
+
+int BoidRenderSystem::CalculateCellLod(const CullingView& View, XMFLOAT3 Min, XMFLOAT3 Max) const
+{
+	XMVECTOR BoxMin = XMLoadFloat3(&Min);
+	XMVECTOR BoxMax = XMLoadFloat3(&Max);
+
+	XMVECTOR Center = XMVectorSetW((BoxMin + BoxMax) * 0.5f, 1.0f);
+	XMVECTOR Extents = (BoxMax - BoxMin) * 0.5f;
+
+	// Depth is linear, so nearest and furthest boid depths are bounded by the box's projected extent
+	XMVECTOR DepthPlane = XMLoadFloat4(&View.DepthPlane);
+	float CenterDepth = XMVectorGetX(XMVector4Dot(DepthPlane, Center));
+	float DepthExtent = XMVectorGetX(XMVector3Dot(XMVectorAbs(DepthPlane), Extents));
+
+	float NearestDepth = std::max(CenterDepth - DepthExtent, 0.0001f);
+	float FurthestDepth = std::max(CenterDepth + DepthExtent, 0.0001f);
+
+	int NearestLod = CalculateLod(View.ProjectedRadiusScale / NearestDepth);
+	int FurthestLod = CalculateLod(View.ProjectedRadiusScale / FurthestDepth);
+
+	return NearestLod == FurthestLod ? NearestLod : -1;
+}
+
+int BoidRenderSystem::CalculateLod(float ProjectedSize) const
+{
+	// Thresholds are in decreasing order, each one passed drops a level of detail
+	int Lod = 0;
+	for (int i = 0; i < LodCount - 1; i++)
+	{
+		Lod += ProjectedSize < m_LodProjectedSizeThresholds[i];
+	}
+
+	return Lod;
+}
+
+void BoidRenderSystem::CullCellBoids(const CullingView& View, const BoidProperties* Boids, uint8_t* BoidLods, uint32_t Count, uint32_t* LodCounts) const
+{
+	// Splat plane components so four boids can be tested against a plane with one multiply-add chain
+	XMVECTOR PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+	for (int i = 0; i < 6; i++)
+	{
+		XMVECTOR Plane = XMLoadFloat4(&View.Frustum.Planes[i]);
+		PlaneX[i] = XMVectorSplatX(Plane);
+		PlaneY[i] = XMVectorSplatY(Plane);
+		PlaneZ[i] = XMVectorSplatZ(Plane);
+		PlaneW[i] = XMVectorSplatW(Plane);
+	}
+	XMVECTOR NegativeRadius = XMVectorReplicate(-m_BoidBoundingRadius);
+
+	XMVECTOR DepthPlane = XMLoadFloat4(&View.DepthPlane);
+	XMVECTOR DepthX = XMVectorSplatX(DepthPlane);
+	XMVECTOR DepthY = XMVectorSplatY(DepthPlane);
+	XMVECTOR DepthZ = XMVectorSplatZ(DepthPlane);
+	XMVECTOR DepthW = XMVectorSplatW(DepthPlane);
+	XMVECTOR MinimumDepth = XMVectorReplicate(0.0001f);
+	XMVECTOR ProjectedRadiusScale = XMVectorReplicate(View.ProjectedRadiusScale);
+
+	XMVECTOR Zero = XMVectorZero();
+	XMVECTOR One = XMVectorSplatOne();
+
+	for (uint32_t i = 0; i < Count; i += 4)
+	{
+		// Transpose four positions into x, y and z lanes, repeating the last boid if fewer than four remain
+		uint32_t Remaining = std::min(Count - i, 4u);
+		XMMATRIX Positions(XMLoadFloat4(&Boids[i].BoidPosition),
+						   XMLoadFloat4(&Boids[i + std::min(1u, Remaining - 1)].BoidPosition),
+						   XMLoadFloat4(&Boids[i + std::min(2u, Remaining - 1)].BoidPosition),
+						   XMLoadFloat4(&Boids[i + std::min(3u, Remaining - 1)].BoidPosition));
+		Positions = XMMatrixTranspose(Positions);
+
+		XMVECTOR InsideMask = XMVectorTrueInt();
+		for (int p = 0; p < 6; p++)
+		{
+			XMVECTOR Distance = XMVectorMultiplyAdd(Positions.r[0], PlaneX[p], PlaneW[p]);
+			Distance = XMVectorMultiplyAdd(Positions.r[1], PlaneY[p], Distance);
+			Distance = XMVectorMultiplyAdd(Positions.r[2], PlaneZ[p], Distance);
+
+			InsideMask = XMVectorAndInt(InsideMask, XMVectorGreaterOrEqual(Distance, NegativeRadius));
+		}
+
+		// Projected size from view depth, then count thresholds passed to get level of detail per lane
+		XMVECTOR Depth = XMVectorMultiplyAdd(Positions.r[0], DepthX, DepthW);
+		Depth = XMVectorMultiplyAdd(Positions.r[1], DepthY, Depth);
+		Depth = XMVectorMultiplyAdd(Positions.r[2], DepthZ, Depth);
+		XMVECTOR ProjectedSize = ProjectedRadiusScale / XMVectorMax(Depth, MinimumDepth);
+
+		XMVECTOR Lod = Zero;
+		for (int t = 0; t < LodCount - 1; t++)
+		{
+			Lod += XMVectorSelect(Zero, One, XMVectorLess(ProjectedSize, XMVectorReplicate(m_LodProjectedSizeThresholds[t])));
+		}
+
+		XMUINT4 Mask;
+		XMStoreUInt4(&Mask, InsideMask);
+		XMFLOAT4 Lods;
+		XMStoreFloat4(&Lods, Lod);
+
+		uint32_t LaneMasks[4] = { Mask.x, Mask.y, Mask.z, Mask.w };
+		float LaneLods[4] = { Lods.x, Lods.y, Lods.z, Lods.w };
+
+		for (uint32_t Lane = 0; Lane < Remaining; Lane++)
+		{
+			if (LaneMasks[Lane] == 0)
+			{
+				BoidLods[i + Lane] = 0;
+				continue;
+			}
+
+			int LaneLod = static_cast<int>(LaneLods[Lane]);
+			BoidLods[i + Lane] = static_cast<uint8_t>(LaneLod + 1);
+			LodCounts[LaneLod]++;
+		}
+	}
 }
 
 void BoidRenderSystem::InitializePyramidVerticesAndIndices()
@@ -50,16 +399,64 @@ void BoidRenderSystem::InitializePyramidVerticesAndIndices()
 		0,5,10
 	};
 
-	int VerticesArraySize = sizeof(PyramidVertices) / sizeof(PyramidVertices[0]);
-	for (int i = 0; i < VerticesArraySize; i++)
+	AddLodMesh(PyramidVertices, _countof(PyramidVertices), PyramidIndices, _countof(PyramidIndices));
+}
+
+void BoidRenderSystem::InitializeLowDetailVerticesAndIndices()
+{
+	// Pyramid sides only, base is rarely visible once boids are small on screen
+	VertexPosColour SidesVertices[5] =
+	{
+		{XMFLOAT3(-1,0,1),  XMFLOAT3(0,1,0)}, // Back Left     0
+		{XMFLOAT3(1,0,1),	XMFLOAT3(0,1,0)}, // Back Right    1
+		{XMFLOAT3(1,0, -1), XMFLOAT3(0,1,0)}, // Front Right   2
+		{XMFLOAT3(-1,0, -1),XMFLOAT3(0,1,0)}, // Front Left	3
+		{XMFLOAT3(0,2,0),	XMFLOAT3(0,1,0)}, // Top           4
+	};
+
+	uint16_t SidesIndices[12] =
+	{
+		4,1,0,
+		4,2,1,
+		4,3,2,
+		4,0,3
+	};
+
+	AddLodMesh(SidesVertices, _countof(SidesVertices), SidesIndices, _countof(SidesIndices));
+
+	// Single triangle impostor, indexed with both windings so it survives back face culling from either side
+	VertexPosColour ImpostorVertices[3] =
+	{
+		{XMFLOAT3(-1,0,0),  XMFLOAT3(0,1,0)}, // Left          0
+		{XMFLOAT3(1,0,0),	XMFLOAT3(0,1,0)}, // Right         1
+		{XMFLOAT3(0,2,0),	XMFLOAT3(0,1,0)}, // Top           2
+	};
+
+	uint16_t ImpostorIndices[6] =
 	{
-		m_Vertices.push_back(PyramidVertices[i]);
+		2,1,0,
+		2,0,1
+	};
+
+	AddLodMesh(ImpostorVertices, _countof(ImpostorVertices), ImpostorIndices, _countof(ImpostorIndices));
+}
+
+void BoidRenderSystem::AddLodMesh(const VertexPosColour* Vertices, int VertexCount, const uint16_t* Indices, int IndexCount)
+{
+	BoidLodMesh Mesh;
+	Mesh.IndexCount = IndexCount;
+	Mesh.StartIndex = static_cast<UINT>(m_Indicies.size());
+	Mesh.BaseVertex = static_cast<INT>(m_Vertices.size());
+	m_LodMeshes.push_back(Mesh);
+
+	for (int i = 0; i < VertexCount; i++)
+	{
+		m_Vertices.push_back(Vertices[i]);
 	}
 
-	int IndiciesArraySize = sizeof(PyramidIndices) / sizeof(PyramidIndices[0]);
-	for (int i = 0; i < IndiciesArraySize; i++)
+	for (int i = 0; i < IndexCount; i++)
 	{
-		m_Indicies.push_back(PyramidIndices[i]);
+		m_Indicies.push_back(Indices[i]);
 	}
 }
 
@@ -72,6 +469,4 @@ void BoidRenderSystem::InitializeBuffers(CommandList& commandList)
 
 	commandList.CopyVertexBuffer(m_BoidVertexBuffer, m_Vertices);
 	commandList.CopyIndexBuffer(m_BoidIndexBuffer, m_Indicies);
-
-	m_NumOfIndices = m_Indicies.size();
 }
\ No newline at end of file
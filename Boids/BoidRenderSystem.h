@@ -4,6 +4,8 @@
 #include <IndexBuffer.h>
 #include <DirectXMath.h>
 #include <CommandList.h>
+#include "BoidPhysicsSystem.h"
+#include "BoidTransformBaker.h"
 
 struct VertexPosColour
 {
@@ -11,16 +13,96 @@ struct VertexPosColour
 	DirectX::XMFLOAT3 Colour;
 };
 
+// Six inward facing planes of camera frustum, normalized so plane distances are in world units
+struct BoidFrustum
+{
+	DirectX::XMFLOAT4 Planes[6];
+};
+
+// Range of the shared vertex and index buffers holding one level of detail
+struct BoidLodMesh
+{
+	UINT IndexCount;
+	UINT StartIndex;
+	INT BaseVertex;
+};
+
 class BoidRenderSystem
 {
 public:
+	// Full pyramid, pyramid without base, then a single triangle impostor
+	static const int LodCount = 3;
+
 	BoidRenderSystem(CommandList& commandList);
 
-	// Render all boids using mesh instancing
+	// Render all boids using mesh instancing, always with the most detailed mesh
 	void RenderBoids(CommandList& commandList, int amount = 1);
 
+	// Render culled boids with one instanced draw per level of detail
+	// Each draw passes its first instance through root constants at given root parameter, as SV_InstanceID restarts per draw
+	void RenderBoidLods(CommandList& commandList, UINT InstanceOffsetRootParameter);
+
+	// Cull CPU boids against camera frustum, compacting visible boids in grid order ready for upload
+	// Whole grid cells are accepted or rejected first, only cells crossing the frustum are tested per boid
+	// Visible boids are written straight into contiguous ranges per level of detail, picked from projected size
+	void CullBoids(BoidPhysicsSystem& PhysicsSystem, DirectX::FXMMATRIX View, DirectX::CXMMATRIX Projection);
+
+	// Visible boids from last cull, only the first GetVisibleBoidCount() entries are valid
+	const std::vector<BoidProperties>& GetVisibleBoidProperties() const;
+	UINT GetVisibleBoidCount() const;
+
+	// Range of visible boids drawn with given level of detail
+	UINT GetLodInstanceStart(int Lod) const;
+	UINT GetLodInstanceCount(int Lod) const;
+
+	// Fraction of boids that survived last cull
+	float GetVisibleFraction() const;
+
+	// Bake rotation and translation of every visible boid, so the baked vertex shader only has to apply them
+	void BakeVisibleBoidTransforms();
+
+	// Baked transforms of visible boids, only the first GetVisibleBoidCount() entries are valid
+	const std::vector<BoidInstanceTransform>& GetInstanceTransforms() const;
+
+	// Extract frustum planes from combined view projection matrix
+	static BoidFrustum CalculateFrustum(DirectX::FXMMATRIX ViewProjection);
+
 protected:
+	enum class CellVisibility
+	{
+		Outside,
+		Intersecting,
+		Inside
+	};
+
+	// Camera data needed for culling and picking level of detail
+	struct CullingView
+	{
+		BoidFrustum Frustum;
+
+		// Clip space w as a plane, giving view depth of a point
+		DirectX::XMFLOAT4 DepthPlane;
+
+		// Projected radius of boid bounding sphere at unit depth, in normalized device units
+		float ProjectedRadiusScale;
+	};
+
+	// Test box grown by boid radius against frustum
+	CellVisibility ClassifyCell(const BoidFrustum& Frustum, DirectX::XMFLOAT3 Min, DirectX::XMFLOAT3 Max) const;
+
+	// Level of detail shared by every boid in box, or -1 if the box spans more than one
+	int CalculateCellLod(const CullingView& View, DirectX::XMFLOAT3 Min, DirectX::XMFLOAT3 Max) const;
+	int CalculateLod(float ProjectedSize) const;
+
+	// Test each boid of a cell against frustum four at a time, storing 0 if culled or level of detail + 1 if visible
+	// Adds visible boids per level of detail to LodCounts
+	void CullCellBoids(const CullingView& View, const BoidProperties* Boids, uint8_t* BoidLods, uint32_t Count, uint32_t* LodCounts) const;
+
 	void InitializePyramidVerticesAndIndices();
+	void InitializeLowDetailVerticesAndIndices();
+
+	// Append mesh to shared vertex and index data, recording it as the next level of detail
+	void AddLodMesh(const VertexPosColour* Vertices, int VertexCount, const uint16_t* Indices, int IndexCount);
 
 	// Initialize vertex and index buffers
 	void InitializeBuffers(CommandList& commandList);
@@ -31,5 +113,25 @@ protected:
 	VertexBuffer m_BoidVertexBuffer;
 	IndexBuffer m_BoidIndexBuffer;
 
-	UINT m_NumOfIndices;
+	// All levels of detail live in the same buffers
+	std::vector<BoidLodMesh> m_LodMeshes;
+
+	// Smallest projected size, in normalized device units, drawn with each level of detail, last level takes the rest
+	float m_LodProjectedSizeThresholds[LodCount - 1] = { 0.03f, 0.01f };
+
+	// Radius of sphere around boid origin containing whole pyramid mesh
+	float m_BoidBoundingRadius = 2.0f;
+
+	// Culling results, per cell counts are kept between frames to avoid reallocating
+	std::vector<BoidProperties> m_VisibleBoids;
+	std::vector<int> m_CellLod;
+	std::vector<uint32_t> m_CellLodCounts;
+	std::vector<uint32_t> m_CellLodOffsets;
+	std::vector<uint8_t> m_BoidLods;
+	UINT m_LodInstanceStart[LodCount] = {};
+	UINT m_LodInstanceCount[LodCount] = {};
+	UINT m_VisibleBoidCount = 0;
+	UINT m_CullInputBoidCount = 0;
+
+	std::vector<BoidInstanceTransform> m_InstanceTransforms;
 };
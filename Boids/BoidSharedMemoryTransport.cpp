@@ -0,0 +1,299 @@
+#include "BoidSharedMemoryTransport.h"
+
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+BoidSharedMemoryTransport::BoidSharedMemoryTransport(const std::string& Name, uint32_t Rank, uint32_t RankCount, uint32_t MailboxCapacity)
+	: m_Name(Name), m_Rank(Rank), m_RankCount(RankCount), m_MailboxCapacity(MailboxCapacity)
+{
+	if (Rank >= RankCount || MailboxCapacity == 0)
+	{
+		return;
+	}
+
+	// Payload rounded up so every header stays cache line aligned, mailboxes start on the line after the attached flags
+	m_MailboxStride = sizeof(MailboxHeader) + (MailboxCapacity + alignof(MailboxHeader) - 1) / alignof(MailboxHeader) * alignof(MailboxHeader);
+	m_MailboxOffset = (sizeof(SegmentHeader) + RankCount * sizeof(std::atomic<uint32_t>) + alignof(MailboxHeader) - 1) / alignof(MailboxHeader) * alignof(MailboxHeader);
+	m_SegmentSize = m_MailboxOffset + m_MailboxStride * RankCount * RankCount;
+
+	// Retiring removes the name, so a second attempt either creates the segment or joins one this run made
+	const uint32_t AttemptCount = 3;
+	bool Retired = true;
+	for (uint32_t Attempt = 0; Attempt < AttemptCount && Retired; Attempt++)
+	{
+		OpenSegment(Retired);
+	}
+}
+
+bool BoidSharedMemoryTransport::OpenSegment(bool& Retired)
+{
+	Retired = false;
+
+#ifndef _WIN32
+	bool Created = true;
+	int File = shm_open(m_Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (File < 0 && errno == EEXIST)
+	{
+		Created = false;
+		File = shm_open(m_Name.c_str(), O_RDWR, 0600);
+	}
+
+	if (File < 0)
+	{
+		return false;
+	}
+
+	const std::chrono::steady_clock::time_point Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_TimeoutMilliseconds);
+
+	if (Created)
+	{
+		if (ftruncate(File, static_cast<off_t>(m_SegmentSize)) != 0)
+		{
+			close(File);
+			shm_unlink(m_Name.c_str());
+			return false;
+		}
+	}
+	else
+	{
+		// Creator may not have sized it yet, any other size is a segment with different ranks or capacity
+		struct stat Status;
+		while (fstat(File, &Status) == 0 && static_cast<size_t>(Status.st_size) != m_SegmentSize)
+		{
+			if (Status.st_size != 0 || std::chrono::steady_clock::now() > Deadline)
+			{
+				close(File);
+				return false;
+			}
+
+			std::this_thread::yield();
+		}
+	}
+
+	void* Mapping = mmap(nullptr, m_SegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+	close(File);
+
+	if (Mapping == MAP_FAILED)
+	{
+		if (Created)
+		{
+			shm_unlink(m_Name.c_str());
+		}
+		return false;
+	}
+
+	uint8_t* Segment = static_cast<uint8_t*>(Mapping);
+	SegmentHeader* Header = reinterpret_cast<SegmentHeader*>(Segment);
+	std::atomic<uint32_t>* Attached = reinterpret_cast<std::atomic<uint32_t>*>(Segment + sizeof(SegmentHeader));
+
+	if (Created)
+	{
+		// New pages are zero, but nothing relies on that, every flag and mailbox is reset before the magic says it is usable
+		for (uint32_t Rank = 0; Rank < m_RankCount; Rank++)
+		{
+			Attached[Rank].store(0, std::memory_order_relaxed);
+		}
+
+		for (uint32_t Mailbox = 0; Mailbox < m_RankCount * m_RankCount; Mailbox++)
+		{
+			MailboxHeader* Reset = reinterpret_cast<MailboxHeader*>(Segment + m_MailboxOffset + Mailbox * m_MailboxStride);
+			Reset->Full.store(0, std::memory_order_relaxed);
+			Reset->Size = 0;
+			Reset->Final = 0;
+		}
+
+		Header->RankCount = m_RankCount;
+		Header->MailboxCapacity = m_MailboxCapacity;
+		Header->Magic.store(MagicValue, std::memory_order_release);
+	}
+	else
+	{
+		uint32_t Magic = Header->Magic.load(std::memory_order_acquire);
+		while (Magic != MagicValue)
+		{
+			if (Magic == RetiredValue || std::chrono::steady_clock::now() > Deadline)
+			{
+				Retired = Magic == RetiredValue;
+				munmap(Segment, m_SegmentSize);
+				return false;
+			}
+
+			std::this_thread::yield();
+			Magic = Header->Magic.load(std::memory_order_acquire);
+		}
+
+		// Same size can still be a different split between ranks and capacity, mailboxes would not line up
+		if (Header->RankCount != m_RankCount || Header->MailboxCapacity != m_MailboxCapacity)
+		{
+			munmap(Segment, m_SegmentSize);
+			return false;
+		}
+	}
+
+	// Only one rank wins the retirement, so the name it unlinks is still the leftover and never a segment of this run
+	if (Attached[m_Rank].exchange(1, std::memory_order_acq_rel) != 0)
+	{
+		uint32_t Magic = MagicValue;
+		if (Header->Magic.compare_exchange_strong(Magic, RetiredValue, std::memory_order_acq_rel))
+		{
+			shm_unlink(m_Name.c_str());
+		}
+
+		Retired = true;
+		munmap(Segment, m_SegmentSize);
+		return false;
+	}
+
+	m_Segment = Segment;
+	return true;
+#else
+	return false;
+#endif
+}
+
+BoidSharedMemoryTransport::~BoidSharedMemoryTransport()
+{
+#ifndef _WIN32
+	if (m_Segment)
+	{
+		// Name disappears once rank 0 is done, ranks still mapped keep their view
+		// A retired segment's name was already removed and may now belong to its replacement
+		bool IsRetired = GetHeader()->Magic.load(std::memory_order_acquire) == RetiredValue;
+		munmap(m_Segment, m_SegmentSize);
+
+		if (m_Rank == 0 && !IsRetired)
+		{
+			shm_unlink(m_Name.c_str());
+		}
+	}
+#endif
+}
+
+bool BoidSharedMemoryTransport::IsOpen() const
+{
+	return m_Segment != nullptr;
+}
+
+uint32_t BoidSharedMemoryTransport::GetRank() const
+{
+	return m_Rank;
+}
+
+uint32_t BoidSharedMemoryTransport::GetRankCount() const
+{
+	return m_RankCount;
+}
+
+void BoidSharedMemoryTransport::SetTimeout(uint32_t Milliseconds)
+{
+	m_TimeoutMilliseconds = Milliseconds;
+}
+
+BoidSharedMemoryTransport::SegmentHeader* BoidSharedMemoryTransport::GetHeader() const
+{
+	return reinterpret_cast<SegmentHeader*>(m_Segment);
+}
+
+BoidSharedMemoryTransport::MailboxHeader* BoidSharedMemoryTransport::GetMailbox(uint32_t From, uint32_t To) const
+{
+	return reinterpret_cast<MailboxHeader*>(m_Segment + m_MailboxOffset + (From * m_RankCount + To) * m_MailboxStride);
+}
+
+bool BoidSharedMemoryTransport::WaitForMailbox(MailboxHeader* Mailbox, uint32_t WantedFull) const
+{
+	const uint32_t SpinCount = 1024;
+
+	for (uint32_t i = 0; i < SpinCount; i++)
+	{
+		if (Mailbox->Full.load(std::memory_order_acquire) == WantedFull)
+		{
+			return true;
+		}
+	}
+
+	const std::chrono::steady_clock::time_point Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_TimeoutMilliseconds);
+
+	while (Mailbox->Full.load(std::memory_order_acquire) != WantedFull)
+	{
+		// Peers of a retired segment have moved on to its replacement, nothing here will change any more
+		if (std::chrono::steady_clock::now() > Deadline || GetHeader()->Magic.load(std::memory_order_relaxed) != MagicValue)
+		{
+			return false;
+		}
+
+		std::this_thread::yield();
+	}
+
+	return true;
+}
+
+bool BoidSharedMemoryTransport::Send(uint32_t Peer, const void* Data, uint32_t Size)
+{
+	if (!m_Segment || Peer >= m_RankCount)
+	{
+		return false;
+	}
+
+	MailboxHeader* Mailbox = GetMailbox(m_Rank, Peer);
+	uint8_t* Payload = reinterpret_cast<uint8_t*>(Mailbox) + sizeof(MailboxHeader);
+	const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+
+	// Empty messages still send one final chunk so the receiver wakes up
+	uint32_t Offset = 0;
+	do
+	{
+		if (!WaitForMailbox(Mailbox, 0))
+		{
+			return false;
+		}
+
+		uint32_t ChunkSize = std::min(Size - Offset, m_MailboxCapacity);
+		memcpy(Payload, Bytes + Offset, ChunkSize);
+		Offset += ChunkSize;
+
+		Mailbox->Size = ChunkSize;
+		Mailbox->Final = Offset == Size;
+		Mailbox->Full.store(1, std::memory_order_release);
+	} while (Offset < Size);
+
+	return true;
+}
+
+bool BoidSharedMemoryTransport::Receive(uint32_t Peer, std::vector<uint8_t>& Data)
+{
+	if (!m_Segment || Peer >= m_RankCount)
+	{
+		return false;
+	}
+
+	MailboxHeader* Mailbox = GetMailbox(Peer, m_Rank);
+	const uint8_t* Payload = reinterpret_cast<const uint8_t*>(Mailbox) + sizeof(MailboxHeader);
+
+	Data.clear();
+
+	bool Final = false;
+	while (!Final)
+	{
+		if (!WaitForMailbox(Mailbox, 1))
+		{
+			return false;
+		}
+
+		Data.insert(Data.end(), Payload, Payload + Mailbox->Size);
+		Final = Mailbox->Final != 0;
+
+		Mailbox->Full.store(0, std::memory_order_release);
+	}
+
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include "BoidTransport.h"
+
+// Transport between processes on one machine through a POSIX shared memory segment
+// Segment holds one single slot mailbox per directed pair of ranks, messages larger than a slot are sent in chunks
+// Whichever rank creates the segment resets every mailbox and then stamps its header, other ranks wait for the stamp
+// A rank finding itself already attached is looking at a segment left by an earlier run, it is retired and replaced,
+// ranks that had already joined it fail their sends and receives instead of waiting out the timeout
+// Only available on POSIX systems, elsewhere IsOpen() is always false
+class BoidSharedMemoryTransport : public BoidTransport
+{
+public:
+	// Every rank opens the same name, e.g. "/boids", segment is created by whichever rank gets there first
+	BoidSharedMemoryTransport(const std::string& Name, uint32_t Rank, uint32_t RankCount, uint32_t MailboxCapacity = 4 << 20);
+	~BoidSharedMemoryTransport();
+
+	bool IsOpen() const;
+
+	uint32_t GetRank() const override;
+	uint32_t GetRankCount() const override;
+
+	bool Send(uint32_t Peer, const void* Data, uint32_t Size) override;
+	bool Receive(uint32_t Peer, std::vector<uint8_t>& Data) override;
+
+	// Give up on a peer that has not emptied or filled its mailbox for this long
+	void SetTimeout(uint32_t Milliseconds);
+
+protected:
+	static const uint32_t MagicValue = 0x4D534842; // "BHSM"
+	static const uint32_t RetiredValue = 0x44455452; // "RTED"
+
+	// Start of segment, magic is stored last by the creator, one attached flag per rank follows it
+	struct alignas(64) SegmentHeader
+	{
+		std::atomic<uint32_t> Magic;
+		uint32_t RankCount;
+		uint32_t MailboxCapacity;
+	};
+
+	// Header of one directed mailbox, payload follows it, own cache line so neighbouring mailboxes never share one
+	struct alignas(64) MailboxHeader
+	{
+		std::atomic<uint32_t> Full;
+		uint32_t Size;
+		uint32_t Final;
+	};
+
+	// Create or join segment, false with Retired set if it was left by an earlier run and should be opened again
+	bool OpenSegment(bool& Retired);
+
+	SegmentHeader* GetHeader() const;
+	MailboxHeader* GetMailbox(uint32_t From, uint32_t To) const;
+
+	// Spin briefly, then yield, until mailbox reaches wanted state or timeout passes
+	bool WaitForMailbox(MailboxHeader* Mailbox, uint32_t WantedFull) const;
+
+	std::string m_Name;
+	uint32_t m_Rank;
+	uint32_t m_RankCount;
+	uint32_t m_MailboxCapacity;
+	uint32_t m_TimeoutMilliseconds = 30000;
+
+	size_t m_MailboxOffset = 0;
+	size_t m_MailboxStride = 0;
+	size_t m_SegmentSize = 0;
+	uint8_t* m_Segment = nullptr;
+};
@@ -0,0 +1,246 @@
+#include "BoidSlabSimulation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	bool CompareIds(const BoidSlabRecord& A, const BoidSlabRecord& B)
+	{
+		return A.Id < B.Id;
+	}
+}
+
+BoidSlabSimulation::BoidSlabSimulation(BoidTransport& Transport) : m_Transport(Transport)
+{
+	// Automatic mode may pick differently per rank, which would change neighbour order
+	m_PhysicsSystem.SetSpatialGridMode(SpatialGridMode::Dense);
+}
+
+BoidPhysicsSystem& BoidSlabSimulation::GetPhysicsSystem()
+{
+	return m_PhysicsSystem;
+}
+
+void BoidSlabSimulation::Initialize(const std::vector<BoidSlabRecord>& Boids)
+{
+	m_OwnedBoids.clear();
+
+	for (const BoidSlabRecord& Record : Boids)
+	{
+		if (CalculateOwner(Record.Boid.BoidPosition.x) == m_Transport.GetRank())
+		{
+			m_OwnedBoids.push_back(Record);
+		}
+	}
+
+	std::sort(m_OwnedBoids.begin(), m_OwnedBoids.end(), CompareIds);
+}
+
+bool BoidSlabSimulation::Step(float DeltaTime)
+{
+	const uint32_t Rank = m_Transport.GetRank();
+	const uint32_t RankCount = m_Transport.GetRankCount();
+	const float Range = m_PhysicsSystem.GetInteractionRange();
+
+	if (RankCount > 1 && GetSlabWidth() < Range)
+	{
+		return false;
+	}
+
+	const float SlabMin = GetSlabMin();
+	const float SlabMax = GetSlabMax();
+
+	// Send boids near each boundary as ghosts to the rank across it
+	m_ToLeft.clear();
+	m_ToRight.clear();
+
+	for (const BoidSlabRecord& Record : m_OwnedBoids)
+	{
+		if (Rank > 0 && Record.Boid.BoidPosition.x <= SlabMin + Range)
+		{
+			m_ToLeft.push_back(Record);
+		}
+		if (Rank + 1 < RankCount && Record.Boid.BoidPosition.x >= SlabMax - Range)
+		{
+			m_ToRight.push_back(Record);
+		}
+	}
+
+	if (!ExchangeWithNeighbours(m_ToLeft, m_ToRight, m_Incoming))
+	{
+		return false;
+	}
+
+	// Merge owned boids and ghosts in Id order, the order a single process would visit them in
+	const uint32_t OwnedCount = static_cast<uint32_t>(m_OwnedBoids.size());
+	const uint32_t Count = OwnedCount + static_cast<uint32_t>(m_Incoming.size());
+
+	std::sort(m_Incoming.begin(), m_Incoming.end(), CompareIds);
+
+	m_StepBoids.resize(Count);
+	m_StepSpecies.resize(Count);
+	m_StepIsGhost.resize(Count);
+	m_StepOwnedIndices.resize(OwnedCount);
+
+	uint32_t Owned = 0;
+	uint32_t Ghost = 0;
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		bool TakeGhost = Owned == OwnedCount || (Ghost < m_Incoming.size() && m_Incoming[Ghost].Id < m_OwnedBoids[Owned].Id);
+		const BoidSlabRecord& Record = TakeGhost ? m_Incoming[Ghost++] : m_OwnedBoids[Owned];
+
+		if (!TakeGhost)
+		{
+			m_StepOwnedIndices[Owned++] = i;
+		}
+
+		m_StepBoids[i] = Record.Boid;
+		m_StepSpecies[i] = Record.Species;
+		m_StepIsGhost[i] = TakeGhost;
+	}
+
+	m_PhysicsSystem.UpdateBoidPhysics(m_StepBoids.data(), m_StepSpecies.data(), m_StepIsGhost.data(), Count, DeltaTime);
+
+	for (uint32_t i = 0; i < OwnedCount; i++)
+	{
+		m_OwnedBoids[i].Boid = m_StepBoids[m_StepOwnedIndices[i]];
+	}
+
+	// Migrate boids that left the slab, a boid crossing more than one slab is passed on over the following steps
+	m_ToLeft.clear();
+	m_ToRight.clear();
+
+	uint32_t Kept = 0;
+	for (uint32_t i = 0; i < OwnedCount; i++)
+	{
+		uint32_t Owner = CalculateOwner(m_OwnedBoids[i].Boid.BoidPosition.x);
+
+		if (Owner < Rank)
+		{
+			m_ToLeft.push_back(m_OwnedBoids[i]);
+		}
+		else if (Owner > Rank)
+		{
+			m_ToRight.push_back(m_OwnedBoids[i]);
+		}
+		else
+		{
+			m_OwnedBoids[Kept++] = m_OwnedBoids[i];
+		}
+	}
+	m_OwnedBoids.resize(Kept);
+
+	if (!ExchangeWithNeighbours(m_ToLeft, m_ToRight, m_Incoming))
+	{
+		return false;
+	}
+
+	if (!m_Incoming.empty())
+	{
+		m_OwnedBoids.insert(m_OwnedBoids.end(), m_Incoming.begin(), m_Incoming.end());
+		std::sort(m_OwnedBoids.begin(), m_OwnedBoids.end(), CompareIds);
+	}
+
+	return true;
+}
+
+const std::vector<BoidSlabRecord>& BoidSlabSimulation::GetOwnedBoids() const
+{
+	return m_OwnedBoids;
+}
+
+bool BoidSlabSimulation::GatherToRoot(std::vector<BoidSlabRecord>& Boids)
+{
+	const uint32_t Rank = m_Transport.GetRank();
+
+	if (Rank != 0)
+	{
+		return m_Transport.Send(0, m_OwnedBoids.data(), static_cast<uint32_t>(m_OwnedBoids.size() * sizeof(BoidSlabRecord)));
+	}
+
+	Boids = m_OwnedBoids;
+
+	for (uint32_t Peer = 1; Peer < m_Transport.GetRankCount(); Peer++)
+	{
+		if (!m_Transport.Receive(Peer, m_Message))
+		{
+			return false;
+		}
+
+		size_t Offset = Boids.size();
+		Boids.resize(Offset + m_Message.size() / sizeof(BoidSlabRecord));
+		memcpy(Boids.data() + Offset, m_Message.data(), (Boids.size() - Offset) * sizeof(BoidSlabRecord));
+	}
+
+	std::sort(Boids.begin(), Boids.end(), CompareIds);
+	return true;
+}
+
+float BoidSlabSimulation::GetSlabWidth()
+{
+	return 2 * m_PhysicsSystem.GetBoundingBoxProperties().x / m_Transport.GetRankCount();
+}
+
+float BoidSlabSimulation::GetSlabMin()
+{
+	float HalfSize = m_PhysicsSystem.GetBoundingBoxProperties().x;
+	return -HalfSize + GetSlabWidth() * m_Transport.GetRank();
+}
+
+float BoidSlabSimulation::GetSlabMax()
+{
+	return GetSlabMin() + GetSlabWidth();
+}
+
+uint32_t BoidSlabSimulation::CalculateOwner(float x)
+{
+	float HalfSize = m_PhysicsSystem.GetBoundingBoxProperties().x;
+	int Slab = static_cast<int>(floorf((x + HalfSize) / GetSlabWidth()));
+
+	return static_cast<uint32_t>(std::min(std::max(Slab, 0), static_cast<int>(m_Transport.GetRankCount()) - 1));
+}
+
+bool BoidSlabSimulation::Exchange(uint32_t Peer, const std::vector<BoidSlabRecord>& Outgoing, std::vector<BoidSlabRecord>& Incoming)
+{
+	const uint32_t Size = static_cast<uint32_t>(Outgoing.size() * sizeof(BoidSlabRecord));
+	const bool SendFirst = m_Transport.GetRank() < Peer;
+
+	if (SendFirst && !m_Transport.Send(Peer, Outgoing.data(), Size))
+	{
+		return false;
+	}
+
+	if (!m_Transport.Receive(Peer, m_Message))
+	{
+		return false;
+	}
+
+	if (!SendFirst && !m_Transport.Send(Peer, Outgoing.data(), Size))
+	{
+		return false;
+	}
+
+	size_t Offset = Incoming.size();
+	Incoming.resize(Offset + m_Message.size() / sizeof(BoidSlabRecord));
+	memcpy(Incoming.data() + Offset, m_Message.data(), (Incoming.size() - Offset) * sizeof(BoidSlabRecord));
+	return true;
+}
+
+bool BoidSlabSimulation::ExchangeWithNeighbours(const std::vector<BoidSlabRecord>& ToLeft, const std::vector<BoidSlabRecord>& ToRight, std::vector<BoidSlabRecord>& Incoming)
+{
+	const uint32_t Rank = m_Transport.GetRank();
+	const bool HasLeft = Rank > 0;
+	const bool HasRight = Rank + 1 < m_Transport.GetRankCount();
+
+	Incoming.clear();
+
+	// Pairs (0, 1), (2, 3) ... exchange first, then (1, 2), (3, 4) ...
+	if (Rank % 2 == 0)
+	{
+		return (!HasRight || Exchange(Rank + 1, ToRight, Incoming)) && (!HasLeft || Exchange(Rank - 1, ToLeft, Incoming));
+	}
+
+	return (!HasLeft || Exchange(Rank - 1, ToLeft, Incoming)) && (!HasRight || Exchange(Rank + 1, ToRight, Incoming));
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "BoidPhysicsSystem.h"
+#include "BoidTransport.h"
+
+// Boid with the identity it keeps across ranks, Id is its index in the single process run
+struct BoidSlabRecord
+{
+	uint32_t Id;
+	uint32_t Species;
+	BoidProperties Boid;
+};
+
+// One rank of a simulation split into slabs along x, each rank advances the boids inside its slab
+// Every step boids within interaction range of a slab boundary are sent to the neighbouring rank as ghosts,
+// and after it boids that left the slab migrate to the neighbour they moved into
+// Boids are kept in Id order and the grid is forced dense, so results match a single process run with boids registered in Id order and a dense grid
+class BoidSlabSimulation
+{
+public:
+	BoidSlabSimulation(BoidTransport& Transport);
+
+	// Rules, species and bounds are set up here, identically on every rank
+	BoidPhysicsSystem& GetPhysicsSystem();
+
+	// Keep the boids of the whole flock that lie within this rank's slab
+	void Initialize(const std::vector<BoidSlabRecord>& Boids);
+
+	// Exchange ghosts, advance owned boids and migrate those that left the slab
+	// False if the transport failed, or slabs are narrower than the interaction range so ghosts would not be enough
+	bool Step(float DeltaTime);
+
+	const std::vector<BoidSlabRecord>& GetOwnedBoids() const;
+
+	// Collect every rank's boids on rank 0 in Id order, other ranks only send theirs
+	bool GatherToRoot(std::vector<BoidSlabRecord>& Boids);
+
+	float GetSlabMin();
+	float GetSlabMax();
+
+	// Rank whose slab contains x, positions outside of the box belong to the border slabs
+	uint32_t CalculateOwner(float x);
+
+protected:
+	float GetSlabWidth();
+
+	// Swap records with a neighbouring rank, lower rank sends first so blocking transports never wait on each other
+	bool Exchange(uint32_t Peer, const std::vector<BoidSlabRecord>& Outgoing, std::vector<BoidSlabRecord>& Incoming);
+
+	// Exchange with both neighbours, even ranks pair up to the right first and odd ranks to the left
+	bool ExchangeWithNeighbours(const std::vector<BoidSlabRecord>& ToLeft, const std::vector<BoidSlabRecord>& ToRight, std::vector<BoidSlabRecord>& Incoming);
+
+	BoidTransport& m_Transport;
+	BoidPhysicsSystem m_PhysicsSystem;
+
+	std::vector<BoidSlabRecord> m_OwnedBoids;
+
+	// Scratch kept between steps to avoid reallocating
+	std::vector<BoidSlabRecord> m_ToLeft;
+	std::vector<BoidSlabRecord> m_ToRight;
+	std::vector<BoidSlabRecord> m_Incoming;
+	std::vector<uint8_t> m_Message;
+
+	std::vector<BoidProperties> m_StepBoids;
+	std::vector<uint32_t> m_StepSpecies;
+	std::vector<uint8_t> m_StepIsGhost;
+	std::vector<uint32_t> m_StepOwnedIndices;
+};
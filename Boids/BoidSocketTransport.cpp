@@ -0,0 +1,379 @@
+#include "BoidSocketTransport.h"
+
+#include <chrono>
+#include <thread>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#ifndef _WIN32
+namespace
+{
+	bool MakeAddress(const std::string& Path, sockaddr_un& Address)
+	{
+		memset(&Address, 0, sizeof(Address));
+		Address.sun_family = AF_UNIX;
+
+		if (Path.size() >= sizeof(Address.sun_path))
+		{
+			return false;
+		}
+
+		memcpy(Address.sun_path, Path.c_str(), Path.size() + 1);
+		return true;
+	}
+
+	// Blocking write or read of exactly Size bytes, only used while connecting
+	bool WriteAll(int Socket, const void* Data, size_t Size)
+	{
+		const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+		while (Size > 0)
+		{
+			ssize_t Written = send(Socket, Bytes, Size, MSG_NOSIGNAL);
+			if (Written <= 0)
+			{
+				return false;
+			}
+
+			Bytes += Written;
+			Size -= Written;
+		}
+		return true;
+	}
+
+	bool ReadAll(int Socket, void* Data, size_t Size)
+	{
+		uint8_t* Bytes = static_cast<uint8_t*>(Data);
+		while (Size > 0)
+		{
+			ssize_t Read = recv(Socket, Bytes, Size, 0);
+			if (Read <= 0)
+			{
+				return false;
+			}
+
+			Bytes += Read;
+			Size -= Read;
+		}
+		return true;
+	}
+}
+#endif
+
+BoidSocketTransport::BoidSocketTransport(const std::string& PathPrefix, uint32_t Rank, uint32_t RankCount, uint32_t TimeoutMilliseconds)
+	: m_PathPrefix(PathPrefix), m_Rank(Rank), m_RankCount(RankCount), m_TimeoutMilliseconds(TimeoutMilliseconds), m_Sockets(RankCount, -1), m_Incoming(RankCount), m_IsClosed(RankCount, 0)
+{
+	if (Rank < RankCount)
+	{
+		m_IsOpen = Connect();
+	}
+}
+
+BoidSocketTransport::~BoidSocketTransport()
+{
+#ifndef _WIN32
+	for (int Socket : m_Sockets)
+	{
+		if (Socket >= 0)
+		{
+			close(Socket);
+		}
+	}
+
+	if (m_ListenSocket >= 0)
+	{
+		close(m_ListenSocket);
+		unlink(GetListenPath(m_Rank).c_str());
+	}
+#endif
+}
+
+bool BoidSocketTransport::IsOpen() const
+{
+	return m_IsOpen;
+}
+
+uint32_t BoidSocketTransport::GetRank() const
+{
+	return m_Rank;
+}
+
+uint32_t BoidSocketTransport::GetRankCount() const
+{
+	return m_RankCount;
+}
+
+std::string BoidSocketTransport::GetListenPath(uint32_t Rank) const
+{
+	return m_PathPrefix + "." + std::to_string(Rank);
+}
+
+bool BoidSocketTransport::Connect()
+{
+#ifndef _WIN32
+	sockaddr_un Address;
+	if (!MakeAddress(GetListenPath(m_Rank), Address))
+	{
+		return false;
+	}
+
+	// Listen before connecting anywhere, higher ranks may already be waiting for us
+	unlink(Address.sun_path);
+	m_ListenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_ListenSocket < 0 || bind(m_ListenSocket, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0 || listen(m_ListenSocket, static_cast<int>(m_RankCount)) != 0)
+	{
+		return false;
+	}
+
+	const std::chrono::steady_clock::time_point Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_TimeoutMilliseconds);
+
+	// Lower ranks may not be listening yet, keep retrying until they are
+	for (uint32_t Peer = 0; Peer < m_Rank; Peer++)
+	{
+		sockaddr_un PeerAddress;
+		if (!MakeAddress(GetListenPath(Peer), PeerAddress))
+		{
+			return false;
+		}
+
+		while (true)
+		{
+			int Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (Socket < 0)
+			{
+				return false;
+			}
+
+			if (connect(Socket, reinterpret_cast<sockaddr*>(&PeerAddress), sizeof(PeerAddress)) == 0)
+			{
+				m_Sockets[Peer] = Socket;
+				break;
+			}
+
+			close(Socket);
+
+			if (std::chrono::steady_clock::now() > Deadline)
+			{
+				return false;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		if (!WriteAll(m_Sockets[Peer], &m_Rank, sizeof(m_Rank)))
+		{
+			return false;
+		}
+	}
+
+	// Higher ranks introduce themselves with their rank
+	for (uint32_t i = m_Rank + 1; i < m_RankCount; i++)
+	{
+		pollfd Listen = { m_ListenSocket, POLLIN, 0 };
+		int Remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(Deadline - std::chrono::steady_clock::now()).count());
+		if (Remaining <= 0 || poll(&Listen, 1, Remaining) <= 0)
+		{
+			return false;
+		}
+
+		int Socket = accept(m_ListenSocket, nullptr, nullptr);
+		uint32_t Peer = 0;
+		if (Socket < 0 || !ReadAll(Socket, &Peer, sizeof(Peer)) || Peer <= m_Rank || Peer >= m_RankCount || m_Sockets[Peer] >= 0)
+		{
+			if (Socket >= 0)
+			{
+				close(Socket);
+			}
+			return false;
+		}
+
+		m_Sockets[Peer] = Socket;
+	}
+
+	// From here on progress is driven by poll, so nothing ever blocks inside a send or receive call
+	for (uint32_t Peer = 0; Peer < m_RankCount; Peer++)
+	{
+		if (m_Sockets[Peer] >= 0)
+		{
+			fcntl(m_Sockets[Peer], F_SETFL, fcntl(m_Sockets[Peer], F_GETFL) | O_NONBLOCK);
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool BoidSocketTransport::ReadAvailable(uint32_t Peer)
+{
+#ifndef _WIN32
+	uint8_t Buffer[64 * 1024];
+
+	while (true)
+	{
+		ssize_t Read = recv(m_Sockets[Peer], Buffer, sizeof(Buffer), 0);
+		if (Read > 0)
+		{
+			m_Incoming[Peer].insert(m_Incoming[Peer].end(), Buffer, Buffer + Read);
+			continue;
+		}
+
+		if (Read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			return true;
+		}
+
+		if (Read < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		// Peer closed the connection or it failed
+		return false;
+	}
+#else
+	return false;
+#endif
+}
+
+bool BoidSocketTransport::PopFrame(uint32_t Peer, std::vector<uint8_t>& Data)
+{
+	std::vector<uint8_t>& Incoming = m_Incoming[Peer];
+
+	uint32_t Size = 0;
+	if (Incoming.size() < sizeof(Size))
+	{
+		return false;
+	}
+
+	memcpy(&Size, Incoming.data(), sizeof(Size));
+	if (Incoming.size() - sizeof(Size) < Size)
+	{
+		return false;
+	}
+
+	Data.assign(Incoming.begin() + sizeof(Size), Incoming.begin() + sizeof(Size) + Size);
+	Incoming.erase(Incoming.begin(), Incoming.begin() + sizeof(Size) + Size);
+	return true;
+}
+
+bool BoidSocketTransport::Send(uint32_t Peer, const void* Data, uint32_t Size)
+{
+#ifndef _WIN32
+	if (!m_IsOpen || Peer >= m_RankCount || m_Sockets[Peer] < 0)
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> Frame(sizeof(Size) + Size);
+	memcpy(Frame.data(), &Size, sizeof(Size));
+	memcpy(Frame.data() + sizeof(Size), Data, Size);
+
+	std::vector<pollfd> Polls;
+	size_t Offset = 0;
+
+	while (Offset < Frame.size())
+	{
+		ssize_t Written = send(m_Sockets[Peer], Frame.data() + Offset, Frame.size() - Offset, MSG_NOSIGNAL);
+		if (Written > 0)
+		{
+			Offset += Written;
+			continue;
+		}
+
+		if (Written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (Written < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			return false;
+		}
+
+		// Socket is full, wait for room while draining every peer, the receiver may itself be stuck sending to us
+		Polls.clear();
+		for (uint32_t i = 0; i < m_RankCount; i++)
+		{
+			if (m_Sockets[i] >= 0 && (i == Peer || !m_IsClosed[i]))
+			{
+				Polls.push_back({ m_Sockets[i], static_cast<short>(i == Peer ? POLLIN | POLLOUT : POLLIN), 0 });
+			}
+		}
+
+		if (poll(Polls.data(), Polls.size(), static_cast<int>(m_TimeoutMilliseconds)) <= 0)
+		{
+			return false;
+		}
+
+		for (const pollfd& Poll : Polls)
+		{
+			if (Poll.revents & (POLLIN | POLLHUP))
+			{
+				uint32_t From = 0;
+				while (m_Sockets[From] != Poll.fd)
+				{
+					From++;
+				}
+
+				// Another peer finishing early is fine, only the one we send to must stay connected
+				if (!ReadAvailable(From))
+				{
+					if (From == Peer)
+					{
+						return false;
+					}
+
+					m_IsClosed[From] = 1;
+				}
+			}
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool BoidSocketTransport::Receive(uint32_t Peer, std::vector<uint8_t>& Data)
+{
+#ifndef _WIN32
+	if (!m_IsOpen || Peer >= m_RankCount || m_Sockets[Peer] < 0)
+	{
+		return false;
+	}
+
+	while (!PopFrame(Peer, Data))
+	{
+		if (m_IsClosed[Peer])
+		{
+			return false;
+		}
+
+		pollfd Poll = { m_Sockets[Peer], POLLIN, 0 };
+		if (poll(&Poll, 1, static_cast<int>(m_TimeoutMilliseconds)) <= 0)
+		{
+			return false;
+		}
+
+		// A closed connection may still have left complete frames behind
+		if (!ReadAvailable(Peer))
+		{
+			m_IsClosed[Peer] = 1;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include "BoidTransport.h"
+
+// Transport over local stream sockets, one connection per pair of ranks, so slabs can be tested as separate processes talking over a wire
+// Messages are length prefixed frames, while a send is stuck on a full socket incoming frames are drained so two ranks sending to each other never deadlock
+// Only available on POSIX systems, elsewhere IsOpen() is always false
+class BoidSocketTransport : public BoidTransport
+{
+public:
+	// Rank listens on "<PathPrefix>.<Rank>", connects to every lower rank and accepts every higher one
+	BoidSocketTransport(const std::string& PathPrefix, uint32_t Rank, uint32_t RankCount, uint32_t TimeoutMilliseconds = 30000);
+	~BoidSocketTransport();
+
+	bool IsOpen() const;
+
+	uint32_t GetRank() const override;
+	uint32_t GetRankCount() const override;
+
+	bool Send(uint32_t Peer, const void* Data, uint32_t Size) override;
+	bool Receive(uint32_t Peer, std::vector<uint8_t>& Data) override;
+
+protected:
+	std::string GetListenPath(uint32_t Rank) const;
+
+	bool Connect();
+
+	// Read whatever is available from peer without blocking, false if connection was closed or failed
+	bool ReadAvailable(uint32_t Peer);
+
+	// Move a complete frame out of peer's incoming bytes, false if none has fully arrived yet
+	bool PopFrame(uint32_t Peer, std::vector<uint8_t>& Data);
+
+	std::string m_PathPrefix;
+	uint32_t m_Rank;
+	uint32_t m_RankCount;
+	uint32_t m_TimeoutMilliseconds;
+
+	int m_ListenSocket = -1;
+	bool m_IsOpen = false;
+
+	// Socket and received but not yet returned bytes per peer
+	std::vector<int> m_Sockets;
+	std::vector<std::vector<uint8_t>> m_Incoming;
+
+	// Peers that closed their end, frames they sent before closing can still be received
+	std::vector<uint8_t> m_IsClosed;
+};
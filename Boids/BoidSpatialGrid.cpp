@@ -0,0 +1,443 @@
+#include "BoidSpatialGrid.h"
+
+#include <algorithm>
+#include <math.h>
+#include "BoidPhysicsSystem.h"
+#include "BoidThreadPool.h"
+
+using namespace DirectX;
+
+void BoidSpatialGrid::SetMode(SpatialGridMode Mode)
+{
+	m_Mode = Mode;
+}
+
+SpatialGridMode BoidSpatialGrid::GetMode() const
+{
+	return m_Mode;
+}
+
+bool BoidSpatialGrid::IsSparse() const
+{
+	return m_IsSparse;
+}
+
+void BoidSpatialGrid::Build(const BoidProperties* Boids, const uint32_t* Species, uint32_t BoidCount, uint32_t SpeciesCount, XMFLOAT3 BoxHalfSize, float CellSize)
+{
+	BeginBuild(BoidCount, SpeciesCount, BoxHalfSize, CellSize);
+
+	// Cell lookup is independent per boid, so spread it across threads
+	std::atomic<bool> AnyBoidOutsideBounds{ false };
+	BoidThreadPool::Get().ParallelFor(BoidCount, 4096, [this, Boids, Species, &AnyBoidOutsideBounds](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		if (BinBoids(Boids, Species, Begin, End))
+		{
+			AnyBoidOutsideBounds.store(true, std::memory_order_relaxed);
+		}
+	});
+
+	FinishBuild(AnyBoidOutsideBounds.load());
+}
+
+void BoidSpatialGrid::BeginBuild(uint32_t BoidCount, uint32_t SpeciesCount, XMFLOAT3 BoxHalfSize, float CellSize)
+{
+	m_SpeciesCount = std::max(SpeciesCount, 1u);
+	m_Origin = XMFLOAT3(-BoxHalfSize.x, -BoxHalfSize.y, -BoxHalfSize.z);
+	CalculateLayout(BoidCount, BoxHalfSize, CellSize);
+
+	m_BoidCellIndices.resize(BoidCount);
+	m_SortedIndices.resize(BoidCount);
+	m_OccupiedCells.clear();
+	if (m_IsSparse)
+	{
+		m_BoidCellKeys.resize(BoidCount);
+	}
+}
+
+bool BoidSpatialGrid::BinBoids(const BoidProperties* Boids, const uint32_t* Species, uint32_t Begin, uint32_t End)
+{
+	// Box is centred on the origin, so its half size is the negated grid origin
+	bool OutsideBounds = false;
+	for (uint32_t i = Begin; i < End; i++)
+	{
+		const XMFLOAT4& Position = Boids[i].BoidPosition;
+		uint32_t BoidSpecies = Species ? std::min(Species[i], m_SpeciesCount - 1) : 0;
+		XMINT3 Cell = CalculateCell(Position);
+
+		if (m_IsSparse)
+		{
+			m_BoidCellKeys[i] = CalculateCellKey(Cell, BoidSpecies);
+		}
+		else
+		{
+			m_BoidCellIndices[i] = CalculateBucketIndex(CalculateCellIndex(Cell), BoidSpecies);
+		}
+
+		OutsideBounds |= fabs(Position.x) > -m_Origin.x || fabs(Position.y) > -m_Origin.y || fabs(Position.z) > -m_Origin.z;
+	}
+
+	return OutsideBounds;
+}
+
+void BoidSpatialGrid::FinishBuild(bool AnyBoidOutsideBounds)
+{
+	uint32_t BoidCount = static_cast<uint32_t>(m_SortedIndices.size());
+	m_HasBoidsOutsideBounds = AnyBoidOutsideBounds;
+
+	if (m_IsSparse)
+	{
+		BuildSparse(BoidCount);
+	}
+	else
+	{
+		BuildDense(BoidCount);
+	}
+
+	// Occupied cells are in species order for both storages, so species ranges follow from their counts
+	m_SpeciesStart.assign(m_SpeciesCount + 1, 0);
+	for (const SpatialGridCell& Cell : m_OccupiedCells)
+	{
+		m_SpeciesStart[Cell.Species + 1] += Cell.Count;
+	}
+	for (uint32_t i = 0; i < m_SpeciesCount; i++)
+	{
+		m_SpeciesStart[i + 1] += m_SpeciesStart[i];
+	}
+}
+
+void BoidSpatialGrid::CalculateLayout(uint32_t BoidCount, XMFLOAT3 BoxHalfSize, float CellSize)
+{
+	float LargestHalfSize = std::max(BoxHalfSize.x, std::max(BoxHalfSize.y, BoxHalfSize.z));
+	float RequestedCellSize = std::max(CellSize, 0.001f);
+
+	// Sparse cells keep the requested size unless coordinates would no longer fit the key
+	float SparseCellSize = std::max(RequestedCellSize, (2 * LargestHalfSize) / MaximumSparseCellsPerAxis);
+	uint64_t SparseCellCount = static_cast<uint64_t>(std::max(1.0f, ceil((2 * BoxHalfSize.x) / SparseCellSize))) *
+							   static_cast<uint64_t>(std::max(1.0f, ceil((2 * BoxHalfSize.y) / SparseCellSize))) *
+							   static_cast<uint64_t>(std::max(1.0f, ceil((2 * BoxHalfSize.z) / SparseCellSize)));
+
+	// Dense is cheaper to look up, so only go sparse once the box has far more cells than could ever be occupied
+	uint64_t DenseCellLimit = std::max<uint64_t>(MaximumAutomaticDenseCells, 8ull * BoidCount);
+	m_IsSparse = m_Mode == SpatialGridMode::Sparse ||
+				 (m_Mode == SpatialGridMode::Automatic && SparseCellCount * m_SpeciesCount > DenseCellLimit);
+
+	// Size cells so box is covered, dense grids grow cells if the box would need too many
+	float SmallestDenseCellSize = (2 * LargestHalfSize) / MaximumCellsPerAxis;
+	m_CellSize = m_IsSparse ? SparseCellSize : std::max(RequestedCellSize, SmallestDenseCellSize);
+	m_InverseCellSize = 1.0f / m_CellSize;
+
+	m_Dimensions = XMINT3(std::max(1, static_cast<int>(ceil((2 * BoxHalfSize.x) * m_InverseCellSize))),
+						  std::max(1, static_cast<int>(ceil((2 * BoxHalfSize.y) * m_InverseCellSize))),
+						  std::max(1, static_cast<int>(ceil((2 * BoxHalfSize.z) * m_InverseCellSize))));
+
+	m_NumberOfCells = m_IsSparse ? 0 : m_Dimensions.x * m_Dimensions.y * m_Dimensions.z;
+}
+
+void BoidSpatialGrid::BuildDense(uint32_t BoidCount)
+{
+	uint32_t NumberOfBuckets = m_NumberOfCells * m_SpeciesCount;
+	m_CellStart.assign(NumberOfBuckets + 1, 0);
+
+	// Counting sort, kept serial so order within a cell is always registration order and results are deterministic
+	for (uint32_t i = 0; i < BoidCount; i++)
+	{
+		m_CellStart[m_BoidCellIndices[i] + 1]++;
+	}
+
+	for (uint32_t b = 0; b < NumberOfBuckets; b++)
+	{
+		uint32_t CellCount = m_CellStart[b + 1];
+		m_CellStart[b + 1] += m_CellStart[b];
+
+		if (CellCount > 0)
+		{
+			uint32_t c = b % m_NumberOfCells;
+			int x = c % m_Dimensions.x;
+			int y = (c / m_Dimensions.x) % m_Dimensions.y;
+			int z = c / (m_Dimensions.x * m_Dimensions.y);
+			m_OccupiedCells.push_back({ XMINT3(x, y, z), b / m_NumberOfCells, m_CellStart[b], CellCount });
+		}
+	}
+
+	// Scatter using cell starts as write cursors
+	m_CellCursor.assign(m_CellStart.begin(), m_CellStart.end() - 1);
+	for (uint32_t i = 0; i < BoidCount; i++)
+	{
+		m_SortedIndices[m_CellCursor[m_BoidCellIndices[i]]++] = i;
+	}
+}
+
+void BoidSpatialGrid::BuildSparse(uint32_t BoidCount)
+{
+	// Number distinct keys in first seen order and count their boids, table can never hold more keys than boids
+	ResetSparseTable(BoidCount);
+	m_OccupiedKeys.clear();
+	m_CellCursor.clear();
+
+	for (uint32_t i = 0; i < BoidCount; i++)
+	{
+		uint32_t NewIndex = static_cast<uint32_t>(m_OccupiedKeys.size());
+		uint32_t Index = InsertSparseCell(m_BoidCellKeys[i], NewIndex);
+		if (Index == NewIndex)
+		{
+			m_OccupiedKeys.push_back(m_BoidCellKeys[i]);
+			m_CellCursor.push_back(0);
+		}
+
+		m_CellCursor[Index]++;
+		m_BoidCellIndices[i] = Index;
+	}
+
+	// Order occupied cells by key, keeping species contiguous and the layout identical to a dense build
+	uint32_t NumberOfOccupiedCells = static_cast<uint32_t>(m_OccupiedKeys.size());
+	m_OccupiedOrder.resize(NumberOfOccupiedCells);
+	for (uint32_t i = 0; i < NumberOfOccupiedCells; i++)
+	{
+		m_OccupiedOrder[i] = i;
+	}
+	std::sort(m_OccupiedOrder.begin(), m_OccupiedOrder.end(), [this](uint32_t A, uint32_t B) { return m_OccupiedKeys[A] < m_OccupiedKeys[B]; });
+
+	// Prefix sum in key order, table is rebuilt at the size of occupied cells and maps keys to sorted cell ranks
+	ResetSparseTable(NumberOfOccupiedCells);
+	m_CellStart.resize(NumberOfOccupiedCells + 1);
+	m_CellStart[0] = 0;
+
+	for (uint32_t Rank = 0; Rank < NumberOfOccupiedCells; Rank++)
+	{
+		uint32_t Index = m_OccupiedOrder[Rank];
+		uint64_t Key = m_OccupiedKeys[Index];
+		uint32_t CellCount = m_CellCursor[Index];
+
+		m_CellStart[Rank + 1] = m_CellStart[Rank] + CellCount;
+		InsertSparseCell(Key, Rank);
+
+		XMINT3 Coord(static_cast<int>(Key & 0xFFFF), static_cast<int>((Key >> 16) & 0xFFFF), static_cast<int>((Key >> 32) & 0xFFFF));
+		m_OccupiedCells.push_back({ Coord, static_cast<uint32_t>(Key >> 48), m_CellStart[Rank], CellCount });
+
+		// Count is no longer needed, cursor now holds where this cell's boids are written
+		m_CellCursor[Index] = m_CellStart[Rank];
+	}
+
+	// Scatter in registration order, so order within a cell matches dense builds
+	for (uint32_t i = 0; i < BoidCount; i++)
+	{
+		m_SortedIndices[m_CellCursor[m_BoidCellIndices[i]]++] = i;
+	}
+}
+
+void BoidSpatialGrid::Clear()
+{
+	m_Dimensions = XMINT3(0, 0, 0);
+	m_NumberOfCells = 0;
+	m_SpeciesCount = 1;
+	m_HasBoidsOutsideBounds = false;
+
+	m_BoidCellIndices.clear();
+	m_CellStart.clear();
+	m_CellCursor.clear();
+	m_BoidCellKeys.clear();
+	m_SparseKeys.clear();
+	m_SparseValues.clear();
+	m_OccupiedKeys.clear();
+	m_OccupiedOrder.clear();
+	m_SparseMask = 0;
+	m_SpeciesStart.clear();
+	m_SortedIndices.clear();
+	m_OccupiedCells.clear();
+}
+
+void BoidSpatialGrid::Gather(const BoidProperties* In, BoidProperties* Out) const
+{
+	uint32_t BoidCount = static_cast<uint32_t>(m_SortedIndices.size());
+	BoidThreadPool::Get().ParallelFor(BoidCount, 4096, [this, In, Out](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		Gather(In, Out, Begin, End);
+	});
+}
+
+void BoidSpatialGrid::Gather(const BoidProperties* In, BoidProperties* Out, uint32_t Begin, uint32_t End) const
+{
+	for (uint32_t i = Begin; i < End; i++)
+	{
+		Out[i] = In[m_SortedIndices[i]];
+	}
+}
+
+XMINT3 BoidSpatialGrid::CalculateCell(const XMFLOAT4& Position) const
+{
+	int x = static_cast<int>(floor((Position.x - m_Origin.x) * m_InverseCellSize));
+	int y = static_cast<int>(floor((Position.y - m_Origin.y) * m_InverseCellSize));
+	int z = static_cast<int>(floor((Position.z - m_Origin.z) * m_InverseCellSize));
+
+	return XMINT3(std::min(std::max(x, 0), m_Dimensions.x - 1),
+				  std::min(std::max(y, 0), m_Dimensions.y - 1),
+				  std::min(std::max(z, 0), m_Dimensions.z - 1));
+}
+
+bool BoidSpatialGrid::GetCellRange(XMINT3 Cell, uint32_t Species, uint32_t& Start, uint32_t& Count) const
+{
+	if (Cell.x < 0 || Cell.y < 0 || Cell.z < 0 ||
+		Cell.x >= m_Dimensions.x || Cell.y >= m_Dimensions.y || Cell.z >= m_Dimensions.z || Species >= m_SpeciesCount)
+	{
+		return false;
+	}
+
+	uint32_t BucketIndex = 0;
+	if (m_IsSparse)
+	{
+		BucketIndex = FindSparseCell(CalculateCellKey(Cell, Species));
+		if (BucketIndex == UINT32_MAX)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		BucketIndex = CalculateBucketIndex(CalculateCellIndex(Cell), Species);
+	}
+
+	Start = m_CellStart[BucketIndex];
+	Count = m_CellStart[BucketIndex + 1] - Start;
+
+	return Count > 0;
+}
+
+void BoidSpatialGrid::GetSpeciesRange(uint32_t Species, uint32_t& Start, uint32_t& Count) const
+{
+	if (m_SpeciesStart.empty() || Species >= m_SpeciesCount)
+	{
+		Start = 0;
+		Count = 0;
+		return;
+	}
+
+	Start = m_SpeciesStart[Species];
+	Count = m_SpeciesStart[Species + 1] - Start;
+}
+
+void BoidSpatialGrid::GetCellBounds(XMINT3 Cell, XMFLOAT3& Min, XMFLOAT3& Max) const
+{
+	Min = XMFLOAT3(m_Origin.x + Cell.x * m_CellSize, m_Origin.y + Cell.y * m_CellSize, m_Origin.z + Cell.z * m_CellSize);
+	Max = XMFLOAT3(Min.x + m_CellSize, Min.y + m_CellSize, Min.z + m_CellSize);
+}
+
+const BoidLargeVector<uint32_t>& BoidSpatialGrid::GetSortedIndices() const
+{
+	return m_SortedIndices;
+}
+
+const std::vector<SpatialGridCell>& BoidSpatialGrid::GetOccupiedCells() const
+{
+	return m_OccupiedCells;
+}
+
+bool BoidSpatialGrid::HasBoidsOutsideBounds() const
+{
+	return m_HasBoidsOutsideBounds;
+}
+
+XMFLOAT3 BoidSpatialGrid::GetOrigin() const
+{
+	return m_Origin;
+}
+
+XMINT3 BoidSpatialGrid::GetDimensions() const
+{
+	return m_Dimensions;
+}
+
+float BoidSpatialGrid::GetCellSize() const
+{
+	return m_CellSize;
+}
+
+uint32_t BoidSpatialGrid::GetBoidCount() const
+{
+	return static_cast<uint32_t>(m_SortedIndices.size());
+}
+
+uint32_t BoidSpatialGrid::GetSpeciesCount() const
+{
+	return m_SpeciesCount;
+}
+
+uint32_t BoidSpatialGrid::CalculateCellIndex(XMINT3 Cell) const
+{
+	return Cell.x + m_Dimensions.x * (Cell.y + m_Dimensions.y * Cell.z);
+}
+
+uint32_t BoidSpatialGrid::CalculateBucketIndex(uint32_t CellIndex, uint32_t Species) const
+{
+	return Species * m_NumberOfCells + CellIndex;
+}
+
+uint64_t BoidSpatialGrid::CalculateCellKey(XMINT3 Cell, uint32_t Species) const
+{
+	return (static_cast<uint64_t>(Species) << 48) | (static_cast<uint64_t>(Cell.z) << 32) | (static_cast<uint64_t>(Cell.y) << 16) | static_cast<uint64_t>(Cell.x);
+}
+
+uint64_t BoidSpatialGrid::HashCellKey(uint64_t Key) const
+{
+	// Neighbouring cells only differ in low bits of each field, so mix every bit into the table index
+	Key ^= Key >> 33;
+	Key *= 0xff51afd7ed558ccdull;
+	Key ^= Key >> 33;
+	Key *= 0xc4ceb9fe1a85ec53ull;
+	Key ^= Key >> 33;
+
+	return Key;
+}
+
+uint32_t BoidSpatialGrid::FindSparseCell(uint64_t Key) const
+{
+	if (m_SparseValues.empty())
+	{
+		return UINT32_MAX;
+	}
+
+	// Linear probing, an empty slot ends the search
+	uint64_t Slot = HashCellKey(Key) & m_SparseMask;
+	while (m_SparseValues[Slot] != UINT32_MAX)
+	{
+		if (m_SparseKeys[Slot] == Key)
+		{
+			return m_SparseValues[Slot];
+		}
+
+		Slot = (Slot + 1) & m_SparseMask;
+	}
+
+	return UINT32_MAX;
+}
+
+uint32_t BoidSpatialGrid::InsertSparseCell(uint64_t Key, uint32_t NewValue)
+{
+	uint64_t Slot = HashCellKey(Key) & m_SparseMask;
+	while (m_SparseValues[Slot] != UINT32_MAX)
+	{
+		if (m_SparseKeys[Slot] == Key)
+		{
+			return m_SparseValues[Slot];
+		}
+
+		Slot = (Slot + 1) & m_SparseMask;
+	}
+
+	m_SparseKeys[Slot] = Key;
+	m_SparseValues[Slot] = NewValue;
+
+	return NewValue;
+}
+
+void BoidSpatialGrid::ResetSparseTable(uint32_t Count)
+{
+	uint64_t Capacity = 16;
+	while (Capacity < 2ull * Count)
+	{
+		Capacity *= 2;
+	}
+
+	m_SparseKeys.assign(Capacity, 0);
+	m_SparseValues.assign(Capacity, UINT32_MAX);
+	m_SparseMask = Capacity - 1;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <DirectXMath.h>
+#include "BoidPageAllocator.h"
+
+struct BoidProperties;
+
+// Occupied cell of one species in the spatial grid, boids within it are contiguous in sorted order
+struct SpatialGridCell
+{
+	DirectX::XMINT3 Coord;
+	uint32_t Species;
+	uint32_t Start;
+	uint32_t Count;
+};
+
+// How cells are stored, automatic picks dense or sparse on every build from how many cells the box would need
+enum class SpatialGridMode
+{
+	Automatic,
+	Dense,
+	Sparse
+};
+
+// Uniform grid over the bounding box, rebuilt with a counting sort so each cell's boids are contiguous
+// Boids are sorted by species first, so every species is one contiguous range with its own cells inside it
+// Boids outside of the box are clamped into the border cells, so neighbours are never lost
+// Dense storage keeps a start per cell of the whole box, sparse storage hashes cell coordinates so memory follows occupied cells only
+class BoidSpatialGrid
+{
+public:
+	// Cap on dense cells per axis, cell size grows past the requested size if the box would need more
+	static const int MaximumCellsPerAxis = 64;
+
+	// Cap on sparse cells per axis, so coordinates always fit the hash key
+	static const int MaximumSparseCellsPerAxis = 0xFFFF;
+
+	// Automatic mode stays dense up to this many cells, or eight cells per boid if that is more
+	static const uint32_t MaximumAutomaticDenseCells = 64 * 64 * 64;
+
+	void SetMode(SpatialGridMode Mode);
+	SpatialGridMode GetMode() const;
+
+	// True if last build used sparse storage
+	bool IsSparse() const;
+
+	// Bin boids into cells of at least CellSize, covering box of given half size
+	// Species may be null when every boid belongs to species 0
+	void Build(const BoidProperties* Boids, const uint32_t* Species, uint32_t BoidCount, uint32_t SpeciesCount, DirectX::XMFLOAT3 BoxHalfSize, float CellSize);
+	void Clear();
+
+	// Build split into its phases, for callers scheduling them themselves, Build runs the same phases in the same order
+	// Binning ranges may run concurrently once layout is set, returns whether any boid in range was outside the box
+	void BeginBuild(uint32_t BoidCount, uint32_t SpeciesCount, DirectX::XMFLOAT3 BoxHalfSize, float CellSize);
+	bool BinBoids(const BoidProperties* Boids, const uint32_t* Species, uint32_t Begin, uint32_t End);
+	void FinishBuild(bool AnyBoidOutsideBounds);
+
+	// Reorder per-boid data into sorted order, Out[i] = In[SortedIndices[i]], either all of it or sorted range [Begin, End)
+	void Gather(const BoidProperties* In, BoidProperties* Out) const;
+	void Gather(const BoidProperties* In, BoidProperties* Out, uint32_t Begin, uint32_t End) const;
+
+	// Cell containing position, clamped to grid
+	DirectX::XMINT3 CalculateCell(const DirectX::XMFLOAT4& Position) const;
+
+	// Range of sorted boids of species within cell, false if cell is outside the grid or empty
+	bool GetCellRange(DirectX::XMINT3 Cell, uint32_t Species, uint32_t& Start, uint32_t& Count) const;
+
+	// Range of sorted boids belonging to species
+	void GetSpeciesRange(uint32_t Species, uint32_t& Start, uint32_t& Count) const;
+	void GetCellBounds(DirectX::XMINT3 Cell, DirectX::XMFLOAT3& Min, DirectX::XMFLOAT3& Max) const;
+
+	// Sorted slot i holds registered boid SortedIndices[i]
+	const BoidLargeVector<uint32_t>& GetSortedIndices() const;
+	const std::vector<SpatialGridCell>& GetOccupiedCells() const;
+
+	// True if any boid was clamped into a border cell, so border cell bounds do not contain all of their boids
+	bool HasBoidsOutsideBounds() const;
+
+	DirectX::XMFLOAT3 GetOrigin() const;
+	DirectX::XMINT3 GetDimensions() const;
+	float GetCellSize() const;
+	uint32_t GetBoidCount() const;
+	uint32_t GetSpeciesCount() const;
+
+protected:
+	// Pick cell size and storage for the box, applying the dense cap if dense storage is chosen
+	void CalculateLayout(uint32_t BoidCount, DirectX::XMFLOAT3 BoxHalfSize, float CellSize);
+
+	void BuildDense(uint32_t BoidCount);
+	void BuildSparse(uint32_t BoidCount);
+
+	uint32_t CalculateCellIndex(DirectX::XMINT3 Cell) const;
+
+	// Bucket of cell within species, species major so each species stays contiguous
+	uint32_t CalculateBucketIndex(uint32_t CellIndex, uint32_t Species) const;
+
+	// Sparse key orders species, then z, y and x, matching the order of dense buckets
+	uint64_t CalculateCellKey(DirectX::XMINT3 Cell, uint32_t Species) const;
+	uint64_t HashCellKey(uint64_t Key) const;
+
+	// Occupied cell index of key, or UINT32_MAX if no boids are there
+	uint32_t FindSparseCell(uint64_t Key) const;
+
+	// Insert key into open addressing table, returning the value stored for it, new keys take NewValue
+	uint32_t InsertSparseCell(uint64_t Key, uint32_t NewValue);
+
+	// Clear table to the smallest power of two capacity holding Count keys at half load
+	void ResetSparseTable(uint32_t Count);
+
+	SpatialGridMode m_Mode = SpatialGridMode::Automatic;
+	bool m_IsSparse = false;
+
+	DirectX::XMFLOAT3 m_Origin = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMINT3 m_Dimensions = DirectX::XMINT3(0, 0, 0);
+	float m_CellSize = 1;
+	float m_InverseCellSize = 1;
+	uint32_t m_NumberOfCells = 0;
+	uint32_t m_SpeciesCount = 1;
+	bool m_HasBoidsOutsideBounds = false;
+
+	// Bucket index per boid in registration order, kept between builds to avoid reallocating
+	// Sparse builds store the occupied cell index instead
+	BoidLargeVector<uint32_t> m_BoidCellIndices;
+
+	// Dense prefix sum of boids per bucket, bucket b holds sorted range [m_CellStart[b], m_CellStart[b + 1])
+	std::vector<uint32_t> m_CellStart;
+	std::vector<uint32_t> m_CellCursor;
+
+	// Sparse key per boid, and open addressing table from key to occupied cell index
+	BoidLargeVector<uint64_t> m_BoidCellKeys;
+	std::vector<uint64_t> m_SparseKeys;
+	std::vector<uint32_t> m_SparseValues;
+	std::vector<uint64_t> m_OccupiedKeys;
+	std::vector<uint32_t> m_OccupiedOrder;
+	uint64_t m_SparseMask = 0;
+
+	// First sorted boid of each species, with one extra entry holding the boid count
+	std::vector<uint32_t> m_SpeciesStart;
+
+	BoidLargeVector<uint32_t> m_SortedIndices;
+	std::vector<SpatialGridCell> m_OccupiedCells;
+};
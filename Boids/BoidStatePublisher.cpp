@@ -0,0 +1,344 @@
+#include "BoidStatePublisher.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+const char* const BoidStatePublisher::DefaultName = "Local\\BoidsState";
+#else
+const char* const BoidStatePublisher::DefaultName = "/boids_state";
+#endif
+
+namespace
+{
+	size_t CalculateSlotStride(uint32_t SlotCapacity)
+	{
+		size_t Stride = sizeof(BoidStateSlotHeader) + SlotCapacity * sizeof(BoidProperties);
+		return (Stride + alignof(BoidStateSlotHeader) - 1) / alignof(BoidStateSlotHeader) * alignof(BoidStateSlotHeader);
+	}
+
+	size_t CalculateHeaderSize()
+	{
+		return (sizeof(BoidStateHeader) + alignof(BoidStateSlotHeader) - 1) / alignof(BoidStateSlotHeader) * alignof(BoidStateSlotHeader);
+	}
+}
+
+BoidStatePublisher::BoidStatePublisher(const std::string& Name, uint32_t SlotCapacity, uint32_t SlotCount) : m_Name(Name)
+{
+	if (SlotCount < 2)
+	{
+		return;
+	}
+
+	const size_t SlotStride = CalculateSlotStride(SlotCapacity);
+	m_SegmentSize = CalculateHeaderSize() + SlotStride * SlotCount;
+
+#ifdef _WIN32
+	HANDLE Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(m_SegmentSize) >> 32), static_cast<DWORD>(m_SegmentSize), Name.c_str());
+	if (!Mapping)
+	{
+		return;
+	}
+
+	// Another publisher, or a reader still mapping an old one, holds this name with a layout that may not match
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(Mapping);
+		return;
+	}
+
+	m_MappingHandle = Mapping;
+	m_Segment = static_cast<uint8_t*>(MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, m_SegmentSize));
+#else
+	// Replace any segment left behind by an earlier publisher, readers of it keep their own mapping
+	shm_unlink(Name.c_str());
+
+	int File = shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (File < 0)
+	{
+		return;
+	}
+
+	if (ftruncate(File, static_cast<off_t>(m_SegmentSize)) == 0)
+	{
+		void* Mapping = mmap(nullptr, m_SegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+		if (Mapping != MAP_FAILED)
+		{
+			m_Segment = static_cast<uint8_t*>(Mapping);
+		}
+	}
+	close(File);
+#endif
+
+	if (!m_Segment)
+	{
+		return;
+	}
+
+	// New segment is zero filled, so every slot sequence starts even and LatestFrame says nothing is published
+	BoidStateHeader* Header = reinterpret_cast<BoidStateHeader*>(m_Segment);
+	Header->Version = BoidStateHeader::CurrentVersion;
+	Header->SlotCount = SlotCount;
+	Header->SlotCapacity = SlotCapacity;
+	Header->SlotStride = SlotStride;
+	Header->Magic.store(BoidStateHeader::MagicValue, std::memory_order_release);
+}
+
+BoidStatePublisher::~BoidStatePublisher()
+{
+	if (m_Segment)
+	{
+		reinterpret_cast<BoidStateHeader*>(m_Segment)->IsClosed.store(1, std::memory_order_release);
+	}
+
+#ifdef _WIN32
+	if (m_Segment)
+	{
+		UnmapViewOfFile(m_Segment);
+	}
+	if (m_MappingHandle)
+	{
+		CloseHandle(m_MappingHandle);
+	}
+#else
+	if (m_Segment)
+	{
+		munmap(m_Segment, m_SegmentSize);
+		shm_unlink(m_Name.c_str());
+	}
+#endif
+}
+
+bool BoidStatePublisher::IsOpen() const
+{
+	return m_Segment != nullptr;
+}
+
+uint32_t BoidStatePublisher::GetSlotCapacity() const
+{
+	return m_Segment ? reinterpret_cast<const BoidStateHeader*>(m_Segment)->SlotCapacity : 0;
+}
+
+bool BoidStatePublisher::Publish(const BoidProperties* Boids, uint32_t Count, double Time)
+{
+	if (!m_Segment || Count > GetSlotCapacity())
+	{
+		return false;
+	}
+
+	memcpy(BeginPublish(Time), Boids, Count * sizeof(BoidProperties));
+	EndPublish(Count);
+
+	return true;
+}
+
+BoidProperties* BoidStatePublisher::BeginPublish(double Time)
+{
+	if (!m_Segment)
+	{
+		return nullptr;
+	}
+
+	BoidStateHeader* Header = reinterpret_cast<BoidStateHeader*>(m_Segment);
+	const uint32_t SlotIndex = static_cast<uint32_t>(m_NextFrame % Header->SlotCount);
+	uint8_t* SlotStart = m_Segment + CalculateHeaderSize() + SlotIndex * Header->SlotStride;
+	BoidStateSlotHeader* Slot = reinterpret_cast<BoidStateSlotHeader*>(SlotStart);
+
+	// Odd sequence tells readers the slot is being rewritten, fence keeps the writes below from moving above it
+	m_OpenSequence = Slot->Sequence.load(std::memory_order_relaxed);
+	Slot->Sequence.store(m_OpenSequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Slot->Frame = m_NextFrame;
+	Slot->Time = Time;
+	m_OpenSlot = Slot;
+
+	return reinterpret_cast<BoidProperties*>(SlotStart + sizeof(BoidStateSlotHeader));
+}
+
+void BoidStatePublisher::EndPublish(uint32_t Count)
+{
+	if (!m_OpenSlot)
+	{
+		return;
+	}
+
+	const uint32_t SlotCapacity = GetSlotCapacity();
+	m_OpenSlot->BoidCount = Count < SlotCapacity ? Count : SlotCapacity;
+	m_OpenSlot->Sequence.store(m_OpenSequence + 2, std::memory_order_release);
+	m_OpenSlot = nullptr;
+
+	m_NextFrame++;
+	reinterpret_cast<BoidStateHeader*>(m_Segment)->LatestFrame.store(m_NextFrame, std::memory_order_release);
+}
+
+BoidStateReader::BoidStateReader(const std::string& Name)
+{
+#ifdef _WIN32
+	HANDLE Mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, Name.c_str());
+	if (!Mapping)
+	{
+		return;
+	}
+
+	m_MappingHandle = Mapping;
+	const uint8_t* Segment = static_cast<const uint8_t*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!Segment)
+	{
+		return;
+	}
+
+	MEMORY_BASIC_INFORMATION Info;
+	VirtualQuery(Segment, &Info, sizeof(Info));
+	m_SegmentSize = Info.RegionSize;
+	m_Segment = Segment;
+#else
+	int File = shm_open(Name.c_str(), O_RDONLY, 0);
+	if (File < 0)
+	{
+		return;
+	}
+
+	struct stat Status;
+	if (fstat(File, &Status) == 0 && Status.st_size >= static_cast<off_t>(sizeof(BoidStateHeader)))
+	{
+		void* Mapping = mmap(nullptr, Status.st_size, PROT_READ, MAP_SHARED, File, 0);
+		if (Mapping != MAP_FAILED)
+		{
+			m_Segment = static_cast<const uint8_t*>(Mapping);
+			m_SegmentSize = Status.st_size;
+		}
+	}
+	close(File);
+#endif
+}
+
+BoidStateReader::~BoidStateReader()
+{
+#ifdef _WIN32
+	if (m_Segment)
+	{
+		UnmapViewOfFile(m_Segment);
+	}
+	if (m_MappingHandle)
+	{
+		CloseHandle(m_MappingHandle);
+	}
+#else
+	if (m_Segment)
+	{
+		munmap(const_cast<uint8_t*>(m_Segment), m_SegmentSize);
+	}
+#endif
+}
+
+bool BoidStateReader::IsOpen() const
+{
+	if (!m_Segment || GetHeader()->Magic.load(std::memory_order_acquire) != BoidStateHeader::MagicValue)
+	{
+		return false;
+	}
+
+	// Never trust a layout that would reach past the mapping
+	const BoidStateHeader* Header = GetHeader();
+	return Header->Version == BoidStateHeader::CurrentVersion && Header->SlotStride == CalculateSlotStride(Header->SlotCapacity) && CalculateHeaderSize() + Header->SlotStride * Header->SlotCount <= m_SegmentSize;
+}
+
+bool BoidStateReader::IsPublisherClosed() const
+{
+	return m_Segment && GetHeader()->IsClosed.load(std::memory_order_acquire) != 0;
+}
+
+bool BoidStateReader::AcquireLatest(BoidStateFrame& Frame) const
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+
+	const BoidStateHeader* Header = GetHeader();
+	const uint64_t Latest = Header->LatestFrame.load(std::memory_order_acquire);
+
+	// Newest slot may already be rewritten if the publisher lapped us, step back through older ones
+	for (uint64_t Back = 1; Back <= Header->SlotCount && Back <= Latest; Back++)
+	{
+		const uint64_t FrameIndex = Latest - Back;
+		const uint32_t SlotIndex = static_cast<uint32_t>(FrameIndex % Header->SlotCount);
+		const BoidStateSlotHeader* Slot = GetSlot(SlotIndex);
+
+		const uint64_t Sequence = Slot->Sequence.load(std::memory_order_acquire);
+		if (Sequence & 1)
+		{
+			continue;
+		}
+
+		BoidStateFrame Candidate;
+		Candidate.Boids = reinterpret_cast<const BoidProperties*>(reinterpret_cast<const uint8_t*>(Slot) + sizeof(BoidStateSlotHeader));
+		Candidate.BoidCount = Slot->BoidCount;
+		Candidate.Frame = Slot->Frame;
+		Candidate.Time = Slot->Time;
+		Candidate.Slot = SlotIndex;
+		Candidate.Sequence = Sequence;
+
+		if (Validate(Candidate) && Candidate.BoidCount <= Header->SlotCapacity)
+		{
+			Frame = Candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool BoidStateReader::Validate(const BoidStateFrame& Frame) const
+{
+	// Reads of the frame must complete before the sequence is checked again
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return GetSlot(Frame.Slot)->Sequence.load(std::memory_order_relaxed) == Frame.Sequence;
+}
+
+bool BoidStateReader::CopyLatest(std::vector<BoidProperties>& Boids, BoidStateFrame* Frame) const
+{
+	const uint32_t MaximumAttempts = 16;
+
+	for (uint32_t Attempt = 0; Attempt < MaximumAttempts; Attempt++)
+	{
+		BoidStateFrame Latest;
+		if (!AcquireLatest(Latest))
+		{
+			return false;
+		}
+
+		Boids.resize(Latest.BoidCount);
+		memcpy(Boids.data(), Latest.Boids, Latest.BoidCount * sizeof(BoidProperties));
+
+		if (Validate(Latest))
+		{
+			if (Frame)
+			{
+				*Frame = Latest;
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const BoidStateHeader* BoidStateReader::GetHeader() const
+{
+	return reinterpret_cast<const BoidStateHeader*>(m_Segment);
+}
+
+const BoidStateSlotHeader* BoidStateReader::GetSlot(uint32_t Slot) const
+{
+	return reinterpret_cast<const BoidStateSlotHeader*>(m_Segment + CalculateHeaderSize() + Slot * GetHeader()->SlotStride);
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "BoidPhysicsSystem.h"
+
+// Layout of a published state segment, a header followed by a ring of slots, each a slot header followed by boids
+// Slot i holds every frame with Frame % SlotCount == i, so a reader has SlotCount - 1 steps to finish with a frame before it is overwritten
+struct BoidStateHeader
+{
+	static const uint32_t MagicValue = 0x44494F42; // "BOID"
+	static const uint32_t CurrentVersion = 1;
+
+	// Written last once the segment is laid out, readers wait until it holds MagicValue
+	std::atomic<uint32_t> Magic;
+	uint32_t Version;
+	uint32_t SlotCount;
+	uint32_t SlotCapacity;
+	uint64_t SlotStride;
+
+	// Number of frames published so far, newest complete frame is LatestFrame - 1
+	std::atomic<uint64_t> LatestFrame;
+
+	// Set when publisher goes away, segment may be recreated under the same name afterwards
+	std::atomic<uint32_t> IsClosed;
+};
+
+// Seqlock protected slot, sequence is odd while publisher writes into it
+struct alignas(64) BoidStateSlotHeader
+{
+	std::atomic<uint64_t> Sequence;
+	uint64_t Frame;
+	double Time;
+	uint32_t BoidCount;
+};
+
+// Writes completed steps into a named shared memory ring, never waits for readers
+// Name follows the platform, e.g. "/boids_state" is /dev/shm/boids_state on Linux, "Local\\boids_state" on Windows
+class BoidStatePublisher
+{
+public:
+	// Name used by the demo application, readers open the same one
+	static const char* const DefaultName;
+
+	BoidStatePublisher(const std::string& Name, uint32_t SlotCapacity, uint32_t SlotCount = 4);
+	~BoidStatePublisher();
+
+	bool IsOpen() const;
+	uint32_t GetSlotCapacity() const;
+
+	// Copy one step of boids into the next slot, false if there are more boids than a slot holds
+	bool Publish(const BoidProperties* Boids, uint32_t Count, double Time);
+
+	// Publish in two halves, so boids can be written straight into the slot, e.g. as step output of the physics system
+	// BeginPublish returns room for GetSlotCapacity() boids, or null if the segment is not open, EndPublish makes Count of them visible
+	BoidProperties* BeginPublish(double Time);
+	void EndPublish(uint32_t Count);
+
+protected:
+	std::string m_Name;
+	size_t m_SegmentSize = 0;
+	uint8_t* m_Segment = nullptr;
+	void* m_MappingHandle = nullptr;
+
+	uint64_t m_NextFrame = 0;
+
+	// Slot between BeginPublish and EndPublish, and its sequence before it was opened
+	BoidStateSlotHeader* m_OpenSlot = nullptr;
+	uint64_t m_OpenSequence = 0;
+};
+
+// Frame in place within the segment, only trustworthy while BoidStateReader::Validate() keeps returning true
+struct BoidStateFrame
+{
+	const BoidProperties* Boids = nullptr;
+	uint32_t BoidCount = 0;
+	uint64_t Frame = 0;
+	double Time = 0;
+
+	uint32_t Slot = 0;
+	uint64_t Sequence = 0;
+};
+
+// Maps a published segment read-only, frames are read in place without copies and without blocking the publisher
+class BoidStateReader
+{
+public:
+	BoidStateReader(const std::string& Name);
+	~BoidStateReader();
+
+	// False until publisher has created and laid out the segment, reopen with a new reader if it never does
+	bool IsOpen() const;
+
+	// Publisher went away, a new one may have created a fresh segment under the same name
+	bool IsPublisherClosed() const;
+
+	// Point Frame at the newest complete frame, false if nothing has been published yet
+	bool AcquireLatest(BoidStateFrame& Frame) const;
+
+	// True if frame has not been overwritten since it was acquired, check after reading it
+	bool Validate(const BoidStateFrame& Frame) const;
+
+	// Copy newest frame out, retrying if it is overwritten while copying
+	bool CopyLatest(std::vector<BoidProperties>& Boids, BoidStateFrame* Frame = nullptr) const;
+
+protected:
+	const BoidStateHeader* GetHeader() const;
+	const BoidStateSlotHeader* GetSlot(uint32_t Slot) const;
+
+	size_t m_SegmentSize = 0;
+	const uint8_t* m_Segment = nullptr;
+	void* m_MappingHandle = nullptr;
+};
@@ -0,0 +1,396 @@
+#include "BoidStepProfiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+#ifdef __linux__
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace
+{
+	std::atomic<uint64_t> s_NextProfilerId{ 1 };
+
+	// Profiler the calling thread was last attached to, so attaching again costs one comparison
+	thread_local uint64_t t_AttachedProfiler = 0;
+
+	int64_t GetTicks()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+#ifdef __linux__
+	int GetThreadId()
+	{
+		return static_cast<int>(syscall(SYS_gettid));
+	}
+
+	// Event of every counter, in BoidCounter order
+	void SetCounterEvent(BoidCounter Counter, perf_event_attr& Attributes)
+	{
+		switch (Counter)
+		{
+		case BoidCounter::Cycles:
+			Attributes.type = PERF_TYPE_HARDWARE;
+			Attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+			break;
+		case BoidCounter::Instructions:
+			Attributes.type = PERF_TYPE_HARDWARE;
+			Attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+			break;
+		case BoidCounter::CacheMisses:
+			// Last level cache misses
+			Attributes.type = PERF_TYPE_HARDWARE;
+			Attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+			break;
+		case BoidCounter::BranchMisses:
+			Attributes.type = PERF_TYPE_HARDWARE;
+			Attributes.config = PERF_COUNT_HW_BRANCH_MISSES;
+			break;
+		default:
+			Attributes.type = PERF_TYPE_HW_CACHE;
+			Attributes.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			break;
+		}
+	}
+
+	int OpenCounter(BoidCounter Counter, int GroupFile)
+	{
+		perf_event_attr Attributes;
+		std::memset(&Attributes, 0, sizeof(Attributes));
+		Attributes.size = sizeof(Attributes);
+		SetCounterEvent(Counter, Attributes);
+
+		// Group starts disabled and is enabled once complete, user space only to work under the default paranoid level
+		Attributes.disabled = GroupFile == -1 ? 1 : 0;
+		Attributes.exclude_kernel = 1;
+		Attributes.exclude_hv = 1;
+		Attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		// Calling thread on whichever CPU it runs
+		return static_cast<int>(syscall(SYS_perf_event_open, &Attributes, 0, -1, GroupFile, 0));
+	}
+#endif
+}
+
+const char* GetProfileStageName(BoidProfileStage Stage)
+{
+	switch (Stage)
+	{
+	case BoidProfileStage::Commands:
+		return "Commands";
+	case BoidProfileStage::Rules:
+		return "Rules";
+	case BoidProfileStage::Apply:
+		return "Apply";
+	case BoidProfileStage::Grid:
+		return "Grid";
+	default:
+		return "Unknown";
+	}
+}
+
+const char* GetCounterName(BoidCounter Counter)
+{
+	switch (Counter)
+	{
+	case BoidCounter::Cycles:
+		return "Cycles";
+	case BoidCounter::Instructions:
+		return "Instructions";
+	case BoidCounter::CacheMisses:
+		return "CacheMisses";
+	case BoidCounter::BranchMisses:
+		return "BranchMisses";
+	case BoidCounter::TLBMisses:
+		return "TLBMisses";
+	default:
+		return "Unknown";
+	}
+}
+
+double BoidStageProfile::GetInstructionsPerCycle() const
+{
+	uint64_t Cycles = Counters[static_cast<uint32_t>(BoidCounter::Cycles)];
+	return Cycles > 0 ? static_cast<double>(Counters[static_cast<uint32_t>(BoidCounter::Instructions)]) / Cycles : 0.0;
+}
+
+double BoidStageProfile::GetPerPair(BoidCounter Counter) const
+{
+	return Pairs > 0 ? static_cast<double>(Counters[static_cast<uint32_t>(Counter)]) / Pairs : 0.0;
+}
+
+BoidStepProfiler::BoidStepProfiler()
+	: m_Id(s_NextProfilerId.fetch_add(1, std::memory_order_relaxed))
+{
+	for (bool& Available : m_CounterAvailable)
+	{
+		Available = true;
+	}
+}
+
+BoidStepProfiler::~BoidStepProfiler()
+{
+	for (uint32_t i = 0; i < m_ThreadCount; i++)
+	{
+		CloseThreadCounters(m_Threads[i]);
+	}
+}
+
+void BoidStepProfiler::AttachThread()
+{
+	if (t_AttachedProfiler == m_Id)
+	{
+		return;
+	}
+	t_AttachedProfiler = m_Id;
+
+	std::lock_guard<std::mutex> Lock(m_Mutex);
+	m_AnyThreadAttached = true;
+
+#ifdef __linux__
+	// Thread may have been attached before and since attached to another profiler
+	int ThreadId = GetThreadId();
+	for (uint32_t i = 0; i < m_ThreadCount; i++)
+	{
+		if (m_Threads[i].ThreadId == ThreadId)
+		{
+			return;
+		}
+	}
+
+	ThreadCounters Counters;
+	Counters.ThreadId = ThreadId;
+	if (m_ThreadCount == MaximumThreads || !OpenThreadCounters(Counters))
+	{
+		// Nothing opened on this thread, so no counter can be summed over every thread any more
+		for (bool& Available : m_CounterAvailable)
+		{
+			Available = false;
+		}
+		return;
+	}
+
+	m_Threads[m_ThreadCount++] = Counters;
+#endif
+}
+
+bool BoidStepProfiler::HasCounter(BoidCounter Counter) const
+{
+	std::lock_guard<std::mutex> Lock(m_Mutex);
+	return m_AnyThreadAttached && m_CounterAvailable[static_cast<uint32_t>(Counter)] && m_ThreadCount > 0;
+}
+
+bool BoidStepProfiler::HasCounters() const
+{
+	return HasCounter(BoidCounter::Cycles) || HasCounter(BoidCounter::Instructions);
+}
+
+void BoidStepProfiler::BeginStage(BoidProfileStage Stage)
+{
+	// Driving thread always takes part in the stage
+	AttachThread();
+
+	m_OpenStage = Stage;
+	ReadCounters(m_StageStartCounters);
+	m_StageStartTicks = GetTicks();
+}
+
+void BoidStepProfiler::EndStage(BoidProfileStage Stage, uint64_t Pairs)
+{
+	int64_t StopTicks = GetTicks();
+
+	uint64_t StopCounters[static_cast<uint32_t>(BoidCounter::Count)];
+	ReadCounters(StopCounters);
+
+	// Ending a stage that was never begun would time it from whichever stage began last, so it is dropped instead
+	if (Stage != m_OpenStage)
+	{
+		return;
+	}
+	m_OpenStage = BoidProfileStage::Count;
+
+	BoidStageProfile& Profile = m_Stages[static_cast<uint32_t>(Stage)];
+	Profile.Steps++;
+	Profile.Milliseconds += (StopTicks - m_StageStartTicks) / 1000000.0;
+	Profile.Pairs += Pairs;
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(BoidCounter::Count); i++)
+	{
+		// Threads attaching mid stage count from zero, and scaled counts can step back slightly, so clamp rather than wrap around
+		if (StopCounters[i] > m_StageStartCounters[i])
+		{
+			Profile.Counters[i] += StopCounters[i] - m_StageStartCounters[i];
+		}
+	}
+}
+
+const BoidStageProfile& BoidStepProfiler::GetStage(BoidProfileStage Stage) const
+{
+	return m_Stages[static_cast<uint32_t>(Stage)];
+}
+
+void BoidStepProfiler::Reset()
+{
+	for (BoidStageProfile& Profile : m_Stages)
+	{
+		Profile = {};
+	}
+}
+
+bool BoidStepProfiler::WriteReport(const char* Path) const
+{
+	std::ofstream File(Path);
+	if (!File)
+	{
+		return false;
+	}
+
+	File << "{" << std::endl;
+	File << "\t\"HardwareCounters\": " << (HasCounters() ? "true" : "false") << "," << std::endl;
+	File << "\t\"Stages\": [" << std::endl;
+
+	for (uint32_t Stage = 0; Stage < static_cast<uint32_t>(BoidProfileStage::Count); Stage++)
+	{
+		const BoidStageProfile& Profile = m_Stages[Stage];
+		double Steps = Profile.Steps > 0 ? static_cast<double>(Profile.Steps) : 1.0;
+
+		File << "\t\t{" << std::endl;
+		File << "\t\t\t\"Name\": \"" << GetProfileStageName(static_cast<BoidProfileStage>(Stage)) << "\"," << std::endl;
+		File << "\t\t\t\"Steps\": " << Profile.Steps << "," << std::endl;
+		File << "\t\t\t\"MillisecondsPerStep\": " << Profile.Milliseconds / Steps << "," << std::endl;
+		File << "\t\t\t\"PairsPerStep\": " << Profile.Pairs / Steps << "," << std::endl;
+
+		// Unavailable counters are left out rather than reported as zero
+		for (uint32_t Counter = 0; Counter < static_cast<uint32_t>(BoidCounter::Count); Counter++)
+		{
+			if (HasCounter(static_cast<BoidCounter>(Counter)))
+			{
+				File << "\t\t\t\"" << GetCounterName(static_cast<BoidCounter>(Counter)) << "PerStep\": " << Profile.Counters[Counter] / Steps << "," << std::endl;
+			}
+		}
+
+		if (HasCounter(BoidCounter::Cycles) && HasCounter(BoidCounter::Instructions))
+		{
+			File << "\t\t\t\"InstructionsPerCycle\": " << Profile.GetInstructionsPerCycle() << "," << std::endl;
+		}
+
+		for (BoidCounter Counter : { BoidCounter::CacheMisses, BoidCounter::BranchMisses, BoidCounter::TLBMisses })
+		{
+			if (HasCounter(Counter) && Profile.Pairs > 0)
+			{
+				File << "\t\t\t\"" << GetCounterName(Counter) << "PerPair\": " << Profile.GetPerPair(Counter) << "," << std::endl;
+			}
+		}
+
+		File << "\t\t\t\"TotalMilliseconds\": " << Profile.Milliseconds << std::endl;
+		File << "\t\t}" << (Stage + 1 < static_cast<uint32_t>(BoidProfileStage::Count) ? "," : "") << std::endl;
+	}
+
+	File << "\t]" << std::endl;
+	File << "}" << std::endl;
+
+	return static_cast<bool>(File);
+}
+
+void BoidStepProfiler::ReadCounters(uint64_t* Values)
+{
+	for (uint32_t i = 0; i < static_cast<uint32_t>(BoidCounter::Count); i++)
+	{
+		Values[i] = 0;
+	}
+
+#ifdef __linux__
+	std::lock_guard<std::mutex> Lock(m_Mutex);
+
+	for (uint32_t Thread = 0; Thread < m_ThreadCount; Thread++)
+	{
+		const ThreadCounters& Counters = m_Threads[Thread];
+
+		// Number of values, time enabled, time running, then one value per group member in the order they were opened
+		uint64_t Buffer[3 + static_cast<uint32_t>(BoidCounter::Count)];
+		ssize_t Size = read(Counters.GroupFile, Buffer, sizeof(Buffer));
+		if (Size < static_cast<ssize_t>(3 * sizeof(uint64_t)) || Buffer[0] != Counters.GroupSize)
+		{
+			continue;
+		}
+
+		// Group shares the hardware with other processes, scale up for the time it was not scheduled
+		double Scale = Buffer[2] > 0 ? static_cast<double>(Buffer[1]) / Buffer[2] : 0.0;
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(BoidCounter::Count); i++)
+		{
+			if (Counters.Files[i] != -1)
+			{
+				Values[i] += static_cast<uint64_t>(Buffer[3 + Counters.GroupSlots[i]] * Scale);
+			}
+		}
+	}
+#endif
+}
+
+bool BoidStepProfiler::OpenThreadCounters(ThreadCounters& Counters)
+{
+	for (int& File : Counters.Files)
+	{
+		File = -1;
+	}
+
+#ifdef __linux__
+	// First counter that opens leads the group, counters the CPU or hypervisor does not provide are skipped
+	for (uint32_t i = 0; i < static_cast<uint32_t>(BoidCounter::Count); i++)
+	{
+		int File = OpenCounter(static_cast<BoidCounter>(i), Counters.GroupFile);
+		if (File == -1)
+		{
+			m_CounterAvailable[i] = false;
+			continue;
+		}
+
+		if (Counters.GroupFile == -1)
+		{
+			Counters.GroupFile = File;
+		}
+
+		Counters.Files[i] = File;
+		Counters.GroupSlots[i] = Counters.GroupSize++;
+	}
+
+	if (Counters.GroupFile == -1)
+	{
+		return false;
+	}
+
+	ioctl(Counters.GroupFile, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(Counters.GroupFile, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void BoidStepProfiler::CloseThreadCounters(ThreadCounters& Counters)
+{
+#ifdef __linux__
+	// Members before leader
+	for (int& File : Counters.Files)
+	{
+		if (File != -1 && File != Counters.GroupFile)
+		{
+			close(File);
+		}
+		File = -1;
+	}
+
+	if (Counters.GroupFile != -1)
+	{
+		close(Counters.GroupFile);
+		Counters.GroupFile = -1;
+	}
+#endif
+}
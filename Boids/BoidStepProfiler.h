@@ -0,0 +1,123 @@
+#pragma once
+#include <mutex>
+#include <cstdint>
+
+// Stages of one CPU physics step, in the order they run
+enum class BoidProfileStage : uint32_t
+{
+	// Draining queued commands from other threads
+	Commands,
+
+	// Neighbour search and rules, the only stage split across the thread pool
+	Rules,
+
+	// Writing new directions and positions back to registered boids
+	Apply,
+
+	// Rebuilding grid, and octree in Barnes-Hut mode, from new positions
+	Grid,
+
+	Count
+};
+
+const char* GetProfileStageName(BoidProfileStage Stage);
+
+// Hardware events counted per stage, summed over every thread that took part
+enum class BoidCounter : uint32_t
+{
+	Cycles,
+	Instructions,
+	CacheMisses,
+	BranchMisses,
+	TLBMisses,
+
+	Count
+};
+
+const char* GetCounterName(BoidCounter Counter);
+
+// Totals of one stage over every profiled step
+struct BoidStageProfile
+{
+	uint64_t Steps;
+	double Milliseconds;
+
+	// Neighbour pairs the stage looked at, only counted for the rules stage
+	uint64_t Pairs;
+	uint64_t Counters[static_cast<uint32_t>(BoidCounter::Count)];
+
+	// Zero when the counters involved are unavailable
+	double GetInstructionsPerCycle() const;
+	double GetPerPair(BoidCounter Counter) const;
+};
+
+// Wall clock time and, on Linux, hardware performance counters around each stage of the physics step
+// Counters come from perf_event_open, counting user space only so no extra privileges are needed
+// Where they cannot be opened, e.g. other platforms, virtual machines or a restrictive perf_event_paranoid, only time is recorded
+class BoidStepProfiler
+{
+public:
+	BoidStepProfiler();
+	~BoidStepProfiler();
+
+	BoidStepProfiler(const BoidStepProfiler&) = delete;
+	BoidStepProfiler& operator=(const BoidStepProfiler&) = delete;
+
+	// Start counting on the calling thread if it is not counted yet, safe from any thread and cheap once attached
+	void AttachThread();
+
+	// Whether counter was opened on every attached thread
+	bool HasCounter(BoidCounter Counter) const;
+	bool HasCounters() const;
+
+	// Bracket one stage, called from the thread driving the step while no stage work runs elsewhere, stages do not nest and an
+	// EndStage not matching the last BeginStage is ignored
+	void BeginStage(BoidProfileStage Stage);
+	void EndStage(BoidProfileStage Stage, uint64_t Pairs = 0);
+
+	const BoidStageProfile& GetStage(BoidProfileStage Stage) const;
+
+	// Clear totals, attached threads stay attached
+	void Reset();
+
+	// Totals, means per step, instructions per cycle and counters per pair of every stage as JSON
+	bool WriteReport(const char* Path) const;
+
+protected:
+	// Counters of one thread, opened as one group so they are always scheduled together
+	struct ThreadCounters
+	{
+		int GroupFile = -1;
+		int Files[static_cast<uint32_t>(BoidCounter::Count)];
+		uint32_t GroupSlots[static_cast<uint32_t>(BoidCounter::Count)];
+		uint32_t GroupSize = 0;
+		int ThreadId = 0;
+	};
+
+	// Sum of counters over every attached thread
+	void ReadCounters(uint64_t* Values);
+
+	bool OpenThreadCounters(ThreadCounters& Counters);
+	void CloseThreadCounters(ThreadCounters& Counters);
+
+	// Fixed storage so attaching a thread mid step never allocates, threads past the maximum leave counters unavailable
+	static const uint32_t MaximumThreads = 128;
+
+	mutable std::mutex m_Mutex;
+	ThreadCounters m_Threads[MaximumThreads];
+	uint32_t m_ThreadCount = 0;
+
+	// Unique per profiler, so a thread attached to one profiler is not mistaken for attached to another
+	uint64_t m_Id;
+
+	// Counters left unavailable on any attached thread are reported as zero
+	bool m_CounterAvailable[static_cast<uint32_t>(BoidCounter::Count)];
+	bool m_AnyThreadAttached = false;
+
+	BoidStageProfile m_Stages[static_cast<uint32_t>(BoidProfileStage::Count)] = {};
+
+	// Readings taken by BeginStage, Count while no stage is open
+	BoidProfileStage m_OpenStage = BoidProfileStage::Count;
+	int64_t m_StageStartTicks = 0;
+	uint64_t m_StageStartCounters[static_cast<uint32_t>(BoidCounter::Count)] = {};
+};
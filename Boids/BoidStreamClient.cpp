@@ -0,0 +1,232 @@
+#include "BoidStreamClient.h"
+#include "BoidPhysicsSystem.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+BoidStreamClient::BoidStreamClient(const std::string& UnixPath)
+{
+#ifndef _WIN32
+	sockaddr_un Address;
+	memset(&Address, 0, sizeof(Address));
+	Address.sun_family = AF_UNIX;
+
+	if (UnixPath.size() >= sizeof(Address.sun_path))
+	{
+		return;
+	}
+	memcpy(Address.sun_path, UnixPath.c_str(), UnixPath.size() + 1);
+
+	m_Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_Socket >= 0 && connect(m_Socket, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0)
+	{
+		close(m_Socket);
+		m_Socket = -1;
+	}
+#endif
+}
+
+BoidStreamClient::BoidStreamClient(const std::string& Address, uint16_t Port)
+{
+#ifndef _WIN32
+	sockaddr_in Server;
+	memset(&Server, 0, sizeof(Server));
+	Server.sin_family = AF_INET;
+	Server.sin_port = htons(Port);
+
+	if (inet_pton(AF_INET, Address.c_str(), &Server.sin_addr) != 1)
+	{
+		return;
+	}
+
+	m_Socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (m_Socket >= 0 && connect(m_Socket, reinterpret_cast<sockaddr*>(&Server), sizeof(Server)) != 0)
+	{
+		close(m_Socket);
+		m_Socket = -1;
+	}
+#endif
+}
+
+BoidStreamClient::~BoidStreamClient()
+{
+#ifndef _WIN32
+	if (m_Socket >= 0)
+	{
+		close(m_Socket);
+	}
+#endif
+}
+
+bool BoidStreamClient::IsConnected() const
+{
+	return m_Socket >= 0;
+}
+
+bool BoidStreamClient::SetRegion(DirectX::XMFLOAT3 Min, DirectX::XMFLOAT3 Max)
+{
+	BoidStreamRegionRequest Request;
+	Request.Type = BoidStreamRegionRequest::SetRegion;
+	Request.Min = Min;
+	Request.Max = Max;
+	return SendRequest(Request);
+}
+
+bool BoidStreamClient::ClearRegion()
+{
+	BoidStreamRegionRequest Request = {};
+	Request.Type = BoidStreamRegionRequest::ClearRegion;
+	return SendRequest(Request);
+}
+
+bool BoidStreamClient::SendRequest(const BoidStreamRegionRequest& Request)
+{
+#ifndef _WIN32
+	if (m_Socket < 0)
+	{
+		return false;
+	}
+
+	// Requests are tiny, a blocking send always completes
+	return send(m_Socket, &Request, sizeof(Request), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(Request));
+#else
+	return false;
+#endif
+}
+
+uint32_t BoidStreamClient::Poll(uint32_t TimeoutMilliseconds)
+{
+#ifndef _WIN32
+	if (m_Socket < 0)
+	{
+		return 0;
+	}
+
+	pollfd Wait = { m_Socket, POLLIN, 0 };
+	if (poll(&Wait, 1, static_cast<int>(TimeoutMilliseconds)) <= 0)
+	{
+		return 0;
+	}
+
+	// Read everything available without blocking again
+	uint8_t Buffer[64 * 1024];
+	while (true)
+	{
+		ssize_t Read = recv(m_Socket, Buffer, sizeof(Buffer), MSG_DONTWAIT);
+		if (Read > 0)
+		{
+			m_Incoming.insert(m_Incoming.end(), Buffer, Buffer + Read);
+			continue;
+		}
+
+		if (Read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		{
+			break;
+		}
+
+		// Server went away, frames already received are still applied below
+		close(m_Socket);
+		m_Socket = -1;
+		break;
+	}
+
+	uint32_t Applied = 0;
+	size_t Offset = 0;
+
+	while (m_Incoming.size() - Offset >= sizeof(BoidStreamFrameHeader))
+	{
+		BoidStreamFrameHeader Header;
+		memcpy(&Header, m_Incoming.data() + Offset, sizeof(Header));
+
+		if (Header.Magic != BoidStreamFrameHeader::MagicValue)
+		{
+			close(m_Socket);
+			m_Socket = -1;
+			m_Incoming.clear();
+			return Applied;
+		}
+
+		if (m_Incoming.size() - Offset - sizeof(Header) < Header.PayloadSize)
+		{
+			break;
+		}
+
+		const uint8_t* Payload = m_Incoming.data() + Offset + sizeof(Header);
+		Offset += sizeof(Header) + Header.PayloadSize;
+
+		if (Header.IsKeyframe)
+		{
+			m_Boids.clear();
+			m_HasKeyframe = true;
+			m_KeyframesReceived++;
+		}
+		else if (!m_HasKeyframe)
+		{
+			continue;
+		}
+
+		if (!DecodeBoidStreamDelta(Payload, Header.PayloadSize, m_Boids) || m_Boids.size() != Header.BoidCount)
+		{
+			// Out of step with the server, wait for the next keyframe
+			m_HasKeyframe = false;
+			continue;
+		}
+
+		m_LastHeader = Header;
+		m_FramesReceived++;
+		Applied++;
+	}
+
+	m_Incoming.erase(m_Incoming.begin(), m_Incoming.begin() + Offset);
+	return Applied;
+#else
+	return 0;
+#endif
+}
+
+const std::vector<BoidStreamBoid>& BoidStreamClient::GetStreamBoids() const
+{
+	return m_Boids;
+}
+
+void BoidStreamClient::GetBoids(std::vector<uint32_t>& Ids, std::vector<BoidProperties>& Boids) const
+{
+	Ids.resize(m_Boids.size());
+	Boids.resize(m_Boids.size());
+
+	for (size_t i = 0; i < m_Boids.size(); i++)
+	{
+		Ids[i] = m_Boids[i].Id;
+		DequantizeStreamBoid(m_Boids[i], m_LastHeader.BoxHalfSize, Boids[i]);
+	}
+}
+
+uint64_t BoidStreamClient::GetFrame() const
+{
+	return m_LastHeader.Frame;
+}
+
+double BoidStreamClient::GetTime() const
+{
+	return m_LastHeader.Time;
+}
+
+uint64_t BoidStreamClient::GetFramesReceived() const
+{
+	return m_FramesReceived;
+}
+
+uint64_t BoidStreamClient::GetKeyframesReceived() const
+{
+	return m_KeyframesReceived;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "BoidStreamProtocol.h"
+
+// Viewer side of BoidStreamServer, keeps the decoded flock as of the last frame received
+// Only available on POSIX systems, elsewhere IsConnected() is always false
+class BoidStreamClient
+{
+public:
+	// Connect to a Unix domain socket, or TCP on an IPv4 address such as "127.0.0.1"
+	BoidStreamClient(const std::string& UnixPath);
+	BoidStreamClient(const std::string& Address, uint16_t Port);
+	~BoidStreamClient();
+
+	bool IsConnected() const;
+
+	// Only receive boids within box from the next frame on
+	bool SetRegion(DirectX::XMFLOAT3 Min, DirectX::XMFLOAT3 Max);
+	bool ClearRegion();
+
+	// Wait up to timeout for data and apply every complete frame, returns how many were applied
+	uint32_t Poll(uint32_t TimeoutMilliseconds);
+
+	// Boids as quantized on the wire, sorted by Id, which is their registration index in the simulation
+	const std::vector<BoidStreamBoid>& GetStreamBoids() const;
+
+	// Dequantized copy of the held flock, Ids[i] belongs to Boids[i]
+	void GetBoids(std::vector<uint32_t>& Ids, std::vector<BoidProperties>& Boids) const;
+
+	uint64_t GetFrame() const;
+	double GetTime() const;
+	uint64_t GetFramesReceived() const;
+	uint64_t GetKeyframesReceived() const;
+
+protected:
+	bool SendRequest(const BoidStreamRegionRequest& Request);
+
+	int m_Socket = -1;
+	std::vector<uint8_t> m_Incoming;
+
+	std::vector<BoidStreamBoid> m_Boids;
+	bool m_HasKeyframe = false;
+	BoidStreamFrameHeader m_LastHeader = {};
+
+	uint64_t m_FramesReceived = 0;
+	uint64_t m_KeyframesReceived = 0;
+};
@@ -0,0 +1,267 @@
+#include "BoidStreamProtocol.h"
+#include "BoidPhysicsSystem.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	int32_t QuantizeComponent(float Value, float Range, int32_t Maximum)
+	{
+		float Scaled = Range > 0 ? roundf(Value / Range * Maximum) : 0;
+		return static_cast<int32_t>(std::min(std::max(Scaled, static_cast<float>(-Maximum)), static_cast<float>(Maximum)));
+	}
+
+	void WriteVarint(std::vector<uint8_t>& Out, uint64_t Value)
+	{
+		while (Value >= 0x80)
+		{
+			Out.push_back(static_cast<uint8_t>(Value | 0x80));
+			Value >>= 7;
+		}
+		Out.push_back(static_cast<uint8_t>(Value));
+	}
+
+	bool ReadVarint(const uint8_t*& Data, const uint8_t* End, uint64_t& Value)
+	{
+		Value = 0;
+		for (uint32_t Shift = 0; Shift < 64; Shift += 7)
+		{
+			if (Data == End)
+			{
+				return false;
+			}
+
+			uint8_t Byte = *Data++;
+			Value |= static_cast<uint64_t>(Byte & 0x7F) << Shift;
+
+			if (!(Byte & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint32_t ZigZag(int32_t Value)
+	{
+		return (static_cast<uint32_t>(Value) << 1) ^ static_cast<uint32_t>(Value >> 31);
+	}
+
+	int32_t UnZigZag(uint64_t Value)
+	{
+		return static_cast<int32_t>(static_cast<uint32_t>(Value >> 1) ^ (0u - static_cast<uint32_t>(Value & 1)));
+	}
+
+	bool IsSameBoid(const BoidStreamBoid& A, const BoidStreamBoid& B)
+	{
+		return A.Position[0] == B.Position[0] && A.Position[1] == B.Position[1] && A.Position[2] == B.Position[2] &&
+			A.Direction[0] == B.Direction[0] && A.Direction[1] == B.Direction[1] && A.Direction[2] == B.Direction[2];
+	}
+}
+
+BoidStreamBoid QuantizeStreamBoid(uint32_t Id, const BoidProperties& Boid, DirectX::XMFLOAT3 BoxHalfSize)
+{
+	BoidStreamBoid Out;
+	Out.Id = Id;
+
+	Out.Position[0] = static_cast<int16_t>(QuantizeComponent(Boid.BoidPosition.x, BoxHalfSize.x, INT16_MAX));
+	Out.Position[1] = static_cast<int16_t>(QuantizeComponent(Boid.BoidPosition.y, BoxHalfSize.y, INT16_MAX));
+	Out.Position[2] = static_cast<int16_t>(QuantizeComponent(Boid.BoidPosition.z, BoxHalfSize.z, INT16_MAX));
+
+	Out.Direction[0] = static_cast<int8_t>(QuantizeComponent(Boid.BoidDirection.x, 1, INT8_MAX));
+	Out.Direction[1] = static_cast<int8_t>(QuantizeComponent(Boid.BoidDirection.y, 1, INT8_MAX));
+	Out.Direction[2] = static_cast<int8_t>(QuantizeComponent(Boid.BoidDirection.z, 1, INT8_MAX));
+
+	return Out;
+}
+
+void DequantizeStreamBoid(const BoidStreamBoid& Boid, DirectX::XMFLOAT3 BoxHalfSize, BoidProperties& Out)
+{
+	Out.BoidPosition = DirectX::XMFLOAT4(Boid.Position[0] * BoxHalfSize.x / INT16_MAX, Boid.Position[1] * BoxHalfSize.y / INT16_MAX, Boid.Position[2] * BoxHalfSize.z / INT16_MAX, 0);
+	Out.BoidDirection = DirectX::XMFLOAT4(Boid.Direction[0] / 127.0f, Boid.Direction[1] / 127.0f, Boid.Direction[2] / 127.0f, 0);
+}
+
+void EncodeBoidStreamDelta(const std::vector<BoidStreamBoid>& Previous, const std::vector<BoidStreamBoid>& Current, std::vector<uint8_t>& Out)
+{
+	thread_local std::vector<uint32_t> Removed;
+	thread_local std::vector<uint32_t> Changed;
+	thread_local std::vector<int32_t> ChangedBase;
+
+	Removed.clear();
+	Changed.clear();
+	ChangedBase.clear();
+
+	// Walk both Id sorted lists together, ChangedBase holds index of previous value or -1 if viewer has none
+	size_t p = 0;
+	for (size_t c = 0; c < Current.size(); c++)
+	{
+		while (p < Previous.size() && Previous[p].Id < Current[c].Id)
+		{
+			Removed.push_back(Previous[p++].Id);
+		}
+
+		if (p < Previous.size() && Previous[p].Id == Current[c].Id)
+		{
+			if (!IsSameBoid(Previous[p], Current[c]))
+			{
+				Changed.push_back(static_cast<uint32_t>(c));
+				ChangedBase.push_back(static_cast<int32_t>(p));
+			}
+			p++;
+		}
+		else
+		{
+			Changed.push_back(static_cast<uint32_t>(c));
+			ChangedBase.push_back(-1);
+		}
+	}
+	while (p < Previous.size())
+	{
+		Removed.push_back(Previous[p++].Id);
+	}
+
+	Out.clear();
+
+	WriteVarint(Out, Removed.size());
+	uint32_t LastId = 0;
+	for (uint32_t Id : Removed)
+	{
+		WriteVarint(Out, Id - LastId);
+		LastId = Id;
+	}
+
+	WriteVarint(Out, Changed.size());
+	LastId = 0;
+	for (size_t i = 0; i < Changed.size(); i++)
+	{
+		const BoidStreamBoid& Boid = Current[Changed[i]];
+		const BoidStreamBoid Zero = {};
+		const BoidStreamBoid& Base = ChangedBase[i] >= 0 ? Previous[ChangedBase[i]] : Zero;
+
+		WriteVarint(Out, Boid.Id - LastId);
+		LastId = Boid.Id;
+
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			WriteVarint(Out, ZigZag(Boid.Position[Axis] - Base.Position[Axis]));
+		}
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			WriteVarint(Out, ZigZag(Boid.Direction[Axis] - Base.Direction[Axis]));
+		}
+	}
+}
+
+bool DecodeBoidStreamDelta(const uint8_t* Data, size_t Size, std::vector<BoidStreamBoid>& State)
+{
+	const uint8_t* End = Data + Size;
+
+	thread_local std::vector<uint32_t> Removed;
+	thread_local std::vector<BoidStreamBoid> Changed;
+	thread_local std::vector<BoidStreamBoid> Merged;
+
+	Removed.clear();
+	Changed.clear();
+
+	uint64_t Count = 0;
+	uint64_t Value = 0;
+	uint64_t Id = 0;
+
+	if (!ReadVarint(Data, End, Count) || Count > Size)
+	{
+		return false;
+	}
+	for (uint64_t i = 0; i < Count; i++)
+	{
+		if (!ReadVarint(Data, End, Value) || (Id += Value) > UINT32_MAX)
+		{
+			return false;
+		}
+		Removed.push_back(static_cast<uint32_t>(Id));
+	}
+
+	// Differences are kept as-is for now and applied against the base while merging
+	Id = 0;
+	if (!ReadVarint(Data, End, Count) || Count > Size)
+	{
+		return false;
+	}
+	for (uint64_t i = 0; i < Count; i++)
+	{
+		BoidStreamBoid Boid = {};
+		if (!ReadVarint(Data, End, Value) || (Id += Value) > UINT32_MAX)
+		{
+			return false;
+		}
+		Boid.Id = static_cast<uint32_t>(Id);
+
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			if (!ReadVarint(Data, End, Value))
+			{
+				return false;
+			}
+			Boid.Position[Axis] = static_cast<int16_t>(UnZigZag(Value));
+		}
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			if (!ReadVarint(Data, End, Value))
+			{
+				return false;
+			}
+			Boid.Direction[Axis] = static_cast<int8_t>(UnZigZag(Value));
+		}
+
+		Changed.push_back(Boid);
+	}
+
+	if (Data != End)
+	{
+		return false;
+	}
+
+	// Merge all three Id sorted lists into the new state
+	Merged.clear();
+	size_t r = 0;
+	size_t c = 0;
+	for (size_t s = 0; s <= State.size(); s++)
+	{
+		const uint32_t StateId = s < State.size() ? State[s].Id : UINT32_MAX;
+
+		// Boids new to this viewer come before the next held one
+		while (c < Changed.size() && (Changed[c].Id < StateId || s == State.size()))
+		{
+			Merged.push_back(Changed[c++]);
+		}
+
+		if (s == State.size())
+		{
+			break;
+		}
+
+		while (r < Removed.size() && Removed[r] < StateId)
+		{
+			r++;
+		}
+		if (r < Removed.size() && Removed[r] == StateId)
+		{
+			continue;
+		}
+
+		BoidStreamBoid Boid = State[s];
+		if (c < Changed.size() && Changed[c].Id == StateId)
+		{
+			for (int Axis = 0; Axis < 3; Axis++)
+			{
+				Boid.Position[Axis] = static_cast<int16_t>(Boid.Position[Axis] + Changed[c].Position[Axis]);
+				Boid.Direction[Axis] = static_cast<int8_t>(Boid.Direction[Axis] + Changed[c].Direction[Axis]);
+			}
+			c++;
+		}
+		Merged.push_back(Boid);
+	}
+
+	State.swap(Merged);
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+
+struct BoidProperties;
+
+// Boid as streamed to viewers, position relative to box half size in 16 bits per axis, direction in 8 bits per axis
+struct BoidStreamBoid
+{
+	uint32_t Id;
+	int16_t Position[3];
+	int8_t Direction[3];
+};
+
+// Precedes every frame sent to a viewer, payload follows it
+// Keyframes are encoded against an empty flock, so viewers drop what they hold before applying one
+struct BoidStreamFrameHeader
+{
+	static const uint32_t MagicValue = 0x52545342; // "BSTR"
+
+	uint32_t Magic;
+	uint32_t IsKeyframe;
+	uint64_t Frame;
+	double Time;
+	DirectX::XMFLOAT3 BoxHalfSize;
+	uint32_t BoidCount;
+	uint32_t PayloadSize;
+
+	// Always zero, spells out what would otherwise be padding so every byte sent is written
+	uint32_t Reserved;
+};
+
+// Sent by viewers to only receive boids inside a box, or everything again
+struct BoidStreamRegionRequest
+{
+	static const uint32_t ClearRegion = 0;
+	static const uint32_t SetRegion = 1;
+
+	uint32_t Type;
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Max;
+};
+
+BoidStreamBoid QuantizeStreamBoid(uint32_t Id, const BoidProperties& Boid, DirectX::XMFLOAT3 BoxHalfSize);
+void DequantizeStreamBoid(const BoidStreamBoid& Boid, DirectX::XMFLOAT3 BoxHalfSize, BoidProperties& Out);
+
+// Encode Current against Previous, both sorted by Id, as removed Ids then changed boids with zigzag varint differences
+// Boids that did not change cost nothing, boids new to the viewer are differences against zero
+void EncodeBoidStreamDelta(const std::vector<BoidStreamBoid>& Previous, const std::vector<BoidStreamBoid>& Current, std::vector<uint8_t>& Out);
+
+// Apply encoded payload to State in place, false if payload is malformed, State is left unchanged then
+bool DecodeBoidStreamDelta(const uint8_t* Data, size_t Size, std::vector<BoidStreamBoid>& State);
@@ -0,0 +1,366 @@
+#include "BoidStreamServer.h"
+#include "BoidPhysicsSystem.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+BoidStreamServer::BoidStreamServer(const BoidStreamSettings& Settings) : m_Settings(Settings)
+{
+#ifndef _WIN32
+	if (!Settings.UnixPath.empty())
+	{
+		sockaddr_un Address;
+		memset(&Address, 0, sizeof(Address));
+		Address.sun_family = AF_UNIX;
+
+		if (Settings.UnixPath.size() >= sizeof(Address.sun_path))
+		{
+			return;
+		}
+		memcpy(Address.sun_path, Settings.UnixPath.c_str(), Settings.UnixPath.size() + 1);
+
+		unlink(Address.sun_path);
+		m_ListenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (m_ListenSocket >= 0 && bind(m_ListenSocket, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0)
+		{
+			close(m_ListenSocket);
+			m_ListenSocket = -1;
+		}
+	}
+	else
+	{
+		sockaddr_in Address;
+		memset(&Address, 0, sizeof(Address));
+		Address.sin_family = AF_INET;
+		Address.sin_port = htons(Settings.TcpPort);
+		Address.sin_addr.s_addr = htonl(Settings.LoopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+
+		m_ListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+		int Enable = 1;
+		if (m_ListenSocket >= 0 && (setsockopt(m_ListenSocket, SOL_SOCKET, SO_REUSEADDR, &Enable, sizeof(Enable)) != 0 || bind(m_ListenSocket, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0))
+		{
+			close(m_ListenSocket);
+			m_ListenSocket = -1;
+		}
+	}
+
+	if (m_ListenSocket >= 0)
+	{
+		if (listen(m_ListenSocket, static_cast<int>(Settings.MaximumClients)) != 0)
+		{
+			close(m_ListenSocket);
+			m_ListenSocket = -1;
+			return;
+		}
+
+		fcntl(m_ListenSocket, F_SETFL, fcntl(m_ListenSocket, F_GETFL) | O_NONBLOCK);
+	}
+#endif
+}
+
+BoidStreamServer::~BoidStreamServer()
+{
+#ifndef _WIN32
+	for (Client& Viewer : m_Clients)
+	{
+		close(Viewer.Socket);
+	}
+
+	if (m_ListenSocket >= 0)
+	{
+		close(m_ListenSocket);
+
+		if (!m_Settings.UnixPath.empty())
+		{
+			unlink(m_Settings.UnixPath.c_str());
+		}
+	}
+#endif
+}
+
+bool BoidStreamServer::IsOpen() const
+{
+	return m_ListenSocket >= 0;
+}
+
+void BoidStreamServer::Update(BoidPhysicsSystem& PhysicsSystem, double Time)
+{
+#ifndef _WIN32
+	if (m_ListenSocket < 0)
+	{
+		return;
+	}
+
+	AcceptClients();
+
+	// Drop viewers that went away, remaining ones get a head start on what is already queued
+	for (size_t i = 0; i < m_Clients.size();)
+	{
+		if (!ReadRequests(m_Clients[i]) || !Flush(m_Clients[i]))
+		{
+			close(m_Clients[i].Socket);
+			m_Clients.erase(m_Clients.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	const double FrameInterval = m_Settings.FramesPerSecond > 0 ? 1.0 / m_Settings.FramesPerSecond : 0;
+	if (m_Clients.empty() || (m_HasSentFrame && Time - m_LastFrameTime < FrameInterval))
+	{
+		return;
+	}
+
+	m_HasSentFrame = true;
+	m_LastFrameTime = Time;
+	m_Frame++;
+
+	// Quantize the flock once, every viewer selects from the same frame
+	// Read straight from the grid, steps leave it built so this only rebuilds if boids changed since
+	PhysicsSystem.UpdateSpatialGrid();
+	const BoidLargeVector<BoidProperties>& Boids = PhysicsSystem.GetSortedBoidProperties();
+	const BoidLargeVector<uint32_t>& SortedIndices = PhysicsSystem.GetSpatialGrid().GetSortedIndices();
+	const DirectX::XMFLOAT4 Bounds = PhysicsSystem.GetBoundingBoxProperties();
+	m_BoxHalfSize = DirectX::XMFLOAT3(Bounds.x, Bounds.y, Bounds.z);
+
+	// Sorted slot maps back to registration order, which is what Ids and deltas follow
+	m_Quantized.resize(Boids.size());
+	for (uint32_t i = 0; i < Boids.size(); i++)
+	{
+		m_Quantized[SortedIndices[i]] = QuantizeStreamBoid(SortedIndices[i], Boids[i], m_BoxHalfSize);
+	}
+
+	for (size_t i = 0; i < m_Clients.size();)
+	{
+		QueueFrame(m_Clients[i], PhysicsSystem, Time);
+
+		if (!Flush(m_Clients[i]))
+		{
+			close(m_Clients[i].Socket);
+			m_Clients.erase(m_Clients.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+#endif
+}
+
+void BoidStreamServer::AcceptClients()
+{
+#ifndef _WIN32
+	while (true)
+	{
+		int Socket = accept(m_ListenSocket, nullptr, nullptr);
+		if (Socket < 0)
+		{
+			return;
+		}
+
+		if (m_Clients.size() >= m_Settings.MaximumClients)
+		{
+			close(Socket);
+			continue;
+		}
+
+		fcntl(Socket, F_SETFL, fcntl(Socket, F_GETFL) | O_NONBLOCK);
+
+		// Frames are sent whole, waiting to coalesce them only adds latency
+		if (m_Settings.UnixPath.empty())
+		{
+			int Enable = 1;
+			setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, &Enable, sizeof(Enable));
+		}
+
+		Client Viewer;
+		Viewer.Socket = Socket;
+		m_Clients.push_back(std::move(Viewer));
+	}
+#endif
+}
+
+bool BoidStreamServer::ReadRequests(Client& Viewer)
+{
+#ifndef _WIN32
+	uint8_t Buffer[1024];
+
+	while (true)
+	{
+		ssize_t Read = recv(Viewer.Socket, Buffer, sizeof(Buffer), 0);
+		if (Read > 0)
+		{
+			Viewer.Incoming.insert(Viewer.Incoming.end(), Buffer, Buffer + Read);
+			continue;
+		}
+
+		if (Read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		{
+			break;
+		}
+
+		return false;
+	}
+
+	// Requests are fixed size, only the latest region matters
+	size_t Offset = 0;
+	while (Viewer.Incoming.size() - Offset >= sizeof(BoidStreamRegionRequest))
+	{
+		BoidStreamRegionRequest Request;
+		memcpy(&Request, Viewer.Incoming.data() + Offset, sizeof(Request));
+		Offset += sizeof(Request);
+
+		if (Request.Type == BoidStreamRegionRequest::SetRegion)
+		{
+			Viewer.HasRegion = true;
+			Viewer.RegionMin = Request.Min;
+			Viewer.RegionMax = Request.Max;
+		}
+		else if (Request.Type == BoidStreamRegionRequest::ClearRegion)
+		{
+			Viewer.HasRegion = false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	Viewer.Incoming.erase(Viewer.Incoming.begin(), Viewer.Incoming.begin() + Offset);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool BoidStreamServer::Flush(Client& Viewer)
+{
+#ifndef _WIN32
+	while (Viewer.OutgoingOffset < Viewer.Outgoing.size())
+	{
+		ssize_t Written = send(Viewer.Socket, Viewer.Outgoing.data() + Viewer.OutgoingOffset, Viewer.Outgoing.size() - Viewer.OutgoingOffset, MSG_NOSIGNAL);
+		if (Written > 0)
+		{
+			Viewer.OutgoingOffset += Written;
+			m_BytesSent += Written;
+			continue;
+		}
+
+		if (Written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		{
+			return true;
+		}
+
+		return false;
+	}
+
+	Viewer.Outgoing.clear();
+	Viewer.OutgoingOffset = 0;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void BoidStreamServer::QueueFrame(Client& Viewer, BoidPhysicsSystem& PhysicsSystem, double Time)
+{
+	// Viewer has not taken its last frame yet, skip this one rather than queue without bound
+	// What it misses would make the next delta as large as a keyframe, so send one of those instead
+	if (Viewer.OutgoingOffset < Viewer.Outgoing.size())
+	{
+		Viewer.NeedsKeyframe = true;
+		m_FramesSkipped++;
+		return;
+	}
+
+	m_Selected.clear();
+
+	if (Viewer.HasRegion)
+	{
+		m_RegionIndices.resize(m_Quantized.size());
+		uint32_t Count = PhysicsSystem.QueryBox(Viewer.RegionMin, Viewer.RegionMax, m_RegionIndices.data(), static_cast<uint32_t>(m_RegionIndices.size()));
+		Count = std::min(Count, static_cast<uint32_t>(m_RegionIndices.size()));
+
+		// Query returns boids in grid order, deltas need them in Id order
+		std::sort(m_RegionIndices.begin(), m_RegionIndices.begin() + Count);
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			m_Selected.push_back(m_Quantized[m_RegionIndices[i]]);
+		}
+	}
+	else
+	{
+		m_Selected = m_Quantized;
+	}
+
+	const bool IsKeyframe = Viewer.NeedsKeyframe || Viewer.FramesSinceKeyframe + 1 >= m_Settings.KeyframeInterval;
+
+	if (IsKeyframe)
+	{
+		Viewer.LastSent.clear();
+		Viewer.NeedsKeyframe = false;
+		Viewer.FramesSinceKeyframe = 0;
+		m_KeyframesSent++;
+	}
+	else
+	{
+		Viewer.FramesSinceKeyframe++;
+	}
+
+	EncodeBoidStreamDelta(Viewer.LastSent, m_Selected, m_Payload);
+
+	// Zeroed so reserved bytes never carry stale stack contents onto the wire
+	BoidStreamFrameHeader Header;
+	memset(&Header, 0, sizeof(Header));
+	Header.Magic = BoidStreamFrameHeader::MagicValue;
+	Header.IsKeyframe = IsKeyframe;
+	Header.Frame = m_Frame;
+	Header.Time = Time;
+	Header.BoxHalfSize = m_BoxHalfSize;
+	Header.BoidCount = static_cast<uint32_t>(m_Selected.size());
+	Header.PayloadSize = static_cast<uint32_t>(m_Payload.size());
+
+	const uint8_t* HeaderBytes = reinterpret_cast<const uint8_t*>(&Header);
+	Viewer.Outgoing.insert(Viewer.Outgoing.end(), HeaderBytes, HeaderBytes + sizeof(Header));
+	Viewer.Outgoing.insert(Viewer.Outgoing.end(), m_Payload.begin(), m_Payload.end());
+
+	Viewer.LastSent.swap(m_Selected);
+	m_FramesSent++;
+}
+
+uint32_t BoidStreamServer::GetClientCount() const
+{
+	return static_cast<uint32_t>(m_Clients.size());
+}
+
+uint64_t BoidStreamServer::GetBytesSent() const
+{
+	return m_BytesSent;
+}
+
+uint64_t BoidStreamServer::GetFramesSent() const
+{
+	return m_FramesSent;
+}
+
+uint64_t BoidStreamServer::GetKeyframesSent() const
+{
+	return m_KeyframesSent;
+}
+
+uint64_t BoidStreamServer::GetFramesSkipped() const
+{
+	return m_FramesSkipped;
+}
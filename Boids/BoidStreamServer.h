@@ -0,0 +1,93 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "BoidStreamProtocol.h"
+
+class BoidPhysicsSystem;
+
+struct BoidStreamSettings
+{
+	// Listen on a Unix domain socket at this path if set, otherwise on TCP
+	std::string UnixPath;
+	uint16_t TcpPort = 7420;
+	bool LoopbackOnly = true;
+
+	float FramesPerSecond = 30;
+
+	// Frames between keyframes, so a viewer that missed something recovers on its own
+	uint32_t KeyframeInterval = 120;
+
+	uint32_t MaximumClients = 16;
+};
+
+// Streams quantized, delta compressed flock state to viewer processes, driven from the simulation thread
+// Sockets are non-blocking, a viewer that has not taken its previous frame yet skips frames and gets a keyframe once it catches up
+// Only available on POSIX systems, elsewhere IsOpen() is always false
+class BoidStreamServer
+{
+public:
+	BoidStreamServer(const BoidStreamSettings& Settings);
+	~BoidStreamServer();
+
+	bool IsOpen() const;
+
+	// Accept viewers, read their region requests and send a frame if one is due, call once per step, never blocks
+	void Update(BoidPhysicsSystem& PhysicsSystem, double Time);
+
+	uint32_t GetClientCount() const;
+	uint64_t GetBytesSent() const;
+	uint64_t GetFramesSent() const;
+	uint64_t GetKeyframesSent() const;
+	uint64_t GetFramesSkipped() const;
+
+protected:
+	struct Client
+	{
+		int Socket = -1;
+
+		std::vector<uint8_t> Outgoing;
+		size_t OutgoingOffset = 0;
+		std::vector<uint8_t> Incoming;
+
+		bool HasRegion = false;
+		DirectX::XMFLOAT3 RegionMin = DirectX::XMFLOAT3(0, 0, 0);
+		DirectX::XMFLOAT3 RegionMax = DirectX::XMFLOAT3(0, 0, 0);
+
+		// What the viewer holds once everything queued has arrived, deltas are encoded against it
+		std::vector<BoidStreamBoid> LastSent;
+		bool NeedsKeyframe = true;
+		uint32_t FramesSinceKeyframe = 0;
+	};
+
+	void AcceptClients();
+
+	// False if viewer disconnected or sent something malformed
+	bool ReadRequests(Client& Viewer);
+	bool Flush(Client& Viewer);
+
+	void QueueFrame(Client& Viewer, BoidPhysicsSystem& PhysicsSystem, double Time);
+
+	BoidStreamSettings m_Settings;
+	int m_ListenSocket = -1;
+
+	std::vector<Client> m_Clients;
+
+	uint64_t m_Frame = 0;
+	double m_LastFrameTime = 0;
+	bool m_HasSentFrame = false;
+
+	// Whole flock quantized once per frame, indexed by registration order
+	std::vector<BoidStreamBoid> m_Quantized;
+	DirectX::XMFLOAT3 m_BoxHalfSize = DirectX::XMFLOAT3(0, 0, 0);
+
+	// Scratch kept between frames to avoid reallocating
+	std::vector<uint32_t> m_RegionIndices;
+	std::vector<BoidStreamBoid> m_Selected;
+	std::vector<uint8_t> m_Payload;
+
+	uint64_t m_BytesSent = 0;
+	uint64_t m_FramesSent = 0;
+	uint64_t m_KeyframesSent = 0;
+	uint64_t m_FramesSkipped = 0;
+};
@@ -0,0 +1,347 @@
+#include "BoidSweepRunner.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "BoidThreadPool.h"
+#include "BoidStepProfiler.h"
+#include "BoidAllocationTracker.h"
+
+using namespace DirectX;
+
+std::vector<BoidSweepResult> BoidSweepRunner::Run(const BoidSweepSettings& Settings)
+{
+	std::vector<BoidSweepResult> Results;
+
+	BoidThreadPool& ThreadPool = BoidThreadPool::Get();
+	const uint32_t PreviousThreadCount = ThreadPool.GetThreadCount();
+
+	for (uint32_t ThreadCount : Settings.ThreadCounts)
+	{
+		ThreadPool.SetThreadCount(ThreadCount);
+
+		for (uint32_t BoidCount : Settings.BoidCounts)
+		{
+			for (const BoidSweepEngine& Engine : Settings.Engines)
+			{
+				for (float Radius : Settings.Radii)
+				{
+					Results.push_back(RunCase(Settings, BoidCount, Engine, ThreadPool.GetThreadCount(), Radius));
+				}
+			}
+		}
+	}
+
+	ThreadPool.SetThreadCount(PreviousThreadCount);
+	return Results;
+}
+
+BoidSweepResult BoidSweepRunner::RunCase(const BoidSweepSettings& Settings, uint32_t BoidCount, const BoidSweepEngine& Engine, uint32_t ThreadCount, float Radius)
+{
+	BoidPhysicsSystem PhysicsSystem;
+	PhysicsSystem.SetBoundingBoxHalfSize(Settings.BoxHalfSize);
+
+	ModelProperties Properties;
+	Properties.MaximumAlignmentDistance = Radius;
+	Properties.MaximumCohesionDistance = Radius;
+	PhysicsSystem.SetModelProperties(Properties);
+
+	PhysicsSystem.SetNeighbourSearchMode(Engine.SearchMode);
+	PhysicsSystem.SetRulePrecision(Engine.Precision);
+	PhysicsSystem.SetStepScheduling(Engine.Scheduling);
+
+	// Same seeded layout for every case, so cases differ only in what the sweep varies
+	std::mt19937 MTEngine(Settings.Seed);
+	std::uniform_real_distribution<float> Unit(-1.0f, 1.0f);
+
+	for (uint32_t i = 0; i < BoidCount; i++)
+	{
+		XMFLOAT3 Position = { Unit(MTEngine) * Settings.BoxHalfSize.x, Unit(MTEngine) * Settings.BoxHalfSize.y, Unit(MTEngine) * Settings.BoxHalfSize.z };
+
+		XMFLOAT3 Direction;
+		XMStoreFloat3(&Direction, XMVector3Normalize(XMVectorSet(Unit(MTEngine), Unit(MTEngine), Unit(MTEngine), 0) + XMVectorSet(0, 0.01f, 0, 0)));
+
+		PhysicsSystem.SpawnBoid(Position, Direction);
+	}
+
+	for (uint32_t i = 0; i < Settings.WarmUpSteps; i++)
+	{
+		PhysicsSystem.UpdateBoidPhysics(Settings.DeltaTime);
+	}
+
+	// Timed without a profiler, which would read counters around every stage and step the stages one after another
+	std::vector<double> Samples(Settings.Repetitions);
+	const uint64_t AllocationsBefore = BoidAllocationTracker::GetTotal().Allocations;
+	for (uint32_t Repetition = 0; Repetition < Settings.Repetitions; Repetition++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < Settings.StepsPerRepetition; i++)
+		{
+			PhysicsSystem.UpdateBoidPhysics(Settings.DeltaTime);
+		}
+		auto Stop = std::chrono::high_resolution_clock::now();
+
+		Samples[Repetition] = std::chrono::duration<double, std::milli>(Stop - Start).count() / std::max(Settings.StepsPerRepetition, 1u);
+	}
+
+	const uint64_t AllocationsAfter = BoidAllocationTracker::GetTotal().Allocations;
+
+	// Counters come from a separate profiled pass, its first step only attaches the threads and is not counted
+	BoidStepProfiler Profiler;
+	PhysicsSystem.SetStepProfiler(&Profiler);
+	PhysicsSystem.UpdateBoidPhysics(Settings.DeltaTime);
+	Profiler.Reset();
+
+	for (uint32_t i = 0; i < Settings.StepsPerRepetition; i++)
+	{
+		PhysicsSystem.UpdateBoidPhysics(Settings.DeltaTime);
+	}
+
+	PhysicsSystem.SetStepProfiler(nullptr);
+
+	BoidSweepResult Result = {};
+	Result.BoidCount = BoidCount;
+	Result.Engine = Engine.Name;
+	Result.Scheduling = GetStepSchedulingName(Engine.Scheduling);
+	Result.ThreadCount = ThreadCount;
+	Result.Radius = Radius;
+	Result.Repetitions = Settings.Repetitions;
+	Result.MeasuredAllocations = AllocationsAfter - AllocationsBefore;
+
+	const BoidStageProfile& Rules = Profiler.GetStage(BoidProfileStage::Rules);
+	if (Profiler.HasCounter(BoidCounter::Cycles) && Profiler.HasCounter(BoidCounter::Instructions))
+	{
+		Result.RulesInstructionsPerCycle = Rules.GetInstructionsPerCycle();
+	}
+	if (Profiler.HasCounter(BoidCounter::CacheMisses))
+	{
+		Result.RulesCacheMissesPerPair = Rules.GetPerPair(BoidCounter::CacheMisses);
+	}
+	if (Profiler.HasCounter(BoidCounter::BranchMisses))
+	{
+		Result.RulesBranchMissesPerPair = Rules.GetPerPair(BoidCounter::BranchMisses);
+	}
+
+	if (Samples.empty())
+	{
+		return Result;
+	}
+
+	double Sum = 0;
+	for (double Sample : Samples)
+	{
+		Sum += Sample;
+	}
+	Result.MeanMilliseconds = Sum / Samples.size();
+
+	// Sample standard deviation, needs at least two repetitions
+	if (Samples.size() > 1)
+	{
+		double SquaredSum = 0;
+		for (double Sample : Samples)
+		{
+			SquaredSum += (Sample - Result.MeanMilliseconds) * (Sample - Result.MeanMilliseconds);
+		}
+
+		Result.StandardDeviation = std::sqrt(SquaredSum / (Samples.size() - 1));
+		Result.ConfidenceInterval = GetTwoSidedCriticalValue(static_cast<double>(Samples.size() - 1)) * Result.StandardDeviation / std::sqrt(static_cast<double>(Samples.size()));
+	}
+
+	return Result;
+}
+
+bool BoidSweepRunner::WriteResults(const char* Path, const std::vector<BoidSweepResult>& Results)
+{
+	std::ofstream File(Path);
+	if (!File)
+	{
+		return false;
+	}
+
+	File << "BoidCount,Engine,ThreadCount,Radius,Repetitions,MeanMilliseconds,StandardDeviation,ConfidenceInterval,RulesInstructionsPerCycle,RulesCacheMissesPerPair,RulesBranchMissesPerPair,MeasuredAllocations,Scheduling" << std::endl;
+	for (const BoidSweepResult& Result : Results)
+	{
+		File << Result.BoidCount << "," << Result.Engine << "," << Result.ThreadCount << "," << Result.Radius << "," << Result.Repetitions << ","
+			 << Result.MeanMilliseconds << "," << Result.StandardDeviation << "," << Result.ConfidenceInterval << ","
+			 << Result.RulesInstructionsPerCycle << "," << Result.RulesCacheMissesPerPair << "," << Result.RulesBranchMissesPerPair << "," << Result.MeasuredAllocations << "," << Result.Scheduling << std::endl;
+	}
+
+	return static_cast<bool>(File);
+}
+
+bool BoidSweepRunner::ReadResults(const char* Path, std::vector<BoidSweepResult>& Results)
+{
+	std::ifstream File(Path);
+	if (!File)
+	{
+		return false;
+	}
+
+	Results.clear();
+
+	std::string Line;
+	std::getline(File, Line);
+
+	while (std::getline(File, Line))
+	{
+		if (Line.empty())
+		{
+			continue;
+		}
+
+		std::istringstream Fields(Line);
+		std::string Field[13];
+		for (std::string& Value : Field)
+		{
+			std::getline(Fields, Value, ',');
+		}
+
+		BoidSweepResult Result = {};
+		try
+		{
+			Result.BoidCount = static_cast<uint32_t>(std::stoul(Field[0]));
+			Result.Engine = Field[1];
+			Result.ThreadCount = static_cast<uint32_t>(std::stoul(Field[2]));
+			Result.Radius = std::stof(Field[3]);
+			Result.Repetitions = static_cast<uint32_t>(std::stoul(Field[4]));
+			Result.MeanMilliseconds = std::stod(Field[5]);
+			Result.StandardDeviation = std::stod(Field[6]);
+			Result.ConfidenceInterval = std::stod(Field[7]);
+
+			// Baselines recorded before counters were added have no counter columns
+			if (!Field[10].empty())
+			{
+				Result.RulesInstructionsPerCycle = std::stod(Field[8]);
+				Result.RulesCacheMissesPerPair = std::stod(Field[9]);
+				Result.RulesBranchMissesPerPair = std::stod(Field[10]);
+			}
+			if (!Field[11].empty())
+			{
+				Result.MeasuredAllocations = std::stoull(Field[11]);
+			}
+
+			// Baselines recorded before engines chose a scheduler ran the stages one after another
+			Result.Scheduling = Field[12].empty() ? GetStepSchedulingName(StepScheduling::Stages) : Field[12];
+		}
+		catch (...)
+		{
+			return false;
+		}
+
+		Results.push_back(Result);
+	}
+
+	return true;
+}
+
+std::vector<BoidSweepRegression> BoidSweepRunner::CompareWithBaseline(const std::vector<BoidSweepResult>& Results, const std::vector<BoidSweepResult>& Baseline, double MinimumSlowdown)
+{
+	std::vector<BoidSweepRegression> Regressions;
+
+	for (const BoidSweepResult& Result : Results)
+	{
+		for (const BoidSweepResult& Reference : Baseline)
+		{
+			if (Reference.BoidCount != Result.BoidCount || Reference.Engine != Result.Engine || Reference.Scheduling != Result.Scheduling || Reference.ThreadCount != Result.ThreadCount || Reference.Radius != Result.Radius)
+			{
+				continue;
+			}
+
+			if (Reference.MeanMilliseconds <= 0 || Result.Repetitions < 2 || Reference.Repetitions < 2)
+			{
+				break;
+			}
+
+			double Slowdown = Result.MeanMilliseconds / Reference.MeanMilliseconds - 1.0;
+			if (Slowdown < MinimumSlowdown)
+			{
+				break;
+			}
+
+			// Welch's t-test, variances of the two runs are not assumed equal
+			double ResultVariance = Result.StandardDeviation * Result.StandardDeviation / Result.Repetitions;
+			double ReferenceVariance = Reference.StandardDeviation * Reference.StandardDeviation / Reference.Repetitions;
+			double StandardError = std::sqrt(ResultVariance + ReferenceVariance);
+
+			double TStatistic = StandardError > 0 ? (Result.MeanMilliseconds - Reference.MeanMilliseconds) / StandardError : HUGE_VAL;
+
+			// Welch-Satterthwaite degrees of freedom
+			double DegreesOfFreedom = 1;
+			if (StandardError > 0)
+			{
+				double Denominator = ResultVariance * ResultVariance / (Result.Repetitions - 1) + ReferenceVariance * ReferenceVariance / (Reference.Repetitions - 1);
+				DegreesOfFreedom = Denominator > 0 ? (ResultVariance + ReferenceVariance) * (ResultVariance + ReferenceVariance) / Denominator : 1;
+			}
+
+			if (TStatistic > GetOneSidedCriticalValue(DegreesOfFreedom))
+			{
+				Regressions.push_back({ Result, Reference, Slowdown, TStatistic });
+			}
+			break;
+		}
+	}
+
+	return Regressions;
+}
+
+bool BoidSweepRunner::WriteRegressions(const char* Path, const std::vector<BoidSweepRegression>& Regressions)
+{
+	std::ofstream File(Path);
+	if (!File)
+	{
+		return false;
+	}
+
+	File << Regressions.size() << " significant slowdowns" << std::endl;
+	for (const BoidSweepRegression& Regression : Regressions)
+	{
+		const BoidSweepResult& Result = Regression.Result;
+		File << Result.Engine << " (" << Result.Scheduling << "), " << Result.BoidCount << " boids, " << Result.ThreadCount << " threads, radius " << Result.Radius << ": "
+			 << Regression.Baseline.MeanMilliseconds << " ms -> " << Result.MeanMilliseconds << " ms (+" << Regression.Slowdown * 100.0 << "%, t = " << Regression.TStatistic << ")" << std::endl;
+	}
+
+	return static_cast<bool>(File);
+}
+
+std::vector<BoidSweepResult> BoidSweepRunner::FindAllocatingCases(const std::vector<BoidSweepResult>& Results)
+{
+	std::vector<BoidSweepResult> AllocatingCases;
+	for (const BoidSweepResult& Result : Results)
+	{
+		if (Result.MeasuredAllocations > 0)
+		{
+			AllocatingCases.push_back(Result);
+		}
+	}
+
+	return AllocatingCases;
+}
+
+double BoidSweepRunner::GetTwoSidedCriticalValue(double DegreesOfFreedom)
+{
+	static const double CriticalValues[] =
+	{
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+	};
+
+	// Rounding down keeps the test conservative, past the table the normal distribution is close enough
+	uint32_t Index = static_cast<uint32_t>(std::max(DegreesOfFreedom, 1.0)) - 1;
+	return Index < 30 ? CriticalValues[Index] : 1.960;
+}
+
+double BoidSweepRunner::GetOneSidedCriticalValue(double DegreesOfFreedom)
+{
+	static const double CriticalValues[] =
+	{
+		6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+		1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+		1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697
+	};
+
+	uint32_t Index = static_cast<uint32_t>(std::max(DegreesOfFreedom, 1.0)) - 1;
+	return Index < 30 ? CriticalValues[Index] : 1.645;
+}
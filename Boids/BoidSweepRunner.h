@@ -0,0 +1,105 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "BoidPhysicsSystem.h"
+
+// CPU physics configuration a sweep measures, timed steps run with the given scheduling
+struct BoidSweepEngine
+{
+	std::string Name;
+	NeighbourSearchMode SearchMode;
+	RulePrecision Precision;
+	StepScheduling Scheduling = StepScheduling::TaskGraph;
+};
+
+// Matrix of boid counts x engines x thread counts x radii, every combination is one case
+// Radius is used for alignment and cohesion, which decide how many neighbours each boid visits
+struct BoidSweepSettings
+{
+	std::vector<uint32_t> BoidCounts = { 1000, 4000, 16000 };
+	std::vector<BoidSweepEngine> Engines =
+	{
+		{ "Grid", NeighbourSearchMode::SpatialGrid, RulePrecision::Exact },
+		{ "GridStages", NeighbourSearchMode::SpatialGrid, RulePrecision::Exact, StepScheduling::Stages },
+		{ "GridFast", NeighbourSearchMode::SpatialGrid, RulePrecision::Fast },
+		{ "BarnesHut", NeighbourSearchMode::BarnesHut, RulePrecision::Exact },
+		{ "Topological", NeighbourSearchMode::Topological, RulePrecision::Exact }
+	};
+
+	// Thread count of 0 selects hardware concurrency
+	std::vector<uint32_t> ThreadCounts = { 1, 0 };
+	std::vector<float> Radii = { 6, 12, 24 };
+
+	// Steps run before measuring so grid, octree and pools reach their steady size
+	uint32_t WarmUpSteps = 10;
+
+	// Each repetition is the mean step time over StepsPerRepetition steps, and one sample of the case
+	uint32_t Repetitions = 10;
+	uint32_t StepsPerRepetition = 5;
+
+	float DeltaTime = 1.0f / 60.0f;
+	DirectX::XMFLOAT3 BoxHalfSize = DirectX::XMFLOAT3{ 40, 40, 40 };
+
+	// Boids start from the same seeded layout in every case and every run
+	uint32_t Seed = 1;
+};
+
+// Step time of one case in milliseconds, ConfidenceInterval is the half width of the 95% interval around the mean
+// Rule stage counters come from a profiled pass after the timed steps, zero where hardware counters are unavailable, misses are per candidate neighbour pair
+// MeasuredAllocations counts heap allocations over every measured step, always zero unless allocation tracking is built in
+// Scheduling names the scheduler of the timed steps, profiled steps always run stage by stage so counters come from that path
+struct BoidSweepResult
+{
+	uint32_t BoidCount;
+	std::string Engine;
+	std::string Scheduling;
+	uint32_t ThreadCount;
+	float Radius;
+	uint32_t Repetitions;
+	double MeanMilliseconds;
+	double StandardDeviation;
+	double ConfidenceInterval;
+	double RulesInstructionsPerCycle;
+	double RulesCacheMissesPerPair;
+	double RulesBranchMissesPerPair;
+	uint64_t MeasuredAllocations;
+};
+
+// Case slower than its baseline by at least the minimum slowdown, with the difference significant at 95%
+struct BoidSweepRegression
+{
+	BoidSweepResult Result;
+	BoidSweepResult Baseline;
+	double Slowdown;
+	double TStatistic;
+};
+
+// Runs parameter sweeps of the CPU physics headlessly and compares them against a stored baseline
+class BoidSweepRunner
+{
+public:
+	// Run every case on its own physics system, thread pool is restored to its previous size afterwards
+	static std::vector<BoidSweepResult> Run(const BoidSweepSettings& Settings);
+
+	// Results as comma separated values, one case per line after a header
+	static bool WriteResults(const char* Path, const std::vector<BoidSweepResult>& Results);
+	static bool ReadResults(const char* Path, std::vector<BoidSweepResult>& Results);
+
+	// Welch's t-test per case found in both with the same scheduling, one sided so only slowdowns are flagged
+	// Slowdowns smaller than MinimumSlowdown, e.g. 0.05 for 5%, are ignored however significant they are
+	static std::vector<BoidSweepRegression> CompareWithBaseline(const std::vector<BoidSweepResult>& Results, const std::vector<BoidSweepResult>& Baseline, double MinimumSlowdown = 0.05);
+
+	// Human readable report of regressions, one line each
+	static bool WriteRegressions(const char* Path, const std::vector<BoidSweepRegression>& Regressions);
+
+	// Cases whose warmed up steps still allocated, a steady state step is expected to reuse everything it needs
+	static std::vector<BoidSweepResult> FindAllocatingCases(const std::vector<BoidSweepResult>& Results);
+
+protected:
+	static BoidSweepResult RunCase(const BoidSweepSettings& Settings, uint32_t BoidCount, const BoidSweepEngine& Engine, uint32_t ThreadCount, float Radius);
+
+	// Critical values of Student's t distribution at 95%, two sided for intervals and one sided for tests
+	static double GetTwoSidedCriticalValue(double DegreesOfFreedom);
+	static double GetOneSidedCriticalValue(double DegreesOfFreedom);
+};
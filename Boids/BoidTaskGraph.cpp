@@ -0,0 +1,245 @@
+#include "BoidTaskGraph.h"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+void BoidTaskGraph::Clear()
+{
+	m_Tasks.clear();
+	m_Dependencies.clear();
+}
+
+uint32_t BoidTaskGraph::AddTask(const char* Name, const TaskFunction& Function, uint32_t Begin, uint32_t End)
+{
+	m_Tasks.push_back({ Name, Function, Begin, End, 0, 0, 0 });
+	return static_cast<uint32_t>(m_Tasks.size()) - 1;
+}
+
+void BoidTaskGraph::AddDependency(uint32_t Before, uint32_t After)
+{
+	m_Dependencies.push_back({ Before, After });
+}
+
+uint32_t BoidTaskGraph::GetTaskCount() const
+{
+	return static_cast<uint32_t>(m_Tasks.size());
+}
+
+uint32_t BoidTaskGraph::GetDependencyCount() const
+{
+	return static_cast<uint32_t>(m_Dependencies.size());
+}
+
+void BoidTaskGraph::Run()
+{
+	uint32_t TaskCount = GetTaskCount();
+	if (TaskCount == 0)
+	{
+		return;
+	}
+
+	BoidThreadPool& ThreadPool = BoidThreadPool::Get();
+	PrepareRun(ThreadPool.GetThreadCount());
+
+	// Successor lists by counting sort of the dependencies, in the order they were added
+	m_SuccessorStart.assign(TaskCount + 1, 0);
+	m_Successors.resize(m_Dependencies.size());
+	for (const Dependency& Edge : m_Dependencies)
+	{
+		m_SuccessorStart[Edge.Before + 1]++;
+	}
+	for (uint32_t i = 0; i < TaskCount; i++)
+	{
+		m_SuccessorStart[i + 1] += m_SuccessorStart[i];
+		m_PendingDependencies[i].store(0, std::memory_order_relaxed);
+	}
+	for (const Dependency& Edge : m_Dependencies)
+	{
+		m_Successors[m_SuccessorStart[Edge.Before]++] = Edge.After;
+		m_PendingDependencies[Edge.After].fetch_add(1, std::memory_order_relaxed);
+	}
+	for (uint32_t i = TaskCount; i > 0; i--)
+	{
+		m_SuccessorStart[i] = m_SuccessorStart[i - 1];
+	}
+	m_SuccessorStart[0] = 0;
+
+	// Tasks ready from the start are dealt out in contiguous blocks, so each thread begins on neighbouring data
+	// Blocks are pushed last first, so owners pop them in the order they were added
+	uint32_t ReadyCount = 0;
+	for (uint32_t i = 0; i < TaskCount; i++)
+	{
+		ReadyCount += m_PendingDependencies[i].load(std::memory_order_relaxed) == 0 ? 1 : 0;
+	}
+
+	uint32_t ReadyIndex = ReadyCount;
+	for (uint32_t i = TaskCount; i > 0; i--)
+	{
+		if (m_PendingDependencies[i - 1].load(std::memory_order_relaxed) == 0)
+		{
+			ReadyIndex--;
+			PushTask(static_cast<uint32_t>(static_cast<uint64_t>(ReadyIndex) * m_QueueCount / ReadyCount), i - 1);
+		}
+	}
+
+	m_RemainingTasks.store(TaskCount, std::memory_order_relaxed);
+	m_RunStart = std::chrono::steady_clock::now();
+
+	// One chunk per thread, each running the work loop under its own thread index
+	ThreadPool.ParallelFor(m_QueueCount, 1, [this](uint32_t, uint32_t, uint32_t ThreadIndex)
+	{
+		RunTasks(ThreadIndex);
+	});
+}
+
+void BoidTaskGraph::PrepareRun(uint32_t ThreadCount)
+{
+	uint32_t TaskCount = GetTaskCount();
+
+	if (TaskCount > m_PendingCapacity)
+	{
+		m_PendingDependencies.reset(new std::atomic<uint32_t>[TaskCount]);
+		m_PendingCapacity = TaskCount;
+	}
+
+	if (ThreadCount != m_QueueCount)
+	{
+		m_Queues.reset(new ReadyQueue[ThreadCount]);
+		m_QueueCount = ThreadCount;
+	}
+
+	if (TaskCount > m_QueueCapacity || m_QueuedTasks.size() < static_cast<size_t>(m_QueueCount) * m_QueueCapacity)
+	{
+		m_QueueCapacity = std::max(TaskCount, m_QueueCapacity);
+		m_QueuedTasks.resize(static_cast<size_t>(m_QueueCount) * m_QueueCapacity);
+	}
+
+	for (uint32_t i = 0; i < m_QueueCount; i++)
+	{
+		m_Queues[i].Head = 0;
+		m_Queues[i].Tail = 0;
+	}
+}
+
+void BoidTaskGraph::RunTasks(uint32_t ThreadIndex)
+{
+	while (m_RemainingTasks.load(std::memory_order_acquire) > 0)
+	{
+		uint32_t TaskIndex = 0;
+		if (PopTask(ThreadIndex, TaskIndex) || StealTask(ThreadIndex, TaskIndex))
+		{
+			RunTask(TaskIndex, ThreadIndex);
+		}
+		else
+		{
+			// Nothing ready yet, remaining tasks wait on ones running elsewhere
+			std::this_thread::yield();
+		}
+	}
+}
+
+void BoidTaskGraph::RunTask(uint32_t TaskIndex, uint32_t ThreadIndex)
+{
+	Task& CurrentTask = m_Tasks[TaskIndex];
+	CurrentTask.Thread = ThreadIndex;
+	CurrentTask.StartTime = GetElapsedMicroseconds();
+
+	CurrentTask.Function(CurrentTask.Begin, CurrentTask.End, ThreadIndex);
+
+	CurrentTask.StopTime = GetElapsedMicroseconds();
+
+	// Last finished dependency queues the successor on this thread, whose caches hold what it just wrote
+	for (uint32_t i = m_SuccessorStart[TaskIndex]; i < m_SuccessorStart[TaskIndex + 1]; i++)
+	{
+		uint32_t Successor = m_Successors[i];
+		if (m_PendingDependencies[Successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			PushTask(ThreadIndex, Successor);
+		}
+	}
+
+	m_RemainingTasks.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void BoidTaskGraph::PushTask(uint32_t ThreadIndex, uint32_t TaskIndex)
+{
+	ReadyQueue& Queue = m_Queues[ThreadIndex];
+	std::lock_guard<std::mutex> Lock(Queue.Mutex);
+	m_QueuedTasks[static_cast<size_t>(ThreadIndex) * m_QueueCapacity + Queue.Tail++] = TaskIndex;
+}
+
+bool BoidTaskGraph::PopTask(uint32_t ThreadIndex, uint32_t& TaskIndex)
+{
+	ReadyQueue& Queue = m_Queues[ThreadIndex];
+	std::lock_guard<std::mutex> Lock(Queue.Mutex);
+	if (Queue.Head == Queue.Tail)
+	{
+		return false;
+	}
+
+	TaskIndex = m_QueuedTasks[static_cast<size_t>(ThreadIndex) * m_QueueCapacity + --Queue.Tail];
+	return true;
+}
+
+bool BoidTaskGraph::StealTask(uint32_t ThreadIndex, uint32_t& TaskIndex)
+{
+	// Victims in order after this thread, so thieves spread over different queues
+	for (uint32_t Offset = 1; Offset < m_QueueCount; Offset++)
+	{
+		uint32_t Victim = (ThreadIndex + Offset) % m_QueueCount;
+		ReadyQueue& Queue = m_Queues[Victim];
+		std::lock_guard<std::mutex> Lock(Queue.Mutex);
+		if (Queue.Head != Queue.Tail)
+		{
+			TaskIndex = m_QueuedTasks[static_cast<size_t>(Victim) * m_QueueCapacity + Queue.Head++];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+double BoidTaskGraph::GetElapsedMicroseconds() const
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_RunStart).count();
+}
+
+bool BoidTaskGraph::WriteTrace(const char* Path) const
+{
+	std::ofstream File(Path);
+	if (!File)
+	{
+		return false;
+	}
+
+	File << "{" << std::endl;
+	File << "\t\"displayTimeUnit\": \"ms\"," << std::endl;
+	File << "\t\"traceEvents\": [" << std::endl;
+
+	const char* Separator = "";
+	for (uint32_t i = 0; i < GetTaskCount(); i++)
+	{
+		const Task& CurrentTask = m_Tasks[i];
+		File << Separator << "\t\t{ \"name\": \"" << CurrentTask.Name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << CurrentTask.Thread
+			 << ", \"ts\": " << CurrentTask.StartTime << ", \"dur\": " << CurrentTask.StopTime - CurrentTask.StartTime
+			 << ", \"args\": { \"Task\": " << i << ", \"Begin\": " << CurrentTask.Begin << ", \"End\": " << CurrentTask.End << " } }";
+		Separator = ",\n";
+	}
+
+	// Flow arrow leaves the end of the dependency and binds to the slice of the task waiting on it
+	for (uint32_t i = 0; i < GetDependencyCount(); i++)
+	{
+		const Task& Before = m_Tasks[m_Dependencies[i].Before];
+		const Task& After = m_Tasks[m_Dependencies[i].After];
+		File << Separator << "\t\t{ \"name\": \"Dependency\", \"cat\": \"Dependency\", \"ph\": \"s\", \"id\": " << i << ", \"pid\": 0, \"tid\": " << Before.Thread
+			 << ", \"ts\": " << Before.StopTime << " }";
+		File << Separator << "\t\t{ \"name\": \"Dependency\", \"cat\": \"Dependency\", \"ph\": \"f\", \"bp\": \"e\", \"id\": " << i << ", \"pid\": 0, \"tid\": " << After.Thread
+			 << ", \"ts\": " << After.StartTime << " }";
+	}
+
+	File << std::endl << "\t]" << std::endl;
+	File << "}" << std::endl;
+
+	return File.good();
+}
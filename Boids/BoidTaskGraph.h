@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BoidThreadPool.h"
+
+// Range tasks with dependencies between them, run on the shared thread pool without barriers between stages
+// A task starts as soon as every task it depends on has finished, so independent parts of different stages overlap
+// Every thread keeps its own queue of ready tasks, runs the newest of them first and steals the oldest from other threads when it runs dry
+// Tasks and edges are kept between runs, so rebuilding a graph of the same size every step does not allocate
+class BoidTaskGraph
+{
+public:
+	// Refers to the caller's function, which has to stay alive until Run returns
+	using TaskFunction = BoidThreadPool::RangeFunction;
+
+	// Remove all tasks and edges, keeping their storage
+	void Clear();
+
+	// Add task running Function on [Begin, End), returns its id, Name must outlive the graph
+	uint32_t AddTask(const char* Name, const TaskFunction& Function, uint32_t Begin, uint32_t End);
+
+	// After only starts once Before has finished
+	void AddDependency(uint32_t Before, uint32_t After);
+
+	// Run every task, returns once all have finished, a graph with a cycle never finishes
+	void Run();
+
+	uint32_t GetTaskCount() const;
+	uint32_t GetDependencyCount() const;
+
+	// Write last run as Chrome trace events, one slice per task on the thread that ran it and one flow arrow per dependency
+	// Loads in chrome://tracing or Perfetto, false if the file could not be written
+	bool WriteTrace(const char* Path) const;
+
+protected:
+	struct Task
+	{
+		const char* Name;
+		TaskFunction Function;
+		uint32_t Begin;
+		uint32_t End;
+
+		// Filled in by the thread running the task, microseconds since the start of the run
+		uint32_t Thread;
+		double StartTime;
+		double StopTime;
+	};
+
+	struct Dependency
+	{
+		uint32_t Before;
+		uint32_t After;
+	};
+
+	// Ready tasks of one thread, owner pops from the back and thieves take from the front
+	// Every task is queued once per run, so each queue has room for all tasks and never wraps
+	struct alignas(64) ReadyQueue
+	{
+		std::mutex Mutex;
+		uint32_t Head = 0;
+		uint32_t Tail = 0;
+	};
+
+	// Work loop of one thread, leaves once every task of the run has finished
+	void RunTasks(uint32_t ThreadIndex);
+	void RunTask(uint32_t TaskIndex, uint32_t ThreadIndex);
+
+	void PushTask(uint32_t ThreadIndex, uint32_t TaskIndex);
+	bool PopTask(uint32_t ThreadIndex, uint32_t& TaskIndex);
+	bool StealTask(uint32_t ThreadIndex, uint32_t& TaskIndex);
+
+	// Grow run state to current task and thread counts, only allocates when either grew
+	void PrepareRun(uint32_t ThreadCount);
+
+	double GetElapsedMicroseconds() const;
+
+	std::vector<Task> m_Tasks;
+	std::vector<Dependency> m_Dependencies;
+
+	// Successors of each task as ranges of one array, built from the dependency list at the start of a run
+	std::vector<uint32_t> m_SuccessorStart;
+	std::vector<uint32_t> m_Successors;
+
+	// Dependencies still unfinished per task, the task is queued when its count reaches zero
+	std::unique_ptr<std::atomic<uint32_t>[]> m_PendingDependencies;
+	uint32_t m_PendingCapacity = 0;
+
+	std::unique_ptr<ReadyQueue[]> m_Queues;
+	std::vector<uint32_t> m_QueuedTasks;
+	uint32_t m_QueueCount = 0;
+	uint32_t m_QueueCapacity = 0;
+
+	std::atomic<uint32_t> m_RemainingTasks{ 0 };
+	std::chrono::steady_clock::time_point m_RunStart;
+};
@@ -0,0 +1,300 @@
+#include "BoidThreadPool.h"
+
+#include <algorithm>
+#include <sstream>
+#include "BoidAllocationTracker.h"
+#include "BoidTopology.h"
+#include "BoidPageAllocator.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	// Set while a thread is executing chunks, so nested ParallelFor calls run inline instead of deadlocking
+	thread_local bool t_InsideParallelFor = false;
+	thread_local uint32_t t_ThreadIndex = 0;
+}
+
+BoidThreadPool& BoidThreadPool::Get()
+{
+	static BoidThreadPool SharedPool;
+	return SharedPool;
+}
+
+BoidThreadPool::BoidThreadPool(uint32_t ThreadCount)
+{
+	StartWorkers(ThreadCount);
+}
+
+BoidThreadPool::~BoidThreadPool()
+{
+	StopWorkers();
+}
+
+void BoidThreadPool::SetThreadCount(uint32_t ThreadCount)
+{
+	std::lock_guard<std::mutex> SubmitLock(m_SubmitMutex);
+
+	StopWorkers();
+	StartWorkers(ThreadCount);
+}
+
+uint32_t BoidThreadPool::GetThreadCount() const
+{
+	// Calling thread counts as thread 0
+	return static_cast<uint32_t>(m_Workers.size()) + 1;
+}
+
+void BoidThreadPool::ParallelFor(uint32_t Count, uint32_t GrainSize, const RangeFunction& Function)
+{
+	if (Count == 0)
+	{
+		return;
+	}
+
+	GrainSize = std::max(GrainSize, 1u);
+
+	// Run inline if nested, too small to split or no workers exist
+	if (t_InsideParallelFor || m_Workers.empty() || Count <= GrainSize)
+	{
+		for (uint32_t Begin = 0; Begin < Count; Begin += GrainSize)
+		{
+			Function(Begin, std::min(Begin + GrainSize, Count), t_ThreadIndex);
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> SubmitLock(m_SubmitMutex);
+
+	// Publish job and wake all workers
+	{
+		std::lock_guard<std::mutex> Lock(m_Mutex);
+
+		m_Function = &Function;
+		m_Count = Count;
+		m_GrainSize = GrainSize;
+		m_ChunkCount = (Count + GrainSize - 1) / GrainSize;
+
+#ifdef __linux__
+		// Calling thread is not pinned, so it works for whichever node it happens to be on
+		int Cpu = sched_getcpu();
+		m_ThreadNodes[0] = Cpu >= 0 ? std::min(BoidTopology::Get().GetNodeOfCpu(static_cast<uint32_t>(Cpu)), m_NodeCount - 1) : 0;
+#endif
+
+		// Node shares are contiguous and depend only on chunk and thread counts, so repeated jobs split the same way
+		uint32_t ThreadCount = GetThreadCount();
+		uint32_t ThreadsBefore = 0;
+		for (uint32_t Node = 0; Node < m_NodeCount; Node++)
+		{
+			uint32_t Begin = static_cast<uint32_t>(static_cast<uint64_t>(m_ChunkCount) * ThreadsBefore / ThreadCount);
+			ThreadsBefore += m_NodeThreadCounts[Node];
+			m_NodeChunks[Node].Next.store(Begin, std::memory_order_relaxed);
+			m_NodeChunks[Node].End = static_cast<uint32_t>(static_cast<uint64_t>(m_ChunkCount) * ThreadsBefore / ThreadCount);
+		}
+
+		m_AllocationZone = BoidAllocationTracker::GetCurrentZone();
+
+		m_ActiveWorkers = static_cast<uint32_t>(m_Workers.size());
+		m_JobGeneration++;
+	}
+	m_WakeCondition.notify_all();
+
+	// Calling thread works as thread 0
+	RunChunks(0);
+
+	// Wait until every worker has left the job before the function goes out of scope
+	std::unique_lock<std::mutex> Lock(m_Mutex);
+	m_DoneCondition.wait(Lock, [this]() { return m_ActiveWorkers == 0; });
+
+	m_Function = nullptr;
+}
+
+void BoidThreadPool::StartWorkers(uint32_t ThreadCount)
+{
+	if (ThreadCount == 0)
+	{
+		ThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	m_ShuttingDown = false;
+	PlaceThreads(ThreadCount);
+
+	// Workers start from the current job generation, read here so a job published before a worker first runs is not missed
+	uint64_t StartGeneration = m_JobGeneration;
+
+	// Calling thread is thread 0, so only spawn the remaining workers
+	for (uint32_t i = 1; i < ThreadCount; i++)
+	{
+		m_Workers.emplace_back(&BoidThreadPool::WorkerLoop, this, i, StartGeneration);
+	}
+}
+
+void BoidThreadPool::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> Lock(m_Mutex);
+		m_ShuttingDown = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (std::thread& Worker : m_Workers)
+	{
+		Worker.join();
+	}
+
+	m_Workers.clear();
+}
+
+void BoidThreadPool::WorkerLoop(uint32_t ThreadIndex, uint64_t StartGeneration)
+{
+	t_ThreadIndex = ThreadIndex;
+
+#ifdef __linux__
+	// Pinned before the first job, so every page this worker first touches lands on its node
+	if (m_Pinned)
+	{
+		cpu_set_t CpuSet;
+		CPU_ZERO(&CpuSet);
+		CPU_SET(m_ThreadCpus[ThreadIndex], &CpuSet);
+		pthread_setaffinity_np(pthread_self(), sizeof(CpuSet), &CpuSet);
+	}
+#endif
+
+	uint64_t LastGeneration = StartGeneration;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> Lock(m_Mutex);
+			m_WakeCondition.wait(Lock, [this, LastGeneration]() { return m_ShuttingDown || m_JobGeneration != LastGeneration; });
+
+			if (m_ShuttingDown)
+			{
+				return;
+			}
+
+			LastGeneration = m_JobGeneration;
+			BoidAllocationTracker::SetCurrentZone(m_AllocationZone);
+		}
+
+		RunChunks(ThreadIndex);
+		BoidAllocationTracker::SetCurrentZone(BoidAllocationTracker::UntrackedZone);
+
+		bool LastWorker = false;
+		{
+			std::lock_guard<std::mutex> Lock(m_Mutex);
+			m_ActiveWorkers--;
+			LastWorker = m_ActiveWorkers == 0;
+		}
+
+		if (LastWorker)
+		{
+			m_DoneCondition.notify_one();
+		}
+	}
+}
+
+void BoidThreadPool::RunChunks(uint32_t ThreadIndex)
+{
+	t_InsideParallelFor = true;
+	t_ThreadIndex = ThreadIndex;
+
+	// Grab chunks of own node until none are left, then help the other nodes, fast threads naturally take more of the work
+	const uint32_t HomeNode = m_ThreadNodes[ThreadIndex];
+	for (uint32_t Offset = 0; Offset < m_NodeCount; Offset++)
+	{
+		NodeChunks& Chunks = m_NodeChunks[(HomeNode + Offset) % m_NodeCount];
+
+		while (true)
+		{
+			uint32_t Chunk = Chunks.Next.fetch_add(1, std::memory_order_relaxed);
+			if (Chunk >= Chunks.End)
+			{
+				break;
+			}
+
+			uint32_t Begin = Chunk * m_GrainSize;
+			uint32_t End = std::min(Begin + m_GrainSize, m_Count);
+			(*m_Function)(Begin, End, ThreadIndex);
+		}
+	}
+
+	t_InsideParallelFor = false;
+}
+
+void BoidThreadPool::SetThreadPinning(BoidThreadPinning Pinning)
+{
+	std::lock_guard<std::mutex> SubmitLock(m_SubmitMutex);
+
+	uint32_t ThreadCount = GetThreadCount();
+	StopWorkers();
+	m_Pinning = Pinning;
+	StartWorkers(ThreadCount);
+}
+
+bool BoidThreadPool::IsPinned() const
+{
+	return m_Pinned;
+}
+
+uint32_t BoidThreadPool::GetThreadNode(uint32_t ThreadIndex) const
+{
+	return ThreadIndex < m_ThreadNodes.size() ? m_ThreadNodes[ThreadIndex] : 0;
+}
+
+std::string BoidThreadPool::DescribePlacement() const
+{
+	const BoidTopology& Topology = BoidTopology::Get();
+	std::ostringstream Description;
+
+	Description << Topology.Describe();
+	Description << "Threads: " << GetThreadCount() << ", Pinned: " << (m_Pinned ? "Yes" : "No") << std::endl;
+
+	for (uint32_t ThreadIndex = 0; ThreadIndex < m_ThreadNodes.size(); ThreadIndex++)
+	{
+		Description << "Thread " << ThreadIndex << ": Node " << Topology.GetNodes()[m_ThreadNodes[ThreadIndex]].Id;
+		if (ThreadIndex == 0)
+		{
+			Description << ", calling thread";
+		}
+		else if (m_Pinned)
+		{
+			Description << ", CPU " << m_ThreadCpus[ThreadIndex];
+		}
+		Description << std::endl;
+	}
+
+	BoidPageStatistics Pages = BoidPages::GetStatistics();
+	Description << "Large Arrays: " << Pages.HugeTLBBytes / 1024 << " kB huge pages, " << Pages.TransparentHugeBytes / 1024 << " kB transparent huge pages, "
+				<< Pages.RegularBytes / 1024 << " kB regular pages" << std::endl;
+
+	return Description.str();
+}
+
+void BoidThreadPool::PlaceThreads(uint32_t ThreadCount)
+{
+	const BoidTopology& Topology = BoidTopology::Get();
+	const std::vector<BoidNumaNode>& Nodes = Topology.GetNodes();
+
+	m_NodeCount = static_cast<uint32_t>(Nodes.size());
+	m_NodeChunks.reset(new NodeChunks[m_NodeCount]);
+	m_NodeThreadCounts.assign(m_NodeCount, 0);
+
+	m_Pinned = Topology.CanPinThreads() && (m_Pinning == BoidThreadPinning::Always || (m_Pinning == BoidThreadPinning::Automatic && m_NodeCount > 1));
+
+	// Threads in order fill nodes evenly, each taking the next CPU of its node
+	m_ThreadNodes.resize(ThreadCount);
+	m_ThreadCpus.resize(ThreadCount);
+	for (uint32_t ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++)
+	{
+		uint32_t Node = static_cast<uint32_t>(static_cast<uint64_t>(ThreadIndex) * m_NodeCount / ThreadCount);
+		const std::vector<uint32_t>& Cpus = Nodes[Node].Cpus;
+
+		m_ThreadNodes[ThreadIndex] = Node;
+		m_ThreadCpus[ThreadIndex] = static_cast<int>(Cpus[m_NodeThreadCounts[Node] % Cpus.size()]);
+		m_NodeThreadCounts[Node]++;
+	}
+}
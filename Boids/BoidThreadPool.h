@@ -0,0 +1,123 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Whether workers are pinned to CPUs, automatic pins only on machines with more than one memory node
+enum class BoidThreadPinning
+{
+	Automatic,
+	Never,
+	Always
+};
+
+// Persistent worker pool used to split CPU boid work across cores
+// Calling thread always takes part in the work, so a pool of one thread runs everything inline
+// Threads are spread evenly over memory nodes and each node is given its own contiguous share of every job,
+// so the same range of an array is always written by threads of the same node and its pages stay local to them
+class BoidThreadPool
+{
+public:
+	// Function run on a chunk [Begin, End), ThreadIndex is stable per thread and below GetThreadCount()
+	// Refers to the caller's function instead of copying it, so handing a lambda to ParallelFor never allocates
+	class RangeFunction
+	{
+	public:
+		template<typename Function, typename = std::enable_if_t<!std::is_same<std::decay_t<Function>, RangeFunction>::value>>
+		RangeFunction(const Function& Callable)
+			: m_Callable(&Callable)
+			, m_Call([](const void* Callable, uint32_t Begin, uint32_t End, uint32_t ThreadIndex) { (*static_cast<const Function*>(Callable))(Begin, End, ThreadIndex); })
+		{
+		}
+
+		void operator()(uint32_t Begin, uint32_t End, uint32_t ThreadIndex) const
+		{
+			m_Call(m_Callable, Begin, End, ThreadIndex);
+		}
+
+	protected:
+		const void* m_Callable;
+		void (*m_Call)(const void* Callable, uint32_t Begin, uint32_t End, uint32_t ThreadIndex);
+	};
+
+	// Shared pool used by all boid systems
+	static BoidThreadPool& Get();
+
+	// Thread count of 0 selects hardware concurrency
+	BoidThreadPool(uint32_t ThreadCount = 0);
+	~BoidThreadPool();
+
+	// Restart workers with a new thread count, must not be called from inside ParallelFor
+	void SetThreadCount(uint32_t ThreadCount);
+	uint32_t GetThreadCount() const;
+
+	// Split [0, Count) into chunks of GrainSize and run them across all threads, returns once every chunk is done
+	// Threads take chunks of their own node first and only then help other nodes, nested calls from inside a chunk run inline
+	void ParallelFor(uint32_t Count, uint32_t GrainSize, const RangeFunction& Function);
+
+	// Restart workers pinned or unpinned, the calling thread is never pinned, it belongs to the application
+	void SetThreadPinning(BoidThreadPinning Pinning);
+	bool IsPinned() const;
+
+	// Memory node of thread, the calling thread takes the node of the CPU it runs on when a job starts
+	uint32_t GetThreadNode(uint32_t ThreadIndex) const;
+
+	// Machine topology, node and CPU of every worker, and pages backing large arrays
+	std::string DescribePlacement() const;
+
+protected:
+	void StartWorkers(uint32_t ThreadCount);
+	void StopWorkers();
+
+	void WorkerLoop(uint32_t ThreadIndex, uint64_t StartGeneration);
+	void RunChunks(uint32_t ThreadIndex);
+
+	// Assign threads to nodes and, when pinning, to CPUs of their node
+	void PlaceThreads(uint32_t ThreadCount);
+
+	std::vector<std::thread> m_Workers;
+
+	BoidThreadPinning m_Pinning = BoidThreadPinning::Automatic;
+	bool m_Pinned = false;
+	std::vector<uint32_t> m_ThreadNodes;
+	std::vector<int> m_ThreadCpus;
+
+	// Chunks still to take on each node, on their own cache lines as every thread of a node hits its counter
+	struct alignas(64) NodeChunks
+	{
+		std::atomic<uint32_t> Next{ 0 };
+		uint32_t End = 0;
+	};
+
+	std::unique_ptr<NodeChunks[]> m_NodeChunks;
+	uint32_t m_NodeCount = 1;
+
+	// Threads on each node, a node's share of a job is proportional to it
+	std::vector<uint32_t> m_NodeThreadCounts;
+
+	// Serializes ParallelFor calls made from different external threads
+	std::mutex m_SubmitMutex;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCondition;
+	std::condition_variable m_DoneCondition;
+
+	// Current job, published under m_Mutex and consumed chunk by chunk
+	const RangeFunction* m_Function = nullptr;
+	uint32_t m_Count = 0;
+	uint32_t m_GrainSize = 1;
+	uint32_t m_ChunkCount = 0;
+
+	// Allocation zone of the thread that published the job, workers count their allocations against it
+	uint32_t m_AllocationZone = 0;
+
+	uint64_t m_JobGeneration = 0;
+	uint32_t m_ActiveWorkers = 0;
+	bool m_ShuttingDown = false;
+};
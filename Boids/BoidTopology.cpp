@@ -0,0 +1,185 @@
+#include "BoidTopology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	// Parse kernel CPU lists such as "0-3,8-11"
+	std::vector<uint32_t> ParseCpuList(const std::string& List)
+	{
+		std::vector<uint32_t> Cpus;
+		std::istringstream Ranges(List);
+		std::string Range;
+
+		while (std::getline(Ranges, Range, ','))
+		{
+			if (Range.empty() || Range[0] < '0' || Range[0] > '9')
+			{
+				continue;
+			}
+
+			size_t Dash = Range.find('-');
+			uint32_t First = static_cast<uint32_t>(std::stoul(Range.substr(0, Dash)));
+			uint32_t Last = Dash == std::string::npos ? First : static_cast<uint32_t>(std::stoul(Range.substr(Dash + 1)));
+
+			for (uint32_t Cpu = First; Cpu <= Last; Cpu++)
+			{
+				Cpus.push_back(Cpu);
+			}
+		}
+
+		return Cpus;
+	}
+}
+
+const BoidTopology& BoidTopology::Get()
+{
+	static BoidTopology SharedTopology;
+	return SharedTopology;
+}
+
+BoidTopology::BoidTopology()
+{
+	ReadNodes();
+	ReadHugePages();
+}
+
+const std::vector<BoidNumaNode>& BoidTopology::GetNodes() const
+{
+	return m_Nodes;
+}
+
+uint32_t BoidTopology::GetNodeCount() const
+{
+	return static_cast<uint32_t>(m_Nodes.size());
+}
+
+uint32_t BoidTopology::GetNodeOfCpu(uint32_t Cpu) const
+{
+	return Cpu < m_CpuNodes.size() ? m_CpuNodes[Cpu] : 0;
+}
+
+bool BoidTopology::CanPinThreads() const
+{
+#ifdef __linux__
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool BoidTopology::HasTransparentHugePages() const
+{
+	return m_TransparentHugePages;
+}
+
+uint64_t BoidTopology::GetReservedHugePages() const
+{
+	return m_ReservedHugePages;
+}
+
+uint64_t BoidTopology::GetHugePageSize() const
+{
+	return m_HugePageSize;
+}
+
+std::string BoidTopology::Describe() const
+{
+	std::ostringstream Description;
+
+	for (const BoidNumaNode& Node : m_Nodes)
+	{
+		Description << "Node " << Node.Id << ": " << Node.Cpus.size() << " CPUs" << std::endl;
+	}
+
+	Description << "Transparent Huge Pages: " << (m_TransparentHugePages ? "On" : "Off") << std::endl;
+	Description << "Reserved Huge Pages: " << m_ReservedHugePages << " of " << m_HugePageSize / 1024 << " kB" << std::endl;
+
+	return Description.str();
+}
+
+void BoidTopology::ReadNodes()
+{
+#ifdef __linux__
+	// Node directories are numbered but may have gaps, e.g. offline or memory only nodes
+	std::ifstream Online("/sys/devices/system/node/online");
+	std::string OnlineList;
+	if (Online && std::getline(Online, OnlineList))
+	{
+		for (uint32_t NodeId : ParseCpuList(OnlineList))
+		{
+			std::ifstream CpuListFile("/sys/devices/system/node/node" + std::to_string(NodeId) + "/cpulist");
+			std::string CpuList;
+			if (!CpuListFile || !std::getline(CpuListFile, CpuList))
+			{
+				continue;
+			}
+
+			BoidNumaNode Node = { NodeId, ParseCpuList(CpuList) };
+			if (!Node.Cpus.empty())
+			{
+				m_Nodes.push_back(Node);
+			}
+		}
+	}
+#endif
+
+	if (m_Nodes.empty())
+	{
+		BoidNumaNode Node = { 0, {} };
+		uint32_t CpuCount = std::max(std::thread::hardware_concurrency(), 1u);
+		for (uint32_t Cpu = 0; Cpu < CpuCount; Cpu++)
+		{
+			Node.Cpus.push_back(Cpu);
+		}
+		m_Nodes.push_back(Node);
+	}
+
+	// Nodes are indexed by position from here on, not by kernel id
+	for (uint32_t NodeIndex = 0; NodeIndex < m_Nodes.size(); NodeIndex++)
+	{
+		for (uint32_t Cpu : m_Nodes[NodeIndex].Cpus)
+		{
+			if (Cpu >= m_CpuNodes.size())
+			{
+				m_CpuNodes.resize(Cpu + 1, 0);
+			}
+			m_CpuNodes[Cpu] = NodeIndex;
+		}
+	}
+}
+
+void BoidTopology::ReadHugePages()
+{
+#ifdef __linux__
+	// Selected mode is bracketed, e.g. "always [madvise] never"
+	std::ifstream Enabled("/sys/kernel/mm/transparent_hugepage/enabled");
+	std::string Modes;
+	if (Enabled && std::getline(Enabled, Modes))
+	{
+		m_TransparentHugePages = Modes.find("[always]") != std::string::npos || Modes.find("[madvise]") != std::string::npos;
+	}
+
+	std::ifstream MemoryInfo("/proc/meminfo");
+	std::string Line;
+	while (std::getline(MemoryInfo, Line))
+	{
+		std::istringstream Fields(Line);
+		std::string Key;
+		uint64_t Value = 0;
+		Fields >> Key >> Value;
+
+		if (Key == "HugePages_Total:")
+		{
+			m_ReservedHugePages = Value;
+		}
+		else if (Key == "Hugepagesize:")
+		{
+			m_HugePageSize = Value * 1024;
+		}
+	}
+#endif
+}
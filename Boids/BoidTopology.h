@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Memory node and the logical CPUs attached to it
+struct BoidNumaNode
+{
+	uint32_t Id;
+	std::vector<uint32_t> Cpus;
+};
+
+// Machine layout read once at first use, on Linux from sysfs and procfs
+// Elsewhere, or where those cannot be read, the machine is one node holding every hardware thread
+class BoidTopology
+{
+public:
+	static const BoidTopology& Get();
+
+	const std::vector<BoidNumaNode>& GetNodes() const;
+	uint32_t GetNodeCount() const;
+
+	// Node of CPU, 0 for CPUs of no known node
+	uint32_t GetNodeOfCpu(uint32_t Cpu) const;
+
+	// Whether thread affinity can be set on this platform
+	bool CanPinThreads() const;
+
+	// Transparent huge pages are on for regions advised to use them, explicit huge pages are reserved by the administrator
+	bool HasTransparentHugePages() const;
+	uint64_t GetReservedHugePages() const;
+	uint64_t GetHugePageSize() const;
+
+	// One line per node and huge page availability
+	std::string Describe() const;
+
+protected:
+	BoidTopology();
+
+	void ReadNodes();
+	void ReadHugePages();
+
+	std::vector<BoidNumaNode> m_Nodes;
+	std::vector<uint32_t> m_CpuNodes;
+
+	bool m_TransparentHugePages = false;
+	uint64_t m_ReservedHugePages = 0;
+	uint64_t m_HugePageSize = 2 * 1024 * 1024;
+};
@@ -0,0 +1,204 @@
+#include "BoidTransformBaker.h"
+
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <algorithm>
+#include <math.h>
+#include "BoidPhysicsSystem.h"
+#include "BoidThreadPool.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Below this, boid points almost straight down and the shortest arc rotation axis is undefined
+	const float DegenerateRotationThreshold = 1e-6f;
+
+	// Largest quaternion component difference from the reference, acos of the reference loses most near vertical
+	const float BakeCheckTolerance = 1e-4f;
+
+	// Both sides pick an axis of their own near vertical, straight down is off the boid direction by up to the axis length
+	const float NearVerticalTolerance = sqrtf(DegenerateRotationThreshold) + BakeCheckTolerance;
+}
+
+void BakeBoidInstanceTransforms(const BoidProperties* Boids, BoidInstanceTransform* Transforms, uint32_t Count)
+{
+	XMVECTOR One = XMVectorSplatOne();
+	XMVECTOR Zero = XMVectorZero();
+	XMVECTOR Threshold = XMVectorReplicate(DegenerateRotationThreshold);
+
+	for (uint32_t i = 0; i < Count; i += 4)
+	{
+		// Transpose four directions into x, y and z lanes, repeating the last boid if fewer than four remain
+		uint32_t Remaining = std::min(Count - i, 4u);
+		XMMATRIX Directions(XMLoadFloat4(&Boids[i].BoidDirection),
+							XMLoadFloat4(&Boids[i + std::min(1u, Remaining - 1)].BoidDirection),
+							XMLoadFloat4(&Boids[i + std::min(2u, Remaining - 1)].BoidDirection),
+							XMLoadFloat4(&Boids[i + std::min(3u, Remaining - 1)].BoidDirection));
+		Directions = XMMatrixTranspose(Directions);
+
+		// Shortest arc from up (0, 1, 0) to direction d is (cross(up, d), 1 + dot(up, d)) = (d.z, 0, -d.x, 1 + d.y) before normalizing
+		XMVECTOR QuaternionX = Directions.r[2];
+		XMVECTOR QuaternionZ = XMVectorNegate(Directions.r[0]);
+		XMVECTOR QuaternionW = One + Directions.r[1];
+
+		XMVECTOR AxisLengthSquared = QuaternionX * QuaternionX + QuaternionZ * QuaternionZ;
+		XMVECTOR LengthSquared = AxisLengthSquared + QuaternionW * QuaternionW;
+		XMVECTOR InverseLength = XMVectorReciprocalSqrt(XMVectorMax(LengthSquared, Threshold));
+
+		// Near straight down turns half a revolution around x instead, decided on axis length like the reference so both agree
+		XMVECTOR Degenerate = XMVectorAndInt(XMVectorLess(AxisLengthSquared, Threshold), XMVectorLess(Directions.r[1], Zero));
+		QuaternionX = XMVectorSelect(QuaternionX * InverseLength, One, Degenerate);
+		QuaternionZ = XMVectorSelect(QuaternionZ * InverseLength, Zero, Degenerate);
+		QuaternionW = XMVectorSelect(QuaternionW * InverseLength, Zero, Degenerate);
+
+		// Transpose back to one quaternion per row
+		XMMATRIX Rotations = XMMatrixTranspose(XMMATRIX(QuaternionX, Zero, QuaternionZ, QuaternionW));
+
+		for (uint32_t Lane = 0; Lane < Remaining; Lane++)
+		{
+			XMStoreFloat4(&Transforms[i + Lane].Rotation, Rotations.r[Lane]);
+
+			const XMFLOAT4& Position = Boids[i + Lane].BoidPosition;
+			Transforms[i + Lane].Translation = XMFLOAT4(Position.x, Position.y, Position.z, 1.0f);
+		}
+	}
+}
+
+void BakeBoidInstanceTransformsParallel(const BoidProperties* Boids, BoidInstanceTransform* Transforms, uint32_t Count)
+{
+	// Chunks are multiples of four so only the final chunk has a partial SIMD block
+	BoidThreadPool::Get().ParallelFor(Count, 4096, [Boids, Transforms](uint32_t Begin, uint32_t End, uint32_t)
+	{
+		BakeBoidInstanceTransforms(Boids + Begin, Transforms + Begin, End - Begin);
+	});
+}
+
+BoidInstanceTransform BakeBoidInstanceTransformReference(const BoidProperties& Boid)
+{
+	XMVECTOR CurrentDir = XMVectorSet(0, 1, 0, 0);
+	XMVECTOR TargetDir = XMLoadFloat4(&Boid.BoidDirection);
+
+	XMVECTOR Rotation = XMQuaternionIdentity();
+
+	// Axis of rotation is perpendicular to both world up and boid direction, angle is between them
+	float Dot = XMVectorGetX(XMVector3Dot(CurrentDir, TargetDir));
+	if (Dot < 1.0f)
+	{
+		float Angle = acosf(std::max(Dot, -1.0f));
+
+		XMVECTOR Axis = XMVector3Cross(CurrentDir, TargetDir);
+		if (XMVectorGetX(XMVector3LengthSq(Axis)) < DegenerateRotationThreshold)
+		{
+			Axis = XMVectorSet(1, 0, 0, 0);
+		}
+
+		Rotation = XMQuaternionRotationAxis(XMVector3Normalize(Axis), Angle);
+	}
+
+	BoidInstanceTransform Transform;
+	XMStoreFloat4(&Transform.Rotation, Rotation);
+	Transform.Translation = XMFLOAT4(Boid.BoidPosition.x, Boid.BoidPosition.y, Boid.BoidPosition.z, 1.0f);
+
+	return Transform;
+}
+
+BoidBakeCheck CheckBoidInstanceTransformBake(uint32_t Count, uint32_t Repetitions, uint32_t Seed)
+{
+	std::mt19937 MTEngine(Seed);
+	std::uniform_real_distribution<float> Unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> TiltExponent(-8.0f, -1.0f);
+
+	std::vector<BoidProperties> Boids(Count);
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		XMVECTOR Direction = XMVectorSet(Unit(MTEngine), Unit(MTEngine), Unit(MTEngine), 0);
+
+		// Every other boid tilted off straight up or down, tilts below float precision land exactly on the pole
+		if (i % 2 == 1)
+		{
+			float Tilt = powf(10.0f, TiltExponent(MTEngine));
+			Tilt = Tilt < 1e-7f ? 0.0f : Tilt;
+			Direction = XMVectorSet(XMVectorGetX(Direction) * Tilt, (i / 2) % 2 == 0 ? 1.0f : -1.0f, XMVectorGetZ(Direction) * Tilt, 0);
+		}
+
+		XMStoreFloat4(&Boids[i].BoidPosition, XMVectorSet(Unit(MTEngine), Unit(MTEngine), Unit(MTEngine), 0) * 40.0f);
+		XMStoreFloat4(&Boids[i].BoidDirection, XMVector3Normalize(Direction));
+	}
+
+	// A partial block of four can overrun by at most three transforms, these stay as written unless it does
+	const uint32_t GuardCount = 3;
+	const BoidInstanceTransform Guard = { XMFLOAT4(-7, -7, -7, -7), XMFLOAT4(-7, -7, -7, -7) };
+	std::vector<BoidInstanceTransform> Transforms(Count + GuardCount, Guard);
+	std::vector<BoidInstanceTransform> References(Count);
+
+	BoidBakeCheck Check = {};
+	Check.BoidCount = Count;
+
+	auto StartReference = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		References[i] = BakeBoidInstanceTransformReference(Boids[i]);
+	}
+	auto StopReference = std::chrono::high_resolution_clock::now();
+	Check.ReferenceMilliseconds = std::chrono::duration<double, std::milli>(StopReference - StartReference).count();
+
+	// At least one bake, so boids are checked even without repetitions to time
+	for (uint32_t Repetition = 0; Repetition < std::max(Repetitions, 1u); Repetition++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		BakeBoidInstanceTransformsParallel(Boids.data(), Transforms.data(), Count);
+		auto Stop = std::chrono::high_resolution_clock::now();
+
+		if (Repetition < Repetitions)
+		{
+			Check.KernelMilliseconds.push_back(std::chrono::duration<double, std::milli>(Stop - Start).count());
+		}
+	}
+
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		XMVECTOR Rotation = XMLoadFloat4(&Transforms[i].Rotation);
+		XMVECTOR ReferenceRotation = XMLoadFloat4(&References[i].Rotation);
+		XMVECTOR Direction = XMLoadFloat4(&Boids[i].BoidDirection);
+
+		float Error = 0;
+		float Tolerance = BakeCheckTolerance;
+		if (XMVectorGetX(XMVector3LengthSq(XMVector3Cross(XMVectorSet(0, 1, 0, 0), Direction))) < DegenerateRotationThreshold)
+		{
+			Check.NearVerticalBoids++;
+			Error = XMVectorGetX(XMVector3Length(XMVector3Rotate(XMVectorSet(0, 1, 0, 0), Rotation) - Direction));
+			Tolerance = NearVerticalTolerance;
+		}
+		else
+		{
+			if (XMVectorGetX(XMVector4Dot(Rotation, ReferenceRotation)) < 0)
+			{
+				ReferenceRotation = XMVectorNegate(ReferenceRotation);
+			}
+
+			XMFLOAT4 Difference;
+			XMStoreFloat4(&Difference, XMVectorAbs(Rotation - ReferenceRotation));
+			Error = std::max(std::max(Difference.x, Difference.y), std::max(Difference.z, Difference.w));
+			Check.MaximumError = std::max(Check.MaximumError, Error);
+		}
+
+		// Translation is copied rather than computed, so it has to match exactly, and not a number fails the tolerance too
+		bool TranslationMatches = std::memcmp(&Transforms[i].Translation, &References[i].Translation, sizeof(XMFLOAT4)) == 0;
+		if (!(Error <= Tolerance) || !TranslationMatches)
+		{
+			Check.MismatchedBoids++;
+		}
+	}
+
+	for (uint32_t i = Count; i < Count + GuardCount; i++)
+	{
+		if (std::memcmp(&Transforms[i], &Guard, sizeof(Guard)) != 0)
+		{
+			Check.MismatchedBoids++;
+		}
+	}
+
+	return Check;
+}
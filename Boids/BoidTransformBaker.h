@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+
+struct BoidProperties;
+
+// Baked per-instance transform read by the baked vertex shader
+// Same size as BoidProperties so either can be uploaded into the same structured buffer
+struct BoidInstanceTransform
+{
+	// Unit quaternion rotating mesh up (0, 1, 0) onto boid direction
+	DirectX::XMFLOAT4 Rotation;
+	DirectX::XMFLOAT4 Translation;
+};
+
+// Bake rotation and translation for Count boids, four at a time with SIMD, on the calling thread only
+void BakeBoidInstanceTransforms(const BoidProperties* Boids, BoidInstanceTransform* Transforms, uint32_t Count);
+
+// Same as above, split across the shared boid thread pool
+void BakeBoidInstanceTransformsParallel(const BoidProperties* Boids, BoidInstanceTransform* Transforms, uint32_t Count);
+
+// Scalar reference of a single boid, matching the rotation previously built per vertex in BoidsVertexShader
+BoidInstanceTransform BakeBoidInstanceTransformReference(const BoidProperties& Boid);
+
+// Kernel checked boid by boid against the scalar reference and timed against it, see CheckBoidInstanceTransformBake
+// Rotation errors are per quaternion component, against whichever sign of the reference is closer as both turn the mesh alike
+// MismatchedBoids also counts transforms written past the last boid, so a broken partial block shows up as well
+struct BoidBakeCheck
+{
+	uint32_t BoidCount;
+
+	// Parallel kernel, one bake per repetition, reference is a single pass on the calling thread
+	std::vector<double> KernelMilliseconds;
+	double ReferenceMilliseconds;
+
+	float MaximumError;
+	uint32_t NearVerticalBoids;
+	uint32_t MismatchedBoids;
+};
+
+// Bake Count seeded boids with the parallel kernel and compare every boid with the reference, needs no renderer or device
+// Half the directions are tilted between 1e-8 and 0.1 off straight up or down, counts that are not multiples of four cover the partial block
+// Where the reference falls back to turning around x, near vertical, only where the mesh up lands is compared, against the boid direction
+BoidBakeCheck CheckBoidInstanceTransformBake(uint32_t Count, uint32_t Repetitions, uint32_t Seed = 1);
@@ -0,0 +1,69 @@
+#include "BoidTransport.h"
+
+#include <cstring>
+
+BoidLocalTransportHub::BoidLocalTransportHub(uint32_t RankCount) : m_RankCount(RankCount), m_Queues(RankCount * RankCount)
+{
+}
+
+uint32_t BoidLocalTransportHub::GetRankCount() const
+{
+	return m_RankCount;
+}
+
+void BoidLocalTransportHub::Push(uint32_t From, uint32_t To, const void* Data, uint32_t Size)
+{
+	const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+	{
+		std::lock_guard<std::mutex> Lock(m_Mutex);
+		m_Queues[From * m_RankCount + To].emplace_back(Bytes, Bytes + Size);
+	}
+	m_MessageArrived.notify_all();
+}
+
+void BoidLocalTransportHub::Pop(uint32_t From, uint32_t To, std::vector<uint8_t>& Data)
+{
+	std::unique_lock<std::mutex> Lock(m_Mutex);
+
+	std::deque<std::vector<uint8_t>>& Queue = m_Queues[From * m_RankCount + To];
+	m_MessageArrived.wait(Lock, [&Queue]() { return !Queue.empty(); });
+
+	Data = std::move(Queue.front());
+	Queue.pop_front();
+}
+
+BoidLocalTransport::BoidLocalTransport(BoidLocalTransportHub& Hub, uint32_t Rank) : m_Hub(Hub), m_Rank(Rank)
+{
+}
+
+uint32_t BoidLocalTransport::GetRank() const
+{
+	return m_Rank;
+}
+
+uint32_t BoidLocalTransport::GetRankCount() const
+{
+	return m_Hub.GetRankCount();
+}
+
+bool BoidLocalTransport::Send(uint32_t Peer, const void* Data, uint32_t Size)
+{
+	if (Peer >= m_Hub.GetRankCount())
+	{
+		return false;
+	}
+
+	m_Hub.Push(m_Rank, Peer, Data, Size);
+	return true;
+}
+
+bool BoidLocalTransport::Receive(uint32_t Peer, std::vector<uint8_t>& Data)
+{
+	if (Peer >= m_Hub.GetRankCount())
+	{
+		return false;
+	}
+
+	m_Hub.Pop(Peer, m_Rank, Data);
+	return true;
+}
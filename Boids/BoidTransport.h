@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+// Point to point messages between ranks of a multi-process simulation
+// Messages between one pair of ranks always arrive in the order they were sent
+class BoidTransport
+{
+public:
+	virtual ~BoidTransport() = default;
+
+	virtual uint32_t GetRank() const = 0;
+	virtual uint32_t GetRankCount() const = 0;
+
+	// Blocks until message is handed over, false if the transport failed or timed out
+	virtual bool Send(uint32_t Peer, const void* Data, uint32_t Size) = 0;
+
+	// Blocks until next message from peer has arrived, replacing contents of Data
+	virtual bool Receive(uint32_t Peer, std::vector<uint8_t>& Data) = 0;
+};
+
+// Queues shared by every rank of an in-process transport, ranks run on threads of the same process
+class BoidLocalTransportHub
+{
+public:
+	BoidLocalTransportHub(uint32_t RankCount);
+
+	uint32_t GetRankCount() const;
+
+	void Push(uint32_t From, uint32_t To, const void* Data, uint32_t Size);
+	void Pop(uint32_t From, uint32_t To, std::vector<uint8_t>& Data);
+
+protected:
+	uint32_t m_RankCount;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_MessageArrived;
+
+	// One queue per directed pair, From * RankCount + To
+	std::vector<std::deque<std::vector<uint8_t>>> m_Queues;
+};
+
+// Transport between threads, useful for checking decomposed results against a single process run
+class BoidLocalTransport : public BoidTransport
+{
+public:
+	BoidLocalTransport(BoidLocalTransportHub& Hub, uint32_t Rank);
+
+	uint32_t GetRank() const override;
+	uint32_t GetRankCount() const override;
+
+	bool Send(uint32_t Peer, const void* Data, uint32_t Size) override;
+	bool Receive(uint32_t Peer, std::vector<uint8_t>& Data) override;
+
+protected:
+	BoidLocalTransportHub& m_Hub;
+	uint32_t m_Rank;
+};
@@ -0,0 +1,63 @@
+// Input of Vertex Shader
+struct VertexPosColorIndex
+{
+    float3 Position : POSITION;
+    float3 Color : COLOR;
+    uint Index : SV_InstanceID;
+};
+
+// Ouput of Vertex Shader
+struct VertexShaderOutput
+{
+    float4 Color : COLOR;
+    float4 Position : SV_Position;
+};
+
+// Rotate vector by unit quaternion (x, y, z = axis * sin(half angle), w = cos(half angle))
+float3 RotateByQuaternion(float3 Vertex, float4 Quaternion)
+{
+    float3 Temp = cross(Quaternion.xyz, Vertex) + (Quaternion.w * Vertex);
+    return Vertex + (2 * cross(Quaternion.xyz, Temp));
+}
+
+struct CameraViewProjectionMatrices
+{
+    matrix CameraViewMatrix;
+    matrix CameraProjectionMatrix;
+};
+
+// Baked on the CPU once per boid, see BoidTransformBaker
+struct BoidInstanceTransform
+{
+    float4 Rotation;
+    float4 Translation;
+};
+
+// SV_InstanceID restarts at zero for every level of detail draw
+struct InstanceRange
+{
+    uint InstanceOffset;
+};
+
+RWStructuredBuffer<BoidInstanceTransform> Transforms : register(u0);
+ConstantBuffer<CameraViewProjectionMatrices> CameraViewProjection : register(b0);
+ConstantBuffer<InstanceRange> Instances : register(b1);
+
+VertexShaderOutput main(VertexPosColorIndex IN)
+{
+    VertexShaderOutput OUT;
+    
+    BoidInstanceTransform Transform = Transforms[IN.Index + Instances.InstanceOffset];
+    
+    // Rotation is already baked, only apply it and translate into world space
+    float3 WorldPosition = RotateByQuaternion(IN.Position, Transform.Rotation) + Transform.Translation.xyz;
+   
+    // Final Camera View + Proj Matrices
+    float4x4 CameraViewMatrix = transpose(CameraViewProjection.CameraViewMatrix);
+    float4x4 CameraProjMatrix = transpose(CameraViewProjection.CameraProjectionMatrix);
+    
+    OUT.Position = mul(mul(float4(WorldPosition, 1), CameraViewMatrix), CameraProjMatrix);
+    OUT.Color = float4(IN.Color, 1.0f);
+
+    return OUT;
+}
@@ -28,6 +28,15 @@ using namespace DirectX;
 
 #include "BoidRenderSystem.h"
 #include "BoidObject.h"
+#include "BoidStatePublisher.h"
+#include "BoidSweepRunner.h"
+#include "BoidEnsemble.h"
+#include "BoidStepProfiler.h"
+#include "BoidFlockAnalytics.h"
+#include "BoidAllocationTracker.h"
+#include "BoidThreadPool.h"
+#include "BoidTopology.h"
+#include "BoidObstacleField.h"
 
 // Clamp a value between a min and max range.
 template<typename T>
@@ -95,6 +104,15 @@ Tutorial3::~Tutorial3()
     delete m_BoidPhysicsSystem;
     m_BoidPhysicsSystem = nullptr;
 
+    delete m_BoidStepProfiler;
+    m_BoidStepProfiler = nullptr;
+
+    delete m_BoidFlockAnalytics;
+    m_BoidFlockAnalytics = nullptr;
+
+    delete m_BoidStatePublisher;
+    m_BoidStatePublisher = nullptr;
+
     delete m_BoidMatricesDoubleBuffer[0];
     m_BoidMatricesDoubleBuffer[0] = nullptr;
 
@@ -179,6 +197,9 @@ bool Tutorial3::LoadContent()
     //ThrowIfFailed(D3DCompileFromFile(L"Tutorial3/shaders/BoidsVertexShader.hlsl", NULL, NULL, "main", "vs_5_1", compileFlags, 0, &BoidsVertexShaderBlob, &errorBlob));
     ThrowIfFailed(D3DReadFileToBlob(L"data/shaders/Tutorial3/BoidsVertexShader.cso", &BoidsVertexShaderBlob));
 
+    ComPtr<ID3DBlob> BoidsBakedVertexShaderBlob;
+    ThrowIfFailed(D3DReadFileToBlob(L"data/shaders/Tutorial3/BoidsBakedVertexShader.cso", &BoidsBakedVertexShaderBlob));
+
     ComPtr<ID3DBlob> BoidsPixelShaderBlob;
     ThrowIfFailed(D3DReadFileToBlob(L"data/shaders/Tutorial3/BoidsPixelShader.cso", &BoidsPixelShaderBlob));
 
@@ -247,9 +268,11 @@ bool Tutorial3::LoadContent()
         D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
         D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
 
-    CD3DX12_ROOT_PARAMETER1 BoidsRootParameters[2];
+    CD3DX12_ROOT_PARAMETER1 BoidsRootParameters[3];
     BoidsRootParameters[0].InitAsDescriptorTable(1, &BoidsMatrices, D3D12_SHADER_VISIBILITY_ALL);
     BoidsRootParameters[1].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_VERTEX);
+    // First instance of the current level of detail draw, used by baked vertex shader only
+    BoidsRootParameters[2].InitAsConstants(1, 1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
 
     CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC BoidsRootSignautreDesc;
     BoidsRootSignautreDesc.Init_1_1(_countof(BoidsRootParameters), BoidsRootParameters, 0, nullptr, BoidsRootSignatureFlags);
@@ -302,6 +325,10 @@ bool Tutorial3::LoadContent()
     };
     ThrowIfFailed(device->CreatePipelineState(&BoidsPipelineStateStreamDesc, IID_PPV_ARGS(&m_BoidsPipelineState)));
 
+    // Same pipeline for CPU version, only swapping vertex shader for one reading baked transforms
+    pipelineStateStream.VS = CD3DX12_SHADER_BYTECODE(BoidsBakedVertexShaderBlob.Get());
+    ThrowIfFailed(device->CreatePipelineState(&BoidsPipelineStateStreamDesc, IID_PPV_ARGS(&m_BoidsBakedPipelineState)));
+
     // Create a Compute Boids pipeline state
     struct ComputePipelineStateStream
     {
@@ -437,6 +464,14 @@ void Tutorial3::BeginSimulation()
     // Register boids with physics system to randomize directions, regardless of being in GPU/Async mode
     m_BoidPhysicsSystem->RegisterBoids(m_BoidObjects);
 
+    // Readers see the old publisher close and reopen the new segment
+    if (!m_BoidStatePublisher || !m_BoidStatePublisher->IsOpen() || m_BoidStatePublisher->GetSlotCapacity() < m_BoidObjects.size())
+    {
+        delete m_BoidStatePublisher;
+        m_BoidStatePublisher = new BoidStatePublisher(BoidStatePublisher::DefaultName, static_cast<uint32_t>(m_BoidObjects.size()));
+    }
+    m_PublishedSimulationTime = 0;
+
     if (m_EnableGPUVersion)
     {
         auto commandQueue = Application::Get().GetCommandQueue(D3D12_COMMAND_LIST_TYPE_COPY);
@@ -485,6 +520,62 @@ void Tutorial3::BeginSimulation()
     }
 }
 
+void Tutorial3::PrintCPUSettingsToTextFile(const char filename[])
+{
+    std::ofstream CurrentFile(filename);
+
+    // Measured on current flock, so error reflects the state the results ended in
+    RulePrecisionReport PrecisionReport = m_BoidPhysicsSystem->CompareRulePrecisionWithExact(1.0f / 60.0f);
+
+    CurrentFile << "Neighbour Search: " << GetNeighbourSearchModeName(m_BoidPhysicsSystem->GetNeighbourSearchMode()) << std::endl;
+    CurrentFile << "Topological Neighbours: " << m_BoidPhysicsSystem->GetTopologicalNeighbourCount() << std::endl;
+    CurrentFile << "Rule Precision: " << GetRulePrecisionName(PrecisionReport.Precision) << std::endl;
+    CurrentFile << "Newton Refinement: " << (PrecisionReport.NewtonRefinement ? "On" : "Off") << std::endl;
+    CurrentFile << "Exact Step: " << PrecisionReport.ExactMilliseconds << " ms" << std::endl;
+    CurrentFile << "Selected Step: " << PrecisionReport.SelectedMilliseconds << " ms" << std::endl;
+    CurrentFile << "Direction Error Mean: " << PrecisionReport.MeanDirectionError << " deg" << std::endl;
+    CurrentFile << "Direction Error Max: " << PrecisionReport.MaximumDirectionError << " deg" << std::endl;
+
+    const BoidSubStepSettings& SubStepSettings = m_BoidPhysicsSystem->GetSubStepSettings();
+    CurrentFile << "Adaptive Sub-Steps: " << (SubStepSettings.Enabled ? "On" : "Off") << std::endl;
+    CurrentFile << "Maximum Sub-Steps: " << SubStepSettings.MaximumSubSteps << std::endl;
+    CurrentFile << "Maximum Turn Per Sub-Step: " << SubStepSettings.MaximumTurnPerSubStep << " rad" << std::endl;
+    CurrentFile << "Maximum Travel Per Spacing: " << SubStepSettings.MaximumTravelPerSpacing << std::endl;
+}
+
+void Tutorial3::PrintFlockMetricsToTextFile(const char filename[])
+{
+    std::ofstream CurrentFile(filename);
+
+    // Metrics of the last step before capturing stopped
+    const BoidFlockMetrics& Metrics = m_BoidFlockAnalytics->GetMetrics();
+
+    CurrentFile << "Boids: " << Metrics.BoidCount << std::endl;
+    CurrentFile << "Link Distance: " << Metrics.LinkDistance << std::endl;
+    CurrentFile << "Clusters: " << Metrics.ClusterCount << std::endl;
+    CurrentFile << "Single Boid Clusters: " << Metrics.SingleBoidClusters << std::endl;
+    CurrentFile << "Mean Cluster Size: " << Metrics.MeanClusterSize << std::endl;
+    CurrentFile << "Largest Clusters:";
+    for (uint32_t i = 0; i < BoidFlockMetrics::ListedClusters; i++)
+    {
+        CurrentFile << " " << Metrics.LargestClusterSizes[i];
+    }
+    CurrentFile << std::endl;
+    CurrentFile << "Polarization: " << Metrics.Polarization << std::endl;
+    CurrentFile << "Mean Speed: " << Metrics.MeanSpeed << std::endl;
+    CurrentFile << "Nearest Neighbour Mean: " << Metrics.NearestNeighbourMean << std::endl;
+    CurrentFile << "Nearest Neighbour Min: " << Metrics.NearestNeighbourMinimum << std::endl;
+    CurrentFile << "Nearest Neighbour Max: " << Metrics.NearestNeighbourMaximum << std::endl;
+    CurrentFile << "Isolated Boids: " << Metrics.IsolatedBoids << std::endl;
+    CurrentFile << "Nearest Neighbour Histogram (0 to " << Metrics.HistogramRange << "):";
+    for (uint32_t i = 0; i < BoidFlockMetrics::HistogramBuckets; i++)
+    {
+        CurrentFile << " " << Metrics.NearestNeighbourHistogram[i];
+    }
+    CurrentFile << std::endl;
+    CurrentFile << "Analytics: " << Metrics.Milliseconds << " ms" << std::endl;
+}
+
 void Tutorial3::PrintResultsToTextFile(const char filename[], std::queue<double>& ValueQueue)
 {
     // Create and open a text file
@@ -555,7 +646,7 @@ void Tutorial3::CalculateGPUQueryTime(CommandQueue& commandQueue, std::vector<do
     }
 }
 
-double Tutorial3::CalculateAverageTimePerSecond(std::vector<double> TimeVector)
+double Tutorial3::CalculateAverageTimePerSecond(const std::vector<double>& TimeVector)
 {
     // Early out if we have not captured any frame results, failed to capture them appropriately
     if (TimeVector.size() == 0)
@@ -590,8 +681,8 @@ void Tutorial3::UpdateResults(std::vector<double>& TimePerFrameVector, std::queu
         }
     }
 
+    // Capacity is kept so the next second's frames do not grow the vector again
     TimePerFrameVector.clear();
-    TimePerFrameVector.shrink_to_fit();
 }
 
 void Tutorial3::UnloadContent()
@@ -602,6 +693,11 @@ void Tutorial3::OnUpdate( UpdateEventArgs& e )
 {
     static double totalTime = 0.0;
 
+    // Frame runs from one update to the next, so allocations made while rendering count towards it
+    static const uint32_t FrameResultsZone = BoidAllocationTracker::RegisterZone("Frame Results");
+    BoidAllocationTracker::EndFrame();
+    BoidAllocationTracker::BeginFrame();
+
     super::OnUpdate( e );
 
     totalTime += e.ElapsedTime;
@@ -609,10 +705,13 @@ void Tutorial3::OnUpdate( UpdateEventArgs& e )
     // Generate results every second
     if ( totalTime >= 1.0 )
     {
+        BoidAllocationScope AllocationScope(FrameResultsZone);
 
         if (m_EnableCPUVersion)
         {
             UpdateResults(m_CPUCalculationTimePerFrame, m_CPUCalculationTimePerSecond, m_CurrentCPUTime);
+            UpdateResults(m_BakeCalculationTimePerFrame, m_BakeCalculationTimePerSecond, m_CurrentBakeTime);
+            UpdateResults(m_SubStepTimePerFrame, m_SubStepTimePerSecond, m_CurrentSubStepTime);
             UpdateResults(m_RenderCalculationTimePerFrame, m_RenderCalculationTimePerSecond, m_CurrentRenderTime);
             UpdateResults(m_FullCalculationTimePerFrame, m_FullCalculationTimePerSecond, m_CurrentOverallTime);
         }
@@ -636,9 +735,14 @@ void Tutorial3::OnUpdate( UpdateEventArgs& e )
     // Update boids physics system
     if (m_RunningSimulation && m_EnableCPUVersion)
     {
+        // Step writes boids straight into the next published slot while it rebuilds the grid, never waits on readers
+        m_PublishedSimulationTime += e.ElapsedTime;
+        BoidProperties* PublishedBoids = m_BoidStatePublisher ? m_BoidStatePublisher->BeginPublish(m_PublishedSimulationTime) : nullptr;
+        m_BoidPhysicsSystem->SetStepOutput(PublishedBoids, PublishedBoids ? m_BoidStatePublisher->GetSlotCapacity() : 0);
+
         auto StartPhysics = std::chrono::high_resolution_clock::now();
 
-        m_BoidPhysicsSystem->UpdateBoidPhysics(static_cast<float>(e.ElapsedTime));
+        m_BoidPhysicsSystem->AdvanceBoidPhysics(static_cast<float>(e.ElapsedTime));
 
         auto StopPhysics = std::chrono::high_resolution_clock::now();
         auto DurationPhysics = std::chrono::duration_cast<std::chrono::microseconds>(StopPhysics - StartPhysics);
@@ -646,6 +750,13 @@ void Tutorial3::OnUpdate( UpdateEventArgs& e )
         TotalPhysicsTime /= 1000;
 
         m_CPUCalculationTimePerFrame.push_back(TotalPhysicsTime);
+        m_SubStepTimePerFrame.push_back(m_BoidPhysicsSystem->GetSubStepReport().SubStepTime * 1000.0);
+
+        m_BoidPhysicsSystem->SetStepOutput(nullptr, 0);
+        if (PublishedBoids)
+        {
+            m_BoidStatePublisher->EndPublish(m_BoidPhysicsSystem->GetStepOutputCount());
+        }
     }
 
     CamViewProj.CameraView = m_Camera.get_ViewMatrix();
@@ -667,6 +778,9 @@ void Tutorial3::OnUpdate( UpdateEventArgs& e )
 
 void Tutorial3::OnRender(RenderEventArgs& e)
 {
+    static const uint32_t RenderZone = BoidAllocationTracker::RegisterZone("Render");
+    BoidAllocationScope AllocationScope(RenderZone);
+
     // Calculate FPS given OnRender and OnUpdate function timings
     static uint64_t frameCount = 0;
     static double totalTime = 0.0;
@@ -779,7 +893,14 @@ void Tutorial3::OnRender(RenderEventArgs& e)
         commandList->GetGraphicsCommandList()->EndQuery(m_RenderQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0);
 
         // Apply Boids Graphics Pipeline
-        commandList->SetPipelineState(m_BoidsPipelineState);
+        if (m_EnableCPUVersion)
+        {
+            commandList->SetPipelineState(m_BoidsBakedPipelineState);
+        }
+        else
+        {
+            commandList->SetPipelineState(m_BoidsPipelineState);
+        }
         commandList->SetGraphicsRootSignature(m_BoidsRootSignature);
 
         commandList->SetViewport(m_Viewport);
@@ -796,21 +917,51 @@ void Tutorial3::OnRender(RenderEventArgs& e)
         // Update buffer based on CPU calculation of Boids algorithm
         if (m_EnableCPUVersion)
         {
-            commandList->CopyBuffer(m_BoidMatricesUAVBuffer, numElements, elementSize, m_BoidPhysicsSystem->GetBoidProperties().data(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-        }
+            // Cull boids outside camera frustum so only visible boids are uploaded and drawn
+            m_BoidRenderSystem->CullBoids(*m_BoidPhysicsSystem, CamViewProj.CameraView, CamViewProj.CameraProjection);
 
-        // Set UAV to single buffer or first frame of double-buffer for rendering
-        if (m_EnableCPUVersion || m_EnableGPUVersion)
-        {
-            commandList->SetUnorderedAccessView(0, 0, m_BoidMatricesUAVBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, 0, 0, &uavDesc);
+            numElements = m_BoidRenderSystem->GetVisibleBoidCount();
+            elementSize = sizeof(BoidInstanceTransform);
+            uavDesc.Buffer.NumElements = static_cast<UINT>(numElements);
+            uavDesc.Buffer.StructureByteStride = static_cast<UINT>(elementSize);
+
+            // Bake per-instance rotation and translation once per boid, timed on its own
+            auto StartBake = std::chrono::high_resolution_clock::now();
+
+            m_BoidRenderSystem->BakeVisibleBoidTransforms();
+
+            auto StopBake = std::chrono::high_resolution_clock::now();
+            auto DurationBake = std::chrono::duration_cast<std::chrono::microseconds>(StopBake - StartBake);
+            m_BakeCalculationTimePerFrame.push_back(static_cast<double>(DurationBake.count()) / 1000);
+
+            if (numElements > 0)
+            {
+                commandList->CopyBuffer(m_BoidMatricesUAVBuffer, numElements, elementSize, m_BoidRenderSystem->GetInstanceTransforms().data(), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+            }
         }
-        else if (m_EnableAsyncCompute)
+
+        if (numElements > 0)
         {
-            commandList->SetUnorderedAccessView(0, 0, *m_BoidMatricesDoubleBuffer[0], D3D12_RESOURCE_STATE_UNORDERED_ACCESS, 0, 0, &uavDesc);
-        }
+            // Set UAV to single buffer or first frame of double-buffer for rendering
+            if (m_EnableCPUVersion || m_EnableGPUVersion)
+            {
+                commandList->SetUnorderedAccessView(0, 0, m_BoidMatricesUAVBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, 0, 0, &uavDesc);
+            }
+            else if (m_EnableAsyncCompute)
+            {
+                commandList->SetUnorderedAccessView(0, 0, *m_BoidMatricesDoubleBuffer[0], D3D12_RESOURCE_STATE_UNORDERED_ACCESS, 0, 0, &uavDesc);
+            }
 
-        // Render all boid instances
-        m_BoidRenderSystem->RenderBoids(*commandList, m_BoidObjects.size());
+            // Render all boid instances, culled CPU boids are split into one draw per level of detail
+            if (m_EnableCPUVersion)
+            {
+                m_BoidRenderSystem->RenderBoidLods(*commandList, 2);
+            }
+            else
+            {
+                m_BoidRenderSystem->RenderBoids(*commandList, static_cast<int>(numElements));
+            }
+        }
 
         // Apply timestap after render, to measure execution length of compute shader
         commandList->GetGraphicsCommandList()->EndQuery(m_RenderQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 1);
@@ -1081,6 +1232,223 @@ void Tutorial3::OnBoidsMenuGui()
 
             ImGui::Separator();
 
+            // Barnes-Hut only pays off once alignment or cohesion distances approach the box size
+            // Topological keeps step time steady in dense swirls, each boid only follows its k nearest neighbours
+            static int SelectedNeighbourSearch = 0;
+            static int TopologicalNeighbourCount = static_cast<int>(m_BoidPhysicsSystem->GetTopologicalNeighbourCount());
+            static float BarnesHutOpeningAngle = 0.5f;
+            static NeighbourSearchReport BarnesHutReport = {};
+            ImGui::Text("CPU Neighbour Search");
+            bool NeighbourSearchChanged = ImGui::RadioButton("Spatial Grid", &SelectedNeighbourSearch, 0);
+            NeighbourSearchChanged |= ImGui::RadioButton("Barnes-Hut Far Field", &SelectedNeighbourSearch, 1);
+            NeighbourSearchChanged |= ImGui::RadioButton("Topological Nearest", &SelectedNeighbourSearch, 2);
+            if (NeighbourSearchChanged)
+            {
+                m_BoidPhysicsSystem->SetNeighbourSearchMode(static_cast<NeighbourSearchMode>(SelectedNeighbourSearch));
+            }
+            if (ImGui::SliderInt("Nearest Neighbours", &TopologicalNeighbourCount, 1, static_cast<int>(BoidPhysicsSystem::MaximumTopologicalNeighbours)))
+            {
+                m_BoidPhysicsSystem->SetTopologicalNeighbourCount(static_cast<uint32_t>(TopologicalNeighbourCount));
+            }
+            ImGui::Text("Opening Angle: %.2f", BarnesHutOpeningAngle);
+            if (ImGui::SliderFloat("11", &BarnesHutOpeningAngle, 0.1f, 1.5f))
+            {
+                m_BoidPhysicsSystem->SetBarnesHutOpeningAngle(BarnesHutOpeningAngle);
+            }
+            if (ImGui::Button("Compare With Exact Search"))
+            {
+                BarnesHutReport = m_BoidPhysicsSystem->CompareBarnesHutWithReference(1.0f / 60.0f);
+            }
+            ImGui::Text("Exact: %.2f ms, Barnes-Hut: %.2f ms", BarnesHutReport.ReferenceMilliseconds, BarnesHutReport.BarnesHutMilliseconds);
+            ImGui::Text("Direction Error Mean: %.3f deg, Max: %.3f deg", BarnesHutReport.MeanDirectionError, BarnesHutReport.MaximumDirectionError);
+
+            ImGui::Separator();
+
+            // Fast and approximate skip square roots and normalizing, recorded with CPU results when capturing stops
+            static int SelectedRulePrecision = 0;
+            static bool NewtonRefinement = true;
+            static RulePrecisionReport PrecisionReport = {};
+            ImGui::Text("CPU Rule Precision");
+            bool RulePrecisionChanged = ImGui::RadioButton("Exact", &SelectedRulePrecision, 0);
+            RulePrecisionChanged |= ImGui::RadioButton("Fast", &SelectedRulePrecision, 1);
+            RulePrecisionChanged |= ImGui::RadioButton("Approximate", &SelectedRulePrecision, 2);
+            if (RulePrecisionChanged)
+            {
+                m_BoidPhysicsSystem->SetRulePrecision(static_cast<RulePrecision>(SelectedRulePrecision));
+            }
+            if (ImGui::Checkbox("Newton Refinement", &NewtonRefinement))
+            {
+                m_BoidPhysicsSystem->SetNewtonRefinement(NewtonRefinement);
+            }
+            if (ImGui::Button("Compare With Exact Precision"))
+            {
+                PrecisionReport = m_BoidPhysicsSystem->CompareRulePrecisionWithExact(1.0f / 60.0f);
+            }
+            ImGui::Text("Exact: %.2f ms, %s: %.2f ms", PrecisionReport.ExactMilliseconds, GetRulePrecisionName(PrecisionReport.Precision), PrecisionReport.SelectedMilliseconds);
+            ImGui::Text("Direction Error Mean: %.4f deg, Max: %.4f deg", PrecisionReport.MeanDirectionError, PrecisionReport.MaximumDirectionError);
+
+            ImGui::Separator();
+
+            // Sweep runs on its own physics systems and blocks until every case is measured
+            // Sweep_Baseline.csv is a Sweep_Results.csv kept from a reference run on the same machine
+            static int SweepCaseCount = 0;
+            static int SweepRegressionCount = -1;
+            static int SweepAllocatingCaseCount = 0;
+            ImGui::Text("CPU Parameter Sweep");
+            if (ImGui::Button("Run Parameter Sweep"))
+            {
+                std::vector<BoidSweepResult> SweepResults = BoidSweepRunner::Run(BoidSweepSettings());
+                BoidSweepRunner::WriteResults("Sweep_Results.csv", SweepResults);
+                SweepCaseCount = static_cast<int>(SweepResults.size());
+                SweepAllocatingCaseCount = static_cast<int>(BoidSweepRunner::FindAllocatingCases(SweepResults).size());
+
+                std::vector<BoidSweepResult> SweepBaseline;
+                SweepRegressionCount = -1;
+                if (BoidSweepRunner::ReadResults("Sweep_Baseline.csv", SweepBaseline))
+                {
+                    std::vector<BoidSweepRegression> Regressions = BoidSweepRunner::CompareWithBaseline(SweepResults, SweepBaseline);
+                    BoidSweepRunner::WriteRegressions("Sweep_Regressions.txt", Regressions);
+                    SweepRegressionCount = static_cast<int>(Regressions.size());
+                }
+            }
+            ImGui::Text("Cases: %i, Slowdowns: %i", SweepCaseCount, SweepRegressionCount);
+            if (BoidAllocationTracker::IsEnabled())
+            {
+                ImGui::Text("Cases Allocating Every Step: %i", SweepAllocatingCaseCount);
+            }
+
+            ImGui::Separator();
+
+            // Ensemble of small flocks with current model properties, alignment and cohesion radius varied across worlds
+            // Blocks until every world has run its steps, statistics of each world go to Ensemble_Statistics.csv
+            static int EnsembleWorldCount = 64;
+            static float EnsembleMilliseconds = 0;
+            static float EnsemblePolarization = 0;
+            ImGui::Text("CPU Ensemble");
+            ImGui::SliderInt("Ensemble Worlds", &EnsembleWorldCount, 1, 512);
+            if (ImGui::Button("Run Ensemble"))
+            {
+                std::vector<BoidWorldSettings> Worlds(EnsembleWorldCount);
+                for (int World = 0; World < EnsembleWorldCount; World++)
+                {
+                    Worlds[World].BoidCount = 2000;
+                    Worlds[World].Properties = m_BoidPhysicsSystem->GetModelProperties();
+                    Worlds[World].Properties.MaximumAlignmentDistance = 4.0f + 28.0f * World / EnsembleWorldCount;
+                    Worlds[World].Properties.MaximumCohesionDistance = Worlds[World].Properties.MaximumAlignmentDistance;
+                    Worlds[World].Seed = World + 1;
+                }
+
+                BoidEnsemble Ensemble(Worlds);
+                auto StartEnsemble = std::chrono::high_resolution_clock::now();
+                Ensemble.Step(1.0f / 60.0f, 300);
+                auto StopEnsemble = std::chrono::high_resolution_clock::now();
+                EnsembleMilliseconds = std::chrono::duration<float, std::milli>(StopEnsemble - StartEnsemble).count();
+
+                EnsemblePolarization = 0;
+                for (const BoidWorldStatistics& World : Ensemble.GetStatistics())
+                {
+                    EnsemblePolarization += World.Polarization / EnsembleWorldCount;
+                }
+                BoidEnsemble::WriteStatistics("Ensemble_Statistics.csv", Ensemble.GetStatistics());
+            }
+            ImGui::Text("Total: %.1f ms, Mean Polarization: %.3f", EnsembleMilliseconds, EnsemblePolarization);
+
+            ImGui::Separator();
+
+            // Splits frames with sharp turns or crowded cells into shorter steps, sub-step lengths are written when capturing stops
+            static bool AdaptiveSubSteps = m_BoidPhysicsSystem->GetSubStepSettings().Enabled;
+            if (ImGui::Checkbox("Adaptive Sub-Steps", &AdaptiveSubSteps))
+            {
+                BoidSubStepSettings SubStepSettings = m_BoidPhysicsSystem->GetSubStepSettings();
+                SubStepSettings.Enabled = AdaptiveSubSteps;
+                m_BoidPhysicsSystem->SetSubStepSettings(SubStepSettings);
+            }
+            const BoidSubStepReport& SubStepReport = m_BoidPhysicsSystem->GetSubStepReport();
+            ImGui::Text("Sub-Steps: %u, Sub-Step: %.2f ms", SubStepReport.SubSteps, SubStepReport.SubStepTime * 1000.0f);
+            ImGui::Text("Max Turn Rate: %.2f rad/s, Peak Density: %.4f", SubStepReport.MaximumTurnRate, SubStepReport.PeakDensity);
+
+            // Task graph overlaps rules, apply and grid rebuild, trace of its last step is written when capturing stops
+            static bool TaskGraphStep = m_BoidPhysicsSystem->GetStepScheduling() == StepScheduling::TaskGraph;
+            if (ImGui::Checkbox("Task Graph Step", &TaskGraphStep))
+            {
+                m_BoidPhysicsSystem->SetStepScheduling(TaskGraphStep ? StepScheduling::TaskGraph : StepScheduling::Stages);
+            }
+
+            // Memory nodes are only told apart on Linux, elsewhere the machine is treated as one node
+            static bool PinWorkerThreads = BoidThreadPool::Get().IsPinned();
+            ImGui::Text("Memory Nodes: %u", BoidTopology::Get().GetNodeCount());
+            if (ImGui::Checkbox("Pin Worker Threads", &PinWorkerThreads))
+            {
+                BoidThreadPool::Get().SetThreadPinning(PinWorkerThreads ? BoidThreadPinning::Always : BoidThreadPinning::Never);
+            }
+
+            ImGui::Separator();
+
+            // Hardware counters need Linux, elsewhere stages are only timed, report is written when capturing stops
+            static bool ProfileStepStages = false;
+            ImGui::Text("CPU Step Profile");
+            if (ImGui::Checkbox("Profile Step Stages", &ProfileStepStages))
+            {
+                m_BoidPhysicsSystem->SetStepProfiler(nullptr);
+                delete m_BoidStepProfiler;
+                m_BoidStepProfiler = nullptr;
+
+                if (ProfileStepStages)
+                {
+                    m_BoidStepProfiler = new BoidStepProfiler();
+                    m_BoidPhysicsSystem->SetStepProfiler(m_BoidStepProfiler);
+                }
+            }
+            if (m_BoidStepProfiler)
+            {
+                for (uint32_t Stage = 0; Stage < static_cast<uint32_t>(BoidProfileStage::Count); Stage++)
+                {
+                    const BoidStageProfile& Profile = m_BoidStepProfiler->GetStage(static_cast<BoidProfileStage>(Stage));
+                    double Steps = Profile.Steps > 0 ? static_cast<double>(Profile.Steps) : 1.0;
+                    ImGui::Text("%s: %.3f ms, IPC: %.2f, Cache Misses/Pair: %.4f", GetProfileStageName(static_cast<BoidProfileStage>(Stage)), Profile.Milliseconds / Steps,
+                                Profile.GetInstructionsPerCycle(), Profile.GetPerPair(BoidCounter::CacheMisses));
+                }
+                if (ImGui::Button("Reset Step Profile"))
+                {
+                    m_BoidStepProfiler->Reset();
+                }
+            }
+
+            ImGui::Separator();
+
+            // Link distance of 0 joins boids within separation distance, metrics are written when capturing stops
+            static bool AnalyseFlock = false;
+            static float FlockLinkDistance = 0;
+            ImGui::Text("CPU Flock Analytics");
+            if (ImGui::Checkbox("Analyse Flock", &AnalyseFlock))
+            {
+                m_BoidPhysicsSystem->SetFlockAnalytics(nullptr);
+                delete m_BoidFlockAnalytics;
+                m_BoidFlockAnalytics = nullptr;
+
+                if (AnalyseFlock)
+                {
+                    m_BoidFlockAnalytics = new BoidFlockAnalytics();
+                    m_BoidFlockAnalytics->SetLinkDistance(FlockLinkDistance);
+                    m_BoidPhysicsSystem->SetFlockAnalytics(m_BoidFlockAnalytics);
+                }
+            }
+            if (ImGui::SliderFloat("Cluster Link Distance", &FlockLinkDistance, 0, 12) && m_BoidFlockAnalytics)
+            {
+                m_BoidFlockAnalytics->SetLinkDistance(FlockLinkDistance);
+            }
+            if (m_BoidFlockAnalytics)
+            {
+                const BoidFlockMetrics& Metrics = m_BoidFlockAnalytics->GetMetrics();
+                ImGui::Text("Clusters: %u, Largest: %u, Mean Size: %.1f", Metrics.ClusterCount, Metrics.LargestClusterSizes[0], Metrics.MeanClusterSize);
+                ImGui::Text("Polarization: %.3f, Mean Speed: %.2f", Metrics.Polarization, Metrics.MeanSpeed);
+                ImGui::Text("Nearest Neighbour Mean: %.2f, Min: %.2f, Max: %.2f, Isolated: %u", Metrics.NearestNeighbourMean, Metrics.NearestNeighbourMinimum,
+                            Metrics.NearestNeighbourMaximum, Metrics.IsolatedBoids);
+                ImGui::Text("Analytics: %.3f ms", Metrics.Milliseconds);
+            }
+
+            ImGui::Separator();
+
             if (ImGui::Button("Apply Changes"))
             {
                 m_BoidPhysicsSystem->SetModelProperties(m_NewModelProperties);
@@ -1135,6 +1503,11 @@ void Tutorial3::OnBoidsMenuGui()
             ImGui::Text("Model Settings");
             ImGui::InputText("Numb of Boids", m_BoidNumberBuffer, IM_ARRAYSIZE(m_BoidNumberBuffer));
             ImGui::Text("Current Boid Count: %i", m_BoidObjects.size());
+            if (m_EnableCPUVersion)
+            {
+                ImGui::Text("Visible Boids: %i (%.1f%%)", m_BoidRenderSystem->GetVisibleBoidCount(), m_BoidRenderSystem->GetVisibleFraction() * 100.0f);
+                ImGui::Text("LOD Boids: %i / %i / %i", m_BoidRenderSystem->GetLodInstanceCount(0), m_BoidRenderSystem->GetLodInstanceCount(1), m_BoidRenderSystem->GetLodInstanceCount(2));
+            }
             ImGui::Separator();
 
             ImGui::Text("Bounding Box Settings");
@@ -1143,9 +1516,54 @@ void Tutorial3::OnBoidsMenuGui()
             ImGui::Text("Debug Settings");
             ImGui::Text("FPS: %f", m_FPS);
             ImGui::Text("CPU ms: %.5f", static_cast<float>(m_CurrentCPUTime));
+            ImGui::Text("Bake ms: %.5f", static_cast<float>(m_CurrentBakeTime));
+
+            // Bake kernel on its own over as many boids as the flock, checked against the scalar reference
+            static BoidBakeCheck BakeCheck = {};
+            static double BakeCheckMilliseconds = 0;
+            if (ImGui::Button("Check Bake Kernel"))
+            {
+                BakeCheck = CheckBoidInstanceTransformBake(std::max(static_cast<uint32_t>(m_BoidObjects.size()), 1u), 10);
+
+                BakeCheckMilliseconds = 0;
+                for (double Milliseconds : BakeCheck.KernelMilliseconds)
+                {
+                    BakeCheckMilliseconds += Milliseconds / BakeCheck.KernelMilliseconds.size();
+                }
+            }
+            ImGui::Text("Bake Kernel ms: %.5f, Reference ms: %.5f", static_cast<float>(BakeCheckMilliseconds), static_cast<float>(BakeCheck.ReferenceMilliseconds));
+            ImGui::Text("Boids Off Reference: %i of %i, Max Error: %.7f", BakeCheck.MismatchedBoids, BakeCheck.BoidCount, BakeCheck.MaximumError);
+
+            // Signed distances of obstacle meshes against boxes and known distances, where the sign is hardest to get right
+            static const char* MeshDistanceCheck = "Not Run";
+            if (ImGui::Button("Check Obstacle Mesh Distances"))
+            {
+                MeshDistanceCheck = BoidObstacleField::CheckMeshDistances() ? "Passed" : "Failed";
+            }
+            ImGui::Text("Obstacle Mesh Distances: %s", MeshDistanceCheck);
+
             ImGui::Text("Compute ms: %.5f", static_cast<float>(m_CurrentGPUTime));
             ImGui::Text("Render ms: %.5f", static_cast<float>(m_CurrentRenderTime));
             ImGui::Text("Overall Frame ms: %.5f", static_cast<float>(m_CurrentOverallTime));
+
+            // Only counted in builds defining BOIDS_TRACK_ALLOCATIONS, figures are for the previous frame
+            if (BoidAllocationTracker::IsEnabled())
+            {
+                BoidAllocationCounts FrameAllocations = BoidAllocationTracker::GetLastFrame();
+                ImGui::Text("Frame Allocations: %llu (%llu bytes)", FrameAllocations.Allocations, FrameAllocations.Bytes);
+                for (uint32_t Zone = 0; Zone < BoidAllocationTracker::GetZoneCount(); Zone++)
+                {
+                    BoidAllocationCounts ZoneAllocations = BoidAllocationTracker::GetLastFrame(Zone);
+                    ImGui::Text("  %s: %llu (%llu bytes)", BoidAllocationTracker::GetZoneName(Zone), ZoneAllocations.Allocations, ZoneAllocations.Bytes);
+                }
+
+                static const char* AlignedCountingCheck = "Not Run";
+                if (ImGui::Button("Check Aligned Allocation Counting"))
+                {
+                    AlignedCountingCheck = BoidAllocationTracker::CheckAlignedCounting() ? "Passed" : "Failed";
+                }
+                ImGui::Text("Aligned Allocation Counting: %s", AlignedCountingCheck);
+            }
             ImGui::Separator();
 
             ImGui::Text("Capturing Results Settings");
@@ -1171,6 +1589,25 @@ void Tutorial3::OnBoidsMenuGui()
                     else if (m_EnableCPUVersion)
                     {
                         PrintResultsToTextFile("CPU_Results.txt", m_CPUCalculationTimePerSecond);
+                        PrintResultsToTextFile("Bake_Results.txt", m_BakeCalculationTimePerSecond);
+                        PrintResultsToTextFile("SubStep_Results.txt", m_SubStepTimePerSecond);
+                        PrintCPUSettingsToTextFile("CPU_Settings.txt");
+
+                        if (m_BoidFlockAnalytics)
+                        {
+                            PrintFlockMetricsToTextFile("Flock_Metrics.txt");
+                        }
+
+                        if (m_BoidStepProfiler)
+                        {
+                            m_BoidStepProfiler->WriteReport("Step_Profile.json");
+                        }
+
+                        m_BoidPhysicsSystem->WriteStepTrace("Step_Trace.json");
+
+                        // Where workers ran and which pages backed the flock, so captures from different machines can be compared
+                        std::ofstream PlacementFile("CPU_Placement.txt");
+                        PlacementFile << BoidThreadPool::Get().DescribePlacement();
                     }
 
                     PrintResultsToTextFile("Render_Results.txt", m_RenderCalculationTimePerSecond);
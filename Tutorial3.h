@@ -28,6 +28,9 @@
 
 class BoidRenderSystem;
 class BoidObject;
+class BoidStatePublisher;
+class BoidStepProfiler;
+class BoidFlockAnalytics;
 
 struct ID3D12QueryHeap;
 
@@ -97,19 +100,38 @@ protected:
     void UpdateResults(std::vector<double>& TimePerFrameVector, std::queue<double>& TimePerSecondQueue, double& CurrentTime);
     void PrintResultsToTextFile(const char filename[], std::queue<double>& ValueQueue);
 
+    // Record CPU physics settings of a capture, and how far selected rule precision strays from exact
+    void PrintCPUSettingsToTextFile(const char filename[]);
+
+    // Record flock analytics of the last CPU step, only while analytics are attached
+    void PrintFlockMetricsToTextFile(const char filename[]);
+
     void CalculateGPUQueryTime(CommandQueue& commandQueue, std::vector<double>& TimePerFrameVector, Microsoft::WRL::ComPtr<ID3D12Resource> ReadbackBuffer);
 
-    double CalculateAverageTimePerSecond(std::vector<double> TimePerFrameVector);
+    double CalculateAverageTimePerSecond(const std::vector<double>& TimePerFrameVector);
 
 private:
     // Boids Systems and Variables
     RootSignature m_BoidsRootSignature;
     Microsoft::WRL::ComPtr<ID3D12PipelineState> m_BoidsPipelineState;
 
+    // CPU version applies per-instance transforms baked by the render system instead of building them per vertex
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> m_BoidsBakedPipelineState;
+
     std::vector<BoidObject*> m_BoidObjects;
     BoidRenderSystem* m_BoidRenderSystem;
     BoidPhysicsSystem* m_BoidPhysicsSystem;
 
+    // Publishes each CPU step to shared memory for external viewers, recreated when the flock outgrows it
+    BoidStatePublisher* m_BoidStatePublisher = nullptr;
+    double m_PublishedSimulationTime = 0;
+
+    // Stage timings and hardware counters of CPU steps, only exists while profiling is switched on
+    BoidStepProfiler* m_BoidStepProfiler = nullptr;
+
+    // Cluster, order and spacing metrics of every CPU step, only exists while analytics are switched on
+    BoidFlockAnalytics* m_BoidFlockAnalytics = nullptr;
+
     CameraViewProjectionMatrices CamViewProj;
 
     // Boids Compute Shader
@@ -144,13 +166,17 @@ private:
     std::vector<double> m_GPUCalculationTimePerFrame;
     std::vector<double> m_RenderCalculationTimePerFrame;
     std::vector<double> m_FullCalculationTimePerFrame;
+    std::vector<double> m_BakeCalculationTimePerFrame;
+    std::vector<double> m_SubStepTimePerFrame;
 
     std::queue<double> m_CPUCalculationTimePerSecond;
     std::queue<double> m_GPUCalculationTimePerSecond;
     std::queue<double> m_RenderCalculationTimePerSecond;
     std::queue<double> m_FullCalculationTimePerSecond;
+    std::queue<double> m_BakeCalculationTimePerSecond;
+    std::queue<double> m_SubStepTimePerSecond;
 
-    double m_CurrentCPUTime = 0, m_CurrentGPUTime = 0, m_CurrentOverallTime = 0, m_CurrentRenderTime = 0;
+    double m_CurrentCPUTime = 0, m_CurrentGPUTime = 0, m_CurrentOverallTime = 0, m_CurrentRenderTime = 0, m_CurrentBakeTime = 0, m_CurrentSubStepTime = 0;
 
     int m_AmountOfCaptures = 100;
 